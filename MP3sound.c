@@ -61,20 +61,17 @@
 	//
 	///////////////////////////////////////////////
 #include "MP3sound.h"
-#include <util/delay.h>		// _delay_ms
-#include <avr/pgmspace.h>	// for PROGMEM program space strings
+#include "hal.h"			// _delay_ms, PROGMEM program space strings, sei()
 
-#include <stdlib.h>			// for itoa(), integer to string conversion
-#include <stdio.h>			// for sprintf(), don't use if you are short on memory
 #include <string.h>			// for strlen()
 #include <ctype.h>			// for isdigit()
-#include <avr/interrupt.h>	// for sei() in our reinterruptible interrupt routine
 
 #include "toolbox.h"
 #include "realtime.h"		// real time interrupt services
 #include "serial.h"			// hardware serial
 #include "suart.h"			// software serial (write only)
 #include "wmath.h"			// random
+#include "fmt.h"			// for fmt_parse_dec(), instead of atoi()
 
 #ifdef _MP3_DEBUG_MESSAGES_
 #include "Print.h"			// quick and easy debug printing
@@ -236,10 +233,10 @@ void mp3_parse_command(char* commandstr)
 	{
 		mp3_stop_random(); // any manual sound command stops random automatically
 		uint8_t bank=(uint8_t)cmdch - 48; // cheap ASCII to number conversion
-		uint8_t sound=0;
+		uint16_t sound=0;
 		if(len>2)
 		{
-			sound=atoi(commandstr+2);
+			fmt_parse_dec(commandstr+2, &sound);
 		}
 		mp3_sound(bank, sound);
 		return;
@@ -0,0 +1,130 @@
+/*
+ * boot.c
+ * Boot sequence of the sound player, run from the main loop, see boot.h
+ *
+ */
+
+#include <string.h>			// strlen, strcpy
+#include "boot.h"
+#include "main.h"			// _MP3TRIGGER_
+#include "realtime.h"		// boot event
+#include "settings.h"
+#include "suart.h"
+#include "MP3sound.h"
+
+static uint8_t boot_state_=BOOT_DONE;
+
+#ifdef _MP3TRIGGER_
+static rt_event boot_event;
+static char boot_sounds[BOOT_SOUNDS][BOOT_SOUND_LENGTH];
+static uint8_t boot_sound_count;
+
+// player is up: startup sound, then the sound commands that came while waiting
+static void boot_player_ready()
+{
+	uint8_t i;
+
+	// Get the Startup sound settings
+	// Unless programmed, the start sound will be 255, the default Dolby sound
+	switch (settings.start_sound)
+	{
+		case 0:
+			mp3_start_sound = 0;   // No startup sound
+			break;
+		case 1:
+			mp3_start_sound = 255; // Default Dolby Sound
+			break;
+		case 2:
+			mp3_start_sound = 254; // Indy Start Sound (Neil's sounds)
+			break;
+		case 3:
+			mp3_start_sound = 253; // Bagpipe Start Sound (Neil's sounds)
+			break;
+		default:
+			// Value didn't match so use the default dolby sound.
+			mp3_start_sound = 255;
+			break;
+	}
+
+	// The mp3_init will also trigger the startup sound
+	// Configure for the MP3 Player used.
+	mp3_init(settings.mp3_player);
+
+	for(i=0; i<boot_sound_count; i++) mp3_parse_command(boot_sounds[i]);
+	boot_sound_count=0;
+}
+
+// startup sound over, random sounds as set up
+static void boot_finish()
+{
+	// Is the random sounds disabled or not?
+	switch(settings.random_sound_disabled)
+	{
+		case 0:
+			mp3_start_random();
+			break;
+		case 1:
+			mp3_stop_random();
+			mp3_volumeoff();
+			break;
+		case 2:
+			mp3_stop_random();
+			break;
+		default:
+			break;
+	}
+	boot_state_=BOOT_DONE;
+}
+
+// boot_event is due, from rt_do()
+static void boot_step(rt_event* event)
+{
+	if(boot_state_==BOOT_PLAYER)
+	{
+		boot_player_ready();
+		// If startup sounds are disabled, then don't wait!
+		if(mp3_start_sound!=0)
+		{
+			rt_event_start(event, BOOT_SOUND_TIME, 0);
+			boot_state_=BOOT_START_SOUND;
+			return;
+		}
+	}
+	boot_finish();
+}
+#endif
+
+void boot_start()
+{
+#ifdef _MP3TRIGGER_
+	// MP3 Trigger connects on suart2 on PC4 (MarcDuino v1) or PC1 (MarcDuino v2)
+	suart2_init(9600);
+	rt_event_init(&boot_event, boot_step, 0);
+	rt_event_start(&boot_event, BOOT_PLAYER_TIME, 0);
+	boot_state_=BOOT_PLAYER;
+#endif
+}
+
+/*****************
+ * Sound command while the player powers up: kept to be played once it's up.
+ * Returns FALSE once the player takes commands, the caller plays it then.
+ * When BOOT_SOUNDS are already waiting, or it is too long, it is dropped.
+ *****************/
+bool boot_sound(char* command)
+{
+#ifdef _MP3TRIGGER_
+	if(boot_state_!=BOOT_PLAYER) return FALSE;
+	if(boot_sound_count<BOOT_SOUNDS && strlen(command)<BOOT_SOUND_LENGTH)
+	{
+		strcpy(boot_sounds[boot_sound_count++], command);
+	}
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+uint8_t boot_state()
+{
+	return boot_state_;
+}
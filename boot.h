@@ -0,0 +1,42 @@
+/*
+ * boot.h
+ * Boot sequence of the sound player, run from the main loop
+ *
+ * The MP3 Trigger (or DFPlayer Mini) needs BOOT_PLAYER_TIME after power on before it takes
+ * commands, then plays the startup sound for up to BOOT_SOUND_TIME. v3.7 waited both
+ * out in _delay_ms() before the main loop, so the dome ignored every command for 16 s.
+ * Now main() goes straight to the main loop and a one-shot rt_event walks the states,
+ * from rt_do() in the main loop:
+ *
+ * 	BOOT_PLAYER			player powering up. Sound commands ($, and the routine sounds)
+ * 						are kept, BOOT_SOUNDS of them, and played once it is up.
+ * 	BOOT_START_SOUND	mp3_init() done, the startup sound plays. Sound commands play
+ * 						right away, over it.
+ * 	BOOT_DONE			random sounds started or silenced as #SQ says
+ *
+ * Panels, the console and the other boards work from the first main loop pass.
+ * Without _MP3TRIGGER_ the CF-III needs no wait, boot is done from the start.
+ *
+ */
+
+#ifndef BOOT_H_
+#define BOOT_H_
+
+#include "hal.h"
+#include "toolbox.h"		// bool
+
+#define BOOT_PLAYER_TIME	300		// 1/100 s for the player to power up
+#define BOOT_SOUND_TIME		1300	// 1/100 s the startup sound plays, less cut some of them off
+#define BOOT_SOUNDS			4		// sound commands kept while the player powers up
+#define BOOT_SOUND_LENGTH	8		// longest one kept, start character and terminating zero included
+
+// boot states
+#define BOOT_PLAYER			0
+#define BOOT_START_SOUND	1
+#define BOOT_DONE			2
+
+void boot_start();					// call once before the main loop, after realtime_init()
+bool boot_sound(char* command);		// TRUE if the sound command was kept for later (or dropped)
+uint8_t boot_state();
+
+#endif /* BOOT_H_ */
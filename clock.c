@@ -0,0 +1,88 @@
+/*
+ * clock.c
+ * Monotonic 1 ms time base on Timer1, see clock.h
+ *
+ */
+
+#include "hal.h"			// registers and interrupts
+#include "toolbox.h"		// set_bit
+#include "clock.h"
+#include "isrprof.h"		// interrupt profiling, when enabled
+
+// time at the last Timer1 overflow, kept both ways so neither needs a division
+static volatile uint32_t clock_us;
+static volatile uint32_t clock_ms;
+static volatile uint16_t clock_frac;	// microseconds past clock_ms, 0 to 999
+
+void clock_init()
+{
+	TCCR1B=0;					// stop it while we set up
+	TCCR1A=0;					// normal mode, counts up to 0xFFFF and overflows
+	TCNT1=0;
+	clock_us=0;
+	clock_ms=0;
+	clock_frac=0;
+	set_bit(TIFR1, TOV1);		// clear the flag by writing a 1
+	set_bit(TIMSK1, TOIE1);		// overflow interrupt (TIMER1_OVF_vect)
+	sei();
+	set_bit(TCCR1B, CS11);		// prescaler 8, 0.5 us counts at 16 MHz
+}
+
+/*******************************************************
+ * Both read the count with interrupts off. When the counter has wrapped
+ * but the overflow interrupt has not run yet, TOV1 is set and the count is
+ * small: the turn it started is added here. A large count with TOV1 set was
+ * read just before the wrap and goes with the time we have.
+ ********************************************************/
+uint32_t millis()
+{
+	uint8_t sreg=SREG;
+	uint32_t ms;
+	uint16_t frac, count;
+
+	cli();
+	ms=clock_ms;
+	frac=clock_frac;
+	count=TCNT1;
+	if(bit_is_set(TIFR1, TOV1) && count<0x8000)
+	{
+		ms+=CLOCK_TURN_US/1000;
+		frac+=CLOCK_TURN_US%1000;
+	}
+	SREG=sreg;
+
+	// at most 1767+32767, no overflow
+	frac+=count/CLOCK_TICKS_PER_US;
+	return ms+frac/1000;
+}
+
+uint32_t micros()
+{
+	uint8_t sreg=SREG;
+	uint32_t us;
+	uint16_t count;
+
+	cli();
+	us=clock_us;
+	count=TCNT1;
+	if(bit_is_set(TIFR1, TOV1) && count<0x8000) us+=CLOCK_TURN_US;
+	SREG=sreg;
+	return us+count/CLOCK_TICKS_PER_US;
+}
+
+// one turn of Timer1, every 32.768 ms
+ISR(TIMER1_OVF_vect)
+{
+	ISRPROF_ENTER(TCNT1);	// ticks since the overflow
+
+	clock_us+=CLOCK_TURN_US;
+	clock_ms+=CLOCK_TURN_US/1000;
+	clock_frac+=CLOCK_TURN_US%1000;
+	if(clock_frac>=1000)
+	{
+		clock_frac-=1000;
+		clock_ms++;
+	}
+
+	ISRPROF_EXIT(ISRPROF_T1OVF);
+}
@@ -0,0 +1,35 @@
+/*
+ * clock.h
+ * Monotonic 1 ms time base on Timer1
+ *
+ * Timer1 counts free from 0 to 0xFFFF at 0.5 us (16 MHz, prescaler 8) and is never
+ * reloaded: servo.c times its pulses with the compare A interrupt on the same count.
+ * The overflow interrupt moves the clock on every 32.768 ms. millis() and micros() add
+ * the count since the last overflow and read it all with interrupts off, so they never
+ * tear and never go back, an overflow not serviced yet included.
+ *
+ * 	millis()	ms since clock_init(), wraps after 49.7 days
+ * 	micros()	us since clock_init(), wraps every 71.6 minutes
+ *
+ * Take differences as uint32_t, or int32_t to compare, and the wrap does no harm:
+ * 	uint32_t due=millis()+250;
+ * 	if((int32_t)(millis()-due)>=0) ...
+ *
+ * The 1/100 s counters of realtime.c (rt_count1, rt_seconds, hours...) are still there
+ * for the v3.7 code. They are read without cli(), new code should time itself on millis().
+ *
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <stdint.h>
+
+#define CLOCK_TICKS_PER_US	2			// Timer1 counts per microsecond
+#define CLOCK_TURN_US		32768UL		// microseconds per Timer1 overflow
+
+void clock_init();		// call once before servo_init(), starts Timer1
+uint32_t millis();
+uint32_t micros();
+
+#endif /* CLOCK_H_ */
@@ -0,0 +1,38 @@
+/*
+ * command.c
+ * Command tables for the two letter command vocabularies, see command.h
+ *
+ */
+
+#include "command.h"
+
+uint8_t cmd_find(const cmd_entry_t* table, uint8_t a, uint8_t b, cmd_entry_t* entry)
+{
+	memcpy_P(entry, &table[CMD_HASH(a,b)], sizeof(cmd_entry_t));
+	if(entry->opcode!=CMD_OPCODE(a,b)) return CMD_UNKNOWN;
+	return CMD_OK;
+}
+
+uint8_t cmd_lookup(const cmd_entry_t* table, const char* command, uint8_t length, cmd_entry_t* entry, uint8_t* value)
+{
+	uint8_t a, b, i;
+	uint16_t v=0;
+
+	if(length<3) return CMD_UNKNOWN;
+	a=command[1];
+	b=command[2];
+
+	if(cmd_find(table, a, b, entry)!=CMD_OK) return CMD_UNKNOWN;
+	if(length<entry->min_length || length>entry->max_length) return CMD_BAD_LENGTH;
+
+	// decimal argument, all the rest of the command
+	for(i=3; i<length; i++)
+	{
+		uint8_t digit=command[i]-'0';
+		if(digit>9) return CMD_BAD_VALUE;
+		v=v*10+digit;
+		if(v>entry->max_value) return CMD_BAD_VALUE;
+	}
+	*value=v;
+	return CMD_OK;
+}
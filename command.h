@@ -0,0 +1,75 @@
+/*
+ * command.h
+ * Command tables for the two letter command vocabularies
+ *
+ * A command like ":SE01" or "#SQ1" is a start character, a two letter opcode and a
+ * decimal argument. Each vocabulary is a table in program memory, with one entry
+ * per opcode holding the handler and what a valid command looks like:
+ *
+ * 	const cmd_entry_t panel_commands[CMD_TABLE_SIZE] PROGMEM =
+ * 	{
+ * 		// opcode	handler				length	max value	flags
+ * 		CMD_ENTRY('S','E',	sequence_command,	5, 5,	99,			CMD_ACK_BEFORE),
+ * 		...
+ * 	};
+ *
+ * Entries sit in the slot given by hashing their opcode, so finding a command is one
+ * hash, one read and one compare instead of a string compare per opcode.
+ * CMD_HASH has no collision within the tables in main.c, with 32 slots (with 16, SB and
+ * IP would share one). Each table has its list of opcodes next to it, checked with
+ * CMD_CHECK_SLOTS: when adding an opcode, add it there too, and a collision stops the
+ * build with a negative array size on that line.
+ *
+ * The table only checks the command, what it does with the result is up to the caller.
+ * The flags are not used here, main.c uses them for the "OK" acknowledge.
+ *
+ */
+
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+#include "hal.h"
+
+#define CMD_TABLE_SIZE	32		// slots per table, power of 2
+
+// packed opcode and its table slot
+#define CMD_OPCODE(a,b)	(((uint16_t)(a)<<8)|(uint8_t)(b))
+#define CMD_HASH(a,b)	((((uint8_t)((a)+3*(b)))>>1)&(CMD_TABLE_SIZE-1))
+
+#define CMD_ENTRY(a,b,handler,min_length,max_length,max_value,flags) \
+	[CMD_HASH(a,b)]={CMD_OPCODE(a,b), handler, min_length, max_length, max_value, flags}
+
+// Compile time check that the opcodes of a table all have a slot of their own:
+// their slot bits summed and or-ed are the same only if no two are in the same slot.
+// 	#define MY_OPCODES(X,op)	X('S','E') op X('O','P') op X('C','L')
+// 	CMD_CHECK_SLOTS(my_commands, MY_OPCODES);
+#define CMD_SLOT(a,b)	(1ULL<<CMD_HASH(a,b))
+#define CMD_CHECK_SLOTS(name, opcodes) \
+	typedef char name##_slot_collision[((opcodes(CMD_SLOT, |))==(opcodes(CMD_SLOT, +))) ? 1 : -1]
+
+// cmd_lookup results
+#define CMD_OK			0
+#define CMD_UNKNOWN		1		// no such opcode
+#define CMD_BAD_LENGTH	2		// command too short or too long
+#define CMD_BAD_VALUE	3		// argument not a number or out of range
+
+typedef void (*cmd_handler)(uint8_t value);
+
+typedef struct
+{
+	uint16_t opcode;		// CMD_OPCODE, 0 for empty slots
+	cmd_handler handler;
+	uint8_t min_length;		// command length, start character included
+	uint8_t max_length;
+	uint8_t max_value;		// highest valid argument
+	uint8_t flags;			// free for the caller
+} cmd_entry_t;
+
+// Finds the entry of opcode a,b in table. Returns CMD_OK with a copy of it, or CMD_UNKNOWN.
+uint8_t cmd_find(const cmd_entry_t* table, uint8_t a, uint8_t b, cmd_entry_t* entry);
+
+// Finds the command in table and checks its length and argument.
+// Returns CMD_OK with a copy of the entry and the argument value, or the error.
+uint8_t cmd_lookup(const cmd_entry_t* table, const char* command, uint8_t length, cmd_entry_t* entry, uint8_t* value);
+
+#endif /* COMMAND_H_ */
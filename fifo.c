@@ -3,7 +3,7 @@
  * In order to use, initialize like this:
  *
  * 	#include "fifo.h"
- * 	#define BUF_SIZE 10
+ * 	#define BUF_SIZE 64		// power of 2, up to 256
  * 	uint8_t buffer[BUF_SIZE];
  * 	fifo_t fifo;
  * 	...
@@ -13,13 +13,14 @@
  * 	***************************************/
 
 
+#include <string.h>
 #include "fifo.h"
 
-void fifo_init (fifo_t *f, uint8_t *buffer, const uint8_t size)
+void fifo_init (fifo_t *f, uint8_t *buffer, const uint16_t size)
 {
-	f->count = 0;
-	f->pread = f->pwrite = buffer;
-	f->read2end = f->write2end = f->size = size;
+	f->buffer = buffer;
+	f->mask = size - 1;
+	f->head = f->tail = 0;
 }
 
 uint8_t fifo_put (fifo_t *f, const uint8_t data)
@@ -29,23 +30,56 @@ uint8_t fifo_put (fifo_t *f, const uint8_t data)
 
 uint8_t fifo_get_wait (fifo_t *f)
 {
-	while (!f->count);
-	
-	return _inline_fifo_get (f);	
+	while (f->head == f->tail) hal_idle();
+
+	return _inline_fifo_get (f);
 }
 
 // uses -1 (0xFF) as error code for empty. Maybe I want to change that with an available function.
 int fifo_get_nowait (fifo_t *f)
 {
-	if (!f->count)		return -1;
-		
-	return (int) _inline_fifo_get (f);	
+	if (f->head == f->tail)		return -1;
+
+	return (int) _inline_fifo_get (f);
 }
 
 // available function would look like this
 int fifo_available(fifo_t *f)
 {
-	 if(f->count) return 1;
+	 if(f->head != f->tail) return 1;
 	 else return 0;
 }
 
+// copies as much of data as fits, in at most two runs (before and after the wrap),
+// and publishes it all with a single head update
+uint8_t fifo_write_block (fifo_t *f, const uint8_t *data, uint8_t length)
+{
+	uint8_t head = f->head;
+	uint8_t n = _inline_fifo_free (f);
+	uint16_t run;
+
+	if (length < n) n = length;
+	run = (uint16_t)f->mask + 1 - head;		// bytes till end of linear buffer
+	if (run > n) run = n;
+	memcpy (f->buffer + head, data, run);
+	memcpy (f->buffer, data + run, n - run);
+	FIFO_BARRIER();
+	f->head = (head + n) & f->mask;
+	return n;
+}
+
+uint8_t fifo_read_block (fifo_t *f, uint8_t *data, uint8_t length)
+{
+	uint8_t tail = f->tail;
+	uint8_t n = _inline_fifo_count (f);
+	uint16_t run;
+
+	if (length < n) n = length;
+	run = (uint16_t)f->mask + 1 - tail;
+	if (run > n) run = n;
+	memcpy (data, f->buffer + tail, run);
+	memcpy (data + run, f->buffer, n - run);
+	FIFO_BARRIER();
+	f->tail = (tail + n) & f->mask;
+	return n;
+}
@@ -0,0 +1,108 @@
+/*
+ * fmt.c
+ * Number formatting and parsing, see fmt.h
+ *
+ */
+
+#include "fmt.h"
+
+char* fmt_dec(char* s, uint16_t value, uint8_t width, char pad)
+{
+	char digits[FMT_DEC_DIGITS];
+	uint8_t n=0;
+
+	do
+	{
+		digits[n++]='0'+value%10;
+		value/=10;
+	} while(value);
+	while(width>n)
+	{
+		*s++=pad;
+		width--;
+	}
+	while(n) *s++=digits[--n];
+	*s='\0';
+	return s;
+}
+
+char* fmt_hex(char* s, uint16_t value)
+{
+	uint8_t shift=12;
+	uint8_t nibble;
+
+	// no leading zeros, but at least one digit
+	while(shift && !(value>>shift)) shift-=4;
+	for(;;)
+	{
+		nibble=(value>>shift) & 0x0F;
+		*s++=nibble<10 ? '0'+nibble : 'A'-10+nibble;
+		if(!shift) break;
+		shift-=4;
+	}
+	*s='\0';
+	return s;
+}
+
+char* fmt_copy_p(char* s, const char* progmem_s)
+{
+	while((*s=pgm_read_byte(progmem_s++))) s++;
+	return s;
+}
+
+// digits only, from where the number starts
+static uint8_t fmt_digits(const char* s, uint16_t* value, uint8_t base)
+{
+	uint32_t v=0;
+	uint8_t n=0, digit;
+	char ch;
+
+	for(;;)
+	{
+		ch=s[n];
+		if(ch>='0' && ch<='9') digit=ch-'0';
+		else if(base==16 && ch>='a' && ch<='f') digit=ch-'a'+10;
+		else if(base==16 && ch>='A' && ch<='F') digit=ch-'A'+10;
+		else break;
+		v=v*base+digit;
+		if(v>0xFFFF) v=0xFFFF;
+		n++;
+	}
+	*value=(uint16_t)v;
+	return n;
+}
+
+static uint8_t fmt_spaces(const char* s)
+{
+	uint8_t n=0;
+	while(s[n]==' ') n++;
+	return n;
+}
+
+uint8_t fmt_parse_dec(const char* s, uint16_t* value)
+{
+	uint8_t n=fmt_spaces(s);
+	uint8_t digits=fmt_digits(s+n, value, 10);
+	return digits ? n+digits : 0;
+}
+
+uint8_t fmt_parse_hex(const char* s, uint16_t* value)
+{
+	uint8_t n=fmt_spaces(s);
+	uint8_t digits=fmt_digits(s+n, value, 16);
+	return digits ? n+digits : 0;
+}
+
+uint8_t fmt_parse_int(const char* s, int16_t* value)
+{
+	uint8_t n=fmt_spaces(s);
+	uint8_t negative=0, digits;
+	uint16_t v;
+
+	if(s[n]=='-' || s[n]=='+') negative=(s[n++]=='-');
+	digits=fmt_digits(s+n, &v, 10);
+	if(!digits) return 0;
+	if(negative) *value=v>32768 ? -32768 : -(int32_t)v;
+	else *value=v>32767 ? 32767 : v;
+	return n+digits;
+}
@@ -0,0 +1,37 @@
+/*
+ * fmt.h
+ * Number formatting and parsing, instead of sprintf(), sscanf() and atoi()
+ *
+ * Each function does one fixed conversion, so the firmware doesn't link the
+ * vfprintf()/vfscanf() format interpreters of avr-libc. Only the test builds
+ * (_ISR_PROFILE_, _STACK_MONITOR_, _LATENCY_STATS_) still use sprintf().
+ *
+ * The formatting functions write at s, add the end of string and return a pointer to it,
+ * so they chain:
+ * 	char string[32];
+ * 	char* p=fmt_copy_p(string, PSTR("Servo "));
+ * 	p=fmt_dec(p, servo, 2, ' ');		// like "%2u"
+ * 	fmt_copy_p(p, PSTR("\r\n"));
+ *
+ * The parsing functions skip leading spaces like sscanf(), read as many digits as they
+ * find and return the number of characters used, 0 if there was no number.
+ * Values too large for 16 bits stop at the limit, so range checks still catch them.
+ *
+ */
+
+#ifndef FMT_H_
+#define FMT_H_
+
+#include "hal.h"
+
+#define FMT_DEC_DIGITS	5				// longest 16 bit decimal number
+
+char* fmt_dec(char* s, uint16_t value, uint8_t width, char pad);	// "%u", padded to width
+char* fmt_hex(char* s, uint16_t value);								// "%X"
+char* fmt_copy_p(char* s, const char* progmem_s);					// string from program memory
+
+uint8_t fmt_parse_dec(const char* s, uint16_t* value);				// "%u", no sign
+uint8_t fmt_parse_int(const char* s, int16_t* value);				// "%d", optional sign
+uint8_t fmt_parse_hex(const char* s, uint16_t* value);				// "%x", without 0x
+
+#endif /* FMT_H_ */
@@ -0,0 +1,103 @@
+/*
+ * frame.c
+ * Binary command frames on the console UART, see frame.h
+ *
+ */
+
+#include "frame.h"
+#include "realtime.h"		// rt_ticks() for the timeout
+
+// receive states
+#define FRAME_WAIT_SYNC		0
+#define FRAME_WAIT_LENGTH	1
+#define FRAME_WAIT_OPCODE	2
+#define FRAME_WAIT_PAYLOAD	3
+#define FRAME_WAIT_CRC		4
+
+frame_t frame_rx;
+uint16_t frame_errors;
+
+// CRC-8, polynomial x^8+x^2+x+1, four bits at a time
+const uint8_t frame_crc_table[16] PROGMEM =
+{
+	0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+uint8_t frame_crc(uint8_t crc, uint8_t data)
+{
+	crc^=data;
+	crc=(crc<<4)^pgm_read_byte(&frame_crc_table[crc>>4]);
+	crc=(crc<<4)^pgm_read_byte(&frame_crc_table[crc>>4]);
+	return crc;
+}
+
+uint8_t frame_receive(uint8_t ch)
+{
+	frame_t* f=&frame_rx;
+	uint16_t now=rt_ticks();
+
+	// a stalled frame is dropped, this byte starts over
+	if(f->state!=FRAME_WAIT_SYNC && (uint16_t)(now-f->last)>FRAME_TIMEOUT)
+	{
+		f->state=FRAME_WAIT_SYNC;
+		frame_errors++;
+	}
+	f->last=now;
+
+	switch(f->state)
+	{
+		case FRAME_WAIT_SYNC:
+			if(ch!=FRAME_SYNC) return FRAME_NONE;
+			f->state=FRAME_WAIT_LENGTH;
+			break;
+
+		case FRAME_WAIT_LENGTH:
+			if(ch>FRAME_MAX_PAYLOAD)
+			{
+				f->state=FRAME_WAIT_SYNC;
+				frame_errors++;
+				break;
+			}
+			f->length=ch;
+			f->count=0;
+			f->crc=frame_crc(0, ch);
+			f->state=FRAME_WAIT_OPCODE;
+			break;
+
+		case FRAME_WAIT_OPCODE:
+			f->opcode=ch;
+			f->crc=frame_crc(f->crc, ch);
+			f->state=f->length ? FRAME_WAIT_PAYLOAD : FRAME_WAIT_CRC;
+			break;
+
+		case FRAME_WAIT_PAYLOAD:
+			f->payload[f->count++]=ch;
+			f->crc=frame_crc(f->crc, ch);
+			if(f->count==f->length) f->state=FRAME_WAIT_CRC;
+			break;
+
+		case FRAME_WAIT_CRC:
+			f->state=FRAME_WAIT_SYNC;
+			if(ch==f->crc) return FRAME_READY;
+			frame_errors++;
+			break;
+	}
+	return FRAME_BUSY;
+}
+
+uint8_t frame_encode(uint8_t* frame, uint8_t opcode, const uint8_t* payload, uint8_t length)
+{
+	uint8_t i, crc;
+
+	frame[0]=FRAME_SYNC;
+	frame[1]=length;
+	frame[2]=opcode;
+	crc=frame_crc(frame_crc(0, length), opcode);
+	for(i=0; i<length; i++)
+	{
+		frame[3+i]=payload[i];
+		crc=frame_crc(crc, payload[i]);
+	}
+	frame[3+length]=crc;
+	return length+FRAME_OVERHEAD;
+}
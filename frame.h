@@ -0,0 +1,75 @@
+/*
+ * frame.h
+ * Binary command frames on the console UART
+ *
+ * Frames share the console with the ASCII commands. They start with FRAME_SYNC,
+ * which the 7 bit ASCII commands never use, so the main loop hands every input byte
+ * to frame_receive() first, and only echoes and builds command lines with the bytes
+ * it turns down.
+ *
+ * 	FRAME_SYNC length opcode payload[length] crc
+ *
+ * length is the payload length, up to FRAME_MAX_PAYLOAD. crc is the CRC-8 (polynomial 0x07,
+ * start 0) of length, opcode and payload. Frames with a bad length or CRC are dropped, so is
+ * a frame stalled for more than FRAME_TIMEOUT: the byte after the gap starts over.
+ * Every byte costs the same to receive, no matter what the frame holds.
+ *
+ * Opcodes, 16 bit values are little endian:
+ * 	FRAME_SERVOS	servo mask (16 bit, bit 0 is servo 1), then one pulse width (16 bit, us)
+ * 					for each servo in the mask, lowest first. 0 turns the servo off.
+ * 					The servos are taken off RC and away from the sequencer, like :OP does.
+ * 	FRAME_SEQUENCE	sequence number (8 bit), like :SExx
+ * 	FRAME_SETUP		two opcode letters and the value (8 bit), like #SSx
+ * 	FRAME_STREAM	live servo positions, see stream.h. Only answered when bad.
+ *
+ * main.c answers every other good frame with a frame of one byte, opcode|FRAME_REPLY and
+ * a cmd_lookup() result of command.h as payload, before it runs the command.
+ *
+ * Encoding, for the other end (see tools/framebench.c):
+ * 	uint8_t frame[FRAME_MAX_SIZE];
+ * 	uint8_t size=frame_encode(frame, FRAME_SEQUENCE, &sequence, 1);
+ *
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include "hal.h"
+
+#define FRAME_SYNC			0xA5
+#define FRAME_MAX_PAYLOAD	32
+#define FRAME_OVERHEAD		4			// sync, length, opcode, crc
+#define FRAME_MAX_SIZE		(FRAME_MAX_PAYLOAD+FRAME_OVERHEAD)
+#define FRAME_TIMEOUT		10			// 1/100 s between two bytes of a frame
+
+// opcodes
+#define FRAME_SERVOS		0x01
+#define FRAME_SEQUENCE		0x02
+#define FRAME_SETUP			0x03
+#define FRAME_STREAM		0x04
+#define FRAME_REPLY			0x80		// set in the answer
+
+// frame_receive() results
+#define FRAME_NONE			0			// not a frame byte, for the ASCII parser
+#define FRAME_BUSY			1			// taken, frame not complete
+#define FRAME_READY			2			// frame complete and good, in frame_rx
+
+typedef struct
+{
+	uint8_t state;
+	uint8_t length;
+	uint8_t opcode;
+	uint8_t count;						// payload bytes received
+	uint8_t crc;
+	uint16_t last;						// rt_ticks() of the last byte
+	uint8_t payload[FRAME_MAX_PAYLOAD];
+} frame_t;
+
+extern frame_t frame_rx;				// the frame being received, valid after FRAME_READY
+extern uint16_t frame_errors;			// frames dropped, bad length, CRC or timeout
+
+uint8_t frame_receive(uint8_t ch);
+uint8_t frame_encode(uint8_t* frame, uint8_t opcode, const uint8_t* payload, uint8_t length);	// returns the frame size
+uint8_t frame_crc(uint8_t crc, uint8_t data);
+
+#endif /* FRAME_H_ */
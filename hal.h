@@ -0,0 +1,45 @@
+/*
+ * hal.h
+ * Hardware abstraction layer
+ *
+ * Every module includes this header instead of the avr-libc ones (<avr/io.h>,
+ * <avr/interrupt.h>, <avr/pgmspace.h>, <avr/eeprom.h>, <util/delay.h>, <util/twi.h>).
+ *
+ * On the AVR this is a straight pass-through to avr-libc, nothing changes in the
+ * generated code.
+ *
+ * On any other compiler the firmware builds as a native host simulation (hal_host.h/.c):
+ * the ATmega328P registers become a plain memory map, PROGMEM and EEPROM become RAM
+ * arrays, and a virtual clock fires the Timer0, Timer1, Timer2, USART and TWI interrupt
+ * routines. USART0 is mapped to stdin/stdout.
+ *
+ * Host build, from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -o marcduino_sim *.c
+ *
+ * hal_idle() must be called from every busy-wait loop. It compiles to nothing on the AVR,
+ * on the host it advances the virtual clock so the interrupts the loop is waiting for can fire.
+ *
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#ifdef __AVR__
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <avr/sfr_defs.h>
+#include <util/delay.h>
+#include <util/twi.h>
+
+#define hal_idle()
+
+#else
+
+#include "hal_host.h"
+
+#endif
+
+#endif /* HAL_H_ */
@@ -0,0 +1,547 @@
+/*
+ * hal_host.c
+ * Host (Linux/x86) backend of the hardware abstraction layer, see hal.h and hal_host.h
+ *
+ * Only compiled off-target. Keeps a virtual CPU cycle counter that advances when the
+ * firmware calls hal_idle() or one of the delay functions. While advancing, the
+ * simulator runs the peripherals the firmware uses:
+ *
+ * - Timer0 in CTC mode, compare A interrupt (realtime.c 100 Hz tick)
+ * - Timer1 in normal mode, compare A (servo.c pulse train) and overflow (clock.c) interrupts
+ * - Timer2 in normal mode, compare A and B interrupts (suart.c bit timing)
+ * - USART0 receive from stdin and transmit to stdout, paced at the programmed baud rate
+ * - TWI with an empty bus (every address is NACKed), interrupt one byte time after each command
+ *
+ * The two software UART pins (PC0 and the suart2 pin) are decoded by a simulated
+ * receiver sampling mid-bit, as the slave board and sound player would, and printed
+ * on stderr. Framing errors are reported there too.
+ *
+ * Environment:
+ *   HAL_SIM_SECONDS  stop after this many virtual seconds
+ *   HAL_EEPROM_FILE  load the EEPROM from and save it to this file
+ *
+ * Without HAL_SIM_SECONDS, the simulation exits HAL_EOF_LINGER virtual seconds after stdin
+ * reaches end of file, so a command script can be piped in.
+ *
+ */
+
+#ifndef __AVR__
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "hal.h"
+#include "suart.h"			// for the suart pin assignments
+
+volatile uint8_t hal_io[HAL_IO_SIZE] __attribute__((aligned(4)));
+
+// one pass of the main loop, about 10 us of CPU time
+#define HAL_IDLE_CYCLES		160
+// software UART rate decoded on the suart pins, tools/suartcheck.c checks the bit timing at the others
+#define HAL_SUART_BAUD		9600
+// time we keep running after the end of stdin, long enough to get through the boot delays
+#define HAL_EOF_LINGER		(20*F_CPU)
+
+// interrupt routines, weak so the firmware only needs to define those it uses
+void TIMER2_COMPA_vect(void) __attribute__((weak));
+void TIMER2_COMPB_vect(void) __attribute__((weak));
+void TIMER1_CAPT_vect(void) __attribute__((weak));
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void TIMER1_OVF_vect(void) __attribute__((weak));
+void TIMER0_COMPA_vect(void) __attribute__((weak));
+void USART_RX_vect(void) __attribute__((weak));
+void USART_UDRE_vect(void) __attribute__((weak));
+void TWI_vect(void) __attribute__((weak));
+
+// pending interrupt flags, kept here since TIFRx reads as 0 on the host
+#define PEND_T2COMPA	0x01
+#define PEND_T2COMPB	0x02
+#define PEND_T1OVF		0x04
+#define PEND_T0COMPA	0x08
+#define PEND_RX			0x10
+#define PEND_T1COMPA	0x20
+
+static uint64_t cycles;			// virtual CPU cycles since reset
+static uint64_t stop_at;		// 0, or cycle count at which we exit
+static uint8_t pending;
+static uint8_t started;
+
+static uint32_t t0_acc, t1_acc, t2_acc;		// prescaler phase of each timer
+
+static uint64_t udre_at;		// transmit data register empty from that time on
+static uint64_t twi_at;			// 0, or time the TWI command in progress completes
+static uint64_t rx_at;			// next time we look at stdin
+static uint8_t stdin_eof;
+
+static uint8_t eeprom[E2END+1];
+static uint8_t eeprom_loaded;
+
+// simulated receiver on a software UART pin
+typedef struct
+{
+	volatile uint8_t* port;
+	uint8_t pin;
+	const char* name;
+	uint8_t last;			// pin level after the last interrupt
+	uint8_t busy;			// receiving a frame
+	uint8_t bit;			// next bit to sample, 0 is start bit, 9 is stop bit
+	uint8_t data;
+	uint64_t sample_at;		// time of next mid-bit sample
+	uint64_t flush_at;		// print the line if nothing more comes by then
+	uint16_t errors;
+	uint8_t len;
+	char line[96];
+} hal_suart_rx;
+
+static hal_suart_rx suart_rx[2] =
+{
+	{ &SUART_TX_PORT, SUART_TX_PIN, "suart", 1, },
+#ifdef SUART_DUAL_PORT
+	{ &SUART2_TX_PORT, SUART2_TX_PIN, "suart2", 1, },
+#else
+	{ 0, 0, "suart2", 1, },
+#endif
+};
+
+#define SUART_BIT_CYCLES	((uint64_t)F_CPU/HAL_SUART_BAUD)
+
+#define HAL_MIN(a,b) ((a)<(b)?(a):(b))
+
+/*****************
+ * Private functions
+ *****************/
+
+static void hal_start(void)
+{
+	const char* s;
+	started=1;
+	fcntl(0, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
+	s=getenv("HAL_SIM_SECONDS");
+	if(s) stop_at=(uint64_t)(atof(s)*F_CPU);
+}
+
+// prescaler division for the clock select bits, 0 if stopped
+static uint32_t hal_prescaler(uint8_t tccrb, uint8_t timer2)
+{
+	static const uint16_t t01[8]={0, 1, 8, 64, 256, 1024, 0, 0};	// 6 and 7 are external clock, not simulated
+	static const uint16_t t2[8]={0, 1, 8, 32, 64, 128, 256, 1024};
+	return timer2 ? t2[tccrb & 0x07] : t01[tccrb & 0x07];
+}
+
+// cycles until a timer makes "ticks" counts, given its prescaler phase
+static uint64_t hal_cycles_to(uint32_t ticks, uint32_t prescaler, uint32_t acc)
+{
+	return (uint64_t)ticks*prescaler - acc;
+}
+
+// timer counts until its next event, all timers run in the modes the firmware uses
+static uint32_t t0_ticks(void)
+{
+	if(TCNT0<=OCR0A) return OCR0A-TCNT0+1;		// CTC, counter clears at OCR0A
+	return 256-TCNT0+OCR0A+1;
+}
+static uint32_t t1_ticks(void)
+{
+	return 0x10000-TCNT1;						// normal mode, overflow
+}
+static uint32_t t1_compa_ticks(void)
+{
+	uint16_t n=OCR1A-TCNT1;						// normal mode, compare match
+	return n ? n : 0x10000;
+}
+static uint32_t t2_ticks(uint8_t ocr)
+{
+	uint8_t n=ocr-TCNT2;						// normal mode, compare match
+	return n ? n : 256;
+}
+
+static void suart_rx_putc(hal_suart_rx* rx, uint8_t c)
+{
+	if(c=='\r' || c=='\n')
+	{
+		if(rx->len) fprintf(stderr, "%s> %.*s\n", rx->name, rx->len, rx->line);
+		rx->len=0;
+		return;
+	}
+	if(rx->len>sizeof(rx->line)-5)
+	{
+		fprintf(stderr, "%s> %.*s\n", rx->name, rx->len, rx->line);
+		rx->len=0;
+	}
+	if(c>=' ' && c<0x7F) rx->line[rx->len++]=c;
+	else rx->len+=sprintf(rx->line+rx->len, "\\x%02X", c);
+}
+
+// look for start bits after each interrupt, the only time a pin can change
+static void suart_rx_watch(void)
+{
+	uint8_t i;
+	for(i=0; i<2; i++)
+	{
+		hal_suart_rx* rx=&suart_rx[i];
+		if(!rx->port) continue;
+		if(!((*(rx->port-1) >> rx->pin) & 1))	// not an output yet (DDR is just below PORT)
+		{
+			rx->last=1;
+			continue;
+		}
+		uint8_t level=(*rx->port >> rx->pin) & 1;
+		if(!rx->busy && rx->last && !level)
+		{
+			rx->busy=1;
+			rx->bit=0;
+			rx->data=0;
+			rx->sample_at=cycles+SUART_BIT_CYCLES/2;
+		}
+		rx->last=level;
+	}
+}
+
+static void suart_rx_sample(hal_suart_rx* rx)
+{
+	uint8_t level=(*rx->port >> rx->pin) & 1;
+	if(rx->bit==0 && level)			// glitch, not a start bit
+	{
+		rx->busy=0;
+		return;
+	}
+	if(rx->bit>=1 && rx->bit<=8) rx->data|=level<<(rx->bit-1);
+	if(rx->bit==9)
+	{
+		rx->busy=0;
+		if(!level)
+		{
+			rx->errors++;
+			fprintf(stderr, "%s: framing error (%u)\n", rx->name, rx->errors);
+		}
+		else suart_rx_putc(rx, rx->data);
+		rx->flush_at=cycles+20*SUART_BIT_CYCLES;
+		return;
+	}
+	rx->bit++;
+	rx->sample_at+=SUART_BIT_CYCLES;
+}
+
+// frame time on USART0, from the programmed baud rate
+static uint64_t usart_frame_cycles(void)
+{
+	uint16_t ubrr=((UBRR0H & 0x0F)<<8) | UBRR0L;
+	uint8_t divider=bit_is_set(UCSR0A, U2X0) ? 8 : 16;
+	return (uint64_t)divider*(ubrr+1)*10;
+}
+
+static void usart_poll_rx(void)
+{
+	char c;
+	ssize_t n;
+	rx_at=cycles+usart_frame_cycles();
+	if(stdin_eof || !bit_is_set(UCSR0B, RXEN0)) return;
+	n=read(0, &c, 1);
+	if(n==1)
+	{
+		if(c=='\n') c='\r';		// the firmware expects carriage returns
+		UDR0=c;
+		pending|=PEND_RX;
+	}
+	else if(n==0)
+	{
+		stdin_eof=1;
+		if(!stop_at) stop_at=cycles+HAL_EOF_LINGER;
+	}
+}
+
+static void hal_call(void (*vector)(void))
+{
+	if(!vector) return;
+	SREG&=~_BV(SREG_I);		// the chip clears I on entry and sets it back on return
+	vector();
+	SREG|=_BV(SREG_I);
+	suart_rx_watch();
+}
+
+// run the pending interrupts in hardware priority order
+static void hal_dispatch(void)
+{
+	// writing a 1 in a flag register clears the pending flag
+	if(TIFR2 & _BV(OCF2A)) pending&=~PEND_T2COMPA;
+	if(TIFR2 & _BV(OCF2B)) pending&=~PEND_T2COMPB;
+	if(TIFR1 & _BV(OCF1A)) pending&=~PEND_T1COMPA;
+	if(TIFR1 & _BV(TOV1)) pending&=~PEND_T1OVF;
+	if(TIFR0 & _BV(OCF0A)) pending&=~PEND_T0COMPA;
+	TIFR0=TIFR1=TIFR2=0;
+
+	while(SREG & _BV(SREG_I))
+	{
+		if((pending & PEND_T2COMPA) && bit_is_set(TIMSK2, OCIE2A))
+		{
+			pending&=~PEND_T2COMPA;
+			hal_call(TIMER2_COMPA_vect);
+		}
+		else if((pending & PEND_T2COMPB) && bit_is_set(TIMSK2, OCIE2B))
+		{
+			pending&=~PEND_T2COMPB;
+			hal_call(TIMER2_COMPB_vect);
+		}
+		else if((pending & PEND_T1COMPA) && bit_is_set(TIMSK1, OCIE1A))
+		{
+			pending&=~PEND_T1COMPA;
+			hal_call(TIMER1_COMPA_vect);
+		}
+		else if((pending & PEND_T1OVF) && bit_is_set(TIMSK1, TOIE1))
+		{
+			pending&=~PEND_T1OVF;
+			hal_call(TIMER1_OVF_vect);
+		}
+		else if((pending & PEND_T0COMPA) && bit_is_set(TIMSK0, OCIE0A))
+		{
+			pending&=~PEND_T0COMPA;
+			hal_call(TIMER0_COMPA_vect);
+		}
+		else if((pending & PEND_RX) && bit_is_set(UCSR0B, RXCIE0))
+		{
+			pending&=~PEND_RX;
+			hal_call(USART_RX_vect);
+		}
+		else if(bit_is_set(UCSR0B, UDRIE0) && bit_is_set(UCSR0B, TXEN0) && cycles>=udre_at && USART_UDRE_vect)
+		{
+			// the routine either loads UDR0 or turns its own interrupt off
+			hal_call(USART_UDRE_vect);
+			if(bit_is_set(UCSR0B, UDRIE0))
+			{
+				putchar(UDR0);
+				fflush(stdout);
+				udre_at=cycles+usart_frame_cycles();
+			}
+		}
+		else if(twi_at && cycles>=twi_at)
+		{
+			twi_at=0;
+			hal_twcr();		// completes the command, sets TWSR
+			hal_call(TWI_vect);
+		}
+		else break;
+	}
+}
+
+// move all the timers forward, never past their next event
+static void hal_step(uint64_t step)
+{
+	uint32_t p, ticks;
+
+	p=hal_prescaler(TCCR0B, 0);
+	if(p)
+	{
+		t0_acc+=step; ticks=t0_acc/p; t0_acc%=p;
+		if(ticks==t0_ticks())
+		{
+			TCNT0=0;
+			pending|=PEND_T0COMPA;
+		}
+		else TCNT0+=ticks;
+	}
+
+	p=hal_prescaler(TCCR1B, 0);
+	if(p)
+	{
+		t1_acc+=step; ticks=t1_acc/p; t1_acc%=p;
+		if(ticks==t1_compa_ticks()) pending|=PEND_T1COMPA;
+		if(ticks==t1_ticks()) pending|=PEND_T1OVF;
+		TCNT1+=ticks;
+	}
+
+	p=hal_prescaler(TCCR2B, 1);
+	if(p)
+	{
+		t2_acc+=step; ticks=t2_acc/p; t2_acc%=p;
+		if(ticks==t2_ticks(OCR2A)) pending|=PEND_T2COMPA;
+		if(ticks==t2_ticks(OCR2B)) pending|=PEND_T2COMPB;
+		TCNT2+=ticks;
+	}
+
+	cycles+=step;
+}
+
+static void hal_exit(void)
+{
+	uint8_t i;
+	for(i=0; i<2; i++)
+	{
+		if(suart_rx[i].len) suart_rx_putc(&suart_rx[i], '\r');
+		if(suart_rx[i].errors) fprintf(stderr, "%s: %u framing errors\n", suart_rx[i].name, suart_rx[i].errors);
+	}
+	fflush(stdout);
+	exit(0);
+}
+
+/*****************
+ * Public functions
+ *****************/
+
+void hal_advance(uint32_t amount)
+{
+	uint64_t end;
+	uint8_t i;
+
+	if(!started) hal_start();
+	end=cycles+amount;
+
+	while(cycles<end)
+	{
+		// find the next event
+		uint64_t step=end-cycles;
+		uint32_t p;
+
+		p=hal_prescaler(TCCR0B, 0);
+		if(p) step=HAL_MIN(step, hal_cycles_to(t0_ticks(), p, t0_acc));
+		p=hal_prescaler(TCCR1B, 0);
+		if(p)
+		{
+			step=HAL_MIN(step, hal_cycles_to(t1_ticks(), p, t1_acc));
+			step=HAL_MIN(step, hal_cycles_to(t1_compa_ticks(), p, t1_acc));
+		}
+		p=hal_prescaler(TCCR2B, 1);
+		if(p)
+		{
+			step=HAL_MIN(step, hal_cycles_to(t2_ticks(OCR2A), p, t2_acc));
+			step=HAL_MIN(step, hal_cycles_to(t2_ticks(OCR2B), p, t2_acc));
+		}
+		if(udre_at>cycles) step=HAL_MIN(step, udre_at-cycles);
+		if(rx_at>cycles) step=HAL_MIN(step, rx_at-cycles);
+		for(i=0; i<2; i++)
+		{
+			if(suart_rx[i].busy) step=HAL_MIN(step, suart_rx[i].sample_at-cycles);
+		}
+		if(stop_at) step=HAL_MIN(step, stop_at>cycles ? stop_at-cycles : 0);
+		// a TWI command written with its interrupt on completes one byte time later
+		if(!twi_at && (hal_io[0xBC] & (_BV(TWINT) | _BV(TWEN) | _BV(TWIE)))==(_BV(TWINT) | _BV(TWEN) | _BV(TWIE)))
+		{
+			twi_at=cycles+9*(16+2*(uint32_t)TWBR*(1<<(2*(TWSR & 3))));
+		}
+		if(twi_at) step=HAL_MIN(step, twi_at>cycles ? twi_at-cycles : 0);
+
+		hal_step(step);
+
+		for(i=0; i<2; i++)
+		{
+			hal_suart_rx* rx=&suart_rx[i];
+			if(rx->busy && cycles>=rx->sample_at) suart_rx_sample(rx);
+			if(!rx->busy && rx->len && rx->flush_at && cycles>=rx->flush_at) suart_rx_putc(rx, '\r');
+		}
+		if(cycles>=rx_at && !(pending & PEND_RX)) usart_poll_rx();
+		if(stop_at && cycles>=stop_at) hal_exit();
+
+		hal_dispatch();
+	}
+}
+
+void hal_idle(void)
+{
+	hal_advance(HAL_IDLE_CYCLES);
+}
+
+uint64_t hal_cycles(void)
+{
+	return cycles;
+}
+
+void _delay_ms(double ms)
+{
+	while(ms>100)		// keep hal_advance in 32 bits
+	{
+		hal_advance(100*(F_CPU/1000));
+		ms-=100;
+	}
+	hal_advance((uint32_t)(ms*(F_CPU/1000)));
+}
+
+void _delay_us(double us)
+{
+	hal_advance((uint32_t)(us*(F_CPU/1000000)));
+}
+
+// stateless TWI bus model with no device: start is granted, address is NACKed, stop releases
+// the bus. Called on every TWCR access, it completes the command written just before.
+volatile uint8_t *hal_twcr(void)
+{
+	volatile uint8_t* twcr=&hal_io[0xBC];
+	if(!(*twcr & _BV(TWEN))) return twcr;
+	if(*twcr & _BV(TWSTO))
+	{
+		*twcr&=~_BV(TWSTO);
+		TWSR=TW_NO_INFO;
+		// stop alone, or stop then start
+		if(!(*twcr & _BV(TWSTA))) *twcr&=~_BV(TWINT);
+		else if(*twcr & _BV(TWINT)) TWSR=TW_START;
+	}
+	else if(*twcr & _BV(TWINT))
+	{
+		if(*twcr & _BV(TWSTA)) TWSR=TW_START;
+		else if(TWSR==TW_START || TWSR==TW_REP_START) TWSR=(TWDR & TW_READ) ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+	}
+	return twcr;
+}
+
+/*****************
+ * EEPROM
+ *****************/
+
+static void eeprom_load(void)
+{
+	const char* name=getenv("HAL_EEPROM_FILE");
+	FILE* f;
+	eeprom_loaded=1;
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	if(!name) return;
+	f=fopen(name, "rb");
+	if(!f) return;
+	if(fread(eeprom, 1, sizeof(eeprom), f)<sizeof(eeprom)) fprintf(stderr, "%s: short EEPROM file\n", name);
+	fclose(f);
+}
+
+static void eeprom_save(void)
+{
+	const char* name=getenv("HAL_EEPROM_FILE");
+	FILE* f;
+	if(!name) return;
+	f=fopen(name, "wb");
+	if(!f) return;
+	fwrite(eeprom, 1, sizeof(eeprom), f);
+	fclose(f);
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+	if(!eeprom_loaded) eeprom_load();
+	return eeprom[(uintptr_t)addr & E2END];
+}
+
+uint16_t eeprom_read_word(const uint16_t *addr)
+{
+	uintptr_t a=(uintptr_t)addr;
+	return eeprom_read_byte((const uint8_t*)a) | (eeprom_read_byte((const uint8_t*)(a+1))<<8);
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value)
+{
+	if(!eeprom_loaded) eeprom_load();
+	eeprom[(uintptr_t)addr & E2END]=value;
+	eeprom_save();
+}
+
+void eeprom_write_word(uint16_t *addr, uint16_t value)
+{
+	uintptr_t a=(uintptr_t)addr;
+	eeprom_write_byte((uint8_t*)a, (uint8_t)value);
+	eeprom_write_byte((uint8_t*)(a+1), (uint8_t)(value>>8));
+}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value)
+{
+	if(eeprom_read_byte(addr)!=value) eeprom_write_byte(addr, value);
+}
+
+void eeprom_update_word(uint16_t *addr, uint16_t value)
+{
+	if(eeprom_read_word(addr)!=value) eeprom_write_word(addr, value);
+}
+
+#endif
@@ -0,0 +1,292 @@
+/*
+ * hal_host.h
+ * Host (Linux/x86) backend of the hardware abstraction layer, see hal.h
+ *
+ * Emulates just enough of the ATmega328P for the firmware to run unmodified:
+ * - registers live in hal_io[], at their real data memory addresses, so that
+ *   pointer tricks like GET_DDR_REG(PORTB) keep working
+ * - SREG I bit is honoured by cli()/sei(), interrupt routines run from hal_idle()
+ *   and the delay functions, never asynchronously
+ * - interrupt flag registers (TIFRx) always read as 0, writing a 1 clears a pending flag
+ *   as on the chip
+ * - TWCR is an accessor: the TWI model has no device on the bus, every address is NACKed
+ *
+ */
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+// pull in the standard headers before toolbox.h defines its int(x), min(), max() macros
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+// the host simulates this chip, the rest of the code picks its pin assignments from it
+#ifndef __AVR_ATmega328P__
+#define __AVR_ATmega328P__
+#endif
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+/*********** register map **************/
+#define HAL_IO_SIZE 0x100
+extern volatile uint8_t hal_io[HAL_IO_SIZE];
+
+#define _SFR_MEM8(addr)		(hal_io[(addr)])
+#define _SFR_MEM16(addr)	(*(volatile uint16_t *)&hal_io[(addr)])
+#define _SFR_IO8(addr)		(hal_io[(addr) + 0x20])
+#define _SFR_BYTE(sfr)		(sfr)
+#define _BV(bit)			(1 << (bit))
+
+#define bit_is_set(sfr, bit)	(_SFR_BYTE(sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit)	(!(_SFR_BYTE(sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit)		do { hal_idle(); } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit)	do { hal_idle(); } while (bit_is_set(sfr, bit))
+
+// ports
+#define PINB	_SFR_MEM8(0x23)
+#define DDRB	_SFR_MEM8(0x24)
+#define PORTB	_SFR_MEM8(0x25)
+#define PINC	_SFR_MEM8(0x26)
+#define DDRC	_SFR_MEM8(0x27)
+#define PORTC	_SFR_MEM8(0x28)
+#define PIND	_SFR_MEM8(0x29)
+#define DDRD	_SFR_MEM8(0x2A)
+#define PORTD	_SFR_MEM8(0x2B)
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+// interrupt flags
+#define TIFR0	_SFR_MEM8(0x35)
+#define TOV0	0
+#define OCF0A	1
+#define OCF0B	2
+#define TIFR1	_SFR_MEM8(0x36)
+#define TOV1	0
+#define OCF1A	1
+#define OCF1B	2
+#define ICF1	5
+#define TIFR2	_SFR_MEM8(0x37)
+#define TOV2	0
+#define OCF2A	1
+#define OCF2B	2
+
+// eeprom control, always ready on the host
+#define EECR	_SFR_MEM8(0x3F)
+#define EEPE	1
+#define E2END	0x3FF
+
+// timer 0
+#define TCCR0A	_SFR_MEM8(0x44)
+#define WGM00	0
+#define WGM01	1
+#define COM0B0	4
+#define COM0B1	5
+#define COM0A0	6
+#define COM0A1	7
+#define TCCR0B	_SFR_MEM8(0x45)
+#define CS00	0
+#define CS01	1
+#define CS02	2
+#define WGM02	3
+#define TCNT0	_SFR_MEM8(0x46)
+#define OCR0A	_SFR_MEM8(0x47)
+#define OCR0B	_SFR_MEM8(0x48)
+
+#define ACSR	_SFR_MEM8(0x50)
+#define ACIC	2
+
+#define SPL		_SFR_MEM8(0x5D)
+#define SPH		_SFR_MEM8(0x5E)
+#define SREG	_SFR_MEM8(0x5F)
+#define SREG_I	7
+
+#define TIMSK0	_SFR_MEM8(0x6E)
+#define TOIE0	0
+#define OCIE0A	1
+#define OCIE0B	2
+#define TIMSK1	_SFR_MEM8(0x6F)
+#define TOIE1	0
+#define OCIE1A	1
+#define OCIE1B	2
+#define ICIE1	5
+#define TIMSK2	_SFR_MEM8(0x70)
+#define TOIE2	0
+#define OCIE2A	1
+#define OCIE2B	2
+
+// timer 1
+#define TCCR1A	_SFR_MEM8(0x80)
+#define WGM10	0
+#define WGM11	1
+#define TCCR1B	_SFR_MEM8(0x81)
+#define CS10	0
+#define CS11	1
+#define CS12	2
+#define WGM12	3
+#define WGM13	4
+#define ICES1	6
+#define ICNC1	7
+#define TCCR1C	_SFR_MEM8(0x82)
+#define TCNT1	_SFR_MEM16(0x84)
+#define ICR1	_SFR_MEM16(0x86)
+#define OCR1A	_SFR_MEM16(0x88)
+#define OCR1B	_SFR_MEM16(0x8A)
+
+// timer 2
+#define TCCR2A	_SFR_MEM8(0xB0)
+#define WGM20	0
+#define WGM21	1
+#define TCCR2B	_SFR_MEM8(0xB1)
+#define CS20	0
+#define CS21	1
+#define CS22	2
+#define WGM22	3
+#define TCNT2	_SFR_MEM8(0xB2)
+#define OCR2A	_SFR_MEM8(0xB3)
+#define OCR2B	_SFR_MEM8(0xB4)
+#define ASSR	_SFR_MEM8(0xB6)
+
+// TWI, TWCR goes through the bus model
+#define TWBR	_SFR_MEM8(0xB8)
+#define TWSR	_SFR_MEM8(0xB9)
+#define TWPS0	0
+#define TWPS1	1
+#define TWAR	_SFR_MEM8(0xBA)
+#define TWDR	_SFR_MEM8(0xBB)
+#define TWCR	(*hal_twcr())
+#define TWIE	0
+#define TWEN	2
+#define TWWC	3
+#define TWSTO	4
+#define TWSTA	5
+#define TWEA	6
+#define TWINT	7
+
+// USART0
+#define UCSR0A	_SFR_MEM8(0xC0)
+#define MPCM0	0
+#define U2X0	1
+#define UPE0	2
+#define DOR0	3
+#define FE0		4
+#define UDRE0	5
+#define TXC0	6
+#define RXC0	7
+#define UCSR0B	_SFR_MEM8(0xC1)
+#define TXB80	0
+#define RXB80	1
+#define UCSZ02	2
+#define TXEN0	3
+#define RXEN0	4
+#define UDRIE0	5
+#define TXCIE0	6
+#define RXCIE0	7
+#define UCSR0C	_SFR_MEM8(0xC2)
+#define UCPOL0	0
+#define UCSZ00	1
+#define UCSZ01	2
+#define USBS0	3
+#define UPM00	4
+#define UPM01	5
+#define UBRR0L	_SFR_MEM8(0xC4)
+#define UBRR0H	_SFR_MEM8(0xC5)
+#define UBRR0	_SFR_MEM16(0xC4)
+#define UDR0	_SFR_MEM8(0xC6)
+
+/*********** util/twi.h **************/
+#define TW_START		0x08
+#define TW_REP_START	0x10
+#define TW_MT_SLA_ACK	0x18
+#define TW_MT_SLA_NACK	0x20
+#define TW_MT_DATA_ACK	0x28
+#define TW_MT_DATA_NACK	0x30
+#define TW_MT_ARB_LOST	0x38
+#define TW_MR_SLA_ACK	0x40
+#define TW_MR_SLA_NACK	0x48
+#define TW_MR_DATA_ACK	0x50
+#define TW_MR_DATA_NACK	0x58
+#define TW_NO_INFO		0xF8
+#define TW_BUS_ERROR	0x00
+#define TW_STATUS		(TWSR & 0xF8)
+#define TW_READ			1
+#define TW_WRITE		0
+
+/*********** interrupts **************/
+// interrupt routines become plain functions, called by the simulator when their
+// enable bit, their flag and the SREG I bit are set
+#define ISR(vector, ...)	void vector(void); void vector(void)
+#define ISR_NOBLOCK
+#define ISR_BLOCK
+#define sei()	(SREG |= _BV(SREG_I))
+#define cli()	(SREG &= (uint8_t)~_BV(SREG_I))
+
+/*********** program memory **************/
+// host data is all in one address space
+typedef uint16_t __attribute__((may_alias)) hal_alias16;
+typedef uint32_t __attribute__((may_alias)) hal_alias32;
+#define PROGMEM
+#define PSTR(s)					(s)
+#define PGM_P					const char *
+#define pgm_read_byte(addr)		(*(const uint8_t *)(addr))
+#define pgm_read_word(addr)		(*(const hal_alias16 *)(addr))
+#define pgm_read_dword(addr)	(*(const hal_alias32 *)(addr))
+#define pgm_read_ptr(addr)		(*(void * const *)(addr))
+#define memcpy_P	memcpy
+#define strcpy_P	strcpy
+#define strlen_P	strlen
+#define strcmp_P	strcmp
+#define sprintf_P	sprintf
+
+/*********** eeprom **************/
+// 1 kB array, optionally loaded from and saved to the file named in HAL_EEPROM_FILE
+uint8_t eeprom_read_byte(const uint8_t *addr);
+uint16_t eeprom_read_word(const uint16_t *addr);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+void eeprom_write_word(uint16_t *addr, uint16_t value);
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
+void eeprom_update_word(uint16_t *addr, uint16_t value);
+#define eeprom_is_ready()	1
+#define eeprom_busy_wait()
+
+/*********** delays and simulation clock **************/
+void _delay_ms(double ms);
+void _delay_us(double us);
+
+// advances the virtual clock by one main loop pass and runs the pending interrupts
+void hal_idle(void);
+// advances the virtual clock by the given number of CPU cycles
+void hal_advance(uint32_t cycles);
+// virtual CPU cycles since reset, for profiling
+uint64_t hal_cycles(void);
+
+volatile uint8_t *hal_twcr(void);
+
+#endif /* HAL_HOST_H_ */
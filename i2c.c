@@ -3,82 +3,396 @@
  *
  *  Created on: Aug 17, 2013
  *  Author: Marc Verdiell
- *  i2C master implemented using twi, polling
+ *  i2C master implemented using twi, interrupt driven
+ *
+ *  The transfers wait in a queue, [i2c_tail, i2c_current) are finished but not reported
+ *  by i2c_do() yet, [i2c_current, i2c_head) are still to run, i2c_current is on the bus.
+ *  Indexes run free and are masked when used.
+ *  The data of [i2c_tail, i2c_head) follows in i2c_pool, in queue order, wrapping around
+ *  at most once: an entry that doesn't fit at the end of the pool goes at its start.
+ *  The TWI interrupt runs the transfer on the bus one TWI state at a time, and chains
+ *  the next one with a stop-start (or a repeated start) without main loop help.
  *
  *****************************************************/
 
+#include <string.h>		// memcpy
 #include "i2c.h"
-#include <avr/io.h> 	// This will include <avr/iom128.h> or , <avr/iom328p.h> register definitions
-#include <util/twi.h>	// TW_... error, status codes. Includes TW_READ and TW_WRITE
-#include <avr/interrupt.h> // for slave interrupt
-
-// if using debug, include serial library
-#ifdef I2C_DEBUG
-#include "RS232.h"
-#endif
-
-// if using timeout (recommended), include the real-time library
-#ifdef I2C_TIMEOUT_ENABLED
-#include "realtime.h"
-#endif
+#include "hal.h" 		// registers, TW_... error, status codes. Includes TW_READ and TW_WRITE
+#include "realtime.h"	// rt_timestamp() for the timeouts
+#include "isrprof.h"	// interrupt profiling, when enabled
+#include "serial.h"		// fault report
+#include "fmt.h"
 
 /* define CPU frequency in Mhz if not defined in Makefile */
 #ifndef F_CPU
 #define F_CPU 16000000UL
 #endif
 
-// Private variable to keep status byte
-static uint8_t i2c_status_;
-#ifdef I2C_TIMEOUT_ENABLED
-	rt_timer rt_timeout_i2c; // our timeout timer
+#if defined(_USE_32KHZ_)
+#error "i2c.c needs rt_timestamp(), not available with the 32 kHz clock"
 #endif
 
+#define I2C_QUEUE_MASK	(I2C_QUEUE_SIZE-1)
+#if I2C_QUEUE_SIZE & I2C_QUEUE_MASK
+#error "I2C_QUEUE_SIZE must be a power of 2"
+#endif
+#if I2C_POOL_SIZE > 255
+#error "I2C_POOL_SIZE must fit in a byte"
+#endif
+#define I2C_POOL_FULL	0xFF
+
+// TWCR commands. TWINT is written to 1 to start the next TWI step.
+#define I2C_TWCR_START	(_BV(TWINT)|_BV(TWSTA)|_BV(TWEN)|_BV(TWIE))	// start, or repeated start
+#define I2C_TWCR_NEXT	(_BV(TWINT)|_BV(TWEN)|_BV(TWIE))				// send byte, or read and NACK
+#define I2C_TWCR_ACK	(I2C_TWCR_NEXT|_BV(TWEA))						// read and ACK
+#define I2C_TWCR_STOP	(_BV(TWINT)|_BV(TWSTO)|_BV(TWEN))
+#define I2C_TWCR_HOLD	_BV(TWEN)		// TWINT left set: SCL stays low, the bus is ours
+
+// where the bus is
+#define I2C_IDLE		0
+#define I2C_BUSY		1		// a transfer is running, the interrupt drives it
+#define I2C_HELD		2		// transfer done without stop, waiting for the next one
+#define I2C_WAIT		3		// pause before a retry, or a recovery
+
+// times on the rt_timestamp() time line
+#define I2C_US_COUNTS(us)		(((us)+RT_TIMESTAMP_US-1)/RT_TIMESTAMP_US)
+#define I2C_STEP_COUNTS(clock)	I2C_US_COUNTS(9000000UL/(clock)+I2C_STRETCH_US)		// a byte and its ACK
+#define I2C_HOLD_COUNTS			(10*RT_TIMESTAMP_TICK)		// bus kept for the next transfer, 0.1 s
+#define I2C_TWBR(clock)			((F_CPU/(clock)-16)/2)
+
+typedef struct
+{
+	uint8_t sla;				// address<<1 | I2C_READ or I2C_WRITE
+	uint8_t length;
+	uint8_t stop;				// FALSE to keep the bus for the next transfer
+	uint8_t status;
+	uint8_t tries;				// retries done
+	uint8_t at;					// data offset in i2c_pool
+	i2c_callback_t callback;
+} i2c_transfer_t;
+
+static i2c_transfer_t i2c_transfers[I2C_QUEUE_SIZE];
+static uint8_t i2c_pool[I2C_POOL_SIZE];		// transfer data
+static uint8_t i2c_pool_head;				// end of the data of the last entry queued
+static uint8_t i2c_head;					// next free entry
+static volatile uint8_t i2c_current;		// entry on the bus, moved by the interrupt
+static uint8_t i2c_tail;					// next finished entry to report
+static volatile uint8_t i2c_state;
+static uint8_t i2c_index;					// data byte of the running transfer
+static uint8_t i2c_enabled;
+static uint8_t i2c_pullup;
+static uint8_t i2c_twbr=I2C_TWBR(SCL_CLOCK);
+static uint16_t i2c_step_counts=I2C_STEP_COUNTS(SCL_CLOCK);
+static volatile uint16_t i2c_step_at;		// rt_timestamp() of the last TWI step, or of the wait start
+static uint16_t i2c_wait;					// counts from i2c_step_at before the timeout, or the end of the wait
+static uint8_t i2c_recover_pending;			// recover the bus before the next start
+
+// Private variables to keep status byte
+static uint8_t i2c_status_;
+static volatile uint8_t i2c_twi_status_;
+
+i2c_stats_t i2c_stats;
+
+static const char i2c_stats_names[][12] PROGMEM =
+{
+	" transfers=", " retries=", " nack=", " arb=", " buserr=", " timeout=", " recovered=", " stuck=", " failed=",
+};
+#define I2C_STATS_COUNTERS	(sizeof(i2c_stats_names)/sizeof(i2c_stats_names[0]))
+
+// i2c_receive_data() waits on this
+static uint8_t* i2c_receive_to;
+static uint8_t i2c_receive_error;
 
 /*****************
- * Private convenience function, for repetitive use
- * Performs a TWI operation, waits for completion and updates status
- * If timeout control is enabled, will return error (TRUE) on timeout
+ * Private functions, interrupts off
  *****************/
-static bool i2c_execCmd(uint8_t cmdReg) {
-	// send command
-	TWCR = cmdReg;
-
-#ifndef I2C_TIMEOUT_ENABLED
-	// wait for operation to complete (no timeout)
-	while (!(TWCR & (1 << TWINT)))
-	// status bits.
-	i2c_status_ = TWSR & 0xF8;
-	return FALSE;
-#else
-	// wait for command to complete with timeout
-	rt_timeout_i2c=I2C_TIMEOUT; 	// initialize timer
-	while (!(TWCR & (1 << TWINT)))
+
+// timeout, or end of the wait, counts from now
+static void i2c_wait_for(uint16_t counts)
+{
+	i2c_step_at=rt_timestamp();
+	i2c_wait=counts;
+}
+
+static void i2c_start()
+{
+	// new clock only between transfers, not for a repeated start
+	if(i2c_state!=I2C_HELD) TWBR=i2c_twbr;
+	i2c_state=I2C_BUSY;
+	i2c_wait_for(i2c_step_counts);
+	TWCR=I2C_TWCR_START;
+}
+
+// the transfer on the bus is over, for good
+static void i2c_done(uint8_t status)
+{
+	i2c_transfers[i2c_current & I2C_QUEUE_MASK].status=status;
+	i2c_current++;
+	i2c_stats.transfers++;
+}
+
+// Ends the transfer on the bus and starts the next one if there is one.
+// twcr is what ends this one: stop, release after a lost arbitration, or nothing
+// if the bus is kept.
+static void i2c_next(uint8_t status, uint8_t twcr)
+{
+	i2c_done(status);
+
+	if(i2c_current!=i2c_head)
 	{
-	  if(!rt_timeout_i2c)	// bus is hanged, we timed out
-	  {
-			#ifdef I2C_DEBUG
-			uart0_puts("**i2c bus timed out \n\r");
-			#endif
-			// status bits.
-			i2c_status_ = TWSR & 0xF8;
-			// return with error
-			return TRUE;
-	  }
+		// stop then start, start when the bus is free, or repeated start
+		TWCR=twcr|I2C_TWCR_START;
+		i2c_wait_for(i2c_step_counts);
 	}
-	// return with no error
-	i2c_status_ = TWSR & 0xF8;
-	return FALSE;
-#endif
+	else if(!(twcr & _BV(TWINT)))
+	{
+		// keep the bus for the next transfer, with the interrupt off
+		TWCR=I2C_TWCR_HOLD;
+		i2c_state=I2C_HELD;
+		i2c_wait_for(I2C_HOLD_COUNTS);
+	}
+	else
+	{
+		TWCR=twcr;
+		i2c_state=I2C_IDLE;
+	}
+}
+
+// The transfer on the bus failed: try it again after a pause, or give up and go on.
+// The pause also lets i2c_do() recover the bus in the main loop.
+static void i2c_fail(uint8_t status, uint8_t twcr)
+{
+	i2c_transfer_t* t=&i2c_transfers[i2c_current & I2C_QUEUE_MASK];
+
+	switch(status)
+	{
+		case I2C_NACK:			i2c_stats.nacks++; break;
+		case I2C_ARB_LOST:		i2c_stats.arb_lost++; break;
+		case I2C_BUS_ERROR:		i2c_stats.bus_errors++; i2c_recover_pending=TRUE; break;
+		case I2C_TIMEOUT_ERROR:	i2c_stats.timeouts++; i2c_recover_pending=TRUE; break;
+	}
+
+	if(t->tries<I2C_RETRIES)
+	{
+		i2c_stats.retries++;
+		TWCR=twcr;
+		i2c_state=I2C_WAIT;
+		i2c_wait_for(I2C_US_COUNTS(I2C_BACKOFF_US)<<t->tries);
+		t->tries++;
+		return;
+	}
+
+	i2c_stats.failed++;
+	i2c_stats.last_failed=t->sla>>1;
+	if(i2c_recover_pending)
+	{
+		TWCR=twcr;
+		i2c_done(status);
+		i2c_state=I2C_WAIT;
+		i2c_wait_for(0);
+	}
+	else i2c_next(status, twcr);
+}
+
+// interrupt side, after the last TWI step of the transfer
+static void i2c_finish(uint8_t status)
+{
+	uint8_t twcr=I2C_TWCR_STOP;
+
+	i2c_twi_status_=TW_STATUS;
+	// after a lost arbitration the bus belongs to the other master, no stop
+	if(status==I2C_ARB_LOST) twcr=_BV(TWINT)|_BV(TWEN);
+	// no stop requested, the next transfer gets a repeated start
+	else if(status==I2C_OK && !i2c_transfers[i2c_current & I2C_QUEUE_MASK].stop) twcr=0;
+
+	if(status==I2C_OK) i2c_next(status, twcr);
+	else i2c_fail(status, twcr);
+}
+
+// timeout or end of the wait reached
+static bool i2c_expired()
+{
+	uint8_t sreg=SREG;
+	uint16_t at;
+
+	cli();
+	at=i2c_step_at;
+	SREG=sreg;
+	return (uint16_t)(rt_timestamp()-at)>i2c_wait;
 }
 
 /*****************
- * Returns status code of last i2c operation
+ * TWI interrupt, one call per TWI step
+ *****************/
+ISR(TWI_vect)
+{
+	ISRPROF_ENTER(ISRPROF_NO_LATENCY);
+	i2c_transfer_t* t=&i2c_transfers[i2c_current & I2C_QUEUE_MASK];
+	uint8_t* data=i2c_pool+t->at;
+
+	i2c_step_at=rt_timestamp();
+	switch(TW_STATUS)
+	{
+		case TW_START:
+		case TW_REP_START:
+			i2c_index=0;
+			TWDR=t->sla;
+			TWCR=I2C_TWCR_NEXT;
+			break;
+
+		case TW_MT_SLA_ACK:
+		case TW_MT_DATA_ACK:
+			if(i2c_index<t->length)
+			{
+				TWDR=data[i2c_index++];
+				TWCR=I2C_TWCR_NEXT;
+			}
+			else i2c_finish(I2C_OK);
+			break;
+
+		// a byte in, or the address ACKed: ask for the next byte.
+		// ACK all bytes but the last one, the NACK tells the slave we're done
+		case TW_MR_DATA_ACK:
+			data[i2c_index++]=TWDR;
+			/* fall through */
+		case TW_MR_SLA_ACK:
+			TWCR=(i2c_index+1<t->length) ? I2C_TWCR_ACK : I2C_TWCR_NEXT;
+			break;
+
+		case TW_MR_DATA_NACK:
+			data[i2c_index++]=TWDR;
+			i2c_finish(I2C_OK);
+			break;
+
+		case TW_MT_SLA_NACK:
+		case TW_MT_DATA_NACK:
+		case TW_MR_SLA_NACK:
+			i2c_finish(I2C_NACK);
+			break;
+
+		case TW_MT_ARB_LOST:		// same as TW_MR_ARB_LOST
+			i2c_finish(I2C_ARB_LOST);
+			break;
+
+		default:					// TW_BUS_ERROR, the stop resets the TWI without touching the bus
+			i2c_finish(I2C_BUS_ERROR);
+			break;
+	}
+	ISRPROF_EXIT(ISRPROF_TWI);
+}
+
+/*****************
+ * Returns status of the last finished transfer, I2C_OK or an error
  * **************/
 uint8_t i2c_status()
 {
 	return i2c_status_;
 }
 
+/*****************
+ * Returns the TWI status code that ended the last transfer on the bus
+ * **************/
+uint8_t i2c_twi_status()
+{
+	return i2c_twi_status_;
+}
+
+/*****************
+ * Transfers queued, on the bus, or finished and not reported yet
+ * **************/
+uint8_t i2c_pending()
+{
+	return i2c_head-i2c_tail;
+}
+
+/*****************
+ * Fault counters
+ * **************/
+void i2c_report()
+{
+	char string[FMT_DEC_DIGITS+16];
+	const uint16_t* count=(const uint16_t*)&i2c_stats;
+	char* p;
+	uint8_t i;
+
+	serial_puts_p(i2c_twbr==I2C_TWBR(SCL_FAST_CLOCK) ? PSTR("I2C 400kHz") : PSTR("I2C 100kHz"));
+	for(i=0; i<I2C_STATS_COUNTERS; i++)
+	{
+		p=fmt_copy_p(string, i2c_stats_names[i]);
+		fmt_dec(p, count[i], 0, ' ');
+		serial_puts(string);
+	}
+	p=fmt_copy_p(string, PSTR(" last="));
+	p=fmt_dec(p, i2c_stats.last_failed, 0, ' ');
+	fmt_copy_p(p, PSTR("\r\n"));
+	serial_puts(string);
+}
+
+void i2c_reset_stats()
+{
+	memset(&i2c_stats, 0, sizeof(i2c_stats));
+}
+
+/******************
+ * Bus clock
+ * Switches between 100 and 400 kHz, the timeout follows
+ * ********************/
+void i2c_set_clock(bool fast)
+{
+	uint8_t sreg=SREG;
+	cli();
+	i2c_twbr=fast ? I2C_TWBR(SCL_FAST_CLOCK) : I2C_TWBR(SCL_CLOCK);
+	i2c_step_counts=fast ? I2C_STEP_COUNTS(SCL_FAST_CLOCK) : I2C_STEP_COUNTS(SCL_CLOCK);
+	if(i2c_state==I2C_IDLE) TWBR=i2c_twbr;
+	SREG=sreg;
+}
+
+/******************
+ * Bus recovery
+ * A slave reset or disturbed in the middle of a read keeps SDA low, waiting for the
+ * clocks of the rest of its byte. Clock SCL by hand until it lets go, 9 clocks at most,
+ * then send a STOP so every slave is back to idle. Takes about 100 us.
+ * The TWI has to be off, the pins work open drain: driven low, or released to the pull-ups.
+ * Returns TRUE if SDA is still stuck.
+ * ********************/
+#ifdef I2C_SDA_PIN
+#define I2C_LINE_LOW(pin)		do { clear_port_pin(I2C_PORT, pin); GET_DDR_REG(I2C_PORT)|=_BV(pin); } while(0)
+#define I2C_LINE_RELEASE(pin)	do { GET_DDR_REG(I2C_PORT)&=~_BV(pin); if(i2c_pullup) set_port_pin(I2C_PORT, pin); } while(0)
+#define I2C_SDA_IS_HIGH()		(GET_PIN_REG(I2C_PORT) & _BV(I2C_SDA_PIN))
+
+bool i2c_recover()
+{
+	uint8_t i;
+
+	I2C_LINE_RELEASE(I2C_SDA_PIN);
+	I2C_LINE_RELEASE(I2C_SCL_PIN);
+	_delay_us(I2C_RECOVERY_US);
+	for(i=0; i<9 && !I2C_SDA_IS_HIGH(); i++)
+	{
+		I2C_LINE_LOW(I2C_SCL_PIN);
+		_delay_us(I2C_RECOVERY_US);
+		I2C_LINE_RELEASE(I2C_SCL_PIN);
+		_delay_us(I2C_RECOVERY_US);
+	}
+
+	// STOP: SDA going up while SCL is high
+	I2C_LINE_LOW(I2C_SCL_PIN);
+	_delay_us(I2C_RECOVERY_US);
+	I2C_LINE_LOW(I2C_SDA_PIN);
+	_delay_us(I2C_RECOVERY_US);
+	I2C_LINE_RELEASE(I2C_SCL_PIN);
+	_delay_us(I2C_RECOVERY_US);
+	I2C_LINE_RELEASE(I2C_SDA_PIN);
+	_delay_us(I2C_RECOVERY_US);
+
+	return !I2C_SDA_IS_HIGH();
+}
+#else
+bool i2c_recover()
+{
+	return TRUE;
+}
+#endif
 
 /******************
  * Init
@@ -89,8 +403,10 @@ uint8_t i2c_status()
 void i2c_init(bool enablePullup)
 {
 
-	TWSR = 0;                         // no prescaler
-	TWBR = ((F_CPU/SCL_CLOCK)-16)/2;  // must be > 10 for stable operation
+	TWSR = 0;                         // no prescaler, TWBR must be > 10 for stable operation
+
+	TWBR = i2c_twbr;
+	i2c_pullup = enablePullup;
 
 	// internal pull-up resistor support if we happen to know the correct pins
 #ifdef I2C_SDA_PIN
@@ -104,272 +420,185 @@ void i2c_init(bool enablePullup)
 	// Load data register with default content; release SDA
 	TWDR = 0xff;
 
-	// Enable TWI peripheral with interrupt disabled (set TWEN bit on)
+	// Enable TWI peripheral, the interrupt gets turned on with each transfer
 	TWCR = (0<<TWINT)|(0<<TWEA)|(0<<TWSTA)|(0<<TWSTO)|(0<<TWWC)|(1<<TWEN)|(0<<TWIE);
 
-#ifdef I2C_TIMEOUT_ENABLED
-	rt_add_timer(&rt_timeout_i2c);
-#endif
+	i2c_enabled=TRUE;
 }
 
 /******************
  * Close
  * If the i2c pins ever need to be released for another use
  * use this function to turn off the i2c transmitter
+ * Transfers not done yet end with I2C_BUS_ERROR
  * ********************/
 void i2c_close()
 {
+	uint8_t sreg=SREG;
+	cli();
 	// Disable i2c
 	TWCR = 0x00;
+	i2c_recover_pending=FALSE;
+	while(i2c_current!=i2c_head) i2c_transfers[i2c_current++ & I2C_QUEUE_MASK].status=I2C_BUS_ERROR;
+	i2c_state=I2C_IDLE;
+	i2c_enabled=FALSE;
+	SREG=sreg;
 }
 
-/******************
- * Start
- * Wait to get hold of the bus and generate a start condition
- * Address is 7 bit, will get shifted one bit right
- * Indicate if this is for a read or write by using TW_READ or TW_WRITE
- * Returns TRUE if error (i.e. the bus was busy)
- * ********************/
-bool i2c_start(uint8_t address, uint8_t readwrite)
+/***************************
+ * Room for length bytes in the pool, after the data of the entries not reported yet
+ * Returns the offset, or I2C_POOL_FULL
+ ****************************/
+static uint8_t i2c_pool_alloc(uint8_t length)
 {
-	// send START condition
-	if(i2c_execCmd((1<<TWINT)|(1<<TWSTA)|(1<<TWEN)))
-	{
-		#ifdef I2C_DEBUG
-		uart0_puts("**i2c start condition timed-out \n\r");
-		#endif
-		i2c_stop();
-		return TRUE;
-	}
+	uint8_t first;
 
-	// return error if the bus is busy
-	if (i2c_status() != TW_START && i2c_status() != TW_REP_START)
-	{
-		#ifdef I2C_DEBUG
-		uart0_puts("**i2c start condition could not be transmitted \n\r");
-		#endif
-		i2c_stop();
-		return TRUE;
-	}
-
-	// send device address and direction byte
-	//TWDR = (address<<1 | (readwrite & 0x01));
-	TWDR = (address<<1 | readwrite);
-	if(i2c_execCmd((1<<TWINT) | (1<<TWEN)))
-	{
-		#ifdef I2C_DEBUG
-		uart0_puts("**i2c address send timed-out \n\r");
-		#endif
-		i2c_stop();
-		return TRUE;
-	}
-
-	// make sure to release the bus if there is an error other than bus timeout
-	if (readwrite == TW_READ)
-	{
-		if(i2c_status() != TW_MR_SLA_ACK)
-		{
-			#ifdef I2C_DEBUG
-			uart0_puts("**i2c start READ ACK failed \n\r");
-			#endif
-			i2c_stop();
-			return TRUE;
-		}
-	}
+	// nothing queued, start over at the beginning
+	if(i2c_head==i2c_tail) i2c_pool_head=0;
 	else
 	{
-		if(i2c_status() != TW_MT_SLA_ACK)
-		{
-			#ifdef I2C_DEBUG
-			uart0_puts("**i2c start TRANSMIT ACK failed \n\r");
-			#endif
-			i2c_stop();
-			return TRUE;
-		}
+		first=i2c_transfers[i2c_tail & I2C_QUEUE_MASK].at;
+		// wrapped around: the room is up to the oldest data
+		if(i2c_pool_head<=first) return (uint8_t)(first-i2c_pool_head)>=length ? i2c_pool_head : I2C_POOL_FULL;
+		// not at the end of the pool, maybe at its start
+		if(I2C_POOL_SIZE-i2c_pool_head<length) return first>=length ? 0 : I2C_POOL_FULL;
 	}
-	return FALSE;
+	return I2C_POOL_SIZE-i2c_pool_head>=length ? i2c_pool_head : I2C_POOL_FULL;
 }
 
-/**************************
- * Stop
- * Release the bus
- * ***********************/
-bool i2c_stop()
+/***************************
+ * Queue a transfer
+ * Copies the data for a write, starts the bus if it was idle
+ * Returns TRUE if it could not be queued, FALSE if no error
+ ****************************/
+bool i2c_queue(uint8_t address, uint8_t readwrite, const uint8_t* data, uint8_t length, bool sendStop, i2c_callback_t callback)
 {
-	// send stop, no time out
-	TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);
-
-#ifndef I2C_TIMEOUT_ENABLED
-	// wait until stop condition is executed and bus released, no time out
-	while (TWCR & (1 << TWSTO));
-	i2c_status_ = TWSR & 0xF8;
-	return FALSE;
-#else
-	// wait for stop to complete with timeout
-	rt_timeout_i2c=I2C_TIMEOUT; 	// initialize timer
-	while (TWCR & (1 << TWSTO))
-	{
-	  if(!rt_timeout_i2c)	// bus is hanged, we timed out
-	  {
-			#ifdef I2C_DEBUG
-			uart0_puts("**i2c bus timed out in stop \n\r");
-			#endif
-			// return with error
-			i2c_status_ = TWSR & 0xF8;
-			return TRUE;
-	  }
-	}
-	// return with no error
-	i2c_status_ = TWSR & 0xF8;
+	i2c_transfer_t* t;
+	uint8_t sreg, at;
+
+	// check that we got at least one byte, and that it fits
+	if(!i2c_enabled || length==0) return TRUE;
+	if(readwrite==I2C_WRITE && data==0) return TRUE;
+	if((uint8_t)(i2c_head-i2c_tail)>=I2C_QUEUE_SIZE) return TRUE;
+	at=i2c_pool_alloc(length);
+	if(at==I2C_POOL_FULL) return TRUE;
+
+	t=&i2c_transfers[i2c_head & I2C_QUEUE_MASK];
+	t->sla=(address<<1) | readwrite;
+	t->length=length;
+	t->stop=sendStop;
+	t->status=I2C_PENDING;
+	t->tries=0;
+	t->callback=callback;
+	t->at=at;
+	i2c_pool_head=at+length;
+	if(readwrite==I2C_WRITE) memcpy(i2c_pool+at, data, length);
+
+	// the interrupt may finish the running transfer just now
+	sreg=SREG;
+	cli();
+	i2c_head++;
+	// start, or repeated start if we kept the bus. After a failure, i2c_do() starts it.
+	if(i2c_state==I2C_IDLE || i2c_state==I2C_HELD) i2c_start();
+	SREG=sreg;
 	return FALSE;
-#endif
 }
 
-/**************************
- * Write
- * Writes a byte on the bus
- * Returns FALSE is the slave ACKed the byte, TRUE (error) if it is NACKed
- * ***********************/
-bool i2c_write(uint8_t databyte)
+/***************************
+ * Send Data Block
+ * Queues a write, the transfer happens in the background
+ * Returns TRUE if it could not be queued
+ * Returns FALSE if no error
+ ****************************/
+bool i2c_send_data(uint8_t address, uint8_t *databuffer, uint8_t datalength, bool sendStop)
 {
-
-	// write the byte on the bus
-	TWDR = databyte;
-	if(i2c_execCmd((1 << TWINT) | (1 << TWEN)))
-	{
-		#ifdef I2C_DEBUG
-		uart0_puts("\n\r i2c write timed-out \n\r");
-		#endif
-		i2c_stop();
-		return TRUE;
-	}
-	//in case of NACK, issue a stop, so user doesn't have to remember
-	if(i2c_status() != TW_MT_DATA_ACK)
-	{
-		#ifdef I2C_DEBUG
-		uart0_puts("\n\r i2c write NACKed by slave \n\r");
-		#endif
-		i2c_stop();
-		return TRUE;
-	}
-	else return FALSE;
+	return i2c_queue(address, I2C_WRITE, databuffer, datalength, sendStop, 0);
 }
 
-/**************************
- * Read
- * Read a single byte requested from the slave
- * if nack_last_byte is false, another byte is requested by sending an ACK
- * Set nack_last_byte to true when this is the last byte to read
- * so no more bytes are requested by signaling a NACK to the slave
- * ***********************/
-bool i2c_read(uint8_t *databyte, bool nack_last_byte)
+static void i2c_received(uint8_t status, const uint8_t* data, uint8_t length)
 {
-	if(i2c_execCmd((1 << TWINT) | (1<<TWEN) | (nack_last_byte ? 0 : (1<<TWEA))))
-	{
-		#ifdef I2C_DEBUG
-		uart0_puts("\n\r i2c read timed-out \n\r");
-		#endif
-		i2c_stop();
-		return TRUE;
-	}
-
-	*databyte=TWDR;
-	return FALSE;
+	if(status==I2C_OK) memcpy(i2c_receive_to, data, length);
+	i2c_receive_error=(status!=I2C_OK);
+	i2c_receive_to=0;
 }
 
 /***************************
- * Send Data Block
- * That's the only send function you should use in a master
- * Generates start condition, sends a block of data,
- * and does stop or prepares for read/restart if stop is set to FALSE
- * Returns TRUE if an error happened (byte not ACK'ed)
+ * Receive Data Block
+ * Queues a read and waits for it to finish
+ * Returns TRUE if an error happened
  * Returns FALSE if no error
  ****************************/
-
-bool i2c_send_data(uint8_t address, uint8_t *databuffer, uint8_t datalength, bool sendStop)
+bool i2c_receive_data(uint8_t address, uint8_t *databuffer, uint8_t datalength)
 {
-	// check that we got a pointer and at least one character
-	if(databuffer==0 || datalength==0)
+	// check that we got a pointer, and that we are not already waiting
+	if(databuffer==0 || i2c_receive_to) return TRUE;
+
+	i2c_receive_to=databuffer;
+	if(i2c_queue(address, I2C_READ, 0, datalength, TRUE, i2c_received))
 	{
-			// we could be in a restart, make sure we issue a stop
-		#ifdef I2C_DEBUG
-		uart0_puts("\n\r i2c_send_data called with null data or length \n\r");
-		#endif
-		i2c_stop();
+		i2c_receive_to=0;
 		return TRUE;
 	}
-
-	// generate start condition, return if error
-	if(i2c_start(address, I2C_WRITE)) return TRUE;
-
-	// send the bytes, return if error
-	for(uint8_t i=0; i<datalength; i++)
+	while(i2c_receive_to)
 	{
-		if(i2c_write(databuffer[i])) return TRUE;
+		hal_idle();
+		i2c_do();
 	}
-
-	// only send a stop if requested, if not, user needs to restart and stop with a read
-	if(sendStop) i2c_stop();
-	return FALSE;
+	return i2c_receive_error;
 }
 
 /***************************
- * Receive Data Block
- * That's the only read function you should use in a master
- * Generates start or restart condition, reads a block of data,
- * and sends a stop at the end
- * Returns TRUE if an error happened
- * Returns FALSE if no error
+ * Main loop part
+ * Catches a hanged bus, recovers it, starts the retries
+ * and reports the finished transfers
  ****************************/
-bool i2c_receive_data(uint8_t address, uint8_t *databuffer, uint8_t datalength)
+void i2c_do()
 {
-	uint8_t databyte;
-	// check that we got a pointer and at least one character
-	if(databuffer==0 || datalength==0)
-	{
-		#ifdef I2C_DEBUG
-		uart0_puts("\n\r i2c_receive_data called with null data or length \n\r");
-		#endif
-		// we could be in a restart, make sure we issue a stop
-		i2c_stop();
-		return TRUE;
-	}
+	i2c_transfer_t* t;
+	uint8_t sreg;
 
-	// generate start or re-start condition
-	if(i2c_start(address, I2C_READ))
+	if(i2c_state!=I2C_IDLE && i2c_state!=I2C_WAIT && i2c_expired())
 	{
-			// an error happened. We could be in a restart, make sure we issue a stop
-			i2c_stop();
-			return TRUE;
+		sreg=SREG;
+		cli();
+		if(i2c_state==I2C_BUSY)
+		{
+			// bus is hanged, TWI off until the recovery
+			TWCR=0;
+			i2c_twi_status_=TW_STATUS;
+			i2c_fail(I2C_TIMEOUT_ERROR, 0);
+		}
+		else if(i2c_state==I2C_HELD)
+		{
+			// nothing came after the transfer without stop, let the bus go
+			TWCR=I2C_TWCR_STOP;
+			i2c_state=I2C_IDLE;
+		}
+		SREG=sreg;
 	}
 
-	// read all bytes except the last one
-	uint8_t i=0;
-	while(i<datalength-1)
+	if(i2c_state==I2C_WAIT && i2c_expired())
 	{
-		// read with ACK for requesting more bytes
-		if(i2c_read(&databyte, FALSE))
+		if(i2c_recover_pending)
 		{
-			//error happened, bus did hang while reading.
-			i2c_stop();
-			return TRUE;
+			i2c_recover_pending=FALSE;
+			TWCR=0;
+			if(i2c_recover()) i2c_stats.stuck++;
+			else i2c_stats.recoveries++;
+			TWCR=_BV(TWEN);
 		}
-		// only fill the databuffer with valid bytes
-		databuffer[i]=databyte;
-		i++;
+		sreg=SREG;
+		cli();
+		if(i2c_current!=i2c_head) i2c_start();
+		else i2c_state=I2C_IDLE;
+		SREG=sreg;
 	}
 
-	// this should now be the last read (datalength-1), NACK it
-	if(i2c_read(&databyte, TRUE))
+	while(i2c_tail!=i2c_current)
 	{
-		//error happened, bus did hang while reading.
-		i2c_stop();
-		return TRUE;
+		t=&i2c_transfers[i2c_tail & I2C_QUEUE_MASK];
+		i2c_status_=t->status;
+		if(t->callback) t->callback(t->status, i2c_pool+t->at, t->length);
+		i2c_tail++;
 	}
-	databuffer[i]=databyte;
-
-	// generate stop condition
-	i2c_stop();
-	return FALSE;
 }
-
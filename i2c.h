@@ -4,7 +4,7 @@
  *  Created on: Aug 17, 2013
  *  Author: Marc Verdiell
  *  i2c library for AVR
- *  version 1.1
+ *  version 1.3
  *
  *	Implements a clean I2C Master with timeout to prevent bus lockup
  * 	Needs realtime.c for the timeout functionality
@@ -12,6 +12,25 @@
  */
 
 /*************************
+ *  version 1.3
+ *  The transfers keep their data in a shared pool instead of 16 bytes each, so the
+ *  longest '&' command payload fits again
+ *  Bus clock selectable at run time, 100 or 400 kHz (#IS setup command)
+ *  Timeout is now per TWI step, a byte time plus the clock stretching we allow,
+ *  on the rt_timestamp() time line. The rt_timer is gone.
+ *  Failed transfers are retried I2C_RETRIES times, after a growing pause
+ *  Bus recovery after a timeout or a bus error: SCL clocked by hand until a stuck
+ *  slave lets SDA go, then a STOP
+ *  Fault counters (#IF setup command)
+ *
+ *  version 1.2
+ *  Interrupt driven: the TWI interrupt runs the transfers, nothing waits on the bus anymore
+ *  Transfers are queued, I2C_QUEUE_SIZE of them, and run back-to-back
+ *  i2c_send_data() copies the data and returns immediately
+ *  Completion reported by a callback, called from i2c_do() in the main loop
+ *  Timeout is now per transfer, checked by i2c_do()
+ *  Low level start/stop/write/read functions removed, the interrupt does their job
+ *
  *  version 1.1
  *  Added support for dynamic timers with new realtime.c library
  *  Added commenting and examples on the main 3 functions
@@ -22,67 +41,119 @@
 
 #include <stdint.h> 		// uint8_t and companions
 #include "toolbox.h"		// for typedef uint8_t bool;
-#include <util/twi.h>		// Includes TW_READ and TW_WRITE
+#include "hal.h"			// Includes TW_READ and TW_WRITE
 
-// Uncomment for debug, makes the i2c talkative on UART0. Comment out for silent operation
-// saves a lot of DRAM too.
-
-//#define I2C_DEBUG
-
-// I2C clock in Hz. Set at 100 kHz.
+// I2C clock in Hz. Starts at 100 kHz, i2c_set_clock() switches to 400 kHz.
 // (F_CPU/SCL_CLOCK)-16)/2 must be >10
 #define SCL_CLOCK  100000L
+#define SCL_FAST_CLOCK  400000L
+
+// I2C timeout. If a TWI step (start, byte, stop) takes longer than a byte time plus this,
+// the bus is hanged: the transfer is abandoned and the bus recovered.
+#define I2C_STRETCH_US		1000	// longest clock stretching we wait for
 
-// I2C timeout. If the I2C bus hangs, this will abandon the transaction after the timeout
-// Requires realtime.c library
-#define I2C_TIMEOUT_ENABLED
-#define I2C_TIMEOUT 50        // times out after 0.5s
+// Failed transfers (NACK, lost arbitration, bus error, timeout) are tried again
+// I2C_RETRIES times. The first retry waits I2C_BACKOFF_US, each next one twice as long.
+#define I2C_RETRIES			2
+#define I2C_BACKOFF_US		2000
 
-// more logical with our naming conventions, to use in start() functions
+// Bus recovery half clock period, 100 kHz clocks work with every device
+#define I2C_RECOVERY_US		5
+
+// Transfer queue. The entries keep their data in one pool: what is written is copied
+// there, what is read lands there. A transfer is refused if the pool can't take it.
+// The longest '&' command payload is CMD_MAX_LENGTH-5 bytes, main.c checks it fits.
+#define I2C_QUEUE_SIZE		4
+#define I2C_POOL_SIZE		80		// no more than 255
+
+// more logical with our naming conventions
 #define I2C_READ  TW_READ
 #define I2C_WRITE TW_WRITE
 
+// transfer status, given to the callback and by i2c_status()
+#define I2C_OK				0
+#define I2C_NACK			1		// address or data byte not acknowledged
+#define I2C_ARB_LOST		2		// another master won the bus
+#define I2C_BUS_ERROR		3		// illegal start or stop on the bus
+#define I2C_TIMEOUT_ERROR	4		// a TWI step didn't complete in time, the TWI was reset
+#define I2C_PENDING			0xFF	// queued or running
+
+// fault counters, reported by #IF0 and reset by #IF1
+typedef struct
+{
+	uint16_t transfers;		// finished, good or not
+	uint16_t retries;
+	uint16_t nacks;
+	uint16_t arb_lost;
+	uint16_t bus_errors;
+	uint16_t timeouts;
+	uint16_t recoveries;	// bus recoveries that freed SDA
+	uint16_t stuck;			// bus recoveries that didn't
+	uint16_t failed;		// transfers given up after the retries
+	uint8_t last_failed;	// address of the last one
+} i2c_stats_t;
+
+extern i2c_stats_t i2c_stats;
+
+// called by i2c_do() when a transfer is over, data holds what was read (or sent)
+typedef void (*i2c_callback_t)(uint8_t status, const uint8_t* data, uint8_t length);
+
 /****************************************************************
  * Main user functions
- * These 3 should be the only ones used for implementing a master
  ****************************************************************/
 
 // init the i2c master. Set enablePullup to TRUE to enable 10k pullups (the usual case)
 // for large systems you might need external 4.7k pullups.
 void    i2c_init(bool enablePullup);
 
-// i2c send data. You should usually put sendStop to True.
-// Optionally, put SendStop to False only if you are going to do a read just afterwards
-// (requesting data for example). This will generate a restart and save time in the I2C
-// read transaction by skipping addressing.
-// This function returns TRUE is an error occurred, FALSE if no error
-// i2caddress is the 7 bit address (can be even or odd)
+// i2c queue a transfer, the way to talk to any device.
+// For a write, data is copied into the queue, it can be reused as soon as this returns.
+// For a read, data is ignored, what is read is given to the callback.
+// callback can be 0 if you don't care about the result.
+// Set sendStop to FALSE to keep the bus for the next transfer with a repeated start,
+// usually a read that follows the write telling the device what to send back.
+// Returns TRUE if the transfer could not be queued (queue or pool full, length 0 or too long)
+// i2caddress is the 7 bit address
+// Example, reading 2 bytes from register 0x10:
+//		uint8_t reg=0x10;
+//		i2c_queue(i2caddress, I2C_WRITE, &reg, 1, FALSE, 0);
+//		i2c_queue(i2caddress, I2C_READ, 0, 2, TRUE, got_register);
+bool i2c_queue(uint8_t address, uint8_t readwrite, const uint8_t* data, uint8_t length, bool sendStop, i2c_callback_t callback);
+
+// i2c send data, queues a write without a callback and returns immediately.
+// This function returns TRUE if it could not be queued, FALSE if no error.
+// Bus errors come later, see i2c_status().
 // To send a C string, write some code like this:
 // 		char teststring[]="1234";
 //		uint8_t i2clength=strlen(teststring);
 // 		i2c_send_data(i2caddress,(uint8_t*)teststring, i2clength, TRUE);
 bool i2c_send_data(uint8_t address, uint8_t *databuffer, uint8_t datalength, bool sendStop);
 
-// i2c receive data. Might be preceded by a write beforehand which will tell the slave what type of data
+// i2c receive data. Queues the read and waits for it: only use it outside of the main loop
+// (at init for example), the main loop should use i2c_queue() with a callback.
+// Might be preceded by a write with sendStop FALSE which will tell the slave what type of data
 // is requested, as there is no way to give any info in the receive request itself.
 // This function returns TRUE is an error occurred, FALSE if no error
-// i2caddress is the 7 bit address (can be even or odd)
 // To receive a C string, write some code like this:
 // 		uint8_t responselength=5;   // ask for 5 chars back?
 // 		char response[responselength];
 // 		i2c_receive_data(i2caddress, (uint8_t*) response, responselength);
 bool i2c_receive_data(uint8_t address, uint8_t *databuffer, uint8_t datalength);
 
-/***************************************************
- * Low level i2c master functions
- * You should not need to call these directly
- ***************************************************/
-void    i2c_close();									// call if you ever want to release the pins for some other use
-bool    i2c_start(uint8_t address, uint8_t readwrite);	// generates start condition, try to get hold of the bus
-bool    i2c_stop(void);									// stop condition, release the bus, returns TRUE if it times out
-bool    i2c_write(uint8_t databyte);					// write a byte
-bool 	i2c_read(uint8_t *databyte, bool nack_last_byte);		// read a byte from the slave, set nack_last_byte to true for the last byte
-uint8_t i2c_status();									// i2c status and error code from last operation
+// call from the main loop: calls the callbacks of the finished transfers, checks the timeout,
+// recovers the bus and starts the retries
+void i2c_do();
+
+// bus clock, FALSE for 100 kHz, TRUE for 400 kHz. Takes effect when the bus is idle.
+void i2c_set_clock(bool fast);
+
+uint8_t i2c_pending();		// transfers queued, running or not reported yet, 0 when all done
+uint8_t i2c_status();		// status of the last finished transfer, I2C_OK or an error
+uint8_t i2c_twi_status();	// TW_STATUS that ended it, for debug
+bool    i2c_recover();		// bus recovery, TRUE if SDA is still stuck. The TWI must be off.
+void    i2c_report();		// fault counters on the console
+void    i2c_reset_stats();
+void    i2c_close();		// call if you ever want to release the pins for some other use
 
 
 /**************************************************
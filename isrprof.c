@@ -0,0 +1,149 @@
+/*
+ * isrprof.c
+ * Interrupt latency and duration profiler, see isrprof.h
+ *
+ */
+
+#include "isrprof.h"
+
+#ifdef _ISR_PROFILE_
+
+#include <stdio.h>			// for sprintf(), test builds only
+#include "serial.h"
+
+static isrprof_stat_t isrprof_stats[ISRPROF_NUM];
+static isrprof_trace_t isrprof_trace[ISRPROF_TRACE_SIZE];
+static uint8_t isrprof_trace_pos;
+
+static const char isrprof_names[ISRPROF_NUM][7] PROGMEM =
+{
+	"T1CMPA", "T0CMPA", "RX", "UDRE", "T2CMPA", "T2CMPB", "TWI", "T1OVF",
+};
+
+const char strIsrprofBegin[] PROGMEM="ISRPROF BEGIN ticks=0.5us\r\n";
+const char strIsrprofEnd[] PROGMEM="ISRPROF END\r\n";
+
+// bucket 0 holds 0 and 1 tick, bucket n holds 2^n to 2^(n+1)-1 ticks
+static uint8_t isrprof_bucket(uint16_t ticks)
+{
+	uint8_t b=0;
+	while(ticks>1 && b<ISRPROF_BUCKETS-1)
+	{
+		ticks>>=1;
+		b++;
+	}
+	return b;
+}
+
+static void isrprof_stat_init(isrprof_stat_t* s)
+{
+	uint8_t i;
+	s->count=0;
+	s->lat_min=s->dur_min=0xFFFF;
+	s->lat_max=s->dur_max=0;
+	for(i=0; i<ISRPROF_BUCKETS; i++) s->lat_hist[i]=s->dur_hist[i]=0;
+}
+
+// called from interrupt routines, interrupts are off
+void isrprof_record(uint8_t id, uint16_t entry, uint16_t latency)
+{
+	uint16_t duration=isrprof_now()-entry;
+	isrprof_stat_t* s=&isrprof_stats[id];
+	uint8_t b;
+
+	if(s->count==0xFFFF) return;	// saturated, dump and reset to continue
+	s->count++;
+
+	if(duration<s->dur_min) s->dur_min=duration;
+	if(duration>s->dur_max) s->dur_max=duration;
+	b=isrprof_bucket(duration);
+	s->dur_hist[b]++;
+
+	if(latency!=ISRPROF_NO_LATENCY)
+	{
+		if(latency<s->lat_min) s->lat_min=latency;
+		if(latency>s->lat_max) s->lat_max=latency;
+		b=isrprof_bucket(latency);
+		s->lat_hist[b]++;
+	}
+
+	isrprof_trace_t* t=&isrprof_trace[isrprof_trace_pos];
+	t->id=id;
+	t->entry=entry;
+	t->latency=latency;
+	t->duration=duration;
+	isrprof_trace_pos=(isrprof_trace_pos+1)%ISRPROF_TRACE_SIZE;
+}
+
+void isrprof_reset()
+{
+	uint8_t i;
+	uint8_t sreg=SREG;
+	cli();
+	for(i=0; i<ISRPROF_NUM; i++) isrprof_stat_init(&isrprof_stats[i]);
+	for(i=0; i<ISRPROF_TRACE_SIZE; i++) isrprof_trace[i].duration=ISRPROF_NO_LATENCY;
+	isrprof_trace_pos=0;
+	SREG=sreg;
+}
+
+static void isrprof_print_hist(const char* type, const char* name, uint16_t* hist)
+{
+	char string[24];
+	uint8_t i;
+	sprintf(string, "%s %s", type, name);
+	serial_puts(string);
+	for(i=0; i<ISRPROF_BUCKETS; i++)
+	{
+		sprintf(string, " %u", hist[i]);
+		serial_puts(string);
+	}
+	serial_puts("\r\n");
+}
+
+// Prints, for each interrupt:
+// ISR <name> n=<count> lat=<min>..<max> dur=<min>..<max>
+// LAT <name> <bucket counts>
+// DUR <name> <bucket counts>
+// then the trace, oldest first:
+// TRC <name> <entry> <latency> <duration>
+void isrprof_dump()
+{
+	char string[64];
+	char name[7];
+	isrprof_stat_t s;
+	isrprof_trace_t t;
+	uint8_t i, pos;
+
+	serial_puts_p(strIsrprofBegin);
+	for(i=0; i<ISRPROF_NUM; i++)
+	{
+		// take a consistent copy, the interrupts keep running while we print
+		cli();
+		s=isrprof_stats[i];
+		sei();
+		if(!s.count) continue;
+		strcpy_P(name, isrprof_names[i]);
+		if(s.lat_min!=0xFFFF) sprintf(string, "ISR %s n=%u lat=%u..%u dur=%u..%u\r\n", name, s.count, s.lat_min, s.lat_max, s.dur_min, s.dur_max);
+		else sprintf(string, "ISR %s n=%u lat=- dur=%u..%u\r\n", name, s.count, s.dur_min, s.dur_max);
+		serial_puts(string);
+		if(s.lat_min!=0xFFFF) isrprof_print_hist("LAT", name, s.lat_hist);
+		isrprof_print_hist("DUR", name, s.dur_hist);
+	}
+
+	pos=isrprof_trace_pos;
+	for(i=0; i<ISRPROF_TRACE_SIZE; i++)
+	{
+		cli();
+		t=isrprof_trace[pos];
+		sei();
+		pos=(pos+1)%ISRPROF_TRACE_SIZE;
+		if(t.duration==ISRPROF_NO_LATENCY) continue;	// unused slot
+		strcpy_P(name, isrprof_names[t.id]);
+		if(t.latency==ISRPROF_NO_LATENCY) sprintf(string, "TRC %s %u - %u\r\n", name, t.entry, t.duration);
+		else sprintf(string, "TRC %s %u %u %u\r\n", name, t.entry, t.latency, t.duration);
+		serial_puts(string);
+	}
+	serial_puts_p(strIsrprofEnd);
+}
+
+#endif
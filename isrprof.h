@@ -0,0 +1,94 @@
+/*
+ * isrprof.h
+ * Interrupt latency and duration profiler
+ *
+ * Compiled in only when _ISR_PROFILE_ is defined in main.h, otherwise all the macros
+ * below compile to nothing (or to the plain register access) and cost no RAM.
+ *
+ * Each profiled interrupt routine starts with ISRPROF_ENTER(latency) and calls
+ * ISRPROF_EXIT(id) before every return. Times are Timer1 ticks (0.5 us at 16 MHz),
+ * Timer1 runs free for clock.c so TCNT1 is a continuous time line.
+ *
+ * Latency is the time from the hardware event to the first instruction of the routine,
+ * as far as each timer lets us see it:
+ * - TIMER1_COMPA: TCNT1 on entry, counted from the compare. This is the servo pulse width error.
+ * - TIMER1_OVF: TCNT1 on entry, counted from the overflow (clock.c)
+ * - TIMER0_COMPA: TCNT0 on entry, counted from the compare clear (16 us resolution)
+ * - TIMER2_COMPA/B: TCNT2 past the compare value (2 us resolution)
+ * - USART, TWI: unknown, only the duration is recorded
+ *
+ * Per interrupt: count, min/max and log2 histograms of latency and duration.
+ * The last ISRPROF_TRACE_SIZE events are kept in a trace ring.
+ * Setup command #IP00 dumps everything on the console, #IP01 resets the counters.
+ * tools/isrprof_replay.py renders a captured dump as histograms.
+ *
+ * Costs about 400 bytes of RAM, meant for test builds.
+ *
+ */
+
+#ifndef ISRPROF_H_
+#define ISRPROF_H_
+
+#include <stdint.h>
+#include "main.h"		// for the _ISR_PROFILE_ compile flag
+#include "hal.h"
+
+// profiled interrupts
+#define ISRPROF_T1COMPA		0
+#define ISRPROF_T0COMPA		1
+#define ISRPROF_USART_RX	2
+#define ISRPROF_USART_UDRE	3
+#define ISRPROF_T2COMPA		4
+#define ISRPROF_T2COMPB		5
+#define ISRPROF_TWI			6
+#define ISRPROF_T1OVF		7
+#define ISRPROF_NUM			8
+
+#define ISRPROF_BUCKETS		10		// log2 buckets, the last one holds everything above 256 us
+#define ISRPROF_TRACE_SIZE	16		// last events kept
+#define ISRPROF_NO_LATENCY	0xFFFF	// for interrupts whose trigger time we can't see
+
+// Timer1 ticks in one tick of the other timers
+#define ISRPROF_T0_TICKS	32		// Timer0 prescaler 256, Timer1 prescaler 8
+#define ISRPROF_T2_TICKS	(SUART_TIMER_PRESCALER/8)
+
+#ifdef _ISR_PROFILE_
+
+typedef struct
+{
+	uint16_t count;
+	uint16_t lat_min, lat_max;
+	uint16_t dur_min, dur_max;
+	uint16_t lat_hist[ISRPROF_BUCKETS];
+	uint16_t dur_hist[ISRPROF_BUCKETS];
+} isrprof_stat_t;
+
+typedef struct
+{
+	uint8_t id;
+	uint16_t entry;			// time line at entry
+	uint16_t latency;
+	uint16_t duration;
+} isrprof_trace_t;
+
+// continuous Timer1 time line, call with interrupts off
+static inline uint16_t isrprof_now()
+{
+	return TCNT1;
+}
+
+#define ISRPROF_ENTER(latency)	uint16_t isrprof_entry=isrprof_now(); uint16_t isrprof_latency=(latency)
+#define ISRPROF_EXIT(id)		isrprof_record((id), isrprof_entry, isrprof_latency)
+
+void isrprof_record(uint8_t id, uint16_t entry, uint16_t latency);
+void isrprof_reset();
+void isrprof_dump();
+
+#else
+
+#define ISRPROF_ENTER(latency)
+#define ISRPROF_EXIT(id)
+
+#endif
+
+#endif /* ISRPROF_H_ */
@@ -0,0 +1,87 @@
+/*
+ * latency.c
+ * Command latency statistics, see latency.h
+ *
+ */
+
+#include "latency.h"
+
+#ifdef _LATENCY_STATS_
+
+#include <stdio.h>			// for sprintf(), test builds only
+#include <string.h>
+#include "realtime.h"
+#include "serial.h"
+
+typedef struct
+{
+	uint16_t count;
+	int16_t min, max;		// rt_timestamp() counts
+	int32_t sum;
+} latency_stat_t;
+
+static latency_stat_t latency_cmd;
+static latency_stat_t latency_deferred;
+static uint16_t latency_start;			// end of the command line being processed
+static uint8_t latency_pending;			// no action run for it yet
+
+const char strLatencyCmd[] PROGMEM="cmd";
+const char strLatencyLate[] PROGMEM="late";
+
+static void latency_add(latency_stat_t* s, int16_t counts)
+{
+	if(s->count==0xFFFF) return;	// saturated, leave the average alone
+	if(!s->count || counts<s->min) s->min=counts;
+	if(!s->count || counts>s->max) s->max=counts;
+	s->sum+=counts;
+	s->count++;
+}
+
+void latency_command()
+{
+	latency_start=rt_timestamp();
+	latency_pending=TRUE;
+}
+
+void latency_command_done()
+{
+	latency_pending=FALSE;
+}
+
+void latency_action()
+{
+	if(!latency_pending) return;
+	latency_pending=FALSE;
+	latency_add(&latency_cmd, (uint16_t)(rt_timestamp()-latency_start));
+}
+
+void latency_late(int16_t counts)
+{
+	latency_add(&latency_deferred, counts);
+}
+
+static void latency_print(const char* name, latency_stat_t* s)
+{
+	char string[80];
+	char n[5];
+
+	strcpy_P(n, name);
+	if(!s->count) sprintf(string, "LAT %s n=0\r\n", n);
+	else sprintf(string, "LAT %s n=%u min=%ldus avg=%ldus max=%ldus\r\n", n, s->count,
+			(long)s->min*RT_TIMESTAMP_US, (long)(s->sum/s->count)*RT_TIMESTAMP_US, (long)s->max*RT_TIMESTAMP_US);
+	serial_puts(string);
+}
+
+void latency_report()
+{
+	latency_print(strLatencyCmd, &latency_cmd);
+	latency_print(strLatencyLate, &latency_deferred);
+}
+
+void latency_reset()
+{
+	memset(&latency_cmd, 0, sizeof(latency_cmd));
+	memset(&latency_deferred, 0, sizeof(latency_deferred));
+}
+
+#endif
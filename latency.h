@@ -0,0 +1,45 @@
+/*
+ * latency.h
+ * Command latency statistics
+ *
+ * Compiled in only when _LATENCY_STATS_ is defined in main.h, otherwise the calls
+ * below compile to nothing.
+ *
+ * Two measurements, in rt_timestamp() counts (16 us):
+ * - cmd: from the end of a command line to the first routine action it runs,
+ *   for the commands that run one right away (parsing, table lookups, loading the
+ *   panel sequence)
+ * - late: how long after its time a deferred routine action ran. Actions are due on
+ *   the millis() clock and never run early, late is the main loop getting to them:
+ *   a millisecond and a pass, more when the main loop is busy elsewhere.
+ *
+ * Setup command #LS00 prints count, min, average and max of both in microseconds,
+ * #LS01 resets them.
+ *
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include "main.h"		// for the _LATENCY_STATS_ compile flag
+#include "hal.h"
+
+#ifdef _LATENCY_STATS_
+
+void latency_command();				// a command line is complete
+void latency_command_done();		// the command has been processed
+void latency_action();				// a routine action runs
+void latency_late(int16_t counts);	// a deferred action ran that many counts after its time
+void latency_report();
+void latency_reset();
+
+#else
+
+#define latency_command()
+#define latency_command_done()
+#define latency_action()
+#define latency_late(counts)
+
+#endif
+
+#endif /* LATENCY_H_ */
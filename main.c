@@ -161,7 +161,7 @@
  * Every command must start with one of these special characters (defined in the header file)
  * The start character is recognized in the main loop:
  *
- * ":" Pie panel command, parsed and treated by this controller in the "process_command" routine
+ * ":" Pie panel command, parsed and treated by this controller through the "panel_commands" table
  * "*" HP commands, passed on to the HoloController board daisy chained to suart1, see "parse_hp_command"
  * "@" Display commands, also passed to the HoloController board, see "parse_display_command"
  * "$" Sound commands, passed to the CFIII sound controller on suart2 "parse_sound_command"
@@ -172,7 +172,7 @@
  *
  * Panel commands
  * They must follow the syntax ":CCxx\r" where CC=command , xx= two digit decimal number, \r is carriage return
- * The following commands are recognized in v1.4 (in process_command)
+ * The following commands are recognized in v1.4 (in panel_commands)
  * :SExx launches sequences, see below
  * :OPxx open panel number xx=01-13. If xx=00, opens all panels
  * 		OP14= open top panels
@@ -233,6 +233,21 @@
  *	#STxx Setup Delay time between Master and Slave Panel Sequences.
  *		Use this if the Slave panels are starting too soon
  *		Values up to 250 are supported.  Values are in ms.
+ *	//// CONSOLE
+ *	#SBx Console baud rate, OK is sent at the old rate then the port switches
+ *		0=9600 (default), 1=19200, 2=38400, 3=57600, 5=250000
+ *		4 (115200) is refused: at 16 MHz it is 2.1% off, more than the UART tolerates
+ *	#SC0 Servo streaming counters, #SC1 resets them
+ *
+ *	Binary frames (see frame.h), mixed with the ASCII commands on the console
+ *	0xA5 length opcode payload crc: servo positions, sequences and setup values
+ *	and live servo streaming (see stream.h)
+ *
+ *	Batch lines
+ *	:SE05;$C;*F1 runs the commands separated by ';' from the same line, in the same main loop pass.
+ *		Panel sequences they start begin together, at the end of the line (_BATCH_SYNC_START_).
+ *		Only a ';' followed by a start character separates, and not between double quotes:
+ *		@1MHI;THERE and &10,"A;B go out whole.
  *
  *  Client Features
  *  *EOxx Pull pin high/low (config in Client code) on EXT1.
@@ -246,51 +261,47 @@
 
 #include "main.h"
 
-#include <util/delay.h>
-#include <avr/io.h>
-#include <avr/interrupt.h>  // needed for the UART interrupt
-#include <avr/pgmspace.h>	// for the sequencer data arrays defined with PROGMEM
-#include <avr/eeprom.h>		// for state save and setup mode
+#include "hal.h"			// registers, interrupts, PROGMEM sequencer data arrays, EEPROM for state save and setup mode
 
-#include <stdlib.h>			// for itoa(), integer to string conversion
-#include <errno.h>			// for errors on atoi (check errno)
-#include <stdio.h>			// for sprintf(), don't use if you are short on memory
 #include <string.h>			// for strlen()
 
 
 #include "toolbox.h"
 #include "servo.h"			// servo drivers
 #include "realtime.h"		// real time interrupt services
+#include "clock.h"			// millisecond time base on Timer1
 #include "serial.h"			// hardware serial
 #include "suart.h"			// software serial (write only)
 #include "sequencer.h"		// servo sequencer
 #include "panel_sequences.h"	// panel sequences, moved off to another file for clarity
+#include "routine.h"		// panel sequences with their sound and light effects
+#include "panel_routines.h"	// the :SExx routines
 
 #ifdef _MP3TRIGGER_
 #include "wmath.h"			// random
-#include "mp3sound.h"
+#include "MP3sound.h"
 #endif
 
 #ifdef _MARCDUINOV2_
 #include "i2c.h"			// include I2C Master libraries for MarcDuino v2
 #endif
 
+#include "isrprof.h"		// interrupt profiling, when enabled
+#include "stackmon.h"		// RAM high-water mark, when enabled
+#include "latency.h"		// command latency statistics, when enabled
+#include "frame.h"			// binary command frames
+#include "stream.h"			// live servo streaming
+#include "fmt.h"			// number formatting and parsing
+#include "settings.h"		// setup settings, saved in EEPROM
+#include "boot.h"			// sound player boot, in the background
+
 // command globals
-char command_buffer[CMD_MAX_LENGTH];		// command string buffer
+// two command lines: one being typed while the other one is parsed, swapped when a line completes
+char command_lines[2][CMD_MAX_LENGTH];
+uint8_t command_fill=0;					// index of the line being typed
 uint8_t panel_rc_control[SERVO_NUM];		// flag array for which panels are under RC control
 uint8_t panel_to_silence[SERVO_NUM];		// flag array for servos we need to turn off after a panel is closed
 
-//setup globals
-/* E2END : last valid address in Internal EEPROM */
-unsigned int servo_eeprom_addr = 0;  // Stores setting for Servos 1-12
-//unsigned int servo_eeprom_addr2 = 1; // Uses a word, so byte 2 is already used.
-unsigned int start_sound_eeprom_addr=2;
-unsigned int slave_delay_addr=3;
-unsigned int last_servo_addr=4;
-unsigned int random_sound_disabled=5;
-unsigned int mp3_player_select_addr=6;
-unsigned int stored_crc_addr = 7; // Uses a word.
-
 // timeout counter
 rt_timer killbuzz_timer;
 
@@ -302,6 +313,8 @@ const char strEnterPrompt[] PROGMEM="Enter panel command starting with \':\' \n\
 const char strInitializing[] PROGMEM="Initializing...\r\n";
 const char strSuart1OK[] PROGMEM="\n\rsuart1 Communication OK \n\r";
 const char strSuart2OK[] PROGMEM="\n\rsuart2 Communication OK \n\r";
+const char strEEPROMDefaults[] PROGMEM="EEPROM Corrupt or never written.  Writing defaults. \r\n";
+const char strSettingsImported[] PROGMEM="Settings from v3.7 EEPROM layout, saving them. \r\n";
 
 #if _ERROR_MSG_ == 1
 const char strStartCharErr[] PROGMEM="**Unrecognized Command Start Character\r\n";
@@ -324,10 +337,22 @@ void echo(char ch)
 
 int main(void) {
 
+	stackmon_init();
+
+#ifdef _ISR_PROFILE_
+	isrprof_reset();
+#endif
+
+	// Read the setup settings, one record from the EEPROM.
+	// Defaults, or settings from the old layout, get saved by the main loop.
+	uint8_t settings_result=settings_load();
+
 	// start hardware and software UARTs, send check string
-	serial_init_9600b8N1();	// 9600 bauds, 8 bits, 1 stop, no parity, use for a regular terminal console
+	serial_init(serial_baud_rate(settings.serial_baud));	// 8 bits, 1 stop, no parity, use for a regular terminal console
 	serial_puts_p(strWelcome);
 	serial_puts_p(strInitializing);
+	if(settings_result==SETTINGS_DEFAULTS) serial_puts_p(strEEPROMDefaults);
+	if(settings_result==SETTINGS_IMPORTED) serial_puts_p(strSettingsImported);
 
 
 	// output test string on the Software UART on PC0
@@ -342,68 +367,12 @@ int main(void) {
 	suart2_puts_p(strSuart2OK);
 #endif
 
-	// Read the EEPROM to set the Servo direction
-	// Note we'll only read it if the EEPROM is ready.
-	while (!eeprom_is_ready())
-	{
-		// Just wait ... should be ready soon
-		// Should be ready instantly, so this will likely not be called.
-		_delay_ms(500);
-	}
-
-	// Calculate the CRC for the EEPROM to determine if it has been written or not.
-	uint16_t calculatedCRC = calc_crc();
-
-	// Get the current CRC from the EEPROM
-	uint16_t storedCRC = eeprom_read_word((uint16_t*)stored_crc_addr);
-
-	char string[30];
-	sprintf(string, "Calc CRC: %X StoredCRC: %X \r\n", calculatedCRC, storedCRC);
-	serial_puts(string);
-
-	// If we've never written data to the EEPROM, the values will be 0xFF
-	// Use this and the CRC to determine if we should save a set of defaults.
-	if (storedCRC != calculatedCRC)
-	{
-		sprintf(string, "EEPROM Corrupt or never written.  Writing defaults. \r\n");
-		serial_puts(string);
-
-		// We have either corrupted the EEPROM, or
-		// we've never written to it before.
-		// Regardless, let's write good values!
-
-		// Set the Servo direction to "normal"
-		eeprom_write_word((uint16_t*)servo_eeprom_addr, (uint16_t)0x0000);
-
-		//Set the startup sound
-		eeprom_write_byte((uint8_t*)start_sound_eeprom_addr, 255);
-
-		// Set the Default chatty mode to on.
-		eeprom_write_byte((uint8_t*)random_sound_disabled, 0);
-
-		// Set the Default MP3 Player to be the SparkFun MP3 Trigger.
-		eeprom_write_byte((uint8_t*)mp3_player_select_addr, 0);
-
-		sprintf(string, "Generating new CRC. \r\n");
-		serial_puts(string);
-
-		// Now that we have written the new values we need to write the CRC
-		calculatedCRC = calc_crc();
-		sprintf(string, "Calc CRC: %X StoredCRC: %X \r\n", calculatedCRC, storedCRC);
-		serial_puts(string);
-
-		eeprom_write_word((uint16_t*)stored_crc_addr, calculatedCRC);
-
-		sprintf(string, "New Defaults and CRC Written to EEPROM \r\n");
-		serial_puts(string);
-	}
-
 	// If Servo Direction is 0, then it's "forward servos"
 	// If Servo Direction is 1, then it's "reverse servos"
-	// The Setup Mode will set this byte in the EEPROM
+	// The Setup Mode will set this bit in the settings
 
 	// Set the servos forward/reverse direction
-	uint16_t servo_dir = eeprom_read_word((uint16_t*)servo_eeprom_addr);
+	uint16_t servo_dir = settings.servo_dir;
 	//char string[30];
 	for (int i=0; i<SERVO_NUM; i++)
 	{
@@ -422,12 +391,13 @@ int main(void) {
 	}
 
 
-	last_servo = eeprom_read_byte((uint8_t*)last_servo_addr);
+	last_servo = settings.last_servo;
 
 	//Read the Slave delay value while we're here
-	slave_delay_time = eeprom_read_byte((uint8_t*)slave_delay_addr);
+	slave_delay_time = settings.slave_delay;
 
-	// initialize servo, realtime and sequencer units
+	// initialize clock, servo, realtime and sequencer units
+	clock_init();
 	servo_init();
 	realtime_init();
 	seq_init();
@@ -441,88 +411,82 @@ int main(void) {
 	rt_add_timer(&killbuzz_timer);
 
 	// run a close sequence on the panels to make sure they are all shut
-	seq_loadsequence(panel_init, SEQ_SIZE(panel_init));
+	seq_loadpanel(panel_init);
 	seq_startsequence();
 
-#ifdef _MP3TRIGGER_
-	// MP3 Trigger connects on suart2 on PC4 (MarcDuino v1) or PC1 (MarcDuino v2)
-	suart2_init(9600);
-	// Initialize the MP3Trigger sound driver
-	_delay_ms(3000);	// need to wait for MP3 to power up
-
-	// Get the Startup sound settings from the EEPROM
-	// Unless programmed, the start sound will be 0 which is no sound
-	switch (eeprom_read_byte((uint8_t*)start_sound_eeprom_addr))
-	{
-		case 0:						// end character recognized
-			mp3_start_sound = 0;   // No startup sound
-			break;
-		case 1:
-			mp3_start_sound = 255; // Default Dolby Sound
-			break;
-		case 2:
-			mp3_start_sound = 254; // Indy Start Sound (Neil's sounds)
-			break;
-		case 3:
-			mp3_start_sound = 253; // Bagpipe Start Sound (Neil's sounds)
-			break;
-		default:
-			// Value didn't match so use the default dolby sound.
-			mp3_start_sound = 255;
-			break;
-	}
-
-	// The mp3_init will also trigger the startup sound
-	// Configure for the MP3 Player used.
-	mp3_init(eeprom_read_byte((uint8_t*)mp3_player_select_addr));
+	// MP3 Trigger power up, startup sound and random sounds go on from rt_do()
+	boot_start();
 
-	// If startup sounds are disabled, then don't wait!
-	if (mp3_start_sound != 0)
-	{
-		// wait for the startup sound to finish and start the random sound sequence
-		// Increased this slightly from 10s to 12 as the startup sounds were being cut off
-		_delay_ms(13000);
-	}
-
-	// Is the random sounds disabled or not?
-	switch(eeprom_read_byte((uint8_t*)random_sound_disabled))
-	{
-		case 0:
-			mp3_start_random();
-			break;
-		case 1:
-			mp3_stop_random();
-			mp3_volumeoff();
-			break;
-		case 2:
-			mp3_stop_random();
-			break;
-		default:
-			break;
-	}
-#endif
-
-	// ready
+	// ready, sound commands wait for the player if it isn't yet
 	serial_puts_p(strEnterPrompt);
 
   while (1)
   {
+	// what the commands and routine actions of this pass send to the slave and
+	// the sound player goes out in one burst per port, after routine_do()
+	suart_stage_begin();
+
 	/////////////////////////////////////////
 	// Serial Command Input
 	////////////////////////////////////////
-	char command_str[CMD_MAX_LENGTH];
-	bool command_available;
+	char* command_str;
+	uint8_t command_length;
 
 	// check for command line input
 	if(serial_available())
 	{
 		char ch;
 		ch=serial_getc();										// get input
-		echo(ch);												// echo back
-		command_available=build_command(ch, command_str);		// build command line
-		if (command_available) dispatch_command(command_str);	// send command line to dispatcher
+#ifdef _BINARY_FRAMES_
+		uint8_t frame=frame_receive(ch);						// binary frames take their bytes first
+		if(frame==FRAME_READY)
+		{
+			latency_command();
+			dispatch_frame();
+			latency_command_done();
+		}
+		if(frame==FRAME_NONE)
+#endif
+		{
+			echo(ch);												// echo back
+			command_str=build_command(ch, &command_length);			// build command line
+			if (command_str)
+			{
+				latency_command();
+				dispatch_batch(command_str, command_length);		// send command line to dispatcher
+				latency_command_done();
+			}
+		}
 	}
 
+	////////////////////////////////////////
+	// Routine effects, timed on the realtime clock
+	////////////////////////////////////////
+	routine_do();
+	suart_stage_flush();
+
+	////////////////////////////////////////
+	// Streamed servo positions, hold if they stop coming
+	////////////////////////////////////////
+	stream_do();
+
+	////////////////////////////////////////
+	// Setup settings, saved once they stop changing
+	////////////////////////////////////////
+	settings_do();
+
+#ifdef _MARCDUINOV2_
+	////////////////////////////////////////
+	// I2C transfers run in the background, this reports the finished ones
+	////////////////////////////////////////
+	i2c_do();
+#endif
+
+	////////////////////////////////////////
+	// Timer wheel events due, the sound player boot steps among them
+	////////////////////////////////////////
+	rt_do();
+
 	////////////////////////////////////////
 	// MP3 Trigger Random Sounds
 	///////////////////////////////////////
@@ -583,56 +547,97 @@ int main(void) {
 	serial_puts(string);
 	********/
 
+	// let the host simulation advance its clock, does nothing on the AVR
+	hal_idle();
 
   } // end of while loop
 return 0;
 }
 
-/*
- * Calculate the CRC based on the values we use in the EEPROM
- */
-uint16_t calc_crc()
-{
-	uint16_t calculatedCRC = 0;
-	// Set the Servo direction to "normal"
-	calculatedCRC += eeprom_read_word((uint16_t*)servo_eeprom_addr);
-	//Set the startup sound
-	calculatedCRC += eeprom_read_byte((uint8_t*)start_sound_eeprom_addr);
-	// Set the Default chatty mode to on.
-	calculatedCRC += eeprom_read_byte((uint8_t*)random_sound_disabled);
-	// Set the MP3 Player used.
-	calculatedCRC += eeprom_read_byte((uint8_t*)mp3_player_select_addr);
-
-	return calculatedCRC;
-}
-
-// builds the command string from the character input
-uint8_t build_command(char ch, char* output_str)
+// builds the command line from the character input
+// returns the completed line and its length, or 0 while the line is not complete
+// The line stays valid until the next one completes: the parsers work on it in place.
+char* build_command(char ch, uint8_t* length)
 {
 	static uint8_t pos=0;
+	char* line=command_lines[command_fill];
 
 	switch(ch)
 	{
 		case CMD_END_CHAR:								// end character recognized
-			command_buffer[pos]='\0';					// append the end of string character
+			line[pos]='\0';								// append the end of string character
+			*length=pos;
 			pos=0;										// reset buffer pointer
-			strcpy(output_str, (char*)command_buffer);	// copy result
-			return TRUE;								// return and signal command ready
+			command_fill^=1;							// hand the line over, type the next one in the other buffer
+			return line;								// return and signal command ready
 			break;
 
 		default:										// regular character
-			command_buffer[pos]=ch;						// append the  character to the command string
-			if(pos<=CMD_MAX_LENGTH-1)pos++;				// too many characters, discard them.
+			if(pos<CMD_MAX_LENGTH-1) line[pos++]=ch;	// append the character, too many characters: discard them.
 			break;
 	}
-	return FALSE;
+	return 0;
+}
+
+// 1 if a command can begin with this character
+uint8_t is_start_char(char ch)
+{
+	switch(ch)
+	{
+		case PANEL_START_CHAR:
+		case HP_START_CHAR:
+		case DISPLAY_START_CHAR:
+		case SOUND_START_CHAR:
+		case ALT1_START_CHAR:
+		case ALT2_START_CHAR:
+		case I2C_START_CHAR:
+		case SETUP_START_CHAR:
+			return 1;
+	}
+	return 0;
+}
+
+// Runs a command line, which can hold several commands separated by CMD_BATCH_CHAR,
+// all from this main loop pass and in order. With _BATCH_SYNC_START_ the panel sequences
+// they start wait for the end of the line, so they begin on the same 1/100 s tick,
+// right after the sound and light commands of the line went out.
+// CMD_BATCH_CHAR only separates when a start character follows it and it is not between
+// double quotes, so text arguments (display, alt, I2C strings) keep their ';' as before.
+// An I2C string has no closing quote: it has to be the last command of its line.
+void dispatch_batch(char* line, uint8_t length)
+{
+	char* command=line;
+	uint8_t i, quoted=0;
+
+	if(!memchr(line, CMD_BATCH_CHAR, length))
+	{
+		dispatch_command(line, length);
+		return;
+	}
+
+#ifdef _BATCH_SYNC_START_
+	seq_defer_start();
+#endif
+	for(i=0; i<=length; i++)
+	{
+		if(i<length)
+		{
+			if(line[i]=='"') quoted^=1;
+			if(quoted || line[i]!=CMD_BATCH_CHAR || !is_start_char(line[i+1])) continue;	// line[length] is '\0'
+		}
+		line[i]='\0';						// each command is a string of its own
+		if(&line[i]>command) dispatch_command(command, &line[i]-command);	// empty commands are skipped
+		command=&line[i+1];
+	}
+#ifdef _BATCH_SYNC_START_
+	seq_release_start();
+#endif
 }
 
 // dispatches further command processing depending on start character
-void dispatch_command(char* command_str)
+void dispatch_command(char* command_str, uint8_t length)
 {
 	char start_char=command_str[0];
-	uint8_t length=strlen(command_str);
 
 	// prompt on empty command to show life at console
 	if(length==0)
@@ -679,251 +684,248 @@ void dispatch_command(char* command_str)
 // New Setup and Configuration functions.
 #if _ERROR_MSG_ == 1
 const char strsetupCommand[] PROGMEM="Setup command Error\r\n";
+const char strSetupCmdErr[] PROGMEM="Err Setup Cmd\n\r";
 #endif
-void parse_setup_command(char* command, uint8_t length)
-{
-#if _FEEDBACK_MSG_ == 1
-	serial_puts_p(strsetupCommand);
-#endif
-
-	char cmd[3];
-	char arg[4];
 
-	// character '*' begins command, should have been already checked if this is called
-	if(command[0]!=SETUP_START_CHAR)
+// Setup command handlers, called through setup_commands[] once the command has been checked.
+// Each one changes its setting in RAM, settings_do() saves them to EEPROM once they
+// stop changing. "OK" is sent after it returns.
+void setup_servo_dir(uint8_t value)
+{
+	//Value must be either 0 or 1
+	if (value == 0)
 	{
-#if _ERROR_MSG_ == 1
-		serial_puts_p("Err Setup Cmd\n\r");
-#endif
-		return;
+		settings.servo_dir=0x0000;
+	}
+	if (value == 1)
+	{
+		settings.servo_dir=0x07FF;
 	}
+	SendSetupToSlave(SETUP_SERVO_DIR, value);
+	settings_changed();
+}
 
-	cmd[0]=command[1];
-	cmd[1]=command[2];
-	cmd[2]='\0';
-	arg[0]=command[3];
-	arg[1]=command[4];
-	arg[2]=command[5];
-	arg[3]='\0';
+void setup_servo_reverse(uint8_t value)
+{
+	// Get the servo settings from the command
+	uint8_t servo_number = value/10;
+	uint8_t servo_value_received = value%10;
 
-	// Get the value of the command
-	uint8_t value;
-	value=atoi(arg);
+	/*
+	char string[30];
+	sprintf(string, "Servo %2d, direction %2d \r\n", servo_number, servo_value_received);
+	serial_puts(string);
 
-	if(strcmp(cmd,SETUP_SERVO_DIR)==0)
+	// DEBUG ... read the current servo values.
+	for (int i=0; i<SERVO_NUM; i++)
 	{
+		uint8_t temp = servo_direction[i];
+		sprintf(string, "Servo %2d, direction %2d \r\n", i+1, temp);
+		serial_puts(string);
+	}
+	*/
 
-		// a properly constructed command should have 5 chars
-		if (length!=5)
-		{
-#if _ERROR_MSG_ == 1
-			serial_puts_p("Err Setup Cmd\n\r");
-#endif
-			return;
-		}
-
-		//Value must be either 0 or 1
-		if (value == 0)
+	// Set the Servo Number to the requested reverse setting
+	if (servo_number < 12){
+		servo_direction[servo_number-1] = servo_value_received;
+		if (servo_value_received == 1)
 		{
-			//Write the value to EEPROM
-			eeprom_write_word((uint16_t*)servo_eeprom_addr, (uint16_t)0x0000);
+			servo_direction[servo_number-1] = 1;
 		}
-		if (value == 1)
+		else if (servo_value_received == 0)
 		{
-			//Write the value to EEPROM
-			eeprom_write_word((uint16_t*)servo_eeprom_addr, (uint16_t)0x07FF);
+			servo_direction[servo_number-1] = 0;
 		}
-		SendSetupToSlave(cmd, value);
-
-		// Now that we have written the new values we need to write the CRC
-		uint16_t calculatedCRC = calc_crc();
-		eeprom_write_word((uint16_t*)stored_crc_addr, calculatedCRC);
-
-		serial_puts_p(strOK);
-		return;
 	}
-	if(strcmp(cmd,SETUP_SERVO_REVERSE)==0)
+	// Pass the command to the slave so the slave can setup the servos there.
+	else
 	{
+		if (servo_number == 12) SendSetupToSlave(SETUP_SERVO_REVERSE, 6);
+		if (servo_number == 13) SendSetupToSlave(SETUP_SERVO_REVERSE, 7);
+	}
 
-		// a properly constructed command should have 5 chars
-		if (length!=6)
-		{
-#if _ERROR_MSG_ == 1
-			serial_puts_p("Err Setup Cmd\n\r");
-#endif
-			return;
-		}
-
-		// Get the servo settings from the command
-		uint8_t servo_number = value/10;
-		uint8_t servo_value_received = value%10;
-
-		/*
-		char string[30];
-		sprintf(string, "Servo %2d, direction %2d \r\n", servo_number, servo_value_received);
+	/*
+	serial_puts("Changed to: \r\n");
+	for (int i=0; i<SERVO_NUM; i++)
+	{
+		uint8_t temp = servo_direction[i];
+		sprintf(string, "Servo %2d, direction %2d \r\n", i+1, temp);
 		serial_puts(string);
+	}
+	*/
 
-		// DEBUG ... read the current servo values.
-		for (int i=0; i<SERVO_NUM; i++)
-		{
-			uint8_t temp = servo_direction[i];
-			sprintf(string, "Servo %2d, direction %2d \r\n", i+1, temp);
-			serial_puts(string);
-		}
-		*/
 
-		// Set the Servo Number to the requested reverse setting
-		if (servo_number < 12){
-			servo_direction[servo_number-1] = servo_value_received;
-			if (servo_value_received == 1)
-			{
-				servo_direction[servo_number-1] = 1;
-			}
-			else if (servo_value_received == 0)
-			{
-				servo_direction[servo_number-1] = 0;
-			}
-		}
-		// Pass the command to the slave so the slave can setup the servos there.
-		else
+	// Loop through the array, and set the bits to store in EEPROM
+	uint16_t servo_set = 0x0000;
+	for (int i=0; i< SERVO_NUM; i++)
+	{
+		// Set the bit
+		if (servo_direction[i])
 		{
-			if (servo_number == 12) SendSetupToSlave(cmd, 6);
-			if (servo_number == 13) SendSetupToSlave(cmd, 7);
+			servo_set |= 1 << i;
 		}
-
-		/*
-		serial_puts("Changed to: \r\n");
-		for (int i=0; i<SERVO_NUM; i++)
+		else
 		{
-			uint8_t temp = servo_direction[i];
-			sprintf(string, "Servo %2d, direction %2d \r\n", i+1, temp);
-			serial_puts(string);
+			servo_set &= ~(1 << i);
 		}
-		*/
-
+	}
 
-		// Loop through the array, and set the bits to store in EEPROM
-		uint16_t servo_set = 0x0000;
-		for (int i=0; i< SERVO_NUM; i++)
-		{
-			// Set the bit
-			if (servo_direction[i])
-			{
-				servo_set |= 1 << i;
-			}
-			else
-			{
-				servo_set &= ~(1 << i);
-			}
-		}
+	settings.servo_dir=servo_set;
+	settings_changed();
+}
 
-		//Write the value to EEPROM
-		eeprom_write_word((uint16_t*)servo_eeprom_addr, (uint16_t)servo_set);
+// NOTE: NOT USED CURRENTLY
+void setup_last_servo(uint8_t value)
+{
+	//Max support is for 12 servos.
+	if (value < 13)
+	{
+		settings.last_servo=value;
+		settings_changed();
+	}
+}
 
-		// Now that we have written the new values we need to write the CRC
-		uint16_t calculatedCRC = calc_crc();
-		eeprom_write_word((uint16_t*)stored_crc_addr, calculatedCRC);
+void setup_start_sound(uint8_t value)
+{
+	// Take care here, there's no checking so this could just go nuts.
+	// Normally the value should be 255 (in the high order!)
+	settings.start_sound=value;
+	settings_changed();
+}
 
-		serial_puts_p(strOK);
+void setup_random_sound_disabled(uint8_t value)
+{
+	//Value must be 0, 1 or 2, checked by the command table
+	settings.random_sound_disabled=value;
+	settings_changed();
+}
 
-		return;
-	}
-	// NOTE: NOT USED CURRENTLY
-	if(strcmp(cmd,SETUP_LAST_SERVO)==0)
-	{
-		//Max support is for 12 servos.
-		if (value < 13)
-		{
-			//Write the value to EEPROM
-			eeprom_write_byte((uint8_t*)last_servo_addr, value);
-		}
-		// Now that we have written the new values we need to write the CRC
-		uint16_t calculatedCRC = calc_crc();
-		eeprom_write_word((uint16_t*)stored_crc_addr, calculatedCRC);
-		serial_puts_p(strOK);
-		return;
-	}
-	if(strcmp(cmd,SETUP_START_SOUND)==0)
-	{
-		// Take care here, there's no checking so this could just go nuts.
-		// Normally the value should be 255 (in the high order!)
-		//Write the value to EEPROM
-		eeprom_write_byte((uint8_t*)start_sound_eeprom_addr, value);
-		// Now that we have written the new values we need to write the CRC
-		uint16_t calculatedCRC = calc_crc();
-		eeprom_write_word((uint16_t*)stored_crc_addr, calculatedCRC);
-		serial_puts_p(strOK);
-		return;
-	}
-	if(strcmp(cmd,SETUP_RANDOM_SOUND_DISABLED)==0)
+// NOTE: NOT USED CURRENTLY
+void setup_slave_delay_time(uint8_t value)
+{
+	// 250 ms should be more than enough!
+	if (value > 250)
 	{
-		//Value must be either 0 or 1
-		if (value == 0)
-		{
-			//Write the value to EEPROM
-			eeprom_write_byte((uint8_t*)random_sound_disabled, value);
-		}
-		if (value == 1)
-		{
-			//Write the value to EEPROM
-			eeprom_write_byte((uint8_t*)random_sound_disabled, value);
-		}
-		if (value == 2)
-		{
-			//Write the value to EEPROM
-			eeprom_write_byte((uint8_t*)random_sound_disabled, value);
-		}
-		// Now that we have written the new values we need to write the CRC
-		uint16_t calculatedCRC = calc_crc();
-		eeprom_write_word((uint16_t*)stored_crc_addr, calculatedCRC);
-		serial_puts_p(strOK);
-		return;
+		value = 250;
 	}
-	// NOTE: NOT USED CURRENTLY
-	if(strcmp(cmd,SETUP_SLAVE_DELAY_TIME)==0)
-	{
-		// 250 ms should be more than enough!
-		//Write the value to EEPROM
-		if (value > 250)
-		{
-			value = 250;
-		}
-		eeprom_write_byte((uint8_t*)slave_delay_addr, value);
-		// Now that we have written the new values we need to write the CRC
-		//uint16_t calculatedCRC = calc_crc();
-		//eeprom_write_word((uint16_t*)stored_crc_addr, calculatedCRC);
-		serial_puts_p(strOK);
-		return;
-	}
-	if(strcmp(cmd,SETUP_MP3_PLAYER)==0)
+	settings.slave_delay=value;
+	settings_changed();
+}
+
+void setup_mp3_player(uint8_t value)
+{
+	//Value must be either 0 or 1, checked by the command table
+	settings.mp3_player=value;
+	settings_changed();
+}
+
+void setup_serial_baud(uint8_t value)
+{
+	//Value is a baud rate code, checked by the command table, but some are left out
+	if(!serial_baud_available(value))
 	{
-		if (value > 1)
-		{
 #if _ERROR_MSG_ == 1
-			serial_puts_p("Err Setup Cmd\n\r");
+		serial_puts_p(strSetupCmdErr);
 #endif
-			return;
-		}
-		//Value must be either 0 or 1
-		if (value == 0)
-		{
-			//Write the value to EEPROM
-			eeprom_write_byte((uint8_t*)mp3_player_select_addr, value);
-		}
-		if (value == 1)
-		{
-			//Write the value to EEPROM
-			eeprom_write_byte((uint8_t*)mp3_player_select_addr, value);
-		}
-		// Now that we have written the new values we need to write the CRC
-		uint16_t calculatedCRC = calc_crc();
-		eeprom_write_word((uint16_t*)stored_crc_addr, calculatedCRC);
-		serial_puts_p(strOK);
 		return;
 	}
+	settings.serial_baud=value;
+	settings_changed();
+	// acknowledge at the old speed, the terminal switches after seeing it
+	serial_puts_p(strOK);
+	serial_set_baud(serial_baud_rate(value));
+}
+
+#ifdef _ISR_PROFILE_
+void setup_isr_profile(uint8_t value)
+{
+	if(value==0) isrprof_dump();
+	if(value==1) isrprof_reset();
+}
+#endif
+
+#ifdef _STACK_MONITOR_
+void setup_stack_monitor(uint8_t value)
+{
+	if(value==0) stackmon_report();
+	if(value==1) stackmon_paint();
+}
+#endif
+
+void setup_stream_stats(uint8_t value)
+{
+	if(value==0) stream_report();
+	if(value==1) stream_reset();
+}
+
+#ifdef _LATENCY_STATS_
+void setup_latency_stats(uint8_t value)
+{
+	if(value==0) latency_report();
+	if(value==1) latency_reset();
+}
+#endif
+
+#ifdef _MARCDUINOV2_
+void setup_i2c_speed(uint8_t value)
+{
+	// RAM only, the slaves on the bus decide if 400 kHz works
+	i2c_set_clock(value);
+}
+
+void setup_i2c_stats(uint8_t value)
+{
+	if(value==0) i2c_report();
+	if(value==1) i2c_reset_stats();
+}
+#endif
+
+// Setup commands are #CCx to #CCxxx, with a 1 to 3 digit argument, see command.h
+// All the opcodes of the table, optional ones included: the build fails if two share a slot
+#define SETUP_OPCODES(X,op)	X('S','D') op X('S','R') op X('S','L') op X('S','S') op X('S','Q') op X('S','T') op \
+							X('S','M') op X('S','B') op X('S','C') op X('I','P') op X('S','K') op X('L','S') op \
+							X('I','S') op X('I','F')
+CMD_CHECK_SLOTS(setup_commands, SETUP_OPCODES);
+
+const cmd_entry_t setup_commands[CMD_TABLE_SIZE] PROGMEM =
+{
+	//			opcode	handler							length	max value	flags
+	CMD_ENTRY(	'S','D',	setup_servo_dir,				5, 5,	1,			CMD_ACK_AFTER),	// #SDxx
+	CMD_ENTRY(	'S','R',	setup_servo_reverse,			6, 6,	255,		CMD_ACK_AFTER),	// #SRxxy
+	CMD_ENTRY(	'S','L',	setup_last_servo,				4, 6,	255,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','S',	setup_start_sound,				4, 6,	255,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','Q',	setup_random_sound_disabled,	4, 6,	2,			CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','T',	setup_slave_delay_time,			4, 6,	255,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','M',	setup_mp3_player,				4, 6,	1,			CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','B',	setup_serial_baud,				4, 6,	SERIAL_BAUD_CODES-1,	0),	// sends its own OK
+	CMD_ENTRY(	'S','C',	setup_stream_stats,				4, 6,	1,			CMD_ACK_AFTER),
+#ifdef _ISR_PROFILE_
+	CMD_ENTRY(	'I','P',	setup_isr_profile,				4, 6,	1,			CMD_ACK_AFTER),
+#endif
+#ifdef _STACK_MONITOR_
+	CMD_ENTRY(	'S','K',	setup_stack_monitor,			4, 6,	1,			CMD_ACK_AFTER),
+#endif
+#ifdef _LATENCY_STATS_
+	CMD_ENTRY(	'L','S',	setup_latency_stats,			4, 6,	1,			CMD_ACK_AFTER),
+#endif
+#ifdef _MARCDUINOV2_
+	CMD_ENTRY(	'I','S',	setup_i2c_speed,				4, 6,	1,			CMD_ACK_AFTER),
+	CMD_ENTRY(	'I','F',	setup_i2c_stats,				4, 6,	1,			CMD_ACK_AFTER),
+#endif
+};
+
+void parse_setup_command(char* command, uint8_t length)
+{
+#if _FEEDBACK_MSG_ == 1
+	serial_puts_p(strsetupCommand);
+#endif
+
+	if(run_command(setup_commands, command, length)!=CMD_OK)
+	{
 #if _ERROR_MSG_ == 1
-	serial_puts_p("Err Setup Cmd\n\r");
+		serial_puts_p(strSetupCmdErr);
 #endif
+	}
 }
 
 #if _FEEDBACK_MSG_ == 1
@@ -964,6 +966,8 @@ void parse_sound_command(char* command,uint8_t length)
 #endif
 
 #ifdef _MP3TRIGGER_
+	// kept for later if the player is still powering up
+	if(boot_sound(command)) return;
 	// pass on command to our own MP3_Trigger interpreter
 	mp3_parse_command(command);
 #else
@@ -1005,6 +1009,10 @@ void parse_alt2_command(char* command, uint8_t length)
 #if _ERROR_MSG_ == 1
 const char strI2CCmdErr[] PROGMEM="**Invalid I2C Command\r\n";
 #endif
+// the longest payload is a string filling the line after &0,"
+#if I2C_POOL_SIZE < CMD_MAX_LENGTH-5
+#error "I2C_POOL_SIZE too small for the longest '&' command"
+#endif
 void parse_i2c_command(char* cmd, uint8_t length)
 {
 	/*****************************************
@@ -1030,14 +1038,14 @@ void parse_i2c_command(char* cmd, uint8_t length)
 	 */
 
 	uint8_t i2caddress=0;
-	uint8_t payload[256];
+	uint8_t* payload=(uint8_t*)cmd;		// built in place: every token takes at least as many characters as it gives bytes
 	uint8_t payloadIndex=0;
 	uint8_t success=0;
 	const char delim[]=",";
 	char* token;
 	//### for debug output
 #if _FEEDBACK_MSG_ == 1
-	char str[65];
+	char str[FMT_DEC_DIGITS+1];
 #endif
 
 	// a properly constructed command should have at least 2 chars
@@ -1083,18 +1091,23 @@ void parse_i2c_command(char* cmd, uint8_t length)
 	}
 
 	// convert and check the address
-	unsigned int temp;
-	success=sscanf(token, "%u", &temp);
-	//i2caddress=atoi(token);
+	uint16_t temp=0;
+	success=fmt_parse_dec(token, &temp)!=0;
 	// make sure I can do the conversion to uint8_t
 	if(temp<255) i2caddress=(uint8_t)temp;
 	else success=0;
 
 	//### confirm first address token is read correctly
 #if _FEEDBACK_MSG_ == 1
-	if (success) sprintf(str, "Token: %s, recognized address: %u \r\n", token, i2caddress);
-	else sprintf(str, "Token: %s, unrecognized address\r\n", token);
-	serial_puts(str);
+	serial_puts("Token: "); serial_puts(token);
+	if (success)
+	{
+		serial_puts(", recognized address: ");
+		fmt_dec(str, i2caddress, 0, ' ');
+		serial_puts(str);
+		serial_puts(" \r\n");
+	}
+	else serial_puts(", unrecognized address\r\n");
 #endif
 
 	if(i2caddress > 127 || !success)
@@ -1124,8 +1137,10 @@ void parse_i2c_command(char* cmd, uint8_t length)
 #if _FEEDBACK_MSG_ == 1 // verify payload
 		if(success) serial_puts("Data Good - ");
 		else serial_puts("Data Error - ");
-		sprintf(str, "Index = %u \r\n", payloadIndex);
+		serial_puts("Index = ");
+		fmt_dec(str, payloadIndex, 0, ' ');
 		serial_puts(str);
+		serial_puts(" \r\n");
 #endif
 
 		//break immediately on payload error
@@ -1148,14 +1163,14 @@ void parse_i2c_command(char* cmd, uint8_t length)
 uint8_t append_token(uint8_t* payload, uint8_t* index, char* token)
 {
 	uint8_t result=0;
-	unsigned int unum;
-	int num;
+	uint16_t unum;
+	int16_t num;
 	char ch;
 	uint8_t i;
 	switch(token[0])
 	{
 		case 'x':	// hex character
-			result=sscanf(token+1, "%x", &unum); // skip the x and read the hex number
+			result=fmt_parse_hex(token+1, &unum)!=0; // skip the x and read the hex number
 			if(result)
 			{
 				if(unum>255) return 0; // limited to 8 bit hex values
@@ -1178,7 +1193,8 @@ uint8_t append_token(uint8_t* payload, uint8_t* index, char* token)
 			result=1;
 			break;
 		case '\'':	// single character
-			result=sscanf(token+1, "%c", &ch);
+			ch=token[1];
+			result=(ch!='\0');
 			if(result)
 			{
 				payload[*index]=ch;
@@ -1189,7 +1205,7 @@ uint8_t append_token(uint8_t* payload, uint8_t* index, char* token)
 		default:
 			// I have problem here if I get a 16 bit int and it doesn't fit in an int8_t or uint8_t.
 			// So I am reducing the allowed range to -128 / +255
-			result=sscanf(token, "%d", &num);
+			result=fmt_parse_int(token, &num)!=0;
 			if(result)
 			{
 				if(num>255 || num<-128) return 0; 				// limited to 8 bit signed or unsigned arguments
@@ -1207,26 +1223,55 @@ void sendI2C(uint8_t address, uint8_t* payload, uint8_t payload_length)
 {
 #if _FEEDBACK_MSG_ == 1 // ifdef it to save memory when not using
 	serial_puts("### RESULT IS ####\r\n");
-	char str[65];
-	sprintf(str, "I2C address = %u \r\n", address);
+	char str[FMT_DEC_DIGITS+1];
+	serial_puts("I2C address = ");
+	fmt_dec(str, address, 0, ' ');
 	serial_puts(str);
-	sprintf(str, "Payload length= %u \r\n", payload_length);
+	serial_puts(" \r\nPayload length= ");
+	fmt_dec(str, payload_length, 0, ' ');
 	serial_puts(str);
+	serial_puts(" \r\n");
 	serial_puts("Payload = \r\n");
 	for(uint8_t i=0; i<payload_length; i++)
 	{
-		sprintf(str, "Byte %u = %u \r\n", i, payload[i]);
+		serial_puts("Byte ");
+		fmt_dec(str, i, 0, ' ');
 		serial_puts(str);
+		serial_puts(" = ");
+		fmt_dec(str, payload[i], 0, ' ');
+		serial_puts(str);
+		serial_puts(" \r\n");
 	}
 	serial_puts("\r\n");
 #endif
-	// send the data via i2c
-	i2c_send_data(address,payload, payload_length, TRUE);
+	// queue the data for i2c, it goes out in the background
+	if(i2c_send_data(address,payload, payload_length, TRUE))
+	{
+		// queue full or payload too long for it
+#if _ERROR_MSG_ == 1
+		serial_puts_p(strI2CCmdErr);
+#endif
+	}
 }
 
 #if _ERROR_MSG_ == 1
 const char strPanelCmdErr[] PROGMEM="**Invalid Panel Command\r\n";
 #endif
+// Panel commands are :CCxx, always with a 2 digit argument, see command.h
+#define PANEL_OPCODES(X,op)	X('S','E') op X('O','P') op X('C','L') op X('R','C') op X('S','T') op X('H','D')
+CMD_CHECK_SLOTS(panel_commands, PANEL_OPCODES);
+
+const cmd_entry_t panel_commands[CMD_TABLE_SIZE] PROGMEM =
+{
+	//			opcode	handler				length	max value	flags
+	CMD_ENTRY(	'S','E',	sequence_command,	5, 5,	99,			CMD_ACK_BEFORE),
+	CMD_ENTRY(	'O','P',	open_command,		5, 5,	15,			CMD_ACK_BEFORE),
+	CMD_ENTRY(	'C','L',	close_command,		5, 5,	13,			CMD_ACK_BEFORE),
+	CMD_ENTRY(	'R','C',	rc_command,			5, 5,	SERVO_NUM,	CMD_ACK_BEFORE),
+	CMD_ENTRY(	'S','T',	stop_command,		5, 5,	SERVO_NUM,	CMD_ACK_BEFORE),
+	CMD_ENTRY(	'H','D',	hold_command,		5, 5,	SERVO_NUM,	CMD_ACK_BEFORE),
+};
+
 void parse_panel_command(char* command_string, uint8_t length)
 {
 	/************************************
@@ -1254,491 +1299,144 @@ void parse_panel_command(char* command_string, uint8_t length)
 	 *
 	 */
 
-	char cmd[3];
-	char arg[3];
+	// panel commands take over from a live stream
+	stream_stop();
 
-	// a properly constructed command should have 5 chars
-	if (length!=5)
+	// a properly constructed command has 5 chars, checked by the command table
+	if(run_command(panel_commands, command_string, length)!=CMD_OK)
 	{
 #if _ERROR_MSG_ == 1
 		serial_puts_p(strPanelCmdErr);
 #endif
-		return;
 	}
+}
 
-	// character ':' begins command, just double check, should not happen
-	if(command_string[0]!=PANEL_START_CHAR)
-	{
-#if _ERROR_MSG_ == 1
-		serial_puts_p(strPanelCmdErr);
-#endif
-		return;
-	}
+// Looks the command up in one of the command tables and runs it.
+// CMD_ACK_BEFORE and CMD_ACK_AFTER send "OK" before or after the handler runs.
+uint8_t run_command(const cmd_entry_t* table, char* command, uint8_t length)
+{
+	cmd_entry_t entry;
+	uint8_t value;
+	uint8_t result;
 
-	cmd[0]=command_string[1];
-	cmd[1]=command_string[2];
-	cmd[2]='\0';
-	arg[0]=command_string[3];
-	arg[1]=command_string[4];
-	arg[2]='\0';
+	result=cmd_lookup(table, command, length, &entry, &value);
+	if(result!=CMD_OK) return result;
 
-	process_command(cmd, arg);
+	if(entry.flags & CMD_ACK_BEFORE) serial_puts_p(strOK);
+	entry.handler(value);
+	if(entry.flags & CMD_ACK_AFTER) serial_puts_p(strOK);
+	return CMD_OK;
 }
 
-void process_command(char* thecommand, char* theargument)
+#ifdef _BINARY_FRAMES_
+// checks a FRAME_SERVOS payload: known servos, one position each, in range
+uint8_t frame_servos_check(const uint8_t* payload, uint8_t length)
 {
-	// hex conversion example
-	// result=(int)strtol(str,(char **)NULL,16);
-	// for now use base10 value conversion
-
-	uint8_t value;
-	value=atoi(theargument);
-
-	if(strcmp(thecommand,CMD_SEQUENCE )==0)
-	{
-		serial_puts_p(strOK);
-		sequence_command(value);
-		return;
-	};
+	uint16_t mask, position;
+	uint8_t i, n=2;
 
-	if(strcmp(thecommand,CMD_OPEN )==0)
+	if(length<2) return CMD_BAD_LENGTH;
+	mask=payload[0] | (payload[1]<<8);
+	if(mask & ~SEQ_ALL_SERVOS) return CMD_BAD_VALUE;
+	for(i=0; i<SERVO_NUM; i++)
 	{
-		serial_puts_p(strOK);
-		open_command(value);
-		return;
-	};
-	if(strcmp(thecommand,CMD_CLOSE )==0)
-	{
-		serial_puts_p(strOK);
-		close_command(value);
-		return;
-	};
-	if(strcmp(thecommand,CMD_RC )==0)
-	{
-		serial_puts_p(strOK);
-		rc_command(value);
-		return;
-	};
-	if(strcmp(thecommand,CMD_STOP )==0)
-	{
-		serial_puts_p(strOK);
-		stop_command(value);
-		return;
-	};
-	if(strcmp(thecommand,CMD_HOLD )==0)
-	{
-		serial_puts_p(strOK);
-		hold_command(value);
-		return;
-	};
+		if(!(mask & SEQ_SERVO_BIT(i+1))) continue;
+		if(n+2>length) return CMD_BAD_LENGTH;
+		position=payload[n] | (payload[n+1]<<8);
+		if(position && (position<SERVO_PULSE_MIN || position>SERVO_PULSE_MAX)) return CMD_BAD_VALUE;
+		n+=2;
+	}
+	if(n!=length) return CMD_BAD_LENGTH;
+	return CMD_OK;
+}
 
-#if _ERROR_MSG_ == 1
-	serial_puts_p(strPanelCmdErr);
-#endif
+void frame_servos_run(const uint8_t* payload)
+{
+	uint16_t mask=payload[0] | (payload[1]<<8);
+	int16_t position;
+	uint8_t i;
 
+	seq_release_servos(mask);
+	payload+=2;
+	for(i=1; i<=SERVO_NUM; i++)
+	{
+		if(!(mask & SEQ_SERVO_BIT(i))) continue;
+		position=payload[0] | (payload[1]<<8);
+		payload+=2;
+		servo_set(i, position ? position : SERVO_NO_PULSE);
+	}
+	panel_rc_off(mask);
 }
 
-#if _FEEDBACK_MSG_ ==1
-const char strSeqCloseAll[] PROGMEM="(Close all panels) \r\n";
-const char strSeqScream[] PROGMEM="(Scream) \r\n";
-const char strSeqWave[] PROGMEM="(Wave) \r\n";
-const char strSeqFastWave[] PROGMEM="(Fast Wave) \r\n";
-const char strSeqOpenCloseWave[] PROGMEM="(Open Close Wave) \r\n";
-const char strSeqCantinaMarchingAnts[] PROGMEM="(Cantina Marching Ants) \r\n";
-const char strSeqShortCircuit[] PROGMEM="(Short Circuit) \r\n";
-const char strSeqCantinaDance[] PROGMEM="(Cantina Dance) \r\n";
-const char strSeqLeia[] PROGMEM="(Leia Message) \r\n";
-const char strSeqDisco[] PROGMEM="(Disco Dance) \r\n";
-const char strSeqQuiet[] PROGMEM="(Set to Quiet) \r\n";
-const char strSeqWideAwake[] PROGMEM="(Set to Wide Awake) \r\n";
-const char strSeqTopRC[] PROGMEM="(All pie panels to RC) \r\n";
-const char strSeqAwake[] PROGMEM="(Set to Awake) \r\n";
-const char strSeqExcited[] PROGMEM="(Set to Excited) \r\n";
-const char strSeqScreamNoPanels[] PROGMEM="(Scream No Panels) \r\n";
-const char strSeqRythmicPanels[] PROGMEM="(Rythmic Panels) \r\n";
-const char strSeqMarchingAnts[] PROGMEM="(Marching Ants Panels) \r\n";
-const char strSeqPanelWiggle[] PROGMEM="(Panel Wiggle with Scream) \r\n";
-const char strSeqByeByeWave[] PROGMEM="(Wave Bye Bye) \r\n";
-#endif
-
-void sequence_command(uint8_t value)
+// takes the servos in mask off RC control
+void panel_rc_off(uint16_t mask)
 {
-	char string[35];
-	switch(value)
+	uint8_t i;
+	for(i=1; i<=SERVO_NUM; i++)
 	{
-		case 0: // CLOSE ALL PANELS
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadspeed(panel_slow_speed);	// slow speed for soft close
-			seq_loadsequence(panel_init, SEQ_SIZE(panel_init));
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// start panel sequence
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqCloseAll);		// debug console feedback
-#endif
-			break;
-
-		case 1: // SCREAM
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_all_open, SEQ_SIZE(panel_all_open));
-			seq_loadspeed(panel_slow_speed);	// slow open
-			SoundScream();						// scream sound
-			DisplayScream(); 					// scream display
-			MagicFlicker(4); 					// magic panel on for 4 seconds
-			HPFlicker(4);						// HPs flicker for 4 seconds
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// start panel sequence
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqScream);		// debug console feedback
-#endif
-			break;
-
-		case 2: // WAVE
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_wave, SEQ_SIZE(panel_wave));
-			seq_resetspeed();
-			HPFlash(4);							// flash holos for 4 seconds
-			SoundWave(); 						// happy sound
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// start sequence
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqWave);			// debug console feedback
-#endif
-			break;
-
-		case 3: // MOODY FAST WAVE
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_fast_wave, SEQ_SIZE(panel_fast_wave));
-			seq_resetspeed();
-			DisplayFlash4();  					// 4 seconds flash display
-			HPFlicker(4);						// HPs flicker for 4 seconds
-			SoundFastWave(); 					// moody sound
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// start panel sequence
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqFastWave);		// debug console feedback
-#endif
-			break;
-
-		case 4: // OPEN WAVE
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_open_close_wave, SEQ_SIZE(panel_open_close_wave));
-			seq_resetspeed();
-			HPFlash(5); 	 					// HPs flash for 5 seconds
-			SoundOpenWave(); 					// long happy sound
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// start panel sequence
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqOpenCloseWave);	// debug console feedback
-#endif
-			break;
-
-		case 5: // Beep Cantina (R2 beeping the cantina, panels doing marching ants)
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_add_completion_callback(resetJEDIcallback); 	// callback to reset displays at end of sequence
-			seq_add_completion_callback(resetMPcallback); 	    // callback to reset Magic Panel at end of sequence
-			seq_loadsequence(panel_marching_ants, SEQ_SIZE(panel_marching_ants));
-			seq_loadspeed(panel_slow_speed);					// slow speed marching ants
-			DisplaySpectrum();	 								// spectrum display
-			HPFlash(17); 	 									// HPs flash for 17 seconds
-			SoundBeepCantina(); 								// beeping cantina sound
-			MagicPanelVU();										// Magic Panel in VU Mode
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();								// start panel sequence
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqCantinaMarchingAnts);			// debug console feedback
-#endif
-			break;
-
-		case 6: // SHORT CIRCUIT / FAINT
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_add_completion_callback(resetMPcallback); 	    // callback to reset Magic Panel at end of sequence
-			seq_loadsequence(panel_all_open_long, SEQ_SIZE(panel_all_open_long));
-			seq_loadspeed(panel_super_slow_speed);	// very slow speed open
-			EXT1On(4); // Turn on Smoke for 4 seconds  Do first so there's smoke when the panels open.
-			DisplayShortCircuit();  				// short circuit display
-			SoundFaint(); 							// Faint sound
-			MagicFlicker(10);  						// Magic Panel Flicker for 10 seconds
-			HPFlicker(10);  						// HPs flicker 10 seconds
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();					// start panel sequence
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqShortCircuit);		// debug console feedback
-#endif
-			break;
-
-		case 7: // Cantina (Orchestral Cantina, Rhythmic Panels)
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_add_completion_callback(resetJEDIcallback); 	// callback to reset displays at end of sequence
-			seq_add_completion_callback(resetMPcallback); 	    // callback to reset Magic Panel at end of sequence
-			seq_loadsequence(panel_dance, SEQ_SIZE(panel_dance));
-			seq_resetspeed();
-			SoundCantina();		 				// code for dance sound
-			DisplaySpectrum();	 				// spectrum display
-			HPFlicker(46); 						// HPs flicker for 46 sec
-			MagicPanelVU();						// Magic Panel in VU Mode
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// start panel sequence
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqCantinaDance);	// debug console feedback
-#endif
-			break;
+		if(mask & SEQ_SERVO_BIT(i)) panel_rc_control[i-1]=0;
+	}
+}
 
-		case 8: // LEIA
-			seq_stopsequence(); 				// Abort previous sequence
-			seq_loadspeed(panel_slow_speed);	// Go slow
-			seq_loadsequence(panel_init, SEQ_SIZE(panel_init));	// Close panels
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-
-			HP1RC();			 				// HP 01 in RC mode
-			SoundLeia();						// Leia message sound
-			HP1Flicker(34); 					// front holos flicker for 34 sec
-			DisplayLeia();		 				// Leia display
-			MagicPanelCylonH();					// HP in Cylon Row Scan mode
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqLeia);			// debug console feedback
-#endif
+// Runs the frame in frame_rx, see frame.h.
+// Everything is checked first, the reply goes out before the command runs.
+void dispatch_frame()
+{
+	uint8_t* payload=frame_rx.payload;
+	uint8_t length=frame_rx.length;
+	uint8_t reply[FRAME_OVERHEAD+1];
+	cmd_entry_t entry;
+	uint8_t status, value=0;
+
+	entry.handler=0;
+	switch(frame_rx.opcode)
+	{
+		case FRAME_STREAM:
+			// no reply when good, at 50 frames per second it would double the traffic
+			status=stream_check(payload, length);
+			if(status!=CMD_OK) break;
+			panel_rc_off(stream_frame(payload));
+			return;
+		case FRAME_SERVOS:
+			status=frame_servos_check(payload, length);
 			break;
-
-		case 9:	// DISCO
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_add_completion_callback(resetJEDIcallback); // callback to reset displays at end of sequence
-			seq_add_completion_callback(resetMPcallback); 	    // callback to reset Magic Panel at end of sequence
-			seq_resetspeed();
-			seq_loadsequence(panel_long_disco, SEQ_SIZE(panel_long_disco)); // 6:26 seconds sequence
-			// message on the logics
-			//suart_puts("@1MR2 D2   \r"); 		// message is top front is R2
-			//_delay_ms(200);
-			//suart_puts("@2M  D2  \r");		// message is lower front is D2
-			//_delay_ms(200);
-			RLDSetMessage("STAR WARS   "); 		// message in rear is STAR WARS...
-			// suart_puts("@3P61\r");			// ... in Aurabesh!
-			//_delay_ms(100);
-			DisplaySpectrum();	 				// all logics in disco spectrum mode
-			RLDDisplayMessage();				// put rear logic in text mode
-			SoundDisco();						// disco music
-			HPFlicker(99);		 				// all holos flciker for as long as possible
-			MagicPanelVU();						// Magic Panel in VU Mode
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// start panel sequence
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqDisco);			// debug console feedback
-#endif
+		case FRAME_SEQUENCE:
+			status=cmd_find(panel_commands, 'S', 'E', &entry);
+			value=payload[0];
+			if(length!=1) status=CMD_BAD_LENGTH;
 			break;
-
-		case 10: // QUIET   sounds off, holo stop, panel closed
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadspeed(panel_slow_speed);	// go slow
-			seq_loadsequence(panel_init, SEQ_SIZE(panel_init));
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// close panels
-
-			init_jedi();						// JEDI back to default
-			HPStop(); 							// all holos to stop
-			SoundStop();						// stop sounds
-			seq_resetspeed();					// sequence speed to fast
-			stop_command(0);					// all panels off RC
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqQuiet);			// debug console feedback
-#endif
+		case FRAME_SETUP:
+			status=length==3 ? cmd_find(setup_commands, payload[0], payload[1], &entry) : CMD_BAD_LENGTH;
+			value=payload[2];
 			break;
-
-		case 11: // WIDE AWAKE	random sounds, holos on random, panels closed
-
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadspeed(panel_slow_speed);	// go slow
-			seq_loadsequence(panel_init, SEQ_SIZE(panel_init));
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// close panels
-
-			init_jedi();						// JEDI back to default
-			HPRandom();			 				// all HPs to random
-			SoundRandom();						// random sounds mode
-			seq_resetspeed();					// sequence speed to fast
-			stop_command(0);					// all panels off RC and closed
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqWideAwake);		// debug console feedback
-#endif
-			break;
-
-		case 12: // TOP PIE PANELS RC
-			rc_command(7);
-			rc_command(8);
-			rc_command(9);
-			rc_command(10);
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqTopRC);
-#endif
+		default:
+			status=CMD_UNKNOWN;
 			break;
+	}
+	if(status==CMD_OK && entry.handler && value>entry.max_value) status=CMD_BAD_VALUE;
 
-		case 13: // AWAKE	random sounds, holos off, panels closed
-
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadspeed(panel_slow_speed);	// go slow
-			seq_loadsequence(panel_init, SEQ_SIZE(panel_init));
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// close panels
-
-			init_jedi();						// JEDI back to default
-			HPStop(); 							// all HPs to stop
-			SoundRandom();						// random sounds mode
-			seq_resetspeed();					// sequence speed to fast
-			stop_command(0);					// all panels off RC and closed
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqAwake);			// debug console feedback
-#endif
-			break;
-		case 14: // EXCITED	random sounds, holos movement, holo lights on, panels closed
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadspeed(panel_slow_speed);	// go slow
-			seq_loadsequence(panel_init, SEQ_SIZE(panel_init));
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();				// close panels
-
-			init_jedi();						// JEDI back to default
-			HPRandom();			 				// all HPs to random
-			HPOn(); 							// all HPs lights on
-			SoundRandom();						// random sounds mode
-			seq_resetspeed();					// sequence speed to fast
-			stop_command(0);					// all panels off RC and closed
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqExcited);		// debug console feedback
-#endif
-			break;
+	serial_write(reply, frame_encode(reply, frame_rx.opcode|FRAME_REPLY, &status, 1), SERIAL_WAIT_FOREVER);
+	if(status!=CMD_OK) return;
 
-		case 15: // SCREAM no panels: sound + lights but no panels
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_add_completion_callback(resetMPcallback); 	    // callback to reset Magic Panel at end of sequence
-			SoundScream();		 				// code for scream sound
-			DisplayScream(); 					// scream display
-			HPFlicker(3);						// holos flicker for 4 seconds
-			MagicFlicker(4); 					// magic panel on for 4 seconds
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqScreamNoPanels); // debug console feedback
-#endif
-			break;
-		case 16: // Panel Wiggle
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadspeed(panel_medium_speed);
-			seq_loadsequence(panel_wiggle, SEQ_SIZE(panel_wiggle));
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-			DisplayScream(); 					// scream display
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqPanelWiggle);
+	if(frame_rx.opcode!=FRAME_SETUP) stream_stop();
+	if(entry.handler) entry.handler(value);
+	else frame_servos_run(payload);
+}
 #endif
-			break;
-
 
-		///////////////////////////////////////////
-		//	sequences of panels only, no sounds or light effects
-		//
-		//	:SE51 Scream, with all panels open
-		//	:SE52 Wave, one panel at a time
-		//	:SE53 Fast (Smirk) back and forth wave
-		//	:SE54 Wave 2 (open progressively all panels, then close one by one)
-		//	:SE55 Marching ants
-		//	:SE56 Faint/Short Circuit
-		//	:SE57 Rythmic panel dance
-		//  :SE58 Bye Bye Wave
-		//	:SE59 Open Panels half way
-		//////////////////////////////////////////
-
-		case 51: // SCREAM
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_all_open, SEQ_SIZE(panel_all_open));
-			seq_loadspeed(panel_slow_speed);	// softer close
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqScream);
-#endif
-			break;
-		case 52: // WAVE1
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_wave, SEQ_SIZE(panel_wave));
-			seq_resetspeed();
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqWave);
-#endif
-			break;
-		case 53: // MOODY FAST WAVE
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_fast_wave, SEQ_SIZE(panel_fast_wave));
-			seq_resetspeed();
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqFastWave);
-#endif
-			break;
-		case 54: // WAVE2
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_open_close_wave, SEQ_SIZE(panel_open_close_wave));
-			seq_resetspeed();
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqOpenCloseWave);
-#endif
-			break;
-		case 55: // Marching ant
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_marching_ants, SEQ_SIZE(panel_marching_ants));
-			seq_loadspeed(panel_slow_speed);	// softer close
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqMarchingAnts);
-#endif
-			break;
-		case 56: // SHORT CIRCUIT / FAINT
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_all_open_long, SEQ_SIZE(panel_all_open_long));
-			seq_loadspeed(panel_super_slow_speed);	// very slow close
-			EXT1On(4); // Turn on Smoke for 4 seconds
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqShortCircuit);
-#endif
-			break;
-		case 57: // Rhythmic Panels
-			seq_stopsequence(); 				// abort any previous sequence immediately
-			seq_loadsequence(panel_dance, SEQ_SIZE(panel_dance));
-			seq_resetspeed();
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqRythmicPanels);
-#endif
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-			break;
-		case 58: // Panel Wave Bye Bye
-			seq_stopsequence();
-			seq_loadsequence(panel_bye_bye_wave, SEQ_SIZE(panel_bye_bye_wave));
-			seq_loadspeed(panel_slow_speed);
-#if _FEEDBACK_MSG_ == 1
-			serial_puts_p(strSeqByeByeWave);
-#endif
-			StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-			break;
-		case 59: // Panel all open Middle - Neil's test sequence to check partial panel opening.
-			seq_stopsequence();
-			seq_loadsequence(panel_all_open_mid, SEQ_SIZE(panel_all_open_mid));
-			seq_loadspeed(panel_slow_speed);
-			//StartSlaveSequence(value);			// Trigger the same sequence on the Slave.  These need to stay in Sync!
-			seq_startsequence();
-			break;
-		default:
-			sprintf(string, "(Sequence %02d not implemented) \r\n", value);
-			seq_resetspeed();
+// Panel sequences with their effects, see routine.h and panel_routines.h
+void sequence_command(uint8_t value)
+{
+	if(!routine_start(value))
+	{
+		seq_resetspeed();
 #if _ERROR_MSG_ == 1
-			serial_puts(string);
+		char string[FMT_DEC_DIGITS+1];
+		serial_puts("(Sequence ");
+		fmt_dec(string, value, 2, '0');
+		serial_puts(string);
+		serial_puts(" not implemented) \r\n");
 #endif
-			break;
 	}
 }
 
@@ -1747,12 +1445,13 @@ void open_command(uint8_t value)
 {
 	uint8_t i;
 
-	// Without it, the open command will wait until the previous sequence completes.
-	seq_stopsequence(); // abort any previous sequence immediately
-
+	// Take the panels we open away from the sequencer, without it the open command
+	// will wait until the previous sequence completes.
+	// Sequences running on other panels keep going.
 
 	if(value==0) // open all
 	{
+		seq_release_servos(SEQ_ALL_SERVOS); // abort any previous sequence immediately
 		for (i=1; i<=SERVO_NUM; i++)
 		{
 			servo_set(i, _OPN);
@@ -1764,6 +1463,7 @@ void open_command(uint8_t value)
 	}
 	if(value<=SERVO_NUM) // open specific panel
 	{
+		seq_release_servos(SEQ_SERVO_BIT(value));
 		servo_set(value, _OPN);
 		return;
 	}
@@ -1779,6 +1479,7 @@ void open_command(uint8_t value)
 	}
 	if(value==14) // open top panels
 	{
+		seq_release_servos(SEQ_ALL_SERVOS & ~(SEQ_SERVO_BIT(7)-1) & ~SEQ_SERVO_BIT(SERVO_NUM));
 		for (i=7; i<=SERVO_NUM-1; i++)
 		{
 			servo_set(i, _OPN);
@@ -1789,6 +1490,7 @@ void open_command(uint8_t value)
 	}
 	if(value==15) // open bottom panels
 	{
+		seq_release_servos((SEQ_SERVO_BIT(7)-1) | SEQ_SERVO_BIT(11));
 		for (i=1; i<=6; i++)
 		{
 			servo_set(i, _OPN);
@@ -1817,7 +1519,7 @@ void close_command(uint8_t value)
 		//sequence to close all panels, turn them off slowly
 		seq_stopsequence(); // abort any previous sequence immediately
 		seq_loadspeed(panel_slow_speed);
-		seq_loadsequence(panel_init, SEQ_SIZE(panel_init));
+		seq_loadpanel(panel_init);
 
 		// Close the slave Panels too
 		suart_puts(":CL00\r");
@@ -1828,6 +1530,7 @@ void close_command(uint8_t value)
 	if(value<=SERVO_NUM)
 	{
 		panel_rc_control[value-1]=0;	// turn off RC control which would re-open the panel
+		seq_release_servos(SEQ_SERVO_BIT(value));	// and any sequence moving it
 		servo_set(value, _CLS);			// close the servo
 
 		// Give time for the panel to close, then shut it off for buzz control
@@ -1915,43 +1618,17 @@ void hold_command(uint8_t value)
 	panel_rc_control[value-1]=0;
 }
 
-// sets JEDI display and Holos in their default state
-void init_jedi()
-{
-	seq_remove_completion_callback(); // remove any competing completion callback
-	suart_puts("*H000\r");	// quick way to turn off holos if connected to MarcDuino
-	_delay_ms(100);
-	suart_puts("@0T1\r");	// abort test routine, reset all to normal
-	_delay_ms(20);
-#ifdef _DIGITALJEDI_
-	/**** initialize JEDI display for digital output on HPs and PSI ******/
-	// I connected Mike Velchecks rear PSI to the JEDI, which requires output to be turned to digital
-	// My holo lights are the older version and also require HPs to be set to digital
-	suart_puts("@6P91\r");	// change front holo (6) parameter 9 (P9) to digital (1)
-	_delay_ms(20);
-	suart_puts("@5P91\r");   // change rear PSI (5) parameter 9 (P9) to digital (1)
-	_delay_ms(20);
-#endif
-}
-
-// callback to reset JEDI to normal after a sequence, works only once
-void resetJEDIcallback()
-{
-	suart_puts("*H000\r");	// quick way to turn off holos if connected to MarcDuino
-	_delay_ms(100);
-	suart_puts("@0T1\r");	// abort test routine, reset all to normal
-	_delay_ms(20);
-	suart_puts("%T00\r");  	// MP Off
-	//_delay_ms(20);
-	//suart_puts("%T00\r");  	// Logics reset to default
-	seq_remove_completion_callback();	// one shot, remove yourself
-}
-
-
 //////////////////////////////////////////////////
 // HP & Magic Panel Actions Commands
 /////////////////////////////////////////////////
 
+void SlaveCommand(const char* prefix, uint8_t value, uint8_t width)
+{
+	suart_puts_p(prefix);
+	suart_putn(value, width);
+	suart_putc('\r');
+}
+
 void HPOff()
 {
 	suart_puts("*H000\r");
@@ -1974,23 +1651,17 @@ void HPRandom()
 
 void HPFlicker(uint8_t seconds)	// all HP flicer seconds from 0 (off) to 99
 {
-	char string[8];
-	sprintf(string, "*F0%02d\r", seconds);
-	suart_puts(string);
+	SlaveCommand(PSTR("*F0"), seconds, 2);
 }
 
 void HP1Flicker(uint8_t seconds) // front HP flicker
 {
-	char string[8];
-	sprintf(string, "*F1%02d\r", seconds);
-	suart_puts(string);
+	SlaveCommand(PSTR("*F1"), seconds, 2);
 }
 
 void HPFlash(uint8_t seconds)	// seconds from 0 (off) to 99 (always on)
 {
-	char string[8];
-	sprintf(string, "*H0%02d\r", seconds);
-	suart_puts(string);
+	SlaveCommand(PSTR("*H0"), seconds, 2);
 }
 
 void HP1RC()
@@ -2005,7 +1676,6 @@ void HP1RC()
 void DisplayScream()
 {
 	suart_puts("@0T5\r"); 	// scream display
-	_delay_ms(100);
 }
 
 void DisplayNormal()
@@ -2013,32 +1683,42 @@ void DisplayNormal()
 	suart_puts("@0T1\r");
 }
 
-void DisplayFlash4()
+void DisplayFlash()
 {
 	suart_puts("@0T2\r");  	// flash display
-	_delay_ms(100);
-	suart_puts("@0W4\r");  	// for 4 seconds
-	_delay_ms(50);
+}
+
+void DisplayWait(uint8_t seconds)	// keep the current display for that many seconds
+{
+	SlaveCommand(PSTR("@0W"), seconds, 0);
 }
 
 void DisplaySpectrum()
 {
-	suart_puts("@0T92\r"); 	// spectrum display
-	_delay_ms(200);			// JEDI needs a large amount of time to setup, 100 ms not enough
+	suart_puts("@0T92\r"); 	// spectrum display, JEDI needs a large amount of time to setup, 100 ms not enough
 }
 
 void DisplayShortCircuit()
 {
 	suart_puts("@0T4\r");	// short circuit display
-	_delay_ms(100);
-	suart_puts("@0W10\r");  // for 10 seconds (this one does not seem to respond)
-	_delay_ms(20);
 }
 
 void DisplayLeia()
 {
 	suart_puts("@0T6\r"); 	// Leia display
-	_delay_ms(100);
+}
+
+void JEDIDigital(uint8_t device)
+{
+#ifdef _DIGITALJEDI_
+	/**** initialize JEDI display for digital output on HPs and PSI ******/
+	// I connected Mike Velchecks rear PSI to the JEDI, which requires output to be turned to digital
+	// My holo lights are the older version and also require HPs to be set to digital
+	// front holo is device 6, rear PSI is 5, parameter 9 (P9) to digital (1)
+	suart_putc('@');
+	suart_putn(device, 0);
+	suart_puts_p(PSTR("P91\r"));
+#endif
 }
 
 void RLDSetMessage(char* message)
@@ -2046,13 +1726,11 @@ void RLDSetMessage(char* message)
 	suart_puts("@3M");
 	suart_puts(message);
 	suart_putc('\r');
-	_delay_ms(250);
 }
 
 void RLDDisplayMessage()
 {
 	suart_puts("@3T100\r");	// put rear logic in text mode
-	_delay_ms(100);
 }
 
 
@@ -2108,8 +1786,10 @@ void SoundLeia()
 void Sound(uint8_t bank, uint8_t number)
 {
 	char string[8];
-	sprintf(string, "$%1d%2d", bank, number);
-	parse_sound_command(string, strlen(string));
+	string[0]=SOUND_START_CHAR;
+	char* p=fmt_dec(string+1, bank, 0, ' ');
+	p=fmt_dec(p, number, 0, ' ');
+	parse_sound_command(string, p-string);
 }
 
 void SoundRandom()
@@ -2127,9 +1807,7 @@ void SoundStop()
 ///////////////////////////////
 void MagicFlicker(uint8_t seconds)	// seconds from 0 (off) to 99 (always on)
 {
-	char string[8];
-	sprintf(string, "*MF%02d\r", seconds);
-	suart_puts(string);
+	SlaveCommand(PSTR("*MF"), seconds, 2);
 
 	if (seconds == 2)
 	{
@@ -2140,52 +1818,32 @@ void MagicFlicker(uint8_t seconds)	// seconds from 0 (off) to 99 (always on)
 		// Assume longer flicker and call longer version.
 		suart_puts("%T43\r");
 	}
-	_delay_ms(50);
 }
 
 void MagicPanelVU()
 {
 	suart_puts("%T52\r");  	// VU Meter display
-	_delay_ms(50);
 }
 
 void MagicPanelCylonH()
 {
 	suart_puts("%T22\r");  	// Cylon Row
-	_delay_ms(50);
 }
 
 void MagicPanelOff()
 {
 	suart_puts("%T00\r");  	// Off
-	_delay_ms(50);
-}
-
-// callback to reset JEDI to normal after a sequence, works only once
-void resetMPcallback()
-{
-	suart_puts("%T00\r");  	// Off
-	_delay_ms(50);
-	seq_remove_completion_callback();	// one shot, remove yourself
 }
 
 // Client EXT1 Controls
 void EXT1On(uint8_t seconds)	// seconds from 0 (off) to 99 (always on)
 {
-	char string[8];
-	sprintf(string, "*EO%02d\r", seconds);
-	suart_puts(string);
-
-	_delay_ms(50);
+	SlaveCommand(PSTR("*EO"), seconds, 2);
 }
 
 void EXT1Off()	// seconds from 0 (off) to 99 (always on)
 {
-	char string[8];
-	sprintf(string, "*EO%02d\r", 0);
-	suart_puts(string);
-
-	_delay_ms(50);
+	SlaveCommand(PSTR("*EO"), 0, 2);
 }
 
 ///////////////////////////
@@ -2193,9 +1851,7 @@ void EXT1Off()	// seconds from 0 (off) to 99 (always on)
 ///////////////////////////
 void StartSlaveSequence(uint8_t value)
 {
-	char string[8];
-	sprintf(string, ":SE%2d\r", value);
-	suart_puts(string);
+	SlaveCommand(PSTR(":SE"), value, 2);
 	// May need a delay to get synced.
 	// Set this here so we can tune it
 	//if (slave_delay_time)
@@ -2206,10 +1862,10 @@ void StartSlaveSequence(uint8_t value)
 
 void SendSetupToSlave(char* command, uint8_t value)
 {
-	char string[8];
-	sprintf(string, "#xx%2d\r", value);
-	string[1] = command[0];
-	string[2] = command[1];
-	suart_puts(string);
+	suart_putc(SETUP_START_CHAR);
+	suart_putc(command[0]);
+	suart_putc(command[1]);
+	suart_putn(value, 2);
+	suart_putc('\r');
 }
 
@@ -15,6 +15,7 @@
 #define MAIN_H_
 
 #include <stdint.h> 		// uint8_t and companions
+#include "command.h"		// command tables
 
 /********* BUILD SETTINGS FOR ALL VARIANTS, COMMENT OUT TO CHANGE OPTION *******************/
 #define _RELEASEVERSION_		// comment out for private release version
@@ -26,6 +27,22 @@
 #define _ERROR_MSG_ 0
 #define _FEEDBACK_MSG_ 0
 
+// uncomment to profile interrupt latency and duration, test builds only (see isrprof.h)
+//#define _ISR_PROFILE_
+
+// uncomment for the RAM high-water report by stack painting, test builds only (see stackmon.h)
+//#define _STACK_MONITOR_
+
+// uncomment to measure command and routine action latency, test builds only (see latency.h)
+//#define _LATENCY_STATS_
+
+// comment out to turn off the binary command frames on the console (see frame.h)
+#define _BINARY_FRAMES_
+
+// comment out to put the panel sequence tables in flash as they are, instead of their
+// compact encoding (see panel_sequences.h and tools/seqconv.c)
+#define _COMPACT_SEQUENCES_
+
 // defaults to private version settings when _RELEASEVERSION_ is undefined
 #ifndef _RELEASEVERSION_
 #define _PRIVATEVERSION_		// settings for my own droid
@@ -56,6 +73,11 @@
 #define SETUP_START_CHAR    '#' // For MarcDuino Setup commands.
 
 #define CMD_END_CHAR 	'\r'// all command must end with one of these characters
+#define CMD_BATCH_CHAR	';'	// separates the commands of a batch line, like :SE05;$C;*F1
+
+// comment out to start the panel sequences of a batch line as soon as their command runs,
+// instead of together once the whole line has run
+#define _BATCH_SYNC_START_
 
 // I2C control characters (not used, hard coded for now)
 #define CMD_SEP_CHAR	','		// separator for I2C arguments
@@ -71,6 +93,10 @@
 #define CMD_STOP		"ST"		// buzz kill/soft hold: remove a panel from RC control, turn servo off (0=all)
 #define CMD_HOLD		"HD"		// hard hold: remove panel from RC and hold in last position (0=all that where on RC)
 
+// command table flags (see command.h and run_command)
+#define CMD_ACK_BEFORE	0x01	// send "OK" before running the command
+#define CMD_ACK_AFTER	0x02	// send "OK" once the command is done
+
 // Setup command vocabulary
 #define SETUP_SERVO_DIR "SD"		// Servo direction.  0 forward, 1 reversed
 #define SETUP_SERVO_REVERSE "SR"	// Reverse Individual Servo.  #SRxxy where xx is the servo y is 0 for forward, 1 for reverse.
@@ -79,18 +105,42 @@
 #define SETUP_RANDOM_SOUND_DISABLED "SQ"		// Random Sounds Disabled.  0 = Random Sounds on, 1=Random Sounds disabled, volume 0, 2=Random Sounds disabled R2 Quiet
 #define SETUP_SLAVE_DELAY_TIME "ST"	// Slave commanding delay.  Allow you to tune the time between sending the Slave panel command and starting master panel command execution.
 #define SETUP_MP3_PLAYER "SM"       // Select the MP3 player to connect to.  0 = SparkFun MP3 Trigger (default), 1=DFPLayer Mini
+#define SETUP_SERIAL_BAUD "SB"		// Console baud rate. 0=9600 (default), 1=19200, 2=38400, 3=57600, 5=250000. OK comes at the old rate. 4 (115200) is refused, 2.1% off at 16 MHz.
+#define SETUP_STREAM_STATS "SC"		// Servo streaming counters. 0 = report, 1 = reset
+#define SETUP_ISR_PROFILE "IP"		// Interrupt profile (_ISR_PROFILE_ builds only). 0 = dump, 1 = reset
+#define SETUP_STACK_MONITOR "SK"	// RAM high-water mark (_STACK_MONITOR_ builds only). 0 = report, 1 = paint again
+#define SETUP_LATENCY_STATS "LS"	// Command latency (_LATENCY_STATS_ builds only). 0 = report, 1 = reset
+#define SETUP_I2C_SPEED "IS"		// I2C bus clock (MarcDuino v2). 0 = 100 kHz (default), 1 = 400 kHz. Not saved.
+#define SETUP_I2C_STATS "IF"		// I2C fault counters (MarcDuino v2). 0 = report, 1 = reset
 
 void echo(char ch);
-uint8_t build_command(char ch, char* output_str);
-void dispatch_command(char* command_str);
+char* build_command(char ch, uint8_t* length);
+void dispatch_command(char* command_str, uint8_t length);
+uint8_t is_start_char(char ch);
+void dispatch_batch(char* line, uint8_t length);
+void dispatch_frame();
+uint8_t frame_servos_check(const uint8_t* payload, uint8_t length);
+void frame_servos_run(const uint8_t* payload);
+void panel_rc_off(uint16_t mask);
 void parse_panel_command(char* command, uint8_t length);
 void parse_hp_command(char* command,uint8_t length);
 void parse_display_command(char* command,uint8_t length);
 void parse_sound_command(char* command,uint8_t length);
 void parse_alt1_command(char* command, uint8_t length);
 void parse_alt2_command(char* command, uint8_t length);
-void process_command(char* thecommand, char* theargument);
 void parse_setup_command(char* command, uint8_t length);
+uint8_t run_command(const cmd_entry_t* table, char* command, uint8_t length);
+void setup_servo_dir(uint8_t value);
+void setup_servo_reverse(uint8_t value);
+void setup_last_servo(uint8_t value);
+void setup_start_sound(uint8_t value);
+void setup_random_sound_disabled(uint8_t value);
+void setup_slave_delay_time(uint8_t value);
+void setup_mp3_player(uint8_t value);
+void setup_serial_baud(uint8_t value);
+void setup_stream_stats(uint8_t value);
+void setup_i2c_speed(uint8_t value);
+void setup_i2c_stats(uint8_t value);
 void sequence_command(uint8_t value);
 void open_command(uint8_t value);
 void close_command(uint8_t value);
@@ -98,24 +148,21 @@ void rc_command(uint8_t value);
 void stop_command(uint8_t value);
 void hold_command(uint8_t value);
 
-//Generate a CRC for the EEPROM
-uint16_t calc_crc();
-
 // i2c parsing (v1.8)
 void parse_i2c_command(char* command,uint8_t length);
 void sendI2C(uint8_t address, uint8_t* payload, uint8_t payload_length);
 uint8_t append_token(uint8_t* payload, uint8_t* index, char* token);
 
 
-void init_jedi();
-void resetJEDIcallback();
-
 ////////////////////////////////////////////
 // below are the internally generated
 // serial commands (not sent directly by R2 Touch)
 // Mostly to generate sequence scripts
 ///////////////////////////////////////////
 
+// Slave command ending with a number: prefix from program memory, value zero padded to width digits
+void SlaveCommand(const char* prefix, uint8_t value, uint8_t width);
+
 // Perform HP actions
 void HPOff();
 void HPOn();
@@ -130,7 +177,7 @@ void HP1RC();
 void MagicFlicker(uint8_t seconds);
 void MagicPanelVU();
 void MagicPanelCylonH();
-void resetMPcallback();
+void MagicPanelOff();
 
 // Perform Client EXT1 Actions
 void EXT1On(uint8_t seconds);
@@ -139,10 +186,12 @@ void EXT1Off();
 // Perform Display actions
 void DisplayNormal();
 void DisplayScream();
-void DisplayFlash4();
+void DisplayFlash();
+void DisplayWait(uint8_t seconds);
 void DisplaySpectrum();
 void DisplayShortCircuit();
 void DisplayLeia();
+void JEDIDigital(uint8_t device);
 
 // RLD text
 void RLDSetMessage(char* message);
@@ -0,0 +1,309 @@
+/*
+ * panel_routines.h
+ *
+ *  The :SExx routines: panel sequence, speed, and the sound, display, holo and magic
+ *  panel actions that go with it. See routine.h for the table format.
+ *  Include once, in main.c, after panel_sequences.h.
+ *
+ *  Action times are in 1/100s. The gaps between display (@) and magic panel (%)
+ *  commands are the delays the JEDI and the magic panel need to take a command, they
+ *  used to be _delay_ms() calls in the display functions.
+ *
+ *	:SE00 Close all panels (full speed), servo off - use as init only. Use CL00 for all soft close.
+ *	:SE01 Scream, with all panels open
+ *	:SE02 Wave, one panel at a time
+ *	:SE03 Fast (Smirk) back and forth wave
+ *	:SE04 Wave 2 (open progressively all panels, then close one by one)
+ *	:SE05 Beep Cantina (with marching ants panel action)
+ *	:SE06 Faint/Short Circuit
+ *	:SE07 Cantina dance (orchestral, rythmic panel dance)
+ *	:SE08 Leia
+ *	:SE09 Disco
+ *	:SE10 Quite Mode reset (panel close, stop holos, stop sounds)
+ *	:SE11 Full Awake Mode reset (panel close, random sound, holo movement, no holo lights)
+ *	:SE12 Top Panels to RC
+ *	:SE13 Mid Awake Mode reset (panel close, random sound, stop holos)
+ *	:SE14 Awake+ Mode reset ((panel close, random sound, holo movement, lights on)
+ *	:SE15 Screams no panels
+ *	:SE16 Panel Wiggle
+ *
+ *	Panel Moves Only
+ *	:SE51 Scream, with all panels open
+ *	:SE52 Wave, one panel at a time
+ *	:SE53 Fast (Smirk) back and forth wave
+ *	:SE54 Wave 2 (open progressively all panels, then close one by one)
+ *	:SE55 Marching ants
+ *	:SE56 Faint/Short Circuit
+ *	:SE57 Rythmic panel dance)
+ *	:SE58 Panel Wave Bye Bye
+ *	:SE59 Open panels half way
+ *
+ */
+
+#ifndef PANEL_ROUTINES_H_
+#define PANEL_ROUTINES_H_
+
+#include "hal.h"				// for the routine tables defined with PROGMEM
+#include "routine.h"
+#include "panel_sequences.h"
+
+#if _FEEDBACK_MSG_ ==1
+const char strSeqCloseAll[] PROGMEM="(Close all panels) \r\n";
+const char strSeqScream[] PROGMEM="(Scream) \r\n";
+const char strSeqWave[] PROGMEM="(Wave) \r\n";
+const char strSeqFastWave[] PROGMEM="(Fast Wave) \r\n";
+const char strSeqOpenCloseWave[] PROGMEM="(Open Close Wave) \r\n";
+const char strSeqCantinaMarchingAnts[] PROGMEM="(Cantina Marching Ants) \r\n";
+const char strSeqShortCircuit[] PROGMEM="(Short Circuit) \r\n";
+const char strSeqCantinaDance[] PROGMEM="(Cantina Dance) \r\n";
+const char strSeqLeia[] PROGMEM="(Leia Message) \r\n";
+const char strSeqDisco[] PROGMEM="(Disco Dance) \r\n";
+const char strSeqQuiet[] PROGMEM="(Set to Quiet) \r\n";
+const char strSeqWideAwake[] PROGMEM="(Set to Wide Awake) \r\n";
+const char strSeqTopRC[] PROGMEM="(All pie panels to RC) \r\n";
+const char strSeqAwake[] PROGMEM="(Set to Awake) \r\n";
+const char strSeqExcited[] PROGMEM="(Set to Excited) \r\n";
+const char strSeqScreamNoPanels[] PROGMEM="(Scream No Panels) \r\n";
+const char strSeqRythmicPanels[] PROGMEM="(Rythmic Panels) \r\n";
+const char strSeqMarchingAnts[] PROGMEM="(Marching Ants Panels) \r\n";
+const char strSeqPanelWiggle[] PROGMEM="(Panel Wiggle with Scream) \r\n";
+const char strSeqByeByeWave[] PROGMEM="(Wave Bye Bye) \r\n";
+const char strSeqHalfOpen[] PROGMEM="(Open Panels Half Way) \r\n";
+#endif
+
+/////////////// actions shared by several routines
+
+// start panels, nothing else
+routine_action_t const ra_start[] PROGMEM =
+{
+	{0,		RA_START},
+	{0,		RA_END}
+};
+
+// end of the cantina and disco routines: displays back to default, magic panel off
+routine_action_t const ra_reset_jedi[] PROGMEM =
+{
+	{0,		RA_HP_OFF},						// quick way to turn off holos if connected to MarcDuino
+	{10,	RA_DISPLAY_NORMAL},				// abort test routine, reset all to normal
+	{12,	RA_MAGIC_OFF},
+	{0,		RA_END}
+};
+
+// end of the magic panel routines
+routine_action_t const ra_reset_mp[] PROGMEM =
+{
+	{0,		RA_MAGIC_OFF},
+	{0,		RA_END}
+};
+
+/////////////// routine actions
+
+routine_action_t const ra_scream[] PROGMEM =		// SE01
+{
+	{0,		RA_SOUND_SCREAM},				// scream sound
+	{0,		RA_DISPLAY_SCREAM},				// scream display
+	{10,	RA_MAGIC_FLICKER,		4},		// magic panel on for 4 seconds
+	{15,	RA_HP_FLICKER,			4},		// HPs flicker for 4 seconds
+	{15,	RA_START},						// start panel sequence
+	{0,		RA_END}
+};
+
+routine_action_t const ra_wave[] PROGMEM =			// SE02
+{
+	{0,		RA_HP_FLASH,			4},		// flash holos for 4 seconds
+	{0,		RA_SOUND_WAVE},					// happy sound
+	{0,		RA_START},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_fast_wave[] PROGMEM =		// SE03
+{
+	{0,		RA_DISPLAY_FLASH},				// flash display...
+	{10,	RA_DISPLAY_WAIT,		4},		// ...for 4 seconds
+	{15,	RA_HP_FLICKER,			4},		// HPs flicker for 4 seconds
+	{15,	RA_SOUND_FAST_WAVE},			// moody sound
+	{15,	RA_START},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_open_wave[] PROGMEM =		// SE04
+{
+	{0,		RA_HP_FLASH,			5},		// HPs flash for 5 seconds
+	{0,		RA_SOUND_OPEN_WAVE},			// long happy sound
+	{0,		RA_START},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_beep_cantina[] PROGMEM =	// SE05
+{
+	{0,		RA_DISPLAY_SPECTRUM},			// spectrum display, JEDI needs 200ms to set it up
+	{20,	RA_HP_FLASH,			17},	// HPs flash for 17 seconds
+	{20,	RA_SOUND_BEEP_CANTINA},			// beeping cantina sound
+	{20,	RA_MAGIC_VU},					// Magic Panel in VU Mode
+	{25,	RA_START},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_short_circuit[] PROGMEM =	// SE06
+{
+	{0,		RA_EXT1_ON,				4},		// smoke for 4 seconds, first so there's smoke when the panels open
+	{5,		RA_DISPLAY_SHORT_CIRCUIT},		// short circuit display...
+	{15,	RA_DISPLAY_WAIT,		10},	// ...for 10 seconds (this one does not seem to respond)
+	{17,	RA_SOUND_FAINT},				// Faint sound
+	{17,	RA_MAGIC_FLICKER,		10},	// Magic Panel Flicker for 10 seconds
+	{22,	RA_HP_FLICKER,			10},	// HPs flicker 10 seconds
+	{22,	RA_START},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_cantina[] PROGMEM =		// SE07
+{
+	{0,		RA_SOUND_CANTINA},				// dance sound
+	{0,		RA_DISPLAY_SPECTRUM},			// spectrum display
+	{20,	RA_HP_FLICKER,			46},	// HPs flicker for 46 sec
+	{20,	RA_MAGIC_VU},					// Magic Panel in VU Mode
+	{25,	RA_START},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_leia[] PROGMEM =			// SE08
+{
+	{0,		RA_START},						// close panels
+	{0,		RA_HP1_RC},						// HP 01 in RC mode
+	{0,		RA_SOUND_LEIA},					// Leia message sound
+	{0,		RA_HP1_FLICKER,			34},	// front holos flicker for 34 sec
+	{0,		RA_DISPLAY_LEIA},				// Leia display
+	{10,	RA_MAGIC_CYLON},				// Magic Panel in Cylon Row Scan mode
+	{0,		RA_END}
+};
+
+routine_action_t const ra_disco[] PROGMEM =			// SE09
+{
+	{0,		RA_RLD_STAR_WARS},				// message in rear is STAR WARS...
+	{25,	RA_DISPLAY_SPECTRUM},			// all logics in disco spectrum mode
+	{45,	RA_RLD_TEXT},					// put rear logic in text mode
+	{55,	RA_SOUND_DISCO},				// disco music
+	{55,	RA_HP_FLICKER,			99},	// all holos flicker for as long as possible
+	{55,	RA_MAGIC_VU},					// Magic Panel in VU Mode
+	{60,	RA_START},						// 6:26 seconds sequence
+	{0,		RA_END}
+};
+
+// SE10, SE11, SE13, SE14: close panels, JEDI back to default, then set the mode
+#define RA_MODE_RESET \
+	{0,		RA_START}, \
+	{0,		RA_HP_OFF}, \
+	{10,	RA_DISPLAY_NORMAL}, \
+	{12,	RA_JEDI_DIGITAL,		6}, \
+	{14,	RA_JEDI_DIGITAL,		5}
+
+routine_action_t const ra_quiet[] PROGMEM =			// SE10
+{
+	RA_MODE_RESET,
+	{16,	RA_HP_STOP},					// all holos to stop
+	{16,	RA_SOUND_STOP},					// stop sounds
+	{16,	RA_RESET_SPEED},				// sequence speed to fast
+	{16,	RA_PANELS_OFF},					// all panels off RC
+	{0,		RA_END}
+};
+
+routine_action_t const ra_wide_awake[] PROGMEM =	// SE11
+{
+	RA_MODE_RESET,
+	{16,	RA_HP_RANDOM},					// all HPs to random
+	{16,	RA_SOUND_RANDOM},				// random sounds mode
+	{16,	RA_RESET_SPEED},
+	{16,	RA_PANELS_OFF},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_top_rc[] PROGMEM =		// SE12
+{
+	{0,		RA_PANEL_RC,			7},
+	{0,		RA_PANEL_RC,			8},
+	{0,		RA_PANEL_RC,			9},
+	{0,		RA_PANEL_RC,			10},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_awake[] PROGMEM =			// SE13
+{
+	RA_MODE_RESET,
+	{16,	RA_HP_STOP},					// all HPs to stop
+	{16,	RA_SOUND_RANDOM},				// random sounds mode
+	{16,	RA_RESET_SPEED},
+	{16,	RA_PANELS_OFF},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_excited[] PROGMEM =		// SE14
+{
+	RA_MODE_RESET,
+	{16,	RA_HP_RANDOM},					// all HPs to random
+	{16,	RA_HP_ON},						// all HPs lights on
+	{16,	RA_SOUND_RANDOM},				// random sounds mode
+	{16,	RA_RESET_SPEED},
+	{16,	RA_PANELS_OFF},
+	{0,		RA_END}
+};
+
+routine_action_t const ra_scream_no_panels[] PROGMEM =	// SE15
+{
+	{0,		RA_SOUND_SCREAM},				// scream sound
+	{0,		RA_DISPLAY_SCREAM},				// scream display
+	{10,	RA_HP_FLICKER,			3},		// holos flicker for 3 seconds
+	{10,	RA_MAGIC_FLICKER,		4},		// magic panel on for 4 seconds
+	{0,		RA_END}
+};
+
+routine_action_t const ra_wiggle[] PROGMEM =		// SE16
+{
+	{0,		RA_START},
+	{0,		RA_DISPLAY_SCREAM},				// scream display
+	{0,		RA_END}
+};
+
+routine_action_t const ra_smoke[] PROGMEM =			// SE56
+{
+	{0,		RA_EXT1_ON,				4},		// Turn on Smoke for 4 seconds
+	{5,		RA_START},
+	{0,		RA_END}
+};
+
+/////////////// the routines
+
+const routine_t routine_table[] PROGMEM =
+{
+	// number	flags				panel sequence						speed					actions					end
+	{0,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_init),				panel_slow_speed,		ra_start,				0				ROUTINE_NAME(strSeqCloseAll)},
+	{1,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_all_open),			panel_slow_speed,		ra_scream,				0				ROUTINE_NAME(strSeqScream)},
+	{2,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_wave),				0,						ra_wave,				0				ROUTINE_NAME(strSeqWave)},
+	{3,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_fast_wave),			0,						ra_fast_wave,			0				ROUTINE_NAME(strSeqFastWave)},
+	{4,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_open_close_wave),	0,						ra_open_wave,			0				ROUTINE_NAME(strSeqOpenCloseWave)},
+	{5,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_marching_ants),		panel_slow_speed,		ra_beep_cantina,		ra_reset_jedi	ROUTINE_NAME(strSeqCantinaMarchingAnts)},
+	{6,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_all_open_long),		panel_super_slow_speed,	ra_short_circuit,		ra_reset_mp		ROUTINE_NAME(strSeqShortCircuit)},
+	{7,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_dance),				0,						ra_cantina,				ra_reset_jedi	ROUTINE_NAME(strSeqCantinaDance)},
+	{8,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_init),				panel_slow_speed,		ra_leia,				0				ROUTINE_NAME(strSeqLeia)},
+	{9,		RT_STOP|RT_SLAVE,	PANEL_REF(panel_long_disco),		0,						ra_disco,				ra_reset_jedi	ROUTINE_NAME(strSeqDisco)},
+	{10,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_init),				panel_slow_speed,		ra_quiet,				0				ROUTINE_NAME(strSeqQuiet)},
+	{11,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_init),				panel_slow_speed,		ra_wide_awake,			0				ROUTINE_NAME(strSeqWideAwake)},
+	{12,	0,					PANEL_NONE,							0,						ra_top_rc,				0				ROUTINE_NAME(strSeqTopRC)},
+	{13,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_init),				panel_slow_speed,		ra_awake,				0				ROUTINE_NAME(strSeqAwake)},
+	{14,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_init),				panel_slow_speed,		ra_excited,				0				ROUTINE_NAME(strSeqExcited)},
+	{15,	RT_STOP,			PANEL_NONE,							0,						ra_scream_no_panels,	ra_reset_mp		ROUTINE_NAME(strSeqScreamNoPanels)},
+	{16,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_wiggle),			panel_medium_speed,		ra_wiggle,				0				ROUTINE_NAME(strSeqPanelWiggle)},
+
+	// panels only, no sounds or light effects
+	{51,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_all_open),			panel_slow_speed,		ra_start,				0				ROUTINE_NAME(strSeqScream)},
+	{52,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_wave),				0,						ra_start,				0				ROUTINE_NAME(strSeqWave)},
+	{53,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_fast_wave),			0,						ra_start,				0				ROUTINE_NAME(strSeqFastWave)},
+	{54,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_open_close_wave),	0,						ra_start,				0				ROUTINE_NAME(strSeqOpenCloseWave)},
+	{55,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_marching_ants),		panel_slow_speed,		ra_start,				0				ROUTINE_NAME(strSeqMarchingAnts)},
+	{56,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_all_open_long),		panel_super_slow_speed,	ra_smoke,				0				ROUTINE_NAME(strSeqShortCircuit)},
+	{57,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_dance),				0,						ra_start,				0				ROUTINE_NAME(strSeqRythmicPanels)},
+	{58,	RT_STOP|RT_SLAVE,	PANEL_REF(panel_bye_bye_wave),		panel_slow_speed,		ra_start,				0				ROUTINE_NAME(strSeqByeByeWave)},
+	{59,	RT_STOP,			PANEL_REF(panel_all_open_mid),		panel_slow_speed,		ra_start,				0				ROUTINE_NAME(strSeqHalfOpen)},	// Neil's test sequence to check partial panel opening
+};
+const uint8_t routine_table_size=sizeof(routine_table)/sizeof(routine_t);
+
+#endif /* PANEL_ROUTINES_H_ */
@@ -16,6 +16,9 @@
  *  Added Partial Panel opening
  *  Added 13 panel support
  *
+ *  Added optional motion profile column
+ *  Added compact encoding of the tables (_COMPACT_SEQUENCES_ in main.h)
+ *
  */
 
 /************ example of how to use the sequencer
@@ -52,6 +55,11 @@
 	first defines the first servo to be called in the row
 	last defines the last servo to be called in the row
 
+	an optional last column after "last" sets the motion profile of the row:
+	_LIN (default when left out), _EASE, _TRAP or _SCRV, see sequencer.h
+			// time	servo1	servo2	servo3	servo4 first last profile
+			{50, 	2000, 	1000, 	1000, 	1000,   1,     11,  _EASE},
+
 
 	in main() or elsewhere call:
 
@@ -69,7 +77,8 @@
 #ifndef PANEL_SEQUENCES_H_
 #define PANEL_SEQUENCES_H_
 
-#include <avr/pgmspace.h>	// for the sequencer data arrays defined with PROGMEM
+#include "hal.h"			// for the sequencer data arrays defined with PROGMEM
+#include "main.h"			// for the _COMPACT_SEQUENCES_ compile flag
 #include "sequencer.h"		// servo sequencer
 
 // Dome panel sequences
@@ -79,6 +88,22 @@
 #define _MID 1750 // Test Value ... 1750 (1.75ms) should be ~135
 #define _CLS 2000 // 180
 
+// Load a panel sequence with seq_loadpanel(panel_wave) instead of seq_loadsequence().
+// With _COMPACT_SEQUENCES_ the tables below are only read by tools/seqconv.c, the firmware
+// gets the same sequences from panel_sequences_compact.h, generated from them.
+// After changing a table, regenerate it with tools/seqconv.c.
+// PANEL_REF(panel_wave) is the same sequence for the tables of panel_routines.h.
+#ifdef _COMPACT_SEQUENCES_
+#include "panel_sequences_compact.h"
+#define seq_loadpanel(name) seq_loadcompact(name##_compact)
+#define PANEL_REF(name) name##_compact, 0
+#else
+#define seq_loadpanel(name) seq_loadsequence(name, SEQ_SIZE(name))
+#define PANEL_REF(name) name, SEQ_SIZE(name)
+#endif
+#define PANEL_NONE 0, 0
+
+#ifndef _COMPACT_SEQUENCES_
 
 
 
@@ -417,6 +442,8 @@ sequence_t const panel_wiggle PROGMEM = //SE16
 		{50, 	_CLS, 	_CLS, 	_CLS, 	_CLS,	_CLS, 	_CLS, 	_CLS, 	_CLS,	_CLS, 	_CLS,	_CLS, 	/*_CLS,	_CLS,*/	_NP,	1,		11},
 		{0, 	_NP, 	_NP, 	_NP, 	_NP,	_NP, 	_NP, 	_NP, 	_NP, 	_NP,	_NP, 	_NP,	/*_NP,	_CLS,*/	_NP,	1,		11}
 };
+#endif /* _COMPACT_SEQUENCES_ */
+
 int16_t panel_fast_speed[]={0,0,0,0,0,0,0,0,0,0,0,0};
 
 int16_t panel_medium_speed[]={25,25,25,25,25,25,25,25,25,25,25,25};
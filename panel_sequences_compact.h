@@ -0,0 +1,184 @@
+/*
+ * panel_sequences_compact.h
+ *
+ *  Generated by tools/seqconv.c from panel_sequences.h, do not edit.
+ *  The panel sequences in the compact format described in sequencer.h,
+ *  used instead of the tables when _COMPACT_SEQUENCES_ is defined in main.h.
+ *
+ */
+
+#ifndef PANEL_SEQUENCES_COMPACT_H_
+#define PANEL_SEQUENCES_COMPACT_H_
+
+#include "hal.h"
+
+const uint8_t panel_all_open_compact[] PROGMEM =
+{
+	4, 3, 208, 7, 232, 3, 255, 255, 20, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 172, 2, 0, 255, 7, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 150,
+	1, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 255, 7, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t panel_all_open_long_compact[] PROGMEM =
+{
+	4, 3, 208, 7, 232, 3, 255, 255, 20, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 232, 7, 0, 255, 7, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 150,
+	1, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 255, 7, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t panel_all_open_mid_compact[] PROGMEM =
+{
+	3, 3, 208, 7, 214, 6, 255, 255, 20, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 200, 1, 0, 255, 7, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0,
+	0, 255, 7, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t panel_wave_compact[] PROGMEM =
+{
+	15, 3, 208, 7, 232, 3, 255, 255, 30, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 30, 0, 1, 0, 1, 30, 0, 3, 0, 0, 1, 30, 0, 6, 0, 0, 1,
+	30, 0, 12, 0, 0, 1, 30, 0, 24, 0, 0, 1, 30, 0, 48, 0, 0, 1, 30, 0,
+	32, 4, 0, 1, 30, 0, 0, 4, 0, 30, 0, 64, 0, 1, 30, 0, 192, 0, 0, 1,
+	30, 0, 128, 1, 0, 1, 30, 0, 0, 3, 0, 1, 60, 0, 0, 2, 0, 0, 0, 255,
+	7, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t panel_fast_wave_compact[] PROGMEM =
+{
+	29, 3, 208, 7, 232, 3, 255, 255, 15, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 15, 0, 1, 0, 1, 15, 0, 3, 0, 0, 1, 15, 0, 6, 0, 0, 1,
+	15, 0, 12, 0, 0, 1, 15, 0, 24, 0, 0, 1, 15, 0, 48, 0, 0, 1, 15, 0,
+	32, 4, 0, 1, 7, 0, 0, 4, 0, 15, 0, 64, 0, 1, 15, 0, 192, 0, 0, 1,
+	15, 0, 128, 1, 0, 1, 15, 0, 0, 3, 0, 1, 15, 0, 0, 0, 45, 0, 0, 2,
+	0, 15, 0, 0, 2, 1, 15, 0, 0, 3, 1, 0, 15, 0, 128, 1, 1, 0, 15, 0,
+	192, 0, 1, 0, 7, 0, 64, 0, 0, 15, 0, 0, 4, 1, 15, 0, 32, 4, 1, 0,
+	15, 0, 48, 0, 1, 0, 15, 0, 24, 0, 1, 0, 15, 0, 12, 0, 1, 0, 15, 0,
+	6, 0, 1, 0, 15, 0, 3, 0, 1, 0, 15, 0, 1, 0, 0, 0, 0, 255, 7, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t panel_open_close_wave_compact[] PROGMEM =
+{
+	27, 3, 208, 7, 232, 3, 255, 255, 20, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 20, 0, 1, 0, 1, 20, 0, 2, 0, 1, 20, 0, 4, 0, 1, 20, 0,
+	8, 0, 1, 20, 0, 16, 0, 1, 20, 0, 32, 0, 1, 20, 0, 0, 4, 1, 20, 0,
+	0, 0, 20, 0, 64, 0, 1, 20, 0, 128, 0, 1, 20, 0, 0, 1, 1, 20, 0, 0,
+	2, 1, 80, 0, 0, 0, 20, 0, 1, 0, 0, 20, 0, 2, 0, 0, 20, 0, 4, 0,
+	0, 20, 0, 8, 0, 0, 20, 0, 16, 0, 0, 20, 0, 32, 0, 0, 20, 0, 0, 4,
+	0, 20, 0, 0, 0, 20, 0, 64, 0, 0, 20, 0, 128, 0, 0, 20, 0, 0, 0, 40,
+	0, 0, 3, 0, 0, 0, 0, 255, 7, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t panel_marching_ants_compact[] PROGMEM =
+{
+	33, 3, 208, 7, 232, 3, 255, 255, 20, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 50, 0, 85, 5, 1, 1, 1, 1, 1, 1, 50, 0, 255, 7, 0, 1, 0,
+	1, 0, 1, 0, 1, 0, 1, 0, 50, 0, 255, 7, 1, 0, 1, 0, 1, 0, 1, 0,
+	1, 0, 1, 50, 0, 255, 7, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 50, 0,
+	255, 7, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 50, 0, 255, 7, 0, 1, 0,
+	1, 0, 1, 0, 1, 0, 1, 0, 50, 0, 255, 7, 1, 0, 1, 0, 1, 0, 1, 0,
+	1, 0, 1, 50, 0, 255, 7, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 50, 0,
+	255, 7, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 50, 0, 255, 7, 0, 1, 0,
+	1, 0, 1, 0, 1, 0, 1, 0, 50, 0, 255, 7, 1, 0, 1, 0, 1, 0, 1, 0,
+	1, 0, 1, 50, 0, 255, 7, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 50, 0,
+	255, 7, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 50, 0, 255, 7, 0, 1, 0,
+	1, 0, 1, 0, 1, 0, 1, 0, 50, 0, 255, 7, 1, 0, 1, 0, 1, 0, 1, 0,
+	1, 0, 1, 50, 0, 255, 7, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 50, 0,
+	255, 7, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 50, 0, 255, 7, 0, 1, 0,
+	1, 0, 1, 0, 1, 0, 1, 0, 50, 0, 255, 7, 1, 0, 1, 0, 1, 0, 1, 0,
+	1, 0, 1, 50, 0, 255, 7, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 50, 0,
+	255, 7, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 50, 0, 255, 7, 0, 1, 0,
+	1, 0, 1, 0, 1, 0, 1, 0, 50, 0, 255, 7, 1, 0, 1, 0, 1, 0, 1, 0,
+	1, 0, 1, 50, 0, 255, 7, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 50, 0,
+	255, 7, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 50, 0, 255, 7, 0, 1, 0,
+	1, 0, 1, 0, 1, 0, 1, 0, 50, 0, 255, 7, 1, 0, 1, 0, 1, 0, 1, 0,
+	1, 0, 1, 50, 0, 255, 7, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 50, 0,
+	255, 7, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 50, 0, 255, 7, 0, 1, 0,
+	1, 0, 1, 0, 1, 0, 1, 0, 100, 0, 170, 2, 0, 0, 0, 0, 0, 0, 0, 255,
+	7, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t panel_dance_compact[] PROGMEM =
+{
+	90, 3, 208, 7, 232, 3, 255, 255, 20, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 45, 0, 64, 0, 1, 45, 0, 128, 0, 1, 45, 0, 0, 1, 1, 45, 0,
+	0, 2, 1, 45, 0, 0, 2, 0, 45, 0, 0, 1, 0, 45, 0, 128, 0, 0, 45, 0,
+	64, 0, 0, 45, 0, 1, 0, 1, 45, 0, 2, 0, 1, 45, 0, 4, 0, 1, 45, 0,
+	8, 0, 1, 45, 0, 1, 0, 0, 45, 0, 2, 0, 0, 45, 0, 4, 0, 0, 45, 0,
+	8, 0, 0, 45, 0, 64, 1, 1, 1, 45, 0, 64, 1, 0, 0, 45, 0, 128, 2, 1,
+	1, 45, 0, 128, 2, 0, 0, 45, 0, 192, 3, 1, 1, 1, 1, 45, 0, 64, 1, 0,
+	0, 45, 0, 192, 3, 1, 0, 1, 0, 45, 0, 64, 1, 0, 0, 45, 0, 48, 4, 1,
+	1, 1, 45, 0, 48, 4, 0, 0, 0, 45, 0, 32, 0, 1, 45, 0, 32, 0, 0, 45,
+	0, 63, 4, 1, 1, 1, 1, 1, 1, 1, 45, 0, 1, 0, 0, 45, 0, 6, 0, 0,
+	0, 45, 0, 56, 4, 0, 0, 0, 0, 45, 0, 10, 0, 1, 1, 45, 0, 10, 0, 0,
+	0, 45, 0, 5, 0, 1, 1, 45, 0, 5, 0, 0, 0, 45, 0, 128, 2, 1, 1, 45,
+	0, 192, 3, 1, 0, 1, 0, 45, 0, 192, 3, 0, 1, 0, 1, 45, 0, 128, 2, 0,
+	0, 45, 0, 192, 3, 1, 1, 1, 1, 45, 0, 64, 1, 0, 0, 45, 0, 192, 3, 1,
+	0, 1, 0, 45, 0, 192, 3, 0, 1, 0, 1, 45, 0, 192, 3, 1, 0, 1, 0, 45,
+	0, 192, 3, 0, 1, 0, 1, 45, 0, 213, 7, 1, 1, 1, 1, 0, 1, 0, 1, 45,
+	0, 85, 5, 0, 0, 0, 0, 0, 0, 45, 0, 64, 1, 1, 1, 45, 0, 192, 3, 0,
+	1, 0, 1, 45, 0, 192, 3, 1, 0, 1, 0, 45, 0, 192, 3, 0, 1, 0, 1, 45,
+	0, 213, 7, 1, 1, 1, 1, 0, 1, 0, 1, 45, 0, 255, 7, 0, 1, 0, 1, 0,
+	1, 0, 1, 0, 1, 0, 45, 0, 255, 7, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0,
+	1, 45, 0, 85, 5, 0, 0, 0, 0, 0, 0, 45, 0, 3, 0, 1, 1, 45, 0, 15,
+	0, 0, 0, 1, 1, 45, 0, 60, 0, 0, 0, 1, 1, 45, 0, 48, 4, 0, 0, 1,
+	45, 0, 51, 7, 1, 1, 1, 1, 1, 1, 0, 45, 0, 255, 7, 0, 0, 1, 1, 0,
+	0, 1, 1, 0, 0, 1, 45, 0, 255, 7, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1,
+	0, 45, 0, 51, 3, 0, 0, 0, 0, 0, 0, 45, 0, 1, 0, 1, 45, 0, 1, 0,
+	0, 45, 0, 2, 0, 1, 45, 0, 2, 0, 0, 45, 0, 7, 0, 1, 1, 1, 45, 0,
+	1, 0, 0, 45, 0, 2, 0, 0, 45, 0, 4, 0, 0, 45, 0, 64, 1, 1, 1, 45,
+	0, 64, 1, 0, 0, 45, 0, 128, 2, 1, 1, 45, 0, 128, 2, 0, 0, 45, 0, 64,
+	1, 1, 1, 45, 0, 192, 3, 0, 1, 0, 1, 45, 0, 192, 3, 1, 0, 1, 0, 45,
+	0, 64, 1, 0, 0, 45, 0, 85, 1, 1, 1, 1, 1, 1, 45, 0, 85, 1, 0, 0,
+	0, 0, 0, 45, 0, 170, 2, 1, 1, 1, 1, 1, 45, 0, 170, 2, 0, 0, 0, 0,
+	0, 45, 0, 255, 7, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 45, 0, 63, 4,
+	0, 0, 0, 0, 0, 0, 0, 45, 0, 255, 7, 1, 1, 1, 1, 1, 1, 0, 0, 0,
+	0, 1, 45, 0, 191, 4, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 255, 7, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t panel_init_compact[] PROGMEM =
+{
+	2, 2, 208, 7, 255, 255, 100, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 255, 7, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+const uint8_t panel_long_disco_compact[] PROGMEM =
+{
+	31, 3, 208, 7, 232, 3, 255, 255, 15, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 15, 0, 1, 0, 1, 15, 0, 3, 0, 0, 1, 15, 0, 6, 0, 0, 1,
+	15, 0, 12, 0, 0, 1, 15, 0, 24, 0, 0, 1, 15, 0, 48, 0, 0, 1, 15, 0,
+	32, 4, 0, 1, 7, 0, 0, 4, 0, 15, 0, 64, 0, 1, 15, 0, 192, 0, 0, 1,
+	15, 0, 128, 1, 0, 1, 15, 0, 0, 3, 0, 1, 15, 0, 0, 0, 45, 0, 0, 2,
+	0, 15, 0, 0, 2, 1, 15, 0, 0, 3, 1, 0, 15, 0, 128, 1, 1, 0, 15, 0,
+	192, 0, 1, 0, 7, 0, 64, 0, 0, 15, 0, 0, 4, 1, 15, 0, 32, 4, 1, 0,
+	15, 0, 48, 0, 1, 0, 15, 0, 24, 0, 1, 0, 15, 0, 12, 0, 1, 0, 15, 0,
+	6, 0, 1, 0, 15, 0, 3, 0, 1, 0, 15, 0, 1, 0, 0, 160, 153, 2, 0, 255,
+	7, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 180, 16, 0, 255, 7, 2, 2, 2,
+	2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 255, 7, 2, 2, 2, 2, 2, 2, 2, 2,
+	2, 2, 2,
+};
+
+const uint8_t panel_bye_bye_wave_compact[] PROGMEM =
+{
+	8, 3, 208, 7, 232, 3, 255, 255, 20, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 75, 0, 3, 0, 1, 1, 20, 0, 3, 0, 0, 0, 20, 0, 3, 0, 1,
+	1, 20, 0, 3, 0, 0, 0, 20, 0, 3, 0, 1, 1, 75, 0, 3, 0, 0, 0, 0,
+	0, 255, 7, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+const uint8_t panel_wiggle_compact[] PROGMEM =
+{
+	10, 3, 208, 7, 232, 3, 255, 255, 20, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 50, 0, 255, 7, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 14, 0,
+	255, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 14, 0, 255, 7, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 14, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 14, 0, 255, 7, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 14, 0,
+	255, 7, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 14, 0, 255, 7, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 50, 0, 255, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 255, 7, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+};
+
+#endif /* PANEL_SEQUENCES_COMPACT_H_ */
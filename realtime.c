@@ -13,6 +13,7 @@
  *  Default implementation updates software delay counters and egg timers
  *  Also maintains a clock counter in seconds, minutes and hours
  *  Blinks the heartbeat LED once a second if RT_HEARTBEAT_LED is defined
+ *  Runs the events of the timer wheel when they are due
  *
  *  On ATMega168 with a 16 MHz clock using the 8-bit counter0
  *  calls realtime_do() every 0.01s
@@ -24,16 +25,28 @@
  *
  */
 
-#include <avr/io.h> 			// This will include <avr/iom128.h>
+#include "hal.h" 				// registers and interrupts
 #include <stdint.h> 			// delays
-#include <avr/interrupt.h>		// interrupts
 #include "toolbox.h"			// clear_bit and set_bit utilities
 #include "realtime.h"
+#include "isrprof.h"			// interrupt profiling, when enabled
 
 // Array of registered functions and timers to call and update at interrupt time
-rt_timer* rt_timer_array[RT_MAX_TIMERS];				// array of pointers to timers
+rt_timer* rt_timer_array[RT_MAX_TIMERS];				// array of pointers to timers, the first rt_timer_count in use
+static uint8_t rt_timer_count;
 rt_do_function rt_function_array[RT_MAX_FUNCTIONS];		// array of functions
 
+// Timer wheel: an armed event sits in the slot of its due tick, in a doubly linked list
+// so it can be taken out in one step. Each tick only looks at the slot of that tick.
+#define RT_WHEEL_MASK	(RT_WHEEL_SLOTS-1)
+#if RT_WHEEL_SLOTS & RT_WHEEL_MASK
+#error "RT_WHEEL_SLOTS must be a power of 2"
+#endif
+static rt_event* rt_wheel[RT_WHEEL_SLOTS];
+static volatile uint16_t rt_wheel_now;		// ticks since start
+static rt_event* rt_pending;				// due events waiting for rt_do(), oldest first
+static rt_event* rt_pending_last;
+
 // global counters and timers, use them in other files by declaring them as 'extern' variables
 // regular counters get incremented every 1/100 (1/32) of a second
 // timeout counters get decremented every 1/100 (1/32) of a second until they reach 0 and stay at 0
@@ -47,6 +60,9 @@ volatile uint8_t seconds;			// clock seconds
 volatile uint8_t minutes;			// clock minutes
 volatile uint8_t hours;				// clock hours
 
+#if !defined (_USE_32KHZ_)
+static volatile uint16_t rt_compares;	// Timer0 compare interrupts, 3 per 1/100 s
+#endif
 
 /********************************
  *
@@ -68,16 +84,17 @@ volatile uint8_t hours;				// clock hours
  *******************************/
 bool rt_add_timer(rt_timer* atimer)
 {
-	uint8_t i;
-	for (i=0; i<RT_MAX_TIMERS; i++)
+	uint8_t sreg=SREG;
+	bool added=FALSE;
+
+	cli();
+	if(rt_timer_count<RT_MAX_TIMERS)
 	{
-		if(!rt_timer_array[i])
-		{
-			rt_timer_array[i]=atimer;
-			return TRUE;
-		}
+		rt_timer_array[rt_timer_count++]=atimer;
+		added=TRUE;
 	}
-	return FALSE;
+	SREG=sreg;
+	return added;
 }
 
 /********************************
@@ -90,16 +107,145 @@ bool rt_add_timer(rt_timer* atimer)
  *******************************/
 bool rt_remove_timer(rt_timer *atimer)
 {
+	uint8_t sreg=SREG;
 	uint8_t i;
-	for (i=0; i<RT_MAX_TIMERS; i++)
+	bool removed=FALSE;
+
+	cli();
+	for (i=0; i<rt_timer_count; i++)
 	{
 		if(rt_timer_array[i]== atimer)
 		{
-			rt_timer_array[i]=0;
-			return TRUE;
+			// the last one takes its place, the array stays packed
+			rt_timer_array[i]=rt_timer_array[--rt_timer_count];
+			rt_timer_array[rt_timer_count]=0;
+			removed=TRUE;
+			break;
 		}
 	}
-	return FALSE;
+	SREG=sreg;
+	return removed;
+}
+
+/********************************
+ *
+ * Events on the timer wheel, see realtime.h
+ * 	rt_event myevent;
+ * 	rt_event_init(&myevent, myfunction, 0);
+ * 	rt_event_start(&myevent, 100, 0);
+ * calls myfunction(&myevent) from rt_do() in 1 s.
+ *
+ *******************************/
+
+// Private functions, interrupts off
+static void rt_wheel_insert(rt_event* event, uint16_t expires)
+{
+	rt_event** slot=&rt_wheel[expires & RT_WHEEL_MASK];
+
+	event->expires=expires;
+	event->prev=0;
+	event->next=*slot;
+	if(*slot) (*slot)->prev=event;
+	*slot=event;
+	event->state=RT_EVENT_ARMED;
+}
+
+static void rt_wheel_remove(rt_event* event)
+{
+	if(event->prev) event->prev->next=event->next;
+	else rt_wheel[event->expires & RT_WHEEL_MASK]=event->next;
+	if(event->next) event->next->prev=event->prev;
+	event->state=RT_EVENT_IDLE;
+}
+
+// the pending list is short, rt_do() empties it every main loop pass
+static void rt_pending_remove(rt_event* event)
+{
+	rt_event* e=rt_pending;
+	rt_event* before=0;
+
+	while(e!=event)
+	{
+		before=e;
+		e=e->next;
+	}
+	if(before) before->next=event->next;
+	else rt_pending=event->next;
+	if(rt_pending_last==event) rt_pending_last=before;
+	event->state=RT_EVENT_IDLE;
+}
+
+void rt_event_init(rt_event* event, rt_event_function function, uint8_t flags)
+{
+	event->function=function;
+	event->flags=flags;
+	event->period=0;
+	event->state=RT_EVENT_IDLE;
+}
+
+// ticks from now, 0 counts as 1. period 0 for a one-shot.
+void rt_event_start(rt_event* event, uint16_t ticks, uint16_t period)
+{
+	uint8_t sreg=SREG;
+
+	cli();
+	if(event->state==RT_EVENT_ARMED) rt_wheel_remove(event);
+	else if(event->state==RT_EVENT_PENDING) rt_pending_remove(event);
+	event->period=period;
+	rt_wheel_insert(event, rt_wheel_now+(ticks ? ticks : 1));
+	SREG=sreg;
+}
+
+void rt_event_cancel(rt_event* event)
+{
+	uint8_t sreg=SREG;
+
+	cli();
+	if(event->state==RT_EVENT_ARMED) rt_wheel_remove(event);
+	else if(event->state==RT_EVENT_PENDING) rt_pending_remove(event);
+	SREG=sreg;
+}
+
+bool rt_event_armed(rt_event* event)
+{
+	return event->state!=RT_EVENT_IDLE;
+}
+
+/********************************
+ *
+ * Main loop part, runs the events that came due
+ * A periodic one is started again for its next period, from the tick it was due,
+ * or from now if the main loop is that late.
+ *
+ *******************************/
+void rt_do()
+{
+	rt_event* event;
+	uint16_t expires;
+	uint8_t sreg;
+
+	while(1)
+	{
+		sreg=SREG;
+		cli();
+		event=rt_pending;
+		if(!event)
+		{
+			SREG=sreg;
+			return;
+		}
+		rt_pending=event->next;
+		if(!rt_pending) rt_pending_last=0;
+		event->state=RT_EVENT_IDLE;
+		if(event->period)
+		{
+			expires=event->expires+event->period;
+			if((int16_t)(expires-rt_wheel_now)<=0) expires=rt_wheel_now+1;
+			rt_wheel_insert(event, expires);
+		}
+		SREG=sreg;
+		event->function(event);
+	}
 }
 
 /******************************************
@@ -153,6 +299,24 @@ bool rt_remove_function(void(*afunction)())
 	return FALSE;
 }
 
+/******************************************
+ *
+ * rt_count1, read atomically
+ * For timeouts outside of the interrupts:
+ * 	uint16_t start=rt_ticks();
+ * 	while((uint16_t)(rt_ticks()-start)<timeout) ...
+ *
+ * ***************************************/
+uint16_t rt_ticks()
+{
+	uint8_t sreg=SREG;
+	uint16_t ticks;
+	cli();
+	ticks=rt_count1;
+	SREG=sreg;
+	return ticks;
+}
+
 /***********************************************************
  *
  * Calls registered background tasks
@@ -183,6 +347,59 @@ inline static void realtime_do()
 	}
 }
 
+/***********************************************************
+ *
+ * Decrements the count-down timers, and fires the events due this tick.
+ * The main loop ones go to the pending list for rt_do().
+ * Every registered timer is looked at, idle or not: that cost stays with rt_add_timer().
+ *
+ ***********************************************************/
+inline static void rt_tick()
+{
+	uint8_t i;
+	rt_timer* timerpointer;
+	rt_event* event;
+	rt_event** slot;
+	uint16_t now;
+
+	// iterate on all timer pointers, decrement the non zero ones
+	for (i=0; i<rt_timer_count; i++)
+	{
+		timerpointer=rt_timer_array[i];
+		if (*timerpointer) (*timerpointer)--;
+	}
+
+	now=++rt_wheel_now;
+	slot=&rt_wheel[now & RT_WHEEL_MASK];
+	event=*slot;
+	while(event)
+	{
+		// the others in this slot are due a turn of the wheel later, or more
+		if(event->expires!=now)
+		{
+			event=event->next;
+			continue;
+		}
+		rt_wheel_remove(event);
+		if(event->flags & RT_EVENT_ISR)
+		{
+			// started again before the call, so the callback can cancel it
+			if(event->period) rt_wheel_insert(event, now+event->period);
+			event->function(event);
+		}
+		else
+		{
+			event->next=0;
+			if(rt_pending_last) rt_pending_last->next=event;
+			else rt_pending=event;
+			rt_pending_last=event;
+			event->state=RT_EVENT_PENDING;
+		}
+		// the callback may have changed the slot, look again from the start
+		event=*slot;
+	}
+}
+
 inline static void increment_time()
 {
 	seconds ++;
@@ -390,18 +607,8 @@ ISR(TIMER0_COMP_vect, ISR_NOBLOCK)	// clear on compare mode - 32 interrupts/s
 	if(rt_ctrlegtimer) rt_ctrlegtimer--;
 	if(rt_blinktimer) rt_blinktimer--;
 
-	// iterate on all timer pointers, decrement the non zero ones
-	uint8_t i;
-	rt_timer* timerpointer;
-	for (i=0; i<RT_MAX_TIMERS; i++)
-	{
-		if(rt_timer_array[i])	// if non zero, it points to a registered timer
-		{
-			// decrement it until it reaches zero
-			timerpointer=rt_timer_array[i];
-			if (!*timerpointer) (*timerpointer)--;
-		}
-	}
+	// registered timers and timer wheel
+	rt_tick();
 
 
 	// do not modify the following, used for real time clock
@@ -419,18 +626,46 @@ ISR(TIMER0_COMP_vect, ISR_NOBLOCK)	// clear on compare mode - 32 interrupts/s
 }
 
 #else
+/*******************************************************
+ * Timestamp for measuring short intervals, 16 us resolution.
+ * Counts each compare period as 208 counts (one in three is 209, the
+ * error is 1 count in 625). The result wraps around, 65536*208 being a
+ * multiple of 65536: differences are right up to 1.05 s.
+ ********************************************************/
+uint16_t rt_timestamp()
+{
+	uint8_t sreg=SREG;
+	uint16_t compares;
+	uint8_t count;
+
+	cli();
+	compares=rt_compares;
+	count=TCNT0;
+	if(bit_is_set(TIFR0, OCF0A))	// counter cleared, interrupt not serviced yet
+	{
+		compares++;
+		count=TCNT0;
+	}
+	SREG=sreg;
+	return compares*208+count;
+}
+
 // code for ATmega168 with 16 MHz crystal, 3 interrupts for 1/100 update intervals
 // Two counts to 208 and one count to 209 lasts 0.01 sec.
 ISR(TIMER0_COMPA_vect)
 {
+	ISRPROF_ENTER(TCNT0*ISRPROF_T0_TICKS);
 	static uint8_t countseconds=0;
 	static uint8_t counter_phase=0;
 
+	rt_compares++;
+
 	// first count twice to 208
 	if(counter_phase<=1)
 	{
 		OCR0A=207;
 		counter_phase++;
+		ISRPROF_EXIT(ISRPROF_T0COMPA);
 		return;
 	}
 	// 3rd time count to 209
@@ -443,18 +678,8 @@ ISR(TIMER0_COMPA_vect)
 		rt_count1++;
 		rt_count2++;
 
-		// iterate on all timer pointers, decrement the non zero ones
-		uint8_t i;
-		rt_timer* timerpointer;
-		for (i=0; i<RT_MAX_TIMERS; i++)
-		{
-			if(rt_timer_array[i])	// if non zero, it points to a registered timer
-			{
-				// decrement it until it reaches zero
-				timerpointer=rt_timer_array[i];
-				if (*timerpointer) (*timerpointer)--;
-			}
-		}
+		// registered timers and timer wheel
+		rt_tick();
 
 		// do not modify the following, used for real time clock
 		hundreds++;
@@ -471,6 +696,7 @@ ISR(TIMER0_COMPA_vect)
 		// add your short real time tasks here
 		realtime_do();
 	}
+	ISRPROF_EXIT(ISRPROF_T0COMPA);
 }
 #endif
 
@@ -33,15 +33,42 @@
 #define RT_MAX_TIMERS 10
 #define RT_MAX_FUNCTIONS 3
 
+// timer wheel slots, power of 2. An event is looked at once every RT_WHEEL_SLOTS ticks
+// until it is due, events further away than that cost a look per turn of the wheel.
+#define RT_WHEEL_SLOTS 32
+
 // a timer is a volatile 16 bit integer
 typedef volatile uint16_t rt_timer;
 // a realtime function takes void and return void
 typedef void(*rt_do_function)();
 
+// an event is a callback due after a number of ticks, once or every period
+typedef struct rt_event rt_event;
+typedef void(*rt_event_function)(rt_event* event);
+struct rt_event
+{
+	rt_event* next;					// wheel slot list, or the list of events waiting for rt_do()
+	rt_event* prev;
+	uint16_t expires;				// tick it is due
+	uint16_t period;				// 0 for a one-shot
+	rt_event_function function;
+	uint8_t flags;
+	uint8_t state;
+};
+
+// event flags
+#define RT_EVENT_ISR		0x01	// called from the interrupt, else from rt_do() in the main loop
+// event states
+#define RT_EVENT_IDLE		0
+#define RT_EVENT_ARMED		1		// in the wheel
+#define RT_EVENT_PENDING	2		// due, waiting for rt_do()
+
 // global counters, use them in other files by declaring them as 'extern' variables
 // regular counters get incremented every 1/100 (1/32) of a second
 // timeout counters get decremented every 1/100 (1/32) of a second until they reach 0 and stay at 0
 // rt_seconds get incremented every second
+// They change in the interrupt and multibyte reads from the main loop can tear:
+// use rt_ticks() below, or the 32 bit millis() of clock.h for time keeping.
 extern volatile uint16_t rt_count1;			// counts up to 65536/COUNTS_PER_SECOND (10 min)
 extern volatile uint16_t rt_count2;			// counts up to 65536/COUNTS_PER_SECOND (10 min)
 
@@ -53,6 +80,17 @@ extern volatile uint8_t hours;				// clock hours
 
 void realtime_init();
 
+// rt_count1 read atomically, for timeouts
+uint16_t rt_ticks();
+
+#if !defined (_USE_32KHZ_)
+// timestamps, in Timer0 counts of 16 us since start. They wrap every 1.05 s:
+// only use them for differences, taken as uint16_t
+#define RT_TIMESTAMP_US		16			// microseconds per count
+#define RT_TIMESTAMP_TICK	625			// counts per 1/100 s tick
+uint16_t rt_timestamp();
+#endif
+
 // to add a timer
 // declare it like this as a global
 // 		rt_timer mytimer;	// declaration as global, needs to be persistent
@@ -64,11 +102,32 @@ void realtime_init();
 // 		if(mytimer==0) 	{ do something, timer has expired }
 //		if(mytimer) 	{ do something, timer has not expired }
 
+// These count-down timers are the v3.7 interface and keep its cost: the tick looks at every
+// registered one, at 0 or not, a few cycles each. They are plain variables the caller sets,
+// the tick can't know when one is started, so they are not backed by wheel events.
+// New code should use the events below, which cost nothing while idle.
 bool rt_add_timer(rt_timer *atimer);
 // to remove a timer
 bool rt_remove_timer(rt_timer *atimer);
 // to add a real time callback function (should be a void function returning void)
 bool rt_add_function(void(*function)());
+// to remove it
+bool rt_remove_function(void(*function)());
+
+// Events. Declare one as a global, set it up once, then start it as often as needed:
+// 		rt_event myevent;
+// 		rt_event_init(&myevent, myfunction, 0);
+//		rt_event_start(&myevent, 2*COUNT_PER_SECOND, 0);	// myfunction(&myevent) in 2 s
+// Starting and cancelling are O(1), an idle event costs nothing at tick time.
+// A periodic event (period not 0) goes on until cancelled. Without RT_EVENT_ISR, the
+// callback runs from rt_do() in the main loop, so it can take its time; with it, it runs
+// in the timer interrupt, where it must be short.
+// A callback can start or cancel any event, its own included.
+void rt_event_init(rt_event* event, rt_event_function function, uint8_t flags);
+void rt_event_start(rt_event* event, uint16_t ticks, uint16_t period);	// restarts it if armed
+void rt_event_cancel(rt_event* event);
+bool rt_event_armed(rt_event* event);	// armed or waiting for rt_do()
+void rt_do();							// call from the main loop, runs the due events
 
 
 
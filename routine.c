@@ -0,0 +1,211 @@
+/*
+ * routine.c
+ * Routines: the :SExx panel sequences with their effects, see routine.h
+ *
+ */
+
+#include "routine.h"
+#include "clock.h"
+#include "realtime.h"
+#include "sequencer.h"
+#include "serial.h"
+#include "suart.h"
+#include "toolbox.h"
+#include "latency.h"			// command latency statistics, when enabled
+
+static const routine_action_t* routine_next;	// next action, 0 when idle
+static const routine_action_t* routine_then;	// list to run after this one
+static const routine_action_t* routine_end;		// end list of the running sequence
+static volatile uint8_t routine_ended;			// the sequence ended, set by the sequencer
+static uint32_t routine_start_ms;				// millis() the running list started at
+static uint8_t routine_number;
+static uint8_t routine_flags;
+#ifdef _LATENCY_STATS_
+static uint8_t routine_waited;					// the next action had to wait for its time
+#endif
+
+#define ROUTINE_TICK_MS		10					// action times are in 1/100 s
+
+// sequence completion callback, may run in the realtime interrupt: only flag it for routine_do()
+static void routine_seq_done()
+{
+	seq_remove_completion_callback();	// one shot
+	routine_ended=TRUE;
+}
+
+static void routine_run(const routine_action_t* a)
+{
+	latency_action();
+	switch(a->action)
+	{
+		case RA_START:
+			if(routine_flags & RT_SLAVE) StartSlaveSequence(routine_number);	// These need to stay in Sync!
+			seq_startsequence();
+			break;
+		case RA_RESET_SPEED:		seq_resetspeed(); break;
+		case RA_PANELS_OFF:			stop_command(0); break;
+		case RA_PANEL_RC:			rc_command(a->argument); break;
+
+		case RA_SOUND_SCREAM:		SoundScream(); break;
+		case RA_SOUND_WAVE:			SoundWave(); break;
+		case RA_SOUND_FAST_WAVE:	SoundFastWave(); break;
+		case RA_SOUND_OPEN_WAVE:	SoundOpenWave(); break;
+		case RA_SOUND_BEEP_CANTINA:	SoundBeepCantina(); break;
+		case RA_SOUND_FAINT:		SoundFaint(); break;
+		case RA_SOUND_CANTINA:		SoundCantina(); break;
+		case RA_SOUND_LEIA:			SoundLeia(); break;
+		case RA_SOUND_DISCO:		SoundDisco(); break;
+		case RA_SOUND_RANDOM:		SoundRandom(); break;
+		case RA_SOUND_STOP:			SoundStop(); break;
+
+		case RA_HP_OFF:				HPOff(); break;
+		case RA_HP_ON:				HPOn(); break;
+		case RA_HP_STOP:			HPStop(); break;
+		case RA_HP_RANDOM:			HPRandom(); break;
+		case RA_HP_FLICKER:			HPFlicker(a->argument); break;
+		case RA_HP1_FLICKER:		HP1Flicker(a->argument); break;
+		case RA_HP_FLASH:			HPFlash(a->argument); break;
+		case RA_HP1_RC:				HP1RC(); break;
+
+		case RA_DISPLAY_NORMAL:		DisplayNormal(); break;
+		case RA_DISPLAY_SCREAM:		DisplayScream(); break;
+		case RA_DISPLAY_FLASH:		DisplayFlash(); break;
+		case RA_DISPLAY_WAIT:		DisplayWait(a->argument); break;
+		case RA_DISPLAY_SPECTRUM:	DisplaySpectrum(); break;
+		case RA_DISPLAY_SHORT_CIRCUIT:	DisplayShortCircuit(); break;
+		case RA_DISPLAY_LEIA:		DisplayLeia(); break;
+		case RA_JEDI_DIGITAL:		JEDIDigital(a->argument); break;
+		case RA_RLD_STAR_WARS:		RLDSetMessage("STAR WARS   "); break;
+		case RA_RLD_TEXT:			RLDDisplayMessage(); break;
+
+		case RA_MAGIC_FLICKER:		MagicFlicker(a->argument); break;
+		case RA_MAGIC_VU:			MagicPanelVU(); break;
+		case RA_MAGIC_CYLON:		MagicPanelCylonH(); break;
+		case RA_MAGIC_OFF:			MagicPanelOff(); break;
+
+		case RA_EXT1_ON:			EXT1On(a->argument); break;
+		default: break;
+	}
+}
+
+// runs the actions that are due
+// Each is due on the millis() clock, its time after the start of its list: it never
+// runs before, and waiting for one action doesn't push back the next ones.
+// Never waits on the suart queues: when they are nearly full, the action is left
+// for the next call
+void routine_do()
+{
+	routine_action_t action;
+	uint32_t due;
+
+	// the sequence ended on its own or was stopped by a panel command
+	if(routine_ended)
+	{
+		routine_ended=FALSE;
+		if(routine_end)
+		{
+			if(!routine_next)
+			{
+				routine_next=routine_end;
+				routine_start_ms=millis();
+#ifdef _LATENCY_STATS_
+				routine_waited=FALSE;
+#endif
+			}
+			else if(!routine_then) routine_then=routine_end;
+			routine_end=0;
+		}
+	}
+
+	while(routine_next)
+	{
+		memcpy_P(&action, routine_next, sizeof(action));
+		if(action.action==RA_END)
+		{
+			routine_next=routine_then;
+			routine_then=0;
+			routine_start_ms=millis();
+			continue;
+		}
+		due=routine_start_ms+(uint32_t)action.time*ROUTINE_TICK_MS;
+		if((int32_t)(millis()-due)<0)
+		{
+#ifdef _LATENCY_STATS_
+			routine_waited=TRUE;
+#endif
+			break;
+		}
+		if(suart_tx_free()<ROUTINE_TX_ROOM || suart2_tx_free()<ROUTINE_TX_ROOM) break;
+#ifdef _LATENCY_STATS_
+		if(routine_waited)
+		{
+			// in timestamp counts, on micros() which is millis() to the us
+			int32_t late=(int32_t)(micros()-due*1000)/RT_TIMESTAMP_US;
+			latency_late(late>INT16_MAX ? INT16_MAX : late);
+			routine_waited=FALSE;
+		}
+#endif
+		routine_next++;
+		routine_run(&action);
+	}
+}
+
+uint8_t routine_start(uint8_t number)
+{
+	routine_t r;
+	uint8_t i;
+
+	for(i=0; i<routine_table_size; i++)
+	{
+		memcpy_P(&r, &routine_table[i], sizeof(routine_t));
+		if(r.number==number) break;
+	}
+	if(i==routine_table_size) return FALSE;
+
+	if(r.flags & RT_STOP) seq_stopsequence();	// abort any previous sequence immediately
+
+	// the previous routine's end actions go first, then ours
+	if(routine_ended && routine_end)
+	{
+		routine_next=routine_end;
+		routine_then=r.actions;
+	}
+	else
+	{
+		routine_next=r.actions;
+		routine_then=0;
+	}
+	routine_ended=FALSE;
+	routine_start_ms=millis();
+#ifdef _LATENCY_STATS_
+	routine_waited=FALSE;
+#endif
+	routine_number=number;
+	routine_flags=r.flags;
+
+	if(r.panels)
+	{
+#ifdef _COMPACT_SEQUENCES_
+		seq_loadcompact(r.panels);
+#else
+		seq_loadsequence(r.panels, r.panels_length);
+#endif
+		if(r.speed) seq_loadspeed(r.speed);
+		else seq_resetspeed();
+	}
+
+	// a routine that leaves the running sequence alone leaves its end actions too
+	if(r.flags & RT_STOP)
+	{
+		routine_end=r.end;
+		if(r.end) seq_add_completion_callback(routine_seq_done);
+		else seq_remove_completion_callback();
+	}
+
+#if _FEEDBACK_MSG_ == 1
+	serial_puts_p(r.name);		// debug console feedback
+#endif
+
+	routine_do();				// what runs at time 0 runs now
+	return TRUE;
+}
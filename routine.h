@@ -0,0 +1,119 @@
+/*
+ * routine.h
+ * Routines: the :SExx panel sequences with their sound, display and holo effects
+ *
+ * A routine is one entry of routine_table[] (panel_routines.h), in program memory:
+ * - the panel sequence and the speed array to run it with
+ * - a list of actions, each with the time it runs at, in 1/100s from the routine start
+ * - optionally a list of actions to run when the panel sequence ends or is stopped,
+ *   typically to put the displays back to normal
+ *
+ * 	routine_action_t const routine_scream[] PROGMEM =
+ * 	{
+ * 		// time	action				argument
+ * 		{0,		RA_SOUND_SCREAM},
+ * 		{0,		RA_DISPLAY_SCREAM},
+ * 		{10,	RA_MAGIC_FLICKER,	4},		// give the JEDI 100ms to take the display command
+ * 		{15,	RA_START},					// start the slave and the panels
+ * 		{0,		RA_END}
+ * 	};
+ *
+ * Actions run from the main loop through routine_do(), due on the millis() clock,
+ * so the gaps the JEDI and magic panel need between commands don't block the main
+ * loop any more, and are never shorter than in the table. Actions at the same time
+ * run in table order.
+ *
+ * Starting a routine aborts the previous one: its remaining actions are dropped,
+ * its end actions (if it had a panel sequence still running) run first.
+ *
+ */
+
+#ifndef ROUTINE_H_
+#define ROUTINE_H_
+
+#include "hal.h"
+#include "main.h"		// for the _FEEDBACK_MSG_ compile flag
+
+// routine actions
+#define RA_END					0	// end of the list
+#define RA_START				1	// start the slave sequence (if RT_SLAVE) and the panel sequence
+#define RA_RESET_SPEED			2	// panel sequence back to full speed
+#define RA_PANELS_OFF			3	// all panels off RC and servos off (:ST00)
+#define RA_PANEL_RC				4	// panel <argument> to RC (:RCxx)
+#define RA_SOUND_SCREAM			10
+#define RA_SOUND_WAVE			11
+#define RA_SOUND_FAST_WAVE		12
+#define RA_SOUND_OPEN_WAVE		13
+#define RA_SOUND_BEEP_CANTINA	14
+#define RA_SOUND_FAINT			15
+#define RA_SOUND_CANTINA		16
+#define RA_SOUND_LEIA			17
+#define RA_SOUND_DISCO			18
+#define RA_SOUND_RANDOM			19
+#define RA_SOUND_STOP			20
+#define RA_HP_OFF				30
+#define RA_HP_ON				31
+#define RA_HP_STOP				32
+#define RA_HP_RANDOM			33
+#define RA_HP_FLICKER			34	// all HPs flicker for <argument> seconds
+#define RA_HP1_FLICKER			35	// front HP flicker for <argument> seconds
+#define RA_HP_FLASH				36	// all HPs flash for <argument> seconds
+#define RA_HP1_RC				37
+#define RA_DISPLAY_NORMAL		40
+#define RA_DISPLAY_SCREAM		41
+#define RA_DISPLAY_FLASH		42
+#define RA_DISPLAY_WAIT			43	// current display mode for <argument> seconds
+#define RA_DISPLAY_SPECTRUM		44
+#define RA_DISPLAY_SHORT_CIRCUIT	45
+#define RA_DISPLAY_LEIA			46
+#define RA_JEDI_DIGITAL			47	// JEDI device <argument> to digital output, _DIGITALJEDI_ only
+#define RA_RLD_STAR_WARS		48	// "STAR WARS" message on the rear logic
+#define RA_RLD_TEXT				49	// rear logic in text mode
+#define RA_MAGIC_FLICKER		50	// magic panel flicker for <argument> seconds
+#define RA_MAGIC_VU				51
+#define RA_MAGIC_CYLON			52
+#define RA_MAGIC_OFF			53
+#define RA_EXT1_ON				60	// client EXT1 pin on for <argument> seconds
+
+// suart queue space an action needs to run without waiting, the longest is the RLD message
+#define ROUTINE_TX_ROOM		16
+
+// routine flags
+#define RT_STOP		0x01	// abort the running panel sequence
+#define RT_SLAVE	0x02	// RA_START also starts the same sequence on the slave
+
+typedef struct
+{
+	uint8_t time;		// 1/100s from the start of the list
+	uint8_t action;		// RA_xxx
+	uint8_t argument;
+} routine_action_t;
+
+typedef struct
+{
+	uint8_t number;						// :SExx number
+	uint8_t flags;						// RT_xxx
+	const void* panels;					// panel sequence, see PANEL_REF in panel_sequences.h, 0 for none
+	uint8_t panels_length;				// rows of a table sequence
+	int16_t* speed;						// speed array, 0 for full speed
+	const routine_action_t* actions;
+	const routine_action_t* end;		// when the panel sequence ends or is stopped, 0 for none
+#if _FEEDBACK_MSG_ == 1
+	const char* name;					// console feedback
+#endif
+} routine_t;
+
+#if _FEEDBACK_MSG_ == 1
+#define ROUTINE_NAME(name) , name
+#else
+#define ROUTINE_NAME(name)
+#endif
+
+// defined with the routines in panel_routines.h
+extern const routine_t routine_table[];
+extern const uint8_t routine_table_size;
+
+uint8_t routine_start(uint8_t number);	// returns FALSE if there is no such routine
+void routine_do();						// call from the main loop
+
+#endif /* ROUTINE_H_ */
@@ -11,85 +11,215 @@
  *  	Added Ability to select a range of servos to be acted on
  *  	Added Partial Panel opening
  *  	Added 13 panel support
+ *
+ *  	Added per row motion profiles (ease in/out, trapezoid, S-curve)
+ *  	Moves are planned once per row, the real time routine only runs the active ones
+ *  	Sequencer tracks: independent sequences running at the same time on different servos
+ *  	Compact sequences, decoded row by row from program memory
+ *  	Steps and moves timed in ms on the millis() clock, positions computed for each servo frame
  */
 
-#include <avr/pgmspace.h> // for reading the sequences from program memory
+#include "hal.h" // for reading the sequences from program memory
 #include "sequencer.h"
 #include "realtime.h"
+#include "clock.h"
 #include "servo.h"
 
 // sequencer global variables
 volatile int16_t seq_current[SERVO_NUM];				// current servo position array
 volatile int16_t seq_goal[SERVO_NUM];					// end goal servo position array
-rt_timer seq_timeout;									// timer until end of current sequence step
-void(*seq_completion_callback)();								// callback function when sequence ends
-
 
-// local variables
-static int16_t servo_speed[SERVO_NUM];
-static uint8_t sequence_step;
-static uint8_t sequence_started;
-static int16_t const (*sequence_array)[SERVO_NUM+SEQUENCE_PARAMETERS]; 	// sequence_array is a pointer to an array of int16_t
-														// this pointer should point to program memory
-														// we don't copy the array, just equate to the pointer passed
-static uint8_t sequence_length;
 
-// initialize by registering our real time callback and our timer
+// Sequencer tracks
+// Each track runs its own sequence with its own step due time and completion callback.
+// A track owns the servos its sequence uses (mask). Starting a track takes its servos away
+// from the other tracks, a track left with no servo stops.
+// Track 0 is the one used by the original single sequence functions.
+typedef struct
+{
+	int16_t const (*array)[SERVO_NUM+SEQUENCE_PARAMETERS];	// points to the sequence in program memory
+															// we don't copy the array, just equate to the pointer passed
+	const uint8_t* rows;		// or, for a compact sequence, its first row in program memory
+	const uint8_t* row;			// and the next row to decode
+	const uint8_t* codes;		// and its position dictionary
+	uint8_t length;
+	uint8_t step;
+	uint8_t started;			// SEQ_RUNNING, or SEQ_WAITING for seq_release_start()
+	uint16_t servos;			// servos used by the sequence
+	uint16_t mask;				// servos owned while running
+	int16_t* speed;				// speed array, 0 for no speed limit
+	uint32_t due;				// millis() the next step is due
+	void(*callback)();			// callback function when sequence ends
+} seq_track_t;
+
+static seq_track_t seq_tracks[SEQ_TRACKS];
+static uint8_t seq_deferred;	// tracks started now wait for seq_release_start()
+
+#define SEQ_RUNNING	1
+#define SEQ_WAITING	2
+
+// Move plans, one per servo, computed when a row sets a new goal (seq_planmove)
+// so that the frame routine does no division and no program memory read but the curve table.
+// Moves are timed in ms on the millis() clock from the time their row was due, not from the
+// tick that got to it, and seq_domotion() computes the positions for the time of each servo
+// frame: they are no longer rounded to the 1/100 s tick. The phase of a move is its elapsed
+// fraction in 0.16 fixed point, elapsed ms times rate. Linear moves go along it, shaped
+// moves look the position up on their curve. Once time is over, the servo lands on its goal.
+typedef struct
+{
+	int16_t from;			// start position
+	int16_t distance;		// goal-from
+	int16_t speed;			// max speed it was planned with
+	uint16_t start;			// millis() it starts at, low 16 bits
+	uint16_t time;			// ms it lasts, 0 to jump to the goal
+	uint32_t rate;			// phase per ms, 0.24 fixed point
+	uint8_t profile;		// curve table index, SEQ_PLAN_LINEAR for linear moves
+} seq_plan_t;
+
+#define SEQ_PLAN_LINEAR 0xFF
+#define SEQ_TICK_MS		10		// sequence times and speeds are in 1/100 s
+#define SEQ_MOVE_MAX_MS	30000	// longest move, times are taken as int16_t
+
+static seq_plan_t seq_plan[SERVO_NUM];
+static uint16_t seq_active;	// bit i set: servo i+1 has a move in progress
+static uint16_t seq_time;	// millis() the moves planned now start at
+
+static uint16_t seq_setservopos(seq_track_t* track, uint8_t step);
+static uint16_t seq_compactrow(seq_track_t* track, const uint8_t** row, uint8_t apply);
+static void seq_track_end(seq_track_t* track);
+static void seq_take_servos(uint16_t mask, seq_track_t* except);
+
+// Profile curves, position fraction (0..65535) at 33 evenly spaced times, interpolated linearly in between
+// _EASE:	(1-cos(pi*t))/2
+// _TRAP:	constant acceleration on t<1/4 and t>3/4, constant speed in between
+// _SCRV:	6t^5-15t^4+10t^3
+#define SEQ_LUT_BITS	5
+#define SEQ_LUT_SHIFT	(16-SEQ_LUT_BITS)
+static const uint16_t seq_profile_lut[SEQ_PROFILE_NUM-1][(1<<SEQ_LUT_BITS)+1] PROGMEM =
+{
+	{0, 158, 630, 1411, 2494, 3869, 5522, 7438, 9597, 11980, 14563, 17321, 20228, 23256, 26375, 29556, 32767,
+	35979, 39160, 42279, 45307, 48214, 50972, 53555, 55938, 58097, 60013, 61666, 63041, 64124, 64905, 65377, 65535},
+	{0, 171, 683, 1536, 2731, 4267, 6144, 8363, 10922, 13653, 16384, 19114, 21845, 24576, 27306, 30037, 32768,
+	35498, 38229, 40959, 43690, 46421, 49151, 51882, 54612, 57172, 59391, 61268, 62804, 63999, 64852, 65364, 65535},
+	{0, 19, 145, 467, 1052, 1951, 3196, 4806, 6784, 9121, 11797, 14781, 18036, 21515, 25167, 28938, 32768,
+	36597, 40368, 44020, 47499, 50754, 53738, 56414, 58751, 60729, 62339, 63584, 64483, 65068, 65390, 65516, 65535},
+};
+
+// initialize by registering our real time and servo frame callbacks
 void seq_init()
 {
 	rt_add_function(seq_dosequence);
-	rt_add_timer(&seq_timeout);
+	servo_add_frame_callback(seq_domotion);
 }
 
 // pass a void function(void) to this, and it will be called at the end of the sequence
-void seq_add_completion_callback(void(*usercallback)())
+void seq_track_add_completion_callback(uint8_t t, void(*usercallback)())
 {
-	seq_completion_callback=usercallback;
+	if(t<SEQ_TRACKS) seq_tracks[t].callback=usercallback;
 }
 
-void seq_remove_completion_callback()
+void seq_track_remove_completion_callback(uint8_t t)
 {
-	seq_completion_callback=0;
+	if(t<SEQ_TRACKS) seq_tracks[t].callback=0;
 }
 
 // servo speed control functions
-void seq_loadspeed(speed_t speedarray)
+// the speed array is not copied, it must stay in place while the sequence runs
+void seq_track_loadspeed(uint8_t t, speed_t speedarray)
 {
-	uint8_t i;
-	for(i=0; i<SERVO_NUM; i++ )
-	{
-		servo_speed[i]=speedarray[i];
-	}
+	if(t<SEQ_TRACKS) seq_tracks[t].speed=speedarray;
 }
 
-void seq_resetspeed()
+void seq_track_resetspeed(uint8_t t)
 {
-	uint8_t i;
-	for(i=0; i<SERVO_NUM; i++ )
-	{
-		servo_speed[i]=0;
-	}
+	if(t<SEQ_TRACKS) seq_tracks[t].speed=0;
 }
 
 // call this first to load the sequence array
-void seq_loadsequence(int16_t const array[][SERVO_NUM+SEQUENCE_PARAMETERS], uint8_t length)
+void seq_track_loadsequence(uint8_t t, int16_t const array[][SERVO_NUM+SEQUENCE_PARAMETERS], uint8_t length)
 {
+	seq_track_t* track=&seq_tracks[t];
+	uint8_t step, i, first, last;
+	uint16_t servos=0;
+
+	if(t>=SEQ_TRACKS) return;
+
 	// stop previous sequence right away before changing pointer array
-	sequence_started=0;	// that will stop the sequence interrupts calls
-	sequence_step=0;	// restart at step one
+	track->started=0;	// that will stop the sequence interrupts calls
+	track->step=0;		// restart at step one
 
 	// point to the new sequence array and store it's length
-	sequence_array=array;
-	sequence_length=length;
+	track->array=array;
+	track->rows=0;
+	track->length=length;
+
+	// collect the servos used by the sequence from the first/last columns
+	for(step=0; step<length; step++)
+	{
+		first=pgm_read_word(&(array[step][START_SERVO_PARAM]));
+		last=pgm_read_word(&(array[step][END_SERVO_PARAM]));
+		if(last>SERVO_NUM) last=SERVO_NUM;
+		for(i=first; i>0 && i<=last; i++) servos|=SEQ_SERVO_BIT(i);
+	}
+	track->servos=servos;
+}
+
+// same for a compact sequence (see sequencer.h), made by tools/seqconv.c
+void seq_track_loadcompact(uint8_t t, const uint8_t* sequence)
+{
+	seq_track_t* track=&seq_tracks[t];
+	const uint8_t* row;
+	uint8_t step;
+	uint16_t servos=0;
+
+	if(t>=SEQ_TRACKS) return;
+
+	track->started=0;
+	track->step=0;
+	track->array=0;
+	track->length=pgm_read_byte(sequence);
+	track->codes=sequence+2;
+	track->rows=track->codes+2*pgm_read_byte(sequence+1);
+	track->row=track->rows;
+
+	// the servos used are all those any row changes
+	row=track->rows;
+	for(step=0; step<track->length; step++) servos|=seq_compactrow(track, &row, 0);
+	track->servos=servos;
+}
+
+// back to the first row
+static void seq_rewind(seq_track_t* track)
+{
+	track->step=0;
+	track->row=track->rows;
+}
+
+// call this second to execute the sequence from the beginning
+void seq_track_startsequence(uint8_t t)
+{
+	if(t>=SEQ_TRACKS) return;
+	seq_rewind(&seq_tracks[t]);
+	seq_track_restartsequence(t);
+}
 
-	// init the servo current position at step 0;
+// this will restart the sequence from the point where it was stopped
+// The track takes its servos from the other tracks.
+void seq_track_restartsequence(uint8_t t)
+{
+	seq_track_t* track=&seq_tracks[t];
 	uint8_t i;
+
+	if(t>=SEQ_TRACKS || !(track->array || track->rows)) return;
+
+	seq_take_servos(track->servos, track);
+
+	uint8_t sreg=SREG;
+	cli();
 	for (i=1; i<=SERVO_NUM; i++)
 	{
-		/***** start with current position = first step **/
-		//seq_current[i-1]= pgm_read_word(&(array[0][i]));
-
-		// better: we should start from where the real position of the servos are,
+		if(!(track->servos & SEQ_SERVO_BIT(i))) continue;
+		// we start from where the real position of the servos are,
 		// so if there is a servo speed limit they continue smoothly from there.
 		// If the servos were not on (SERVO_NO_PULSE), they'll jump to the start position
 		// regardless of servo speed settings.
@@ -97,35 +227,109 @@ void seq_loadsequence(int16_t const array[][SERVO_NUM+SEQUENCE_PARAMETERS], uint
 		// Also equate goals to current so we start from steady state
 		seq_goal[i-1]=seq_current[i-1];
 	}
+	track->mask=track->servos;
+	track->started=seq_deferred ? SEQ_WAITING : SEQ_RUNNING;
+	track->due=millis();
+	SREG=sreg;
 }
 
-// call this second to execute the sequence from the beginning
-void seq_startsequence()
+// Tracks started from now on wait, holding their servos, until seq_release_start()
+void seq_defer_start()
 {
-	sequence_step=0;
-	sequence_started=1;
+	seq_deferred=1;
 }
 
-// this will restart the sequence from the point where it was stopped
-void seq_restartsequence()
+// Starts the waiting tracks together, their first rows run on the same tick
+void seq_release_start()
 {
-	sequence_started=1;
+	uint8_t t;
+	uint32_t now=millis();
+
+	uint8_t sreg=SREG;
+	cli();
+	seq_deferred=0;
+	for(t=0; t<SEQ_TRACKS; t++)
+	{
+		if(seq_tracks[t].started!=SEQ_WAITING) continue;
+		seq_tracks[t].started=SEQ_RUNNING;
+		seq_tracks[t].due=now;
+	}
+	SREG=sreg;
 }
 
 // this will stop the sequencer
-void seq_stopsequence()
+void seq_track_stopsequence(uint8_t t)
 {
-	sequence_started=0;
-	seq_timeout=0;
-	if(seq_completion_callback) seq_completion_callback();
+	if(t>=SEQ_TRACKS) return;
+	seq_track_end(&seq_tracks[t]);
 }
 
 // call this before calling restart to specify a specific step from which to restart
-void seq_jumptostep(uint8_t step)
+// A compact row only holds the servos that changed, so the servos keep their current goals
+// until the rows after the jump move them.
+void seq_track_jumptostep(uint8_t t, uint8_t step)
+{
+	seq_track_t* track=&seq_tracks[t];
+	if(t>=SEQ_TRACKS || step>=track->length) return;
+	seq_rewind(track);
+	if(track->rows)
+	{
+		for(; track->step<step; track->step++) seq_compactrow(track, &track->row, 0);
+	}
+	track->step=step;
+}
+
+uint8_t seq_track_running(uint8_t t)
+{
+	return t<SEQ_TRACKS && seq_tracks[t].started;
+}
+
+// Takes the servos in the mask away from every track but one: moves in progress are dropped
+// and a track left with no servo stops.
+static void seq_take_servos(uint16_t mask, seq_track_t* except)
+{
+	seq_track_t* track;
+	uint8_t t;
+	uint8_t ended=0;
+
+	uint8_t sreg=SREG;
+	cli();
+	seq_active&=~mask;
+	for(t=0; t<SEQ_TRACKS; t++)
+	{
+		track=&seq_tracks[t];
+		if(track==except || !(track->mask & mask)) continue;
+		track->mask&=~mask;
+		if(!track->mask) ended|=(1<<t);
+	}
+	SREG=sreg;
+
+	// completion callbacks run with interrupts on, they may send commands
+	for(t=0; t<SEQ_TRACKS; t++)
+	{
+		if(ended & (1<<t)) seq_track_end(&seq_tracks[t]);
+	}
+}
+
+// Frees the servos in the mask from the sequencer.
+// Call this before driving servos directly with servo_set().
+void seq_release_servos(uint16_t mask)
 {
-	if(step<sequence_length) sequence_step=step;
+	seq_take_servos(mask, 0);
 }
 
+// the original single sequence functions, work on track 0
+void seq_add_completion_callback(void(*usercallback)())	{ seq_track_add_completion_callback(0, usercallback); }
+void seq_remove_completion_callback()					{ seq_track_remove_completion_callback(0); }
+void seq_loadspeed(speed_t speedarray)					{ seq_track_loadspeed(0, speedarray); }
+void seq_resetspeed()									{ seq_track_resetspeed(0); }
+void seq_loadsequence(int16_t const array[][SERVO_NUM+SEQUENCE_PARAMETERS], uint8_t length)	{ seq_track_loadsequence(0, array, length); }
+void seq_startsequence()								{ seq_track_startsequence(0); }
+void seq_restartsequence()								{ seq_track_restartsequence(0); }
+void seq_stopsequence()									{ seq_track_stopsequence(0); }
+void seq_jumptostep(uint8_t step)						{ seq_track_jumptostep(0, step); }
+void seq_loadcompact(const uint8_t* sequence)			{ seq_track_loadcompact(0, sequence); }
+
 // internal functions
 
 /*******old implementation, directly set the position of the servos.
@@ -141,36 +345,211 @@ void seq_setservopos(int16_t array[][SERVO_NUM+1], uint8_t step)
 }
 ******************/
 
+// Plans the move of servo i (0 based) from its current position to its new goal, starting at seq_time.
+// All the divisions happen here, once per row.
+// Speed 0, or a servo waking up from SERVO_NO_PULSE with no known position, jumps to the goal
+// on the next frame. Moves take distance/maxspeed 1/100 s, to the ms, shaped moves as long as
+// the linear move would.
+static void seq_planmove(uint8_t i, uint8_t profile, int16_t maxspeed)
+{
+	seq_plan_t* plan=&seq_plan[i];
+	uint16_t distance;
+	uint32_t time;
+
+	distance=seq_goal[i]>seq_current[i] ? seq_goal[i]-seq_current[i] : seq_current[i]-seq_goal[i];
+	if(distance==0)
+	{
+		seq_active&=~(1<<i);
+		return;
+	}
+
+	if(maxspeed<=0 || seq_current[i]==SERVO_NO_PULSE) time=0;
+	else
+	{
+		time=((uint32_t)distance*SEQ_TICK_MS+maxspeed-1)/maxspeed;
+		if(time>SEQ_MOVE_MAX_MS) time=SEQ_MOVE_MAX_MS;
+	}
+
+	plan->from=seq_current[i];
+	plan->distance=seq_goal[i]-seq_current[i];
+	plan->speed=maxspeed;
+	plan->start=seq_time;
+	plan->time=time;
+	plan->rate=time ? (1UL<<24)/time : 0;	// rounded down, the phase stays below 1 until the end
+	plan->profile=SEQ_PLAN_LINEAR;
+	if(profile!=_LIN && profile<SEQ_PROFILE_NUM) plan->profile=profile-1;
+	seq_active|=(1<<i);
+}
+
+// position of servo i (0 based) on its plan at millis() time at
+static int16_t seq_planpos(uint8_t i, uint16_t at)
+{
+	seq_plan_t* plan=&seq_plan[i];
+	int16_t elapsed=at-plan->start;
+	uint16_t fraction;
+
+	if(elapsed>=(int16_t)plan->time) return seq_goal[i];
+	if(elapsed<=0) return plan->from;
+
+	// below 1<<24 since elapsed<time
+	fraction=((uint32_t)elapsed*plan->rate)>>8;
+	if(plan->profile!=SEQ_PLAN_LINEAR)
+	{
+		const uint16_t* lut=seq_profile_lut[plan->profile];
+		uint8_t index=fraction>>SEQ_LUT_SHIFT;
+		uint16_t low=pgm_read_word(&lut[index]);
+		uint16_t high=pgm_read_word(&lut[index+1]);
+
+		// linear interpolation between table entries, the curves only go up.
+		// In 1/16 of the gap: entries are less than 4096 apart, the product fits
+		// in 16 bits, a 16x8 multiply on the AVR.
+		fraction=low+(((high-low)*(uint8_t)((fraction>>(SEQ_LUT_SHIFT-4))&0x0F))>>4);
+	}
+	return plan->from+(int16_t)(((int32_t)plan->distance*fraction+0x8000)>>16);
+}
+
+// ends a track: its servos stop where they are and are free again
+static void seq_track_end(seq_track_t* track)
+{
+	uint8_t sreg=SREG;
+	cli();
+	seq_active&=~track->mask;
+	track->mask=0;
+	track->started=0;
+	SREG=sreg;
+	if(track->callback) track->callback();
+}
+
+// sets the new goal of servo i (1 based) and plans its move
+static void seq_movegoal(uint8_t i, int16_t position, uint8_t profile, int16_t maxspeed)
+{
+	uint16_t bit=1<<(i-1);
+	seq_plan_t* plan=&seq_plan[i-1];
+
+	if(seq_active & bit)
+	{
+		// the same linear move again goes on as it is, the compact sequences count on it
+		if(position==seq_goal[i-1] && profile==_LIN && plan->profile==SEQ_PLAN_LINEAR && plan->speed==maxspeed) return;
+		// a moving servo starts its new move from where it is by then
+		seq_current[i-1]=seq_planpos(i-1, seq_time);
+	}
+	// just udpate the goals, but not the position of the servos directly
+	seq_goal[i-1]=position;
+	// cutting off servo pulses is the only immediate servo assignment
+	if(position==SERVO_NO_PULSE)
+	{
+		servo_set(i,SERVO_NO_PULSE);
+		seq_current[i-1]=SERVO_NO_PULSE;
+		seq_active&=~(1<<(i-1));
+		return;
+	}
+	// all other servo assignment take place at interrupt time in seq_domotion()
+	// following the plan made here
+	seq_planmove(i-1, profile, maxspeed);
+}
+
+// same, at the speed of this row
+static void seq_setgoal(seq_track_t* track, uint8_t i, int16_t position, uint8_t profile, int16_t override_max_speed)
+{
+	if(override_max_speed!=-1) seq_movegoal(i, position, profile, override_max_speed);
+	else seq_movegoal(i, position, profile, track->speed ? track->speed[i-1] : 0);
+}
+
+// Moves a servo (1 based) to position at up to maxspeed per 1/100 s, 0 for no limit,
+// outside of the tracks: release the servo from them first.
+// An idle servo starts from where servo_set() left it, a moving one from where it is.
+void seq_servo_goal(uint8_t servo, int16_t position, int16_t maxspeed)
+{
+	uint8_t sreg;
+
+	if(servo==0 || servo>SERVO_NUM) return;
+	sreg=SREG;
+	cli();
+	seq_time=millis();
+	if(!(seq_active & SEQ_SERVO_BIT(servo))) seq_current[servo-1]=servo_read(servo);
+	seq_movegoal(servo, position, _LIN, maxspeed);
+	SREG=sreg;
+}
+
+// Reads (and applies if asked) the compact row at *row, moves *row to the next one.
+// Returns the servos changed by the row when not applying, the row time when applying.
+static uint16_t seq_compactrow(seq_track_t* track, const uint8_t** row, uint8_t apply)
+{
+	const uint8_t* p=*row;
+	uint16_t time=0;
+	uint8_t shift=0;
+	uint8_t b, flags, i;
+	int16_t override_max_speed=-1;
+	uint8_t profile=_LIN;
+	uint16_t mask;
+
+	// time, 7 bits per byte, low bits first, top bit set on all bytes but the last
+	do
+	{
+		b=pgm_read_byte(p++);
+		time|=(uint16_t)(b&0x7F)<<shift;
+		shift+=7;
+	} while(b&0x80);
+
+	flags=pgm_read_byte(p++);
+	if(flags & SEQC_SPEED)
+	{
+		override_max_speed=pgm_read_byte(p)|(pgm_read_byte(p+1)<<8);
+		p+=2;
+	}
+	if(flags & SEQC_PROFILE) profile=pgm_read_byte(p++);
+	mask=pgm_read_byte(p)|(pgm_read_byte(p+1)<<8);
+	p+=2;
+
+	// one position code per servo in the mask
+	for(i=1; i<=SERVO_NUM; i++)
+	{
+		if(!(mask & SEQ_SERVO_BIT(i))) continue;
+		b=pgm_read_byte(p++);
+		if(apply && (track->mask & SEQ_SERVO_BIT(i)))
+		{
+			seq_setgoal(track, i, pgm_read_byte(&track->codes[2*b])|(pgm_read_byte(&track->codes[2*b+1])<<8), profile, override_max_speed);
+		}
+	}
+	*row=p;
+	return apply ? time : mask;
+}
+
 // new version with servo speed control
-void seq_setservopos(int16_t const array[][SERVO_NUM+SEQUENCE_PARAMETERS], uint8_t step)
+// sets the goals of the servos of row step, returns the row time
+static uint16_t seq_setservopos(seq_track_t* track, uint8_t step)
 {
 	uint8_t i;
+	int16_t const (*array)[SERVO_NUM+SEQUENCE_PARAMETERS]=track->array;
+
+	if(track->rows) return seq_compactrow(track, &track->row, 1);
+
+	uint8_t profile=pgm_read_word(&(array[step][PROFILE_PARAM]));
+	int16_t override_max_speed=pgm_read_word(&(array[step][SPEED_PARAM]));
+	uint8_t first=pgm_read_word(&(array[step][START_SERVO_PARAM]));
+	uint8_t last=pgm_read_word(&(array[step][END_SERVO_PARAM]));
 	// This doesn't set the servo position directly anymore.
 	// It just sets a goal for the the servo to get to.
 	// The actual position sent to the servo will move progressively toward the goal
 	// as controlled by the speed setting.
-	// The servo actual position updates now occurs at interrupt time in seq_dosequence()
+	// The servo actual position updates now occurs at interrupt time in seq_domotion()
 	// and are calculated from the servo goal and servo speed values.
 
 	for (i=1; i<=SERVO_NUM; i++)
 	{
 		// Check to see if we skip this servo
 		if (
-			   (i < pgm_read_word(&(array[step][START_SERVO_PARAM]))) // First servo to be triggered
-			&& (i > pgm_read_word(&(array[step][END_SERVO_PARAM])))   // Last servo to be triggered.  0 will skip the entire row
+			   (i < first) 	// First servo to be triggered
+			|| (i > last)   // Last servo to be triggered.  0 will skip the entire row
+			|| !(track->mask & SEQ_SERVO_BIT(i))	// taken over by another track
 			)
 		{
 			// Skip and go to the next servo.
 			continue;
 		}
-
-		// just udpate the goals, but not the position of the servos directly
-		seq_goal[i-1]=pgm_read_word(&(array[step][i]));
-		// cutting off servo pulses is the only immediate servo assignment
-		if(seq_goal[i-1]==SERVO_NO_PULSE){servo_set(i,SERVO_NO_PULSE);
-		// all other servo assignment take place at interrupt time in seq_dosequence()
-		}
+		seq_setgoal(track, i, pgm_read_word(&(array[step][i])), profile, override_max_speed);
 	}
+	return pgm_read_word(&(array[step][0]));
 }
 
 /**********************************************
@@ -179,94 +558,75 @@ void seq_setservopos(int16_t const array[][SERVO_NUM+SEQUENCE_PARAMETERS], uint8
 * (see the rt_dorealtime() function in that module).
 * Alternately if you do not want to use the realtime.c module, you can call this
 * directly every 1/100s using your own timer method
+* The steps are due on the millis() clock, each runs on the last tick before it is due
+* and its moves start at the due time, the servos move in seq_domotion().
 **********************************************/
 
-void seq_dosequence()
+// runs one sequencer track, its step is due before the next tick
+static void seq_track_do(seq_track_t* track)
 {
-	// do nothing unless sequencer explicitly started
-	if(!sequence_started) return;
-	// sequence array pointer not set, return
-	if(!sequence_array) return;
+	uint16_t time;
 
-	// the first part of this function just updates the servo position
-	// towards the goal position at the maximum speed allowed
-	uint8_t i;
-	int16_t maxspeed;
-	int16_t override_max_speed;
-	int16_t delta;
-	for(i=0; i<SERVO_NUM; i++)
+	// the moves of the step start when it is due, not on this tick
+	seq_time=track->due;
+	time=seq_setservopos(track, track->step); 	// put servos in position
+	if (track->step<track->length-1) // normal step
 	{
-		// See if this sequence row overwrites the global speed setting, and use that instead
-		override_max_speed = pgm_read_word(&(sequence_array[sequence_step][SPEED_PARAM]));
-		if (override_max_speed != -1)
-		{
-			maxspeed = override_max_speed;
-		}
-		else
-		{
-			maxspeed=servo_speed[i];			// read servo speed
-		}
-
-		delta=seq_goal[i]-seq_current[i];	// calculate difference between goal and current
-		if (delta==0) continue;				// if goal position already reached, nothing to do
-
-		// speed code 0 means no speed limit
-		// SERVO_NO_PULSE means waking up, we have no valid current position info
-		// so we must update it instantly too.
-		if (maxspeed==0 || seq_current[i]==SERVO_NO_PULSE)
-		{
-			seq_current[i]=seq_goal[i];		// set current position=goal
-			servo_set(i+1, seq_current[i]); // update actual servo position
-		}
-		else	// get closer to goal maxspeed at a time
-		{
-			if(delta>0)
-			{
-				if(delta>maxspeed) seq_current[i]=seq_current[i]+maxspeed;
-				else seq_current[i]=seq_goal[i];
-			}
-			else
-			{
-				if(delta<maxspeed) seq_current[i]=seq_current[i]-maxspeed;
-				else seq_current[i]=seq_goal[i];
-			}
-
-			servo_set(i+1, seq_current[i]); // update actual servo position
-		}
+		// next step due from this one, no drift. A 0 time step lasts a tick, as in v3.7
+		track->due+=(time ? (uint32_t)time : 1)*SEQ_TICK_MS;
+		track->step++;				// advance to next step
 	}
+	else // last step
+	{
+		// if last step time is zero, means stop
+		// ### this has a problem, means that the sequence is stopped before the servos
+		// actually reach their goal position. The last step is not "performed", except
+		// if it's a no pulse (_NP) servo assignment
+		seq_rewind(track);
+		if(!time) seq_track_end(track);	// also calls the completion callback
+		else track->due+=(uint32_t)time*SEQ_TICK_MS;	// it's a looping sequence, rewind to step 0
+	}
+}
 
-	// This second part now run the sequence
-
-	if(!seq_timeout==0) return; // wait until previous step has finished
+void seq_dosequence()
+{
+	// runs the sequences, only the started tracks, all their steps due before the next tick.
+	// Each step moves due on by a tick or more, that's two steps at most.
+	uint32_t next=millis()+SEQ_TICK_MS;
+	seq_track_t* track;
+	uint8_t i;
 
-	// step has finished, go to next sequence step
-	if (sequence_step<sequence_length-1) // normal step
+	for(i=0; i<SEQ_TRACKS; i++)
 	{
-		seq_setservopos(sequence_array, sequence_step); 					// put servos in position
-		seq_timeout=pgm_read_word(&(sequence_array[sequence_step][0]));		// restart timer with step time value
-		sequence_step++;													// advance to next step
+		track=&seq_tracks[i];
+		while(track->started==SEQ_RUNNING && (int32_t)(next-track->due)>0) seq_track_do(track);
 	}
-	else // last step
-	{
-		// if last step time is zero, means stop
+}
 
-		if(!pgm_read_word(&(sequence_array[sequence_length-1][0])))
-		{
-			seq_setservopos(sequence_array, sequence_length-1);
-			// ### this has a problem, means that the sequence is stopped before the servos
-			// actually reach their goal position. The last step is not "performed", except
-			// if it's a no pulse (_NP) servo assignment
-			sequence_started=0;
-			sequence_step=0;
-			// call the completion callback
-			if(seq_completion_callback) seq_completion_callback();
-		}
-		else // it's a looping sequence, just rewind sequence step to 0
+/**********************************************
+* Moves the servos with a move in progress to where their plan has them now,
+* idle servos cost nothing. Called by servo.c at the start of each pause between
+* pulse trains, with interrupts on: each moving servo is done with interrupts off,
+* a new plan can't come in the middle.
+**********************************************/
+void seq_domotion()
+{
+	uint16_t now=millis();
+	uint8_t i, sreg;
+	uint16_t bit;
+
+	for(i=0, bit=1; i<SERVO_NUM; i++, bit<<=1)
+	{
+		if(!(seq_active & bit)) continue;	// a bit is in one byte, it reads whole
+		sreg=SREG;
+		cli();
+		if(seq_active & bit)
 		{
-			seq_setservopos(sequence_array, sequence_length-1);
-			seq_timeout=pgm_read_word(&(sequence_array[sequence_length-1][0]));
-			sequence_step=0;
+			seq_current[i]=seq_planpos(i, now);
+			// landed on the goal: the curves only go up, it stays there until time is over
+			if(seq_current[i]==seq_goal[i]) seq_active&=~bit;
+			servo_set(i+1, seq_current[i]); // update actual servo position
 		}
+		SREG=sreg;
 	}
 }
-
@@ -68,20 +68,63 @@
 
 // Count the number of Non-Servo entries in the sequence
 // Means less work if I add more params
-#define SEQUENCE_PARAMETERS 4
+#define SEQUENCE_PARAMETERS 5
 
 //Used for indexing into the array
 #define SEQUENCE_ROW (SERVO_NUM + SEQUENCE_PARAMETERS)
 
 //Useful stuff
-#define SPEED_PARAM SEQUENCE_ROW - 3
-#define START_SERVO_PARAM SEQUENCE_ROW - 2
-#define END_SERVO_PARAM SEQUENCE_ROW - 1
+#define SPEED_PARAM SEQUENCE_ROW - 4
+#define START_SERVO_PARAM SEQUENCE_ROW - 3
+#define END_SERVO_PARAM SEQUENCE_ROW - 2
+#define PROFILE_PARAM SEQUENCE_ROW - 1
+
+// Motion profiles, optional last column of a row (left out = 0 = linear)
+// Linear is the original constant speed move, maxspeed per 1/100s.
+// The others take the same time as the linear move would (distance/maxspeed 1/100s, to the ms)
+// but follow a curve, so the peak speed is higher than maxspeed:
+// _EASE: half cosine, peak 1.57x
+// _TRAP: constant acceleration for the first and last quarter, peak 1.33x
+// _SCRV: S-curve (smootherstep), no jerk at the ends, peak 1.88x
+// Profiles need a speed: with speed 0 or a servo coming out of _NP the move is instant.
+#define _LIN 	0
+#define _EASE	1
+#define _TRAP	2
+#define _SCRV	3
+#define SEQ_PROFILE_NUM 4
 
 typedef int16_t sequence_t[][SERVO_NUM + SEQUENCE_PARAMETERS];
 typedef int16_t (*sequence_t_ptr)[SERVO_NUM + SEQUENCE_PARAMETERS];
 typedef int16_t speed_t[SERVO_NUM];
 
+// Sequencer tracks, each runs its own sequence at the same time as the others.
+// A started track takes the servos its sequence uses (the first..last columns of its rows)
+// away from the other tracks; a track that loses all its servos stops.
+// The functions without a track number work on track 0.
+#define SEQ_TRACKS 4
+
+// Compact sequences
+// The same sequences as sequence_t tables in a byte stream, about 5x smaller.
+// A row only holds the servos whose position changes, as one byte codes into a
+// per sequence dictionary of positions. Made from the tables by tools/seqconv.c,
+// which also checks that both give the same servo output.
+//	byte	number of rows
+//	byte	dictionary size n
+//	n words	dictionary: servo positions, low byte first
+//	then for each row:
+//		time in 1/100s, 7 bits per byte low bits first, bit 7 set on all bytes but the last
+//		flags
+//		[speed word, if SEQC_SPEED, otherwise _NP, the servo speed arrays]
+//		[profile byte, if SEQC_PROFILE, otherwise _LIN]
+//		word, servos changed by this row, bit 0 is servo 1
+//		one dictionary index byte for each servo changed, servo 1 first
+#define SEQC_SPEED		0x01
+#define SEQC_PROFILE	0x02
+
+// servo masks, for seq_release_servos()
+#define SEQ_SERVO_BIT(servo) (1<<((servo)-1))
+#define SEQ_ALL_SERVOS ((1<<SERVO_NUM)-1)
+
 // public
 void seq_init();
 void seq_add_completion_callback(void(*usercallback)());
@@ -92,10 +135,33 @@ void seq_loadsequence(int16_t const array[][SERVO_NUM + SEQUENCE_PARAMETERS], ui
 void seq_startsequence();
 void seq_stopsequence();
 void seq_restartsequence();
+void seq_loadcompact(const uint8_t* sequence);
+
+void seq_track_add_completion_callback(uint8_t t, void(*usercallback)());
+void seq_track_remove_completion_callback(uint8_t t);
+void seq_track_loadspeed(uint8_t t, speed_t speedarray);
+void seq_track_resetspeed(uint8_t t);
+void seq_track_loadsequence(uint8_t t, int16_t const array[][SERVO_NUM + SEQUENCE_PARAMETERS], uint8_t length);
+void seq_track_loadcompact(uint8_t t, const uint8_t* sequence);
+void seq_track_startsequence(uint8_t t);
+void seq_track_stopsequence(uint8_t t);
+void seq_track_restartsequence(uint8_t t);
+void seq_track_jumptostep(uint8_t t, uint8_t step);
+uint8_t seq_track_running(uint8_t t);
+
+// stops the sequencer from moving these servos, before setting them directly
+void seq_release_servos(uint16_t mask);
+
+// sequences started in between begin together, on the same tick (see dispatch_batch)
+void seq_defer_start();
+void seq_release_start();
+
+// moves a released servo with the speed limit of the sequencer, see stream.c
+void seq_servo_goal(uint8_t servo, int16_t position, int16_t maxspeed);
 
 // private
-void seq_dosequence();
+void seq_dosequence();		// realtime tick, runs the steps that are due
+void seq_domotion();		// servo frame, moves the servos (see servo_add_frame_callback)
 void seq_jumptostep(uint8_t step);
-void seq_setservopos(int16_t const array[][SERVO_NUM + SEQUENCE_PARAMETERS], uint8_t step);
 
 #endif /* SEQUENCER_H_ */
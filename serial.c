@@ -17,14 +17,21 @@
  *  v2.1 06.01/2015
  *  - made serial_puts wait if output buffer is full
  *  - created serial_puts_nowait if no waiting is required (faster too for fast serial speeds)
+ *  v2.2
+ *  - lock free fifo, strings are copied in blocks. serial_puts only waits when the output buffer is full.
+ *  - serial_write with timeout, serial_write_nonblocking
+ *  - U2X double speed when it gives a smaller baud rate error, rates up to 250000
+ *  - serial_set_baud to change the speed at runtime
  *
  *************************************/
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include <string.h>
+#include "hal.h"
 #include "serial.h"
 #include "binary.h"
 #include "fifo.h"
+#include "realtime.h"	// rt_ticks() for the write timeout
+#include "isrprof.h"	// interrupt profiling, when enabled
 
 // Fifo buffers for input and output
 
@@ -34,8 +41,60 @@ fifo_t infifo;
 uint8_t outbuf[BUFSIZE_OUT];
 fifo_t outfifo;
 
+// baud rate codes of the #SB setup command, 0 for a code left out.
+// 115200 is left out: at 16 MHz it is 2.1% off, over the 1.5% of U2X mode, and a console
+// saved at a rate the PC can't receive has no way back. Boards that saved it come back at 9600.
+const uint32_t serial_baud_rates[SERIAL_BAUD_CODES] PROGMEM =
+{
+	9600, 19200, 38400, 57600, 0, 250000
+};
+
+uint8_t serial_baud_available(uint8_t code)
+{
+	return code<SERIAL_BAUD_CODES && pgm_read_dword(&serial_baud_rates[code]);
+}
+
+uint32_t serial_baud_rate(uint8_t code)
+{
+	if(!serial_baud_available(code)) code=0;	// erased EEPROM and such
+	return pgm_read_dword(&serial_baud_rates[code]);
+}
+
+// UBRR+1 is rounded in both modes, and the mode with the smaller error wins.
+// On a tie normal mode wins, its receiver samples 16 times per bit instead of 8.
+// For instance at 16 MHz, 57600 is 2.1% off in normal mode, 0.8% with U2X.
+uint16_t serial_ubrr(uint32_t baudrate)
+{
+	uint32_t n16, n8;
+	int32_t error16, error8;
+
+	n16=(F_CPU+8UL*baudrate)/(16UL*baudrate);
+	n8=(F_CPU+4UL*baudrate)/(8UL*baudrate);
+	if(n16<1) n16=1;
+	if(n16>4096) n16=4096;
+	if(n8<1) n8=1;
+	if(n8>4096) n8=4096;
+
+	// F_CPU is baud clock*divider*(UBRR+1) when exact, the difference is the error
+	error16=(int32_t)(F_CPU-16UL*n16*baudrate);
+	error8=(int32_t)(F_CPU-8UL*n8*baudrate);
+	if(error16<0) error16=-error16;
+	if(error8<0) error8=-error8;
+
+	if(error8<error16) return (uint16_t)(n8-1) | SERIAL_U2X;
+	return (uint16_t)(n16-1);
+}
 
-void serial_init(uint16_t baudrate)
+static void serial_set_ubrr(uint16_t ubrr)
+{
+	if(ubrr & SERIAL_U2X) UCSR0A |= (1 << U2X0);
+	else UCSR0A &= ~(1 << U2X0);
+	ubrr &= ~SERIAL_U2X;
+	UBRR0H=(uint8_t) (ubrr>>8);
+	UBRR0L=(uint8_t) (ubrr);
+}
+
+void serial_init(uint32_t baudrate)
 {
   /************ explanation of registers **************
 	// USART1 initialization
@@ -44,7 +103,7 @@ void serial_init(uint16_t baudrate)
 	// USART1 Transmitter: On
 	// USART1 Mode: Asynchronous
 	// USART1 Baud rate: 9600
-	// UBRR=(CPUCLOCK/(16*BAUDRATE))-1
+	// UBRR=(CPUCLOCK/(16*BAUDRATE))-1, or (CPUCLOCK/(8*BAUDRATE))-1 with U2X
 
 	// UCSR1A bit0=MPMC  (set for addressed serial, normally 0)
 	// UCSR1A bit1=U2X1  (set to Double the USART Transmission Speed, normally 0)
@@ -87,16 +146,13 @@ void serial_init(uint16_t baudrate)
     uint8_t dummydata;		// to avoid warning from compiler later
     uint8_t sreg = SREG;	// save status register
 
-    // bit rate calculation
-	uint16_t ubrr = (uint16_t) ((uint32_t) F_CPU/(16UL*baudrate) - 1);
-	UBRR0H=(uint8_t) (ubrr>>8);	//UBRRH = (uint8_t) (ubrr>>8);
-	UBRR0L=(uint8_t) (ubrr);	//UBRRL = (uint8_t) (ubrr);
-
 	// Disable interrupts for a short while
 	cli();
 
 	// all defaults for UCSRA
 	UCSR0A=0x00;
+	// bit rate, sets U2X if needed
+	serial_set_ubrr(serial_ubrr(baudrate));
 	// turn on Rx, Tx and set to generate interrupts when Rx got a character
 	UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);
 	// Data mode 8N1,  asynchronous (UCSZ00=8bit,
@@ -109,8 +165,8 @@ void serial_init(uint16_t baudrate)
 	}
 	while (UCSR0A & (1 << RXC0)); // polling the receive complete bit
 
-   // Reset Receive and Transmit Complete Flags
-	UCSR0A = (1 << RXC0) | (1 << TXC0);
+   // Reset Receive and Transmit Complete Flags, keep U2X
+	UCSR0A = (UCSR0A & (1 << U2X0)) | (1 << RXC0) | (1 << TXC0);
 
     // Re-enable interrupts (don't see sei() call?)
     // Oh I see not needed, the global interrupt bit was part of saved SREG!)
@@ -144,7 +200,7 @@ void serial_init_9600b7E1(void) // 9600 bauds, 7 bits, 1 stop, even parity
  * 	{
  * 		charread=serial_getc(void)
  * 	}
- *
+ *
  ******/
 
 void serial_enable_rx_interrupt(void)
@@ -166,7 +222,9 @@ void serial_disable_rx_interrupt(void)
 // Input Interrupt - can't do any simpler, just store input in FIFO...
 ISR (USART_RX_vect)
 {
+	ISRPROF_ENTER(ISRPROF_NO_LATENCY);
     _inline_fifo_put (&infifo, UDR0);
+	ISRPROF_EXIT(ISRPROF_USART_RX);
 }
 
 // Output Interrupt
@@ -176,12 +234,14 @@ ISR (USART_RX_vect)
 // The serial_putc routine resets the interrupt on to start the process
 ISR(USART_UDRE_vect)
 {
+	ISRPROF_ENTER(ISRPROF_NO_LATENCY);
     // send out byte if there is one waiting
-	if (outfifo.count > 0)
+	if (outfifo.head != outfifo.tail)
        UDR0 = _inline_fifo_get (&outfifo);
 	// no more bytes, deactivate send interrupts
     else
         UCSR0B &= ~(1 << UDRIE0);
+    ISRPROF_EXIT(ISRPROF_USART_UDRE);
 }
 
 // Add character to output buffer, and try to send
@@ -226,31 +286,66 @@ unsigned char serial_getc_wait (void)
     return fifo_get_wait (&infifo);
 }
 
-// If the output buffer is full, this will wait for serial buffer clear before returning
-// all characters are sent guaranteed
-void serial_puts(char* string)
+// Lets the output buffer drain at the current speed, then switches.
+// The last two bytes are still in the UART when the buffer is empty,
+// one to two 1/100 s ticks covers them down to 2400 bauds.
+// The input buffer is kept.
+void serial_set_baud(uint32_t baudrate)
 {
-	uint8_t i=0;
-	while( (string[i]!='\0') & (i<255))
+	uint16_t start;
+	uint16_t ubrr=serial_ubrr(baudrate);
+	uint8_t sreg;
+
+	while(!serial_tx_complete()) hal_idle();
+	start=rt_ticks();
+	while((uint16_t)(rt_ticks()-start)<2) hal_idle();
+
+	sreg=SREG;
+	cli();
+	serial_set_ubrr(ubrr);
+	SREG=sreg;
+}
+
+// Queues as much as fits in the output buffer, returns right away with the number of bytes queued
+uint8_t serial_write_nonblocking(const uint8_t* data, uint8_t length)
+{
+	uint8_t n=fifo_write_block(&outfifo, data, length);
+	UCSR0B |= (1 << UDRIE0);		// start sending
+	return n;
+}
+
+// Queues all the bytes, waiting for room in the output buffer only when it is full.
+// Gives up after timeout 1/100 s, never with SERIAL_WAIT_FOREVER. Called with
+// interrupts off, it gives up as soon as the buffer is full: it would never drain.
+// Returns the number of bytes queued.
+uint8_t serial_write(const uint8_t* data, uint8_t length, uint16_t timeout)
+{
+	uint16_t start=rt_ticks();
+	uint8_t done=serial_write_nonblocking(data, length);
+
+	while(done<length)
 	{
-		while(!serial_tx_complete()){};
-		serial_putc(string[i]);
-	 	i++;
+		if(!(SREG & _BV(SREG_I))) break;
+		if(timeout!=SERIAL_WAIT_FOREVER && (uint16_t)(rt_ticks()-start)>=timeout) break;
+		hal_idle();					// full, let the interrupt make room
+		done+=serial_write_nonblocking(data+done, length-done);
 	}
+	return done;
+}
+
+// If the output buffer is full, this will wait for room in the buffer before returning
+// all characters are sent guaranteed
+void serial_puts(char* string)
+{
+	serial_write((uint8_t*)string, strnlen(string, 255), SERIAL_WAIT_FOREVER);
 }
 
 //this version will return no matter what, not waiting for serial buffer to clear
-//if the output buffer is full some character will be lost
+//if the output buffer is full the end of the string will be lost
 uint8_t serial_puts_nowait(char* string)
 {
-	uint8_t i=0;
-	uint8_t noerror=1;
-	while( (string[i]!='\0') & (i<255))
-	{
-		noerror &= serial_putc(string[i]); // if an overflow occurs, force noerror to 0
-	 	i++;
-	}
-	return noerror;
+	uint8_t length=strnlen(string, 255);
+	return serial_write_nonblocking((uint8_t*)string, length)==length;	// if an overflow occurs, return 0
 }
 
 
@@ -264,13 +359,16 @@ serial_puts_p(string);
 **************************************************************************/
 void serial_puts_p(const char *progmem_s )
 {
-    register char c;
+    uint8_t chunk[SERIAL_PGM_CHUNK];
+    uint8_t n;
 
-    while ( (c = pgm_read_byte(progmem_s++)) )
+    // copied out of program memory a chunk at a time
+    do
     {
-    	while(!serial_tx_complete()){};	// wait for serial buffer availability
-    	serial_putc(c);
+    	for (n=0; n<SERIAL_PGM_CHUNK && (chunk[n] = pgm_read_byte(progmem_s++)); n++);
+    	serial_write(chunk, n, SERIAL_WAIT_FOREVER);
     }
+    while (n==SERIAL_PGM_CHUNK);
 }
 
 
@@ -21,7 +21,7 @@
  *************************************/
 
 #include <stdint.h>
-#include <avr/pgmspace.h>	// for using PROGMEM strings
+#include "hal.h"			// for using PROGMEM strings
 
 #ifndef RS232_H_
 #define RS232_H_
@@ -31,9 +31,15 @@
 #define _HAS_UART1_
 #endif
 
-// you can change the default ring buffer sizes here
+// you can change the default ring buffer sizes here, powers of 2 up to 0x100
 #define BUFSIZE_IN  0x40
-#define BUFSIZE_OUT 0xFF
+#define BUFSIZE_OUT 0x100
+
+#define SERIAL_WAIT_FOREVER	0xFFFF	// serial_write() timeout
+#define SERIAL_PGM_CHUNK	16		// serial_puts_p() copies program memory strings in chunks of that size
+
+#define SERIAL_U2X			0x8000	// serial_ubrr() flag for double speed mode
+#define SERIAL_BAUD_CODES	6		// serial_baud_rate() codes: 9600, 19200, 38400, 57600, (115200 left out), 250000
 
 #define PARITYNONE 0
 #define PARITYODD 1
@@ -46,14 +52,20 @@
 #endif
 
 /********* init ***************/
-void serial_init(uint16_t baudrate); 	//defaults to 1 stop, no parity.
+void serial_init(uint32_t baudrate); 	//defaults to 1 stop, no parity.
+void serial_set_baud(uint32_t baudrate);	// changes speed once the output buffer is sent, keeps the settings and buffers
+uint16_t serial_ubrr(uint32_t baudrate);	// UBRR with the smallest error, ORed with SERIAL_U2X if double speed mode is better
+uint32_t serial_baud_rate(uint8_t code);	// baud rate for a code, 9600 for unknown codes and those left out
+uint8_t serial_baud_available(uint8_t code);	// the code has a baud rate
 void serial_init_9600b8N1(void); 		// 9600 bauds, 8 bits, 1 stop, no parity
 void serial_init_9600b7E1(void); 		// 9600 bauds, 7 bits, 1 stop, no parity
 
 /********* sending ***********/
 uint8_t serial_tx_complete();			// use to check if the output buffer has emptied before sending more if you need flow control
 uint8_t serial_putc(unsigned char ch);	// returns 0 if output buffer was full
-void serial_puts(char* string);			// send string, waits for output buffer to clear if full
+uint8_t serial_write(const uint8_t* data, uint8_t length, uint16_t timeout);	// waits for room up to timeout 1/100 s, returns bytes queued
+uint8_t serial_write_nonblocking(const uint8_t* data, uint8_t length);		// returns right away with the bytes queued
+void serial_puts(char* string);			// send string, waits for room in the output buffer if full
 uint8_t serial_puts_nowait(char* string);  // send string, returns immediately, if output buffer is full char will be lost and it will return 0
 void serial_puts_p(const char *progmem_s ); // for printing program memory strings
 // this is how to use it
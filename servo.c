@@ -7,8 +7,8 @@
  *
  *      12 independent servo control on ATmega128, ATmega168
  *      Assumes 16 MHz clock
- *      Uses timer counter 1 to count at 0.5 us
- *      This timer cannot be used for anything else
+ *      Uses timer counter 1, counting at 0.5 us for the clock.c time base
+ *      Pulses are timed with its compare A, only the overflow is left for clock.c
  *
  *		Revised: July 12, 2012
  *		Ported to ATmega 168
@@ -23,13 +23,19 @@
  *		Added preliminary support for servo reversing
  *		Right now all servos reversed. I'll need to add 1:1 reversing with EEPROM control later
  *		(#define _REVERSE_SERVOS_ if you want them reversed)
+ *
+ *		Timer1 is no longer reloaded at each pulse, it runs free as the millis() clock.
+ *		Each pulse end is scheduled on the compare A register (OCR1A += pulse length),
+ *		so the pulse lengths are the same and the clock loses no tick.
+ *		servo_add_frame_callback() gets a function called at the start of each pause,
+ *		which can set the positions of the next pulse train.
  */
 
 #include "servo.h"
-#include <avr/interrupt.h>
-#include <avr/io.h> 	// This will include <avr/iom128.h>
+#include "hal.h" 		// registers and interrupts
 #include "binary.h" 	// BIT0-BIT31 definitions and binary fields
 #include "toolbox.h"
+#include "isrprof.h"	// interrupt profiling, when enabled
 
 
 
@@ -55,12 +61,16 @@ int16_t servo_rcpulse;
 
 // private global variable updated in interrupt routine
 static volatile uint8_t current_servo;
+static void(*servo_frame_callback)();
+
+// the pause values were counter reloads, the pause lasts that many ticks (modulo 65536)
+#define SERVO_PAUSE_TICKS ((uint16_t)(SERVO_PULSE_PAUSE))
 
 /************************************************
  * Start the servo pulses
  * Sets servo output pins
- * Set counter1 to 0.5 us ticks on 16 MHz clock
- * Enable overflow interrupts
+ * Timer1 must be running, see clock_init()
+ * Enable compare A interrupts
  * Start by counting a long pause
  * *********************************************/
 void servo_init()
@@ -115,11 +125,9 @@ void servo_init()
 	}
 	// Reset all servo values to SERVO_NO_PULSE
 
-	// Timer1 setup, used for timing servo outputs
-	TIMSK &= ~_BV(TOIE1); 			// Disable overflow interrupts for now (TIMER1_OVF_vect)
+	// Timer1 runs free for clock.c, we only use its compare A for timing servo outputs
+	TIMSK &= ~_BV(OCIE1A); 			// Disable compare interrupts for now (TIMER1_COMPA_vect)
 	current_servo = SERVO_NUM;		// start with servo pause
-	TCCR1A =0; 						// Simple up counting operation until overflow
-	TCNT1= -(SERVO_PULSE_PAUSE);	// start counter at -16000 us
 
 	// further init if RC input is enabled
 	#ifdef SERVO_RCINPUT
@@ -134,18 +142,17 @@ void servo_init()
 
 /************************************************
  * Start the servo pulses
- * Set counter1 to 0.5 us ticks on 16 MHz clock
- * Enable overflow interrupts
+ * Enable compare A interrupts
  * Start by counting a long pause
  * *********************************************/
 void servo_start()
 {
-	// Uses clock input divided by 8, 0.5 microsecond/tick
+	cli();
 	current_servo = SERVO_NUM;		// start with servo pause
-	TCNT1= -(SERVO_PULSE_PAUSE);	// start counter at -16000 us
-	TIMSK |= _BV(TOIE1); 			// Enable overflow interrupts
+	OCR1A = TCNT1+SERVO_PAUSE_TICKS;	// first compare one pause from now
+	set_bit(TIFR, OCF1A);			// clear a stale compare flag by writing a 1
+	TIMSK |= _BV(OCIE1A); 			// Enable compare A interrupts
 	sei();							// enable global interrupts
-	TCCR1B |= _BV(CS11); 			// Launch timer, pre-scaler div clock by 8, gives 0.5 us ticks at 16 MHz
 }
 
 /*****************************
@@ -159,8 +166,20 @@ void servo_stop()
 	{
 		clear_bit(*servo_port[i], servo_pin[i]);
 	}
-	TIMSK &= ~_BV(TOIE1); 	// Disable overflow interrupts
-	TCCR1B = 0; 			// Stop timer
+	TIMSK &= ~_BV(OCIE1A); 	// Disable compare interrupts, the timer goes on for the clock
+	#ifdef SERVO_RCINPUT
+	clear_bit(TIMSK, ICIE1);	// no more input capture either
+	#endif
+}
+
+/*****************************
+ * Function called at the start of each pause between pulse trains, from
+ * the interrupt but with interrupts on. The servo values it sets go out in
+ * the next train, one pause later.
+ ****************************/
+void servo_add_frame_callback(void(*callback)())
+{
+	servo_frame_callback=callback;
 }
 
 /*****************************************************
@@ -211,7 +230,7 @@ int16_t servo_read(uint8_t servo)
 	if(servo==0 || servo>SERVO_NUM) return 0;
 
 	// time=SERVO_NO_PULSE means no output
-	if(servo_value[servo-1]==SERVO_NO_PULSE)
+	if(servo_value[servo-1]==(uint16_t)SERVO_NO_PULSE)
 	{
 		return SERVO_NO_PULSE;
 	}
@@ -225,14 +244,16 @@ int16_t servo_read(uint8_t servo)
 
 
 /******************************************************
- * Counter1 Overflow interrupt
- * At each iteration, sets the timer to the
+ * Counter1 compare A interrupt
+ * At each iteration, moves the compare to the end of the
  * next servo pulse length as set in the global variable
  * servo_value[]
  * A value of 0 in the servo means no pulse is put out
  ***************************************************/
-ISR(TIMER1_OVF_vect)
+ISR(TIMER1_COMPA_vect)
 {
+	ISRPROF_ENTER(TCNT1-OCR1A);	// ticks since the compare match, that's our pulse width error
+
 	// first end the current pulse except if in pause
 	if(current_servo>=SERVO_NUM) // we were doing the long pause
 	{
@@ -253,7 +274,7 @@ ISR(TIMER1_OVF_vect)
 	// now start the next one except if it's time for pause
 	if(current_servo>=SERVO_NUM) // we've reached the pause
 	{
-		TCNT1= -(SERVO_PULSE_PAUSE); // load the counter with long pause value
+		OCR1A += SERVO_PAUSE_TICKS; // next compare after the long pause
 
 		// if RC reading, start the input capture during the pause
 		#ifdef SERVO_RCINPUT
@@ -262,29 +283,38 @@ ISR(TIMER1_OVF_vect)
 	}
 	else	// regular start of a new pulse
 	{
-		if(servo_value[current_servo] != SERVO_NO_PULSE) // regular pulse value
+		if(servo_value[current_servo] != (uint16_t)SERVO_NO_PULSE) // regular pulse value (cast, or the test depends on the int size)
 		{
 			// start pulse
 			set_bit(*servo_port[current_servo], servo_pin[current_servo]);
 			if (servo_direction[current_servo] == 1)
 			{
-				// set inverse pulse length, and wait for overflow
+				// set inverse pulse length, and wait for the compare
 				// servo values are stored as twice their us value
-				TCNT1= servo_value[current_servo]-4*SERVO_PULSE_CENTER;
+				OCR1A += 4*SERVO_PULSE_CENTER-servo_value[current_servo];
 			}
 			else if (servo_direction[current_servo] == 0)
 			{
 
-				// set normal pulse length, and wait for overflow
-				TCNT1= -(servo_value[current_servo]);
+				// set normal pulse length, and wait for the compare
+				OCR1A += servo_value[current_servo];
 			}
 
 		}
 		else	// SERVO_NO_PULSE means no output, wait minimum pulse value
 		{
-			TCNT1= -SERVO_PULSE_MIN;
+			OCR1A += SERVO_PULSE_MIN;
 		}
 	}
+
+	ISRPROF_EXIT(ISRPROF_T1COMPA);
+
+	// pause started, there is time for the callback before the next compare
+	if(current_servo>=SERVO_NUM && servo_frame_callback)
+	{
+		sei();
+		servo_frame_callback();
+	}
 }
 
 /***********************************
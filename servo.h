@@ -6,8 +6,8 @@
  *
  *      6 independent servo control on AVR-128
  *      Assumes 16 MHz clock
- *      Uses timer counter 1 to count at 0.5 us
- *      This time cannot be used for anything else
+ *      Uses timer counter 1 to count at 0.5 us, started by clock_init() (clock.h)
+ *      Its compare A times the pulses, its overflow is the clock, nothing else can use it
  *
  *      Usage:
  *      Set servo port and pins below in the #define section, then:
@@ -122,11 +122,15 @@ uint8_t last_servo;					// Used to limit panel sequences if using less servos.
 
 // init, start and stop the servo pulses. Init calls start automatically,
 // Only call start if you have stopped. Stopping will also stop
-// reading the RC input
+// reading the RC input, Timer1 keeps counting for the clock
 void servo_init();
 void servo_start();
 void servo_stop();
 
+// function called at the start of each pause between pulse trains, interrupts on,
+// to set the servo positions of the next train. One only, 0 removes it.
+void servo_add_frame_callback(void(*callback)());
+
 
 /*****************************************************
  * sets servo position value
@@ -0,0 +1,159 @@
+/*
+ * settings.c
+ * Setup settings, mirrored in RAM and saved in EEPROM in the background, see settings.h
+ *
+ */
+
+#include "settings.h"
+#include "realtime.h"		// rt_ticks() for the save delay
+
+// v3.7 layout, one address per setting
+#define SETTINGS_V37_SERVO_DIR		0		// word
+#define SETTINGS_V37_START_SOUND	2
+#define SETTINGS_V37_SLAVE_DELAY	3
+#define SETTINGS_V37_LAST_SERVO		4
+#define SETTINGS_V37_RANDOM_SOUND	5
+#define SETTINGS_V37_MP3_PLAYER		6
+#define SETTINGS_V37_CRC			7		// word, sum of the settings
+#define SETTINGS_V37_SERIAL_BAUD	9		// not in the sum while erased
+
+#define SETTINGS_CRC_LENGTH			(sizeof(settings_record_t)-sizeof(uint16_t))
+
+// a record that doesn't fit its slot makes this array size negative
+typedef char settings_fits_slot[(sizeof(settings_record_t)<=SETTINGS_SLOT_SIZE) ? 1 : -1];
+
+settings_t settings;
+
+static uint8_t settings_slot;			// slot of the record in use
+static uint8_t settings_sequence;		// and its sequence
+static uint8_t settings_dirty;			// changed since the last save started
+static uint16_t settings_last;			// rt_ticks() of the last change
+static settings_record_t settings_out;	// record being written
+static uint8_t settings_written;		// bytes of it written, sizeof(settings_out) when done
+
+static const settings_t settings_defaults PROGMEM =
+{
+	0x0000,		// all servos forward
+	255,		// Dolby start sound
+	0,
+	12,
+	0,			// random sounds on
+	0,			// SparkFun MP3 Trigger
+	0,			// 9600 bauds
+};
+
+// CRC-16, polynomial x^16+x^12+x^5+1
+uint16_t settings_crc(const uint8_t* data, uint8_t length)
+{
+	uint16_t crc=0xFFFF;
+	uint8_t i;
+
+	while(length--)
+	{
+		crc^=(uint16_t)(*data++)<<8;
+		for(i=0; i<8; i++) crc=(crc & 0x8000) ? (crc<<1)^0x1021 : crc<<1;
+	}
+	return crc;
+}
+
+static uint8_t* settings_address(uint8_t slot)
+{
+	return (uint8_t*)SETTINGS_BASE+slot*SETTINGS_SLOT_SIZE;
+}
+
+static uint8_t settings_read(uint8_t slot, settings_record_t* record)
+{
+	uint8_t* p=(uint8_t*)record;
+	uint8_t* address=settings_address(slot);
+	uint8_t i;
+
+	for(i=0; i<sizeof(settings_record_t); i++) p[i]=eeprom_read_byte(address+i);
+	return record->version==SETTINGS_VERSION && record->crc==settings_crc(p, SETTINGS_CRC_LENGTH);
+}
+
+// the v3.7 settings, if their sum is good
+static uint8_t settings_import()
+{
+	uint16_t sum;
+	uint8_t baud=eeprom_read_byte((uint8_t*)SETTINGS_V37_SERIAL_BAUD);
+
+	settings.servo_dir=eeprom_read_word((uint16_t*)SETTINGS_V37_SERVO_DIR);
+	settings.start_sound=eeprom_read_byte((uint8_t*)SETTINGS_V37_START_SOUND);
+	settings.slave_delay=eeprom_read_byte((uint8_t*)SETTINGS_V37_SLAVE_DELAY);
+	settings.last_servo=eeprom_read_byte((uint8_t*)SETTINGS_V37_LAST_SERVO);
+	settings.random_sound_disabled=eeprom_read_byte((uint8_t*)SETTINGS_V37_RANDOM_SOUND);
+	settings.mp3_player=eeprom_read_byte((uint8_t*)SETTINGS_V37_MP3_PLAYER);
+
+	// boards set up before the baud rate existed have it erased, and out of the sum
+	sum=settings.servo_dir+settings.start_sound+settings.random_sound_disabled+settings.mp3_player;
+	if(baud!=0xFF) sum+=baud;
+	else baud=0;
+	settings.serial_baud=baud;
+
+	return sum==eeprom_read_word((uint16_t*)SETTINGS_V37_CRC);
+}
+
+uint8_t settings_load()
+{
+	settings_record_t record;
+	uint8_t slot, found=0;
+
+	for(slot=0; slot<SETTINGS_SLOTS; slot++)
+	{
+		if(!settings_read(slot, &record)) continue;
+		// sequences are close together, the difference tells which is later even across a wrap
+		if(found && (int8_t)(record.sequence-settings_sequence)<=0) continue;
+		found=1;
+		settings_slot=slot;
+		settings_sequence=record.sequence;
+		settings=record.settings;
+	}
+	settings_written=sizeof(settings_out);
+	if(found) return SETTINGS_LOADED;
+
+	// the first save goes to slot 0
+	settings_slot=SETTINGS_SLOTS-1;
+	settings_sequence=0;
+	settings_dirty=1;
+	settings_last=rt_ticks()-SETTINGS_DELAY;
+	if(settings_import()) return SETTINGS_IMPORTED;
+	memcpy_P(&settings, &settings_defaults, sizeof(settings));
+	return SETTINGS_DEFAULTS;
+}
+
+void settings_changed()
+{
+	settings_dirty=1;
+	settings_last=rt_ticks();
+}
+
+void settings_do()
+{
+	const uint8_t* p=(const uint8_t*)&settings_out;
+
+	if(settings_written<sizeof(settings_out))
+	{
+		// one byte at a time, never waiting for the previous one
+		if(!eeprom_is_ready()) return;
+		eeprom_update_byte(settings_address(settings_slot)+settings_written, p[settings_written]);
+		settings_written++;
+		return;
+	}
+
+	if(!settings_dirty || (uint16_t)(rt_ticks()-settings_last)<SETTINGS_DELAY) return;
+
+	// later changes start another save
+	settings_dirty=0;
+	settings_slot=(settings_slot+1)%SETTINGS_SLOTS;
+	settings_sequence++;
+	settings_out.version=SETTINGS_VERSION;
+	settings_out.sequence=settings_sequence;
+	settings_out.settings=settings;
+	settings_out.crc=settings_crc(p, SETTINGS_CRC_LENGTH);
+	settings_written=0;
+}
+
+uint8_t settings_pending()
+{
+	return settings_dirty || settings_written<sizeof(settings_out);
+}
@@ -0,0 +1,67 @@
+/*
+ * settings.h
+ * Setup settings, mirrored in RAM and saved in EEPROM in the background
+ *
+ * The setup commands (#SD, #SR, #SS...) change the settings structure in RAM and call
+ * settings_changed(). Once no change has come for SETTINGS_DELAY, settings_do() writes
+ * the whole structure as one record, a byte per main loop pass while the EEPROM is ready,
+ * so the main loop never waits the 3.4 ms of a byte write, and tuning with a burst of #SR
+ * commands costs one record write instead of two words per command.
+ *
+ * Records go to SETTINGS_SLOTS slots in turn, each save to the slot after the current one,
+ * which spreads the wear. A record is:
+ * 	version, sequence, settings_t, CRC-16 (CCITT, start 0xFFFF) of all that
+ * At boot settings_load() reads the slots and keeps the valid record with the latest
+ * sequence. The CRC bytes are written last, so a record cut short by a power loss
+ * doesn't count and the previous one is used.
+ * If no slot is valid, the settings come from the v3.7 layout (one address per setting
+ * and a sum at 7, still left alone for older firmware), or else the defaults.
+ *
+ * Changing settings_t means a new SETTINGS_VERSION, the old records are then ignored.
+ *
+ */
+
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+#include "hal.h"
+
+#define SETTINGS_VERSION	1
+#define SETTINGS_BASE		16			// EEPROM address of the first slot, after the v3.7 layout
+#define SETTINGS_SLOT_SIZE	16
+#define SETTINGS_SLOTS		8
+#define SETTINGS_DELAY		100			// 1/100 s without a change before saving
+
+// settings_load() results
+#define SETTINGS_LOADED		0
+#define SETTINGS_IMPORTED	1			// from the v3.7 layout
+#define SETTINGS_DEFAULTS	2
+
+typedef struct
+{
+	uint16_t servo_dir;					// bit per servo, 1 is reversed (#SD, #SR)
+	uint8_t start_sound;				// #SS
+	uint8_t slave_delay;				// #ST
+	uint8_t last_servo;					// #SL
+	uint8_t random_sound_disabled;		// #SQ
+	uint8_t mp3_player;					// #SM
+	uint8_t serial_baud;				// #SB, see serial_baud_rate()
+} settings_t;
+
+typedef struct
+{
+	uint8_t version;
+	uint8_t sequence;					// one more at every save, wraps
+	settings_t settings;
+	uint16_t crc;
+} settings_record_t;
+
+extern settings_t settings;
+
+uint8_t settings_load();				// at boot, before anything uses the settings
+void settings_changed();				// saves them once they stop changing
+void settings_do();						// call from the main loop
+uint8_t settings_pending();				// 1 until the last change is in EEPROM
+uint16_t settings_crc(const uint8_t* data, uint8_t length);
+
+#endif /* SETTINGS_H_ */
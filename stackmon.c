@@ -0,0 +1,106 @@
+/*
+ * stackmon.c
+ * RAM high-water mark by stack painting, see stackmon.h
+ *
+ */
+
+#include "stackmon.h"
+
+#ifdef _STACK_MONITOR_
+
+#include <stdio.h>			// for sprintf(), test builds only
+#include "serial.h"
+
+#ifdef __AVR__
+
+extern uint8_t __heap_start;	// end of .data and .bss, set by the linker (no malloc in this firmware)
+
+#define stack_bottom	(&__heap_start)
+#define stack_top		((uint8_t*)RAMEND)
+#define stack_pointer()	((uint8_t*)SP)
+
+// runs at reset before the stack pointer and r1 are set up, so in assembly only
+void stackmon_reset_paint() __attribute__((naked, used, section(".init1")));
+void stackmon_reset_paint()
+{
+	__asm volatile (
+		"	ldi r30, lo8(__heap_start)	\n"
+		"	ldi r31, hi8(__heap_start)	\n"
+		"	ldi r24, %0					\n"
+		"	ldi r25, hi8(%1)			\n"
+		"	rjmp 2f						\n"
+		"1:	st Z+, r24					\n"
+		"2:	cpi r30, lo8(%1)			\n"
+		"	cpc r31, r25				\n"
+		"	brlo 1b						\n"
+		"	breq 1b						\n"
+		:: "M" (STACKMON_PAINT), "i" (RAMEND)
+	);
+}
+
+void stackmon_init()
+{
+}
+
+#else
+
+// the host paints an area of its own stack below main()
+static uint8_t* stack_bottom;
+static uint8_t* stack_top;
+
+#define stack_pointer()	((uint8_t*)__builtin_frame_address(0))
+
+// makes sure the area is there, then leaves it to the functions main() calls
+static void __attribute__((noinline)) stackmon_host_area()
+{
+	volatile uint8_t area[STACKMON_HOST_SIZE];
+	uint16_t i;
+	for(i=0; i<STACKMON_HOST_SIZE; i+=256) area[i]=0;
+	(void)area;
+	stack_bottom=stack_pointer()-STACKMON_HOST_SIZE;
+}
+
+void stackmon_init()
+{
+	uint8_t top;
+	stack_top=&top;
+	stackmon_host_area();
+	stackmon_paint();
+}
+
+#endif
+
+const char strStackmon[] PROGMEM="RAM ";
+
+void stackmon_paint()
+{
+	uint8_t* p=stack_bottom;
+	uint8_t* limit=stack_pointer()-STACKMON_MARGIN;
+
+	// everything below us is free, interrupts only use it temporarily
+	while(p<limit) *p++=STACKMON_PAINT;
+}
+
+uint16_t stackmon_free()
+{
+	uint8_t* p=stack_bottom;
+	while(p<stack_top && *p==STACKMON_PAINT) p++;
+	return p-stack_bottom;
+}
+
+void stackmon_report()
+{
+	char string[48];
+	uint16_t free=stackmon_free();
+	uint16_t stack=stack_top-stack_bottom+1-free;
+
+	serial_puts_p(strStackmon);
+#ifdef __AVR__
+	sprintf(string, "static=%u ", (uint16_t)(stack_bottom-(uint8_t*)RAMSTART));
+	serial_puts(string);
+#endif
+	sprintf(string, "stack max=%u free min=%u\r\n", stack, free);
+	serial_puts(string);
+}
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * stackmon.h
+ * RAM high-water mark by stack painting
+ *
+ * Compiled in only when _STACK_MONITOR_ is defined in main.h.
+ *
+ * At reset, before the C runtime runs, all the RAM between the end of the static
+ * variables and the top of the stack is filled with STACKMON_PAINT. The stack grows
+ * down into it, and never cleans up after itself: the painted bytes still found above
+ * the static variables are RAM that was never used since the paint.
+ *
+ * Setup command #SK00 prints the report on the console, #SK01 paints again what
+ * is free right now, to measure one command or sequence at a time:
+ *
+ * 	RAM static=1234 stack max=345 free min=469
+ *
+ * static is .data and .bss, stack max the deepest the stack went (interrupts included),
+ * free min what was left between the two at that time.
+ *
+ * The host simulation paints STACKMON_HOST_SIZE bytes of its own stack below main(),
+ * its numbers are in host stack bytes: only the differences between two builds mean something.
+ *
+ */
+
+#ifndef STACKMON_H_
+#define STACKMON_H_
+
+#include "main.h"		// for the _STACK_MONITOR_ compile flag
+#include "hal.h"
+
+#define STACKMON_PAINT		0xC5
+#define STACKMON_HOST_SIZE	8192
+
+// bytes kept unpainted below the stack pointer by stackmon_paint()
+#ifdef __AVR__
+#define STACKMON_MARGIN		16
+#else
+#define STACKMON_MARGIN		256		// x86-64 leaf functions use up to 128 bytes below the stack pointer
+#endif
+
+#ifdef _STACK_MONITOR_
+
+void stackmon_init();				// host: call first thing in main(), nothing to do on the AVR
+void stackmon_paint();				// paints the free RAM again
+uint16_t stackmon_free();			// painted bytes never touched since the last paint
+void stackmon_report();				// prints the report on the console
+
+#else
+
+#define stackmon_init()
+
+#endif
+
+#endif /* STACKMON_H_ */
@@ -0,0 +1,122 @@
+/*
+ * stream.c
+ * Live servo positions, streamed by an animation host, see stream.h
+ *
+ */
+
+#include <string.h>
+#include "stream.h"
+#include "command.h"		// for the check results
+#include "fmt.h"
+#include "realtime.h"
+#include "sequencer.h"
+#include "serial.h"
+#include "servo.h"
+
+stream_stats_t stream_stats;
+
+static uint16_t stream_mask;	// servos driven by the stream, 0 when not streaming
+static uint16_t stream_last;	// rt_ticks() of the last frame
+static uint8_t stream_counter;	// counter of the last frame
+
+uint8_t stream_check(const uint8_t* payload, uint8_t length)
+{
+	uint16_t mask;
+	uint8_t i, n=4;
+
+	if(length<4) return CMD_BAD_LENGTH;
+	mask=payload[2] | (payload[3]<<8);
+	if(mask & ~SEQ_ALL_SERVOS) return CMD_BAD_VALUE;
+	for(i=1; i<=SERVO_NUM; i++)
+	{
+		if(mask & SEQ_SERVO_BIT(i)) n++;
+	}
+	if(n!=length) return CMD_BAD_LENGTH;
+	return CMD_OK;
+}
+
+uint16_t stream_frame(const uint8_t* payload)
+{
+	uint16_t now=rt_ticks();
+	uint8_t counter=payload[0];
+	uint8_t speed=payload[1];
+	uint16_t mask=payload[2] | (payload[3]<<8);
+	int8_t ahead=(int8_t)(counter-stream_counter);
+	int16_t position;
+	uint8_t i;
+
+	if(stream_mask)
+	{
+		if(ahead<=0)
+		{
+			// out of order or repeated, a newer frame already ran
+			stream_stats.late++;
+			return 0;
+		}
+		stream_stats.dropped+=ahead-1;
+		if((uint16_t)(now-stream_last)>STREAM_LATE) stream_stats.late++;
+	}
+	stream_stats.frames++;
+	stream_counter=counter;
+	stream_last=now;
+
+	// servos new to the stream leave the sequences
+	if(mask & ~stream_mask) seq_release_servos(mask & ~stream_mask);
+	stream_mask|=mask;
+
+	payload+=4;
+	for(i=1; i<=SERVO_NUM; i++)
+	{
+		if(!(mask & SEQ_SERVO_BIT(i))) continue;
+		if(*payload==STREAM_OFF) position=SERVO_NO_PULSE;
+		else
+		{
+			position=SERVO_PULSE_MIN+STREAM_STEP*(*payload);
+			if(position>SERVO_PULSE_MAX) position=SERVO_PULSE_MAX;
+		}
+		payload++;
+		seq_servo_goal(i, position, speed);
+	}
+	return mask;
+}
+
+void stream_do()
+{
+	if(stream_mask && (uint16_t)(rt_ticks()-stream_last)>STREAM_TIMEOUT)
+	{
+		stream_stats.holds++;
+		stream_stop();
+	}
+}
+
+void stream_stop()
+{
+	if(!stream_mask) return;
+	seq_release_servos(stream_mask);	// moves in progress stop where they are
+	stream_mask=0;
+}
+
+uint16_t stream_servos()
+{
+	return stream_mask;
+}
+
+void stream_report()
+{
+	char string[64];
+	char* p=fmt_copy_p(string, PSTR("STREAM frames="));
+	p=fmt_dec(p, stream_stats.frames, 0, ' ');
+	p=fmt_copy_p(p, PSTR(" dropped="));
+	p=fmt_dec(p, stream_stats.dropped, 0, ' ');
+	p=fmt_copy_p(p, PSTR(" late="));
+	p=fmt_dec(p, stream_stats.late, 0, ' ');
+	p=fmt_copy_p(p, PSTR(" holds="));
+	p=fmt_dec(p, stream_stats.holds, 0, ' ');
+	fmt_copy_p(p, PSTR("\r\n"));
+	serial_puts(string);
+}
+
+void stream_reset()
+{
+	memset(&stream_stats, 0, sizeof(stream_stats));
+}
@@ -0,0 +1,56 @@
+/*
+ * stream.h
+ * Live servo positions, streamed by an animation host
+ *
+ * The host sends a FRAME_STREAM binary frame (see frame.h) at a steady rate, 50 to 100 per second:
+ * 	counter (8 bit), speed (8 bit), servo mask (16 bit, bit 0 is servo 1),
+ * 	one position byte for each servo in the mask, lowest first
+ * counter goes up by one every frame. speed is how far a servo may move in 1/100 s, in us,
+ * 0 for no limit. Position p is a pulse of SERVO_PULSE_MIN+STREAM_STEP*p us, up to
+ * SERVO_PULSE_MAX, STREAM_OFF turns the servo off.
+ * A frame for all 11 servos is 19 bytes: 50 per second fit in 9600 bauds, 100 need 19200 (see #SB).
+ *
+ * The positions become sequencer goals, the servos get there at the speed limit of the
+ * frame (see seq_servo_goal). Good frames get no reply, bad ones get the usual error reply.
+ * The first frame takes its servos off RC and away from the sequences.
+ *
+ * When frames stop for STREAM_TIMEOUT, the servos hold where they are and the stream ends.
+ * Any panel command ends it the same way.
+ *
+ * Counters, reported by #SC0 and reset by #SC1:
+ * - frames: good frames received
+ * - dropped: frames missing from the counter sequence
+ * - late: frames more than STREAM_LATE after the previous one, and frames out of order (ignored)
+ * - holds: streams ended by the timeout
+ *
+ */
+
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include "hal.h"
+
+#define STREAM_STEP			8		// us per position step
+#define STREAM_OFF			0xFF	// position byte turning the servo off
+#define STREAM_LATE			4		// 1/100 s, two frame periods at 50 per second
+#define STREAM_TIMEOUT		25		// 1/100 s without a frame before holding
+
+typedef struct
+{
+	uint16_t frames;
+	uint16_t dropped;
+	uint16_t late;
+	uint16_t holds;
+} stream_stats_t;
+
+extern stream_stats_t stream_stats;
+
+uint8_t stream_check(const uint8_t* payload, uint8_t length);	// CMD_OK or the error, see command.h
+uint16_t stream_frame(const uint8_t* payload);	// runs a checked frame, returns its servo mask
+void stream_do();								// main loop, holds when the frames stop
+void stream_stop();								// holds the servos and ends the stream
+uint16_t stream_servos();						// servos driven by the stream
+void stream_report();
+void stream_reset();
+
+#endif /* STREAM_H_ */
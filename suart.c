@@ -1,13 +1,15 @@
 /*
  * softuart.c
  * Software serial communication implementation
- * Does not use timers, just delays
- * For best timing compile with interrupts off (define SUART_TURN_OFF_INTERRUPTS_WHILE_TRANSMIT),
- * but at 9600 bauds with short interrupts it is not necessary
  * v1.0 - clean C code, inspired from complex arduino C++ library
  * v1.1 - correct assembly routine so it compiles in gcc 4.4
  * v1.2 - add support for 2 suart pins
  * v1.3 - switch for MarcDuino v1 and v2 Suart2 pin in header
+ * v1.4 - interrupt driven transmit from per-port ring buffers, no more busy-wait delays
+ * 		  with interrupts turned off. Bits are timed by Timer2 output compares A and B.
+ * v1.5 - staging buffers: the main loop stages what one pass sends, which goes to the
+ * 		  ring buffer in one copy and leaves out an HP or display command sent twice in a row.
+ * 		  suart_putn() for numbers, instead of sprintf().
  *
 */
 
@@ -16,122 +18,239 @@
 #include <stdio.h>			// for sprintf(), don't use if you are short on memory
 *********/
 
-#include <avr/interrupt.h>
-#include <avr/pgmspace.h>
+#include <string.h>			// for memcmp()
+#include "hal.h"
 #include "toolbox.h"
 #include "suart.h"
+#include "isrprof.h"	// interrupt profiling, when enabled
+#include "fmt.h"		// for suart_putn()
 
-// Delay lookup table
+// Bit period lookup table
+// Timer2 runs free at F_CPU/SUART_TIMER_PRESCALER, each port reschedules its own output compare
+// one bit period ahead in its interrupt. Periods are 8.8 fixed point Timer2 ticks.
+// At 16 MHz: 9600 bauds is 52.08 ticks (104.17 us), 2400 bauds is 208.33 ticks (416.67 us)
 
-typedef struct _DELAY_TABLE
+typedef struct _PERIOD_TABLE
 {
   long baud;
-  unsigned short rx_delay_centering;
-  unsigned short rx_delay_intrabit;
-  unsigned short rx_delay_stopbit;
-  unsigned short tx_delay;
-} DELAY_TABLE;
+  uint16_t tx_period;
+} PERIOD_TABLE;
 
-// delay tables are available for 8 MHz, 16 MHz and 20 MHz clocks only
 // stored in program memory to save RAM
-
-#if F_CPU == 16000000
-
-static const DELAY_TABLE PROGMEM suart_delay_table[] =
-{
-  //  baud    rxcenter   rxintra    rxstop    tx
-  { 115200,   1,         17,        17,       12,    },
-  { 57600,    10,        37,        37,       33,    },
-  { 38400,    25,        57,        57,       54,    },
-  { 31250,    31,        70,        70,       68,    },
-  { 28800,    34,        77,        77,       74,    },
-  { 19200,    54,        117,       117,      114,   },
-  { 14400,    74,        156,       156,      153,   },
-  { 9600,     114,       236,       236,      233,   },
-  { 4800,     233,       474,       474,      471,   },
-  { 2400,     471,       950,       950,      947,   },
-  { 1200,     947,       1902,      1902,     1899,  },
-  { 300,      3804,      7617,      7617,     7614,  },
+static const PERIOD_TABLE PROGMEM suart_period_table[] =
+{
+  //  baud    tx period (ticks * 256)
+  { 38400,    SUART_BIT_PERIOD(38400), },
+  { 28800,    SUART_BIT_PERIOD(28800), },
+  { 19200,    SUART_BIT_PERIOD(19200), },
+  { 14400,    SUART_BIT_PERIOD(14400), },
+  { 9600,     SUART_BIT_PERIOD(9600),  },
+  { 4800,     SUART_BIT_PERIOD(4800),  },
+  { 2400,     SUART_BIT_PERIOD(2400),  },
 };
 
-const int XMIT_START_ADJUSTMENT = 5;
-
-#elif F_CPU == 8000000
-
-static const DELAY_TABLE suart_delay_table[] PROGMEM =
-{
-  //  baud    rxcenter    rxintra    rxstop  tx
-  { 115200,   1,          5,         5,      3,      },
-  { 57600,    1,          15,        15,     13,     },
-  { 38400,    2,          25,        26,     23,     },
-  { 31250,    7,          32,        33,     29,     },
-  { 28800,    11,         35,        35,     32,     },
-  { 19200,    20,         55,        55,     52,     },
-  { 14400,    30,         75,        75,     72,     },
-  { 9600,     50,         114,       114,    112,    },
-  { 4800,     110,        233,       233,    230,    },
-  { 2400,     229,        472,       472,    469,    },
-  { 1200,     467,        948,       948,    945,    },
-  { 300,      1895,       3805,      3805,   3802,   },
-};
+// shortest and longest periods the interrupt routine can handle
+#define SUART_MIN_PERIOD	(8*256)		// leaves time for the interrupt itself and others
+#define SUART_MAX_PERIOD	(255*256)	// has to fit in the 8 bit Timer2 compare
+
+// returned by suart_tx_step when there is nothing left to send
+#define SUART_IDLE	0xFF
+
+// transmitter state, one per port
+// head is only written by the queuing functions, tail only by the interrupt
+typedef struct
+{
+	volatile uint8_t head;		// next free slot in the ring buffer
+	volatile uint8_t tail;		// next byte to send
+	uint8_t shift;				// byte being shifted out, lsb first
+	uint8_t bits;				// bits left to send in the current frame, 0 = between frames
+	uint8_t frac;				// fractional tick accumulator
+	uint16_t period;			// bit period, 0 means port not initialized
+	suart_stats_t* stats;
+} suart_tx_t;
+
+// staging buffer, one per port, only used from the main loop
+// Bytes before start are whole commands, ending with \r
+typedef struct
+{
+	uint8_t length;				// bytes staged
+	uint8_t start;				// start of the command being staged
+	uint8_t previous;			// start of the command before it, when start is not 0
+	uint8_t broken;				// a command did not fit, its end goes straight out
+	uint8_t repeats;			// leave out HP and display commands sent twice in a row
+} suart_stage_t;
+
+typedef void (*suart_write_t)(const uint8_t* data, uint8_t n);
 
-const int XMIT_START_ADJUSTMENT = 4;
+volatile uint8_t suart_dropped;
+suart_stats_t suart_stats;
+static uint8_t suart_staging;	// suart_stage_begin() calls not flushed yet
 
-#elif F_CPU == 20000000
+// commands that do nothing more when sent again right after themselves: HP (*) and JEDI display (@)
+// Only the command just before is compared: "*ON00;*OF00;*ON00" has to end with the HP on.
+#define SUART_REPEATABLE(c)	((c) == '*' || (c) == '@')
 
-// 20MHz support courtesy of the good people at macegr.com.
-// Thanks, Garrett!
+/*****************
+ * Private functions shared by both ports
+ *****************/
 
-static const DELAY_TABLE PROGMEM suart_delay_table[] =
+// look up the bit period for a baud rate, returns 0 if the baud rate is not supported
+static uint16_t suart_lookup_period(long speed)
 {
-  //  baud    rxcenter    rxintra    rxstop  tx
-  { 115200,   3,          21,        21,     18,     },
-  { 57600,    20,         43,        43,     41,     },
-  { 38400,    37,         73,        73,     70,     },
-  { 31250,    45,         89,        89,     88,     },
-  { 28800,    46,         98,        98,     95,     },
-  { 19200,    71,         148,       148,    145,    },
-  { 14400,    96,         197,       197,    194,    },
-  { 9600,     146,        297,       297,    294,    },
-  { 4800,     296,        595,       595,    592,    },
-  { 2400,     592,        1189,      1189,   1186,   },
-  { 1200,     1187,       2379,      2379,   2376,   },
-  { 300,      4759,       9523,      9523,   9520,   },
-};
+	uint8_t i;
+	for (i=0; i<sizeof(suart_period_table)/sizeof(suart_period_table[0]); ++i)
+	{
+		long baud = pgm_read_dword(&suart_period_table[i].baud);
+		if (baud == speed)
+		{
+			uint16_t period = pgm_read_word(&suart_period_table[i].tx_period);
+			if(period < SUART_MIN_PERIOD || period > SUART_MAX_PERIOD) return 0;
+			return period;
+		}
+	}
+	return 0;
+}
+
+// Timer2 free running in normal mode, shared by both ports. Safe to call twice.
+static void suart_timer_init()
+{
+	TCCR2A = 0;					// normal mode, output compare pins disconnected
+	TCCR2B = SUART_TIMER_CS;	// start counting
+}
 
-const int XMIT_START_ADJUSTMENT = 6;
+// Called from the interrupt at each bit boundary, returns the pin level for the next bit
+// Frame is 1 start bit, 8 data bits lsb first, 1 stop bit
+static inline uint8_t suart_tx_step(suart_tx_t* tx, uint8_t* buffer, uint8_t mask)
+{
+	if(tx->bits == 0)	// between frames, fetch the next byte
+	{
+		uint8_t tail = tx->tail;
+		if(tail == tx->head) return SUART_IDLE;
+		tx->shift = buffer[tail];
+		tx->tail = (tail+1) & mask;
+		tx->bits = 9;
+		return LOW;		// start bit
+	}
+	if(--tx->bits)		// data bits
+	{
+		uint8_t level = tx->shift & 0x01;
+		tx->shift >>= 1;
+		return level;
+	}
+	return HIGH;		// stop bit, the next call comes a full bit period later
+}
 
-#else
+// number of whole ticks to the next bit boundary, carrying the fraction over
+static inline uint8_t suart_tx_advance(suart_tx_t* tx)
+{
+	uint16_t step = tx->frac + tx->period;
+	tx->frac = (uint8_t) step;
+	return (uint8_t)(step >> 8);
+}
 
-#error This version of SoftUart supports only 20, 16 and 8MHz processors
+// Queues n bytes, waits if the buffer is full.
+// The bytes are copied in one go as long as they fit, so they go out back to back.
+// Returns the bytes queued, fewer if the buffer was full while interrupts were off (we can't wait then)
+static uint8_t suart_tx_queue(suart_tx_t* tx, uint8_t* buffer, uint8_t mask, const uint8_t* data, uint8_t n)
+{
+	uint8_t sreg = SREG;
+	uint8_t head, i = 0;
 
-#endif
+	// may be called both from the main loop and from realtime callbacks, so protect the head
+	cli();
+	head = tx->head;
+	while(i < n)
+	{
+		if(((head+1) & mask) == tx->tail)
+		{
+			if(!(sreg & _BV(SREG_I)))	// called with interrupts off, the buffer will never drain
+			{
+				suart_dropped += n-i;
+				break;
+			}
+			tx->head = head;
+			sei();						// let the bit interrupt drain the buffer
+			hal_idle();
+			cli();
+			continue;
+		}
+		buffer[head] = data[i++];
+		head = (head+1) & mask;
+	}
+	tx->head = head;
+	tx->stats->bytes += i;
+	tx->stats->bursts++;
+	SREG = sreg;
+	return i;
+}
 
+// 1 if the command just staged is an HP or display command, the same as the one staged before it
+static uint8_t suart_stage_repeat(suart_stage_t* stage, const uint8_t* buffer)
+{
+	const uint8_t* command = buffer + stage->start;
+	uint8_t n = stage->length - stage->start;
 
-// variables used by this module [NEED TO RENAME]
-
-static uint16_t _rx_delay_centering;
-static uint16_t _rx_delay_intrabit;
-static uint16_t _rx_delay_stopbit;
-static uint16_t _tx_delay;
-
-// tuned delay loop
-inline void suart_tunedDelay(uint16_t delay) {
-  uint8_t tmp=0;
-
-  asm volatile("sbiw    %0, 0x01 \n\t"
-    "ldi %1, 0xFF \n\t"
-    "cpi %A0, 0xFF \n\t"
-    "cpc %B0, %1 \n\t"
-    "brne .-10 \n\t"
-//    : "+r" (delay), "+a" (tmp)
-//	for gcc 4.4 compiler, need to use 'w' qualifier to force it to use upper registers for sbiw
-//	instruction. Any register 'r' will not work with sbiw causing asm error.
-    : "+w" (delay), "+a" (tmp)
-    : "0" (delay)
-    );
+	if(!SUART_REPEATABLE(command[0]) || !stage->start) return 0;
+	if(stage->start - stage->previous != n) return 0;
+	return !memcmp(buffer + stage->previous, command, n);
 }
 
+// Stages one byte. When the buffer is full, what it holds goes out right away.
+static void suart_stage_put(suart_stage_t* stage, uint8_t* buffer, uint8_t size, suart_write_t write, uint8_t b)
+{
+	if(stage->length == size)
+	{
+		write(buffer, size);
+		stage->broken = stage->repeats && stage->start != size;
+		stage->length = stage->start = 0;
+	}
+	if(stage->broken)
+	{
+		write(&b, 1);
+		if(b == '\r') stage->broken = 0;
+		return;
+	}
+	buffer[stage->length++] = b;
+	if(b != '\r') return;
+	if(stage->repeats && suart_stage_repeat(stage, buffer))
+	{
+		// the one before stays the last command staged
+		suart_stats.repeats += stage->length - stage->start;
+		stage->length = stage->start;
+		return;
+	}
+	stage->previous = stage->start;
+	stage->start = stage->length;
+}
+
+// what is left staged goes to the ring buffer
+static void suart_stage_out(suart_stage_t* stage, uint8_t* buffer, suart_write_t write)
+{
+	if(stage->length) write(buffer, stage->length);
+	stage->length = stage->start = 0;
+	stage->broken = 0;
+}
+
+// bytes free in the ring buffer, less what is staged for it
+static uint8_t suart_free(uint8_t ring, suart_stage_t* stage)
+{
+	if(!suart_staging) return ring;
+	return ring > stage->length ? ring - stage->length : 0;
+}
+
+/*****************
+ * suart, first port
+ *****************/
+
+static uint8_t suart_buffer[SUART_TX_BUFSIZE];
+static suart_tx_t suart_tx = { .stats = &suart_stats };
+static uint8_t suart_stage_buffer[SUART_STAGE_SIZE];
+static suart_stage_t suart_stage = { .repeats = 1 };
+
+#if SUART_STAGE_SIZE >= SUART_TX_BUFSIZE
+#error "SUART_STAGE_SIZE has to be smaller than SUART_TX_BUFSIZE"
+#endif
+
 inline void suart_tx_pin_write(uint8_t pin_state)
 {
     digitalWrite(SUART_TX_PORT, SUART_TX_PIN, pin_state);
@@ -140,69 +259,47 @@ inline void suart_tx_pin_write(uint8_t pin_state)
 // Module Init
 void suart_init(long speed)
 {
-  _rx_delay_centering=0;
-  _rx_delay_intrabit=0;
-  _rx_delay_stopbit=0;
-  _tx_delay=0;
+  // stop any transmission in progress
+  clear_bit(TIMSK2, OCIE2A);
+  suart_tx.head = suart_tx.tail = 0;
+  suart_tx.bits = 0;
+  suart_tx.frac = 0;
 
   // set Tx pin for output
   digitalMode(SUART_TX_PORT, SUART_TX_PIN, OUTPUT);
   digitalWrite(SUART_TX_PORT, SUART_TX_PIN, HIGH);
 
-  // read delay settings from table to match baud rate
+  // read bit period from table to match baud rate, 0 disables the port
+  suart_tx.period = suart_lookup_period(speed);
+
+  suart_timer_init();
+}
+
+static void suart_write(const uint8_t* data, uint8_t n)
+{
+  if(!suart_tx_queue(&suart_tx, suart_buffer, SUART_TX_BUFSIZE-1, data, n)) return;
 
-  uint8_t i;
-  for (i=0; i<sizeof(suart_delay_table)/sizeof(suart_delay_table[0]); ++i)
+  // start the bit interrupt if it is not already running
+  uint8_t sreg = SREG;
+  cli();
+  if(!bit_is_set(TIMSK2, OCIE2A))
   {
-    long baud = pgm_read_dword(&suart_delay_table[i].baud);
-    if (baud == speed)
-    {
-      _rx_delay_centering = pgm_read_word(&suart_delay_table[i].rx_delay_centering);
-      _rx_delay_intrabit = pgm_read_word(&suart_delay_table[i].rx_delay_intrabit);
-      _rx_delay_stopbit = pgm_read_word(&suart_delay_table[i].rx_delay_stopbit);
-      _tx_delay = pgm_read_word(&suart_delay_table[i].tx_delay);
-      break;
-    }
+	  suart_tx.frac = 0;
+	  OCR2A = TCNT2 + 2;			// first bit starts right away
+	  set_bit(TIFR2, OCF2A);		// clear any stale compare flag (by writing a 1)
+	  set_bit(TIMSK2, OCIE2A);
   }
+  SREG = sreg;
 }
 
-
 void suart_putc(uint8_t b)
 {
-	uint8_t mask;
-
-  if (_tx_delay == 0)
+  if (suart_tx.period == 0)
     return;
 
-#ifdef SUART_TURN_OFF_INTERRUPTS_WHILE_TRANSMIT
-  uint8_t oldSREG = SREG;
-  cli();  // turn off interrupts for a clean txmit
-#endif
-
-  // Write the start bit
-  suart_tx_pin_write(LOW);
-  suart_tunedDelay(_tx_delay + XMIT_START_ADJUSTMENT);
-
-  // Write each of the 8 bits
-
-	for (mask = 0x01; mask; mask <<= 1)
-	{
-	  if (b & mask) // choose bit
-		suart_tx_pin_write(HIGH); // send 1
-	  else
-		suart_tx_pin_write(LOW); // send 0
-
-	  suart_tunedDelay(_tx_delay);
-	}
-
-	suart_tx_pin_write(HIGH); // restore pin to natural state
-
-#ifdef SUART_TURN_OFF_INTERRUPTS_WHILE_TRANSMIT
-  SREG = oldSREG; // turn interrupts back on
-  sei();
-#endif
-
-  suart_tunedDelay(_tx_delay);
+  // realtime callbacks, with interrupts off, go straight to the ring buffer
+  if(suart_staging && (SREG & _BV(SREG_I))) suart_stage_put(&suart_stage, suart_stage_buffer, SUART_STAGE_SIZE, suart_write, b);
+  else suart_write(&b, 1);
 }
 
 void suart_puts(char* string)
@@ -230,13 +327,54 @@ void suart_puts_p(const char *progmem_s )
       suart_putc(c);
 }
 
+// value in decimal, zero padded to width digits (up to 3), 0 for no padding
+void suart_putn(uint8_t value, uint8_t width)
+{
+	char digits[FMT_DEC_DIGITS+1];
+
+	fmt_dec(digits, value, width < 3 ? width : 3, '0');
+	suart_puts(digits);
+}
+
+// returns 1 when the ring buffer is empty and the last stop bit is out
+uint8_t suart_tx_complete()
+{
+	return !bit_is_set(TIMSK2, OCIE2A);
+}
+
+uint8_t suart_tx_free()
+{
+	return suart_free((suart_tx.tail-suart_tx.head-1) & (SUART_TX_BUFSIZE-1), &suart_stage);
+}
+
+// bit timing interrupt, keep it short: it delays the servo pulses as much as it runs
+ISR(TIMER2_COMPA_vect)
+{
+	ISRPROF_ENTER((uint8_t)(TCNT2-OCR2A)*ISRPROF_T2_TICKS);
+	uint8_t level = suart_tx_step(&suart_tx, suart_buffer, SUART_TX_BUFSIZE-1);
+	if(level == SUART_IDLE)
+	{
+		clear_bit(TIMSK2, OCIE2A);	// all sent, pin stays high
+		ISRPROF_EXIT(ISRPROF_T2COMPA);
+		return;
+	}
+	suart_tx_pin_write(level);
+	OCR2A += suart_tx_advance(&suart_tx);
+	ISRPROF_EXIT(ISRPROF_T2COMPA);
+}
+
 // **** suart2 functions for dual port ********
 #ifdef SUART_DUAL_PORT
 
-static uint16_t _rx2_delay_centering;
-static uint16_t _rx2_delay_intrabit;
-static uint16_t _rx2_delay_stopbit;
-static uint16_t _tx2_delay;
+suart_stats_t suart2_stats;
+static uint8_t suart2_buffer[SUART2_TX_BUFSIZE];
+static suart_tx_t suart2_tx = { .stats = &suart2_stats };
+static uint8_t suart2_stage_buffer[SUART2_STAGE_SIZE];
+static suart_stage_t suart2_stage;		// sound player commands, all kept
+
+#if SUART2_STAGE_SIZE >= SUART2_TX_BUFSIZE
+#error "SUART2_STAGE_SIZE has to be smaller than SUART2_TX_BUFSIZE"
+#endif
 
 inline void suart2_tx_pin_write(uint8_t pin_state)
 {
@@ -246,30 +384,20 @@ inline void suart2_tx_pin_write(uint8_t pin_state)
 // Module Init
 void suart2_init(long speed)
 {
-  _rx2_delay_centering=0;
-  _rx2_delay_intrabit=0;
-  _rx2_delay_stopbit=0;
-  _tx2_delay=0;
+  // stop any transmission in progress
+  clear_bit(TIMSK2, OCIE2B);
+  suart2_tx.head = suart2_tx.tail = 0;
+  suart2_tx.bits = 0;
+  suart2_tx.frac = 0;
 
   // set Tx pin for output
   digitalMode(SUART2_TX_PORT, SUART2_TX_PIN, OUTPUT);
   digitalWrite(SUART2_TX_PORT, SUART2_TX_PIN, HIGH);
 
-  // read delay settings from table to match baud rate
+  // read bit period from table to match baud rate, 0 disables the port
+  suart2_tx.period = suart_lookup_period(speed);
 
-  uint8_t i;
-  for (i=0; i<sizeof(suart_delay_table)/sizeof(suart_delay_table[0]); ++i)
-  {
-    long baud = pgm_read_dword(&suart_delay_table[i].baud);
-    if (baud == speed)
-    {
-      _rx2_delay_centering = pgm_read_word(&suart_delay_table[i].rx_delay_centering);
-      _rx2_delay_intrabit = pgm_read_word(&suart_delay_table[i].rx_delay_intrabit);
-      _rx2_delay_stopbit = pgm_read_word(&suart_delay_table[i].rx_delay_stopbit);
-      _tx2_delay = pgm_read_word(&suart_delay_table[i].tx_delay);
-      break;
-    }
-  }
+  suart_timer_init();
 
   /**** debug
   suart2_puts("\r\nsuart2 output test\r\n");
@@ -279,43 +407,30 @@ void suart2_init(long speed)
   ***********/
 }
 
+static void suart2_write(const uint8_t* data, uint8_t n)
+{
+  if(!suart_tx_queue(&suart2_tx, suart2_buffer, SUART2_TX_BUFSIZE-1, data, n)) return;
+
+  // start the bit interrupt if it is not already running
+  uint8_t sreg = SREG;
+  cli();
+  if(!bit_is_set(TIMSK2, OCIE2B))
+  {
+	  suart2_tx.frac = 0;
+	  OCR2B = TCNT2 + 2;			// first bit starts right away
+	  set_bit(TIFR2, OCF2B);		// clear any stale compare flag (by writing a 1)
+	  set_bit(TIMSK2, OCIE2B);
+  }
+  SREG = sreg;
+}
 
 void suart2_putc(uint8_t b)
 {
-	uint8_t mask;
-
-  if (_tx2_delay == 0)
+  if (suart2_tx.period == 0)
     return;
 
-#ifdef SUART_TURN_OFF_INTERRUPTS_WHILE_TRANSMIT
-  uint8_t oldSREG = SREG;
-  cli();  // turn off interrupts for a clean txmit
-#endif
-
-  // Write the start bit
-  suart2_tx_pin_write(LOW);
-  suart_tunedDelay(_tx2_delay + XMIT_START_ADJUSTMENT);
-
-  // Write each of the 8 bits
-
-	for (mask = 0x01; mask; mask <<= 1)
-	{
-	  if (b & mask) // choose bit
-		suart2_tx_pin_write(HIGH); // send 1
-	  else
-		suart2_tx_pin_write(LOW); // send 0
-
-	  suart_tunedDelay(_tx2_delay);
-	}
-
-	suart2_tx_pin_write(HIGH); // restore pin to natural state
-
-#ifdef SUART_TURN_OFF_INTERRUPTS_WHILE_TRANSMIT
-  SREG = oldSREG; // turn interrupts back on
-  sei();
-#endif
-
-  suart_tunedDelay(_tx2_delay);
+  if(suart_staging && (SREG & _BV(SREG_I))) suart_stage_put(&suart2_stage, suart2_stage_buffer, SUART2_STAGE_SIZE, suart2_write, b);
+  else suart2_write(&b, 1);
 }
 
 void suart2_puts(char* string)
@@ -335,7 +450,49 @@ void suart2_puts_p(const char *progmem_s )
       suart2_putc(c);
 }
 
+uint8_t suart2_tx_complete()
+{
+	return !bit_is_set(TIMSK2, OCIE2B);
+}
 
+uint8_t suart2_tx_free()
+{
+	return suart_free((suart2_tx.tail-suart2_tx.head-1) & (SUART2_TX_BUFSIZE-1), &suart2_stage);
+}
+
+ISR(TIMER2_COMPB_vect)
+{
+	ISRPROF_ENTER((uint8_t)(TCNT2-OCR2B)*ISRPROF_T2_TICKS);
+	uint8_t level = suart_tx_step(&suart2_tx, suart2_buffer, SUART2_TX_BUFSIZE-1);
+	if(level == SUART_IDLE)
+	{
+		clear_bit(TIMSK2, OCIE2B);
+		ISRPROF_EXIT(ISRPROF_T2COMPB);
+		return;
+	}
+	suart2_tx_pin_write(level);
+	OCR2B += suart_tx_advance(&suart2_tx);
+	ISRPROF_EXIT(ISRPROF_T2COMPB);
+}
+
+#endif
+
+/*****************
+ * Staging, both ports
+ *****************/
 
+// From now on the main loop output is staged, until suart_stage_flush()
+// Calls can nest, the output goes out at the last flush.
+void suart_stage_begin()
+{
+	suart_staging++;
+}
 
+void suart_stage_flush()
+{
+	if(!suart_staging || --suart_staging) return;
+	suart_stage_out(&suart_stage, suart_stage_buffer, suart_write);
+#ifdef SUART_DUAL_PORT
+	suart_stage_out(&suart2_stage, suart2_stage_buffer, suart2_write);
 #endif
+}
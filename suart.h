@@ -4,9 +4,15 @@
  *
  * Turns a regular I/O pin into a serial output
  *
- * In order to preserve hardware timers for other uses, this uses calibrated delays
- * For best timing compile with interrupts off (define SUART_TURN_OFF_INTERRUPTS_WHILE_TRANSMIT),
- * but at 9600 bauds with short interrupts it does not matter
+ * Bytes are queued in a per-port ring buffer and shifted out one bit at a time
+ * by the Timer2 output compare interrupts (channel A for suart, channel B for suart2).
+ * suart_putc() and suart_puts() return as soon as the bytes are queued, they only wait
+ * if the ring buffer is full. Timer2 cannot be used for anything else.
+ *
+ * Between suart_stage_begin() and suart_stage_flush(), the main loop output is staged
+ * instead: what one main loop pass sends goes to each ring buffer in one copy at the
+ * flush, and an HP (*) or JEDI display (@) command staged twice in a row is sent once.
+ * Output from realtime callbacks, with interrupts off, is never staged.
  *
  * Created July 7, 2012
  * Author: Marc Verdiell
@@ -17,30 +23,40 @@
 #ifndef suart_h
 #define suart_h
 
-#include <avr/pgmspace.h>	// for reading strings from program memory
+#include "hal.h"			// for reading strings from program memory
 #include "main.h"			// for the _MARCDUINOV2_ compile flag
 
-#ifndef GCC_VERSION
-#define GCC_VERSION (__GNUC__ * 10000 + __GNUC_MINOR__ * 100 + __GNUC_PATCHLEVEL__)
-#endif
-
 #ifndef F_CPU
 /* prevent compiler error by supplying a 16 MHz default */
 # warning "F_CPU not defined for <suart.h>"
 # define F_CPU 16000000UL
 #endif
 
-
-// for very high baud rates you might need to uncomment this for precise timing.
-// It will turn off interrupts while transmitting on the software UART.
-// But at 9600 bauds no need to do this if running interrupt handlers are fast enough
-
-#define SUART_TURN_OFF_INTERRUPTS_WHILE_TRANSMIT
-
-
 // comment the following line out if you only need one SUART port
 #define SUART_DUAL_PORT
 
+// transmit ring buffer sizes, must be a power of two no larger than 128
+// A :SExx sequence command queues about 40 bytes to the slave, a few to the sound player
+#define SUART_TX_BUFSIZE	64
+#define SUART2_TX_BUFSIZE	32
+
+// staging buffer sizes, smaller than the ring buffers. When full, what they hold goes out.
+#define SUART_STAGE_SIZE	48
+#define SUART2_STAGE_SIZE	24
+
+// Timer2 prescaler. Bit periods are counted in Timer2 ticks and must fit in 8 bits.
+// At 16 MHz a tick is 2 us, which covers 2400 to 38400 bauds.
+#if F_CPU > 16000000
+#define SUART_TIMER_PRESCALER	64
+#define SUART_TIMER_CS			(_BV(CS22))				// clk/64
+#else
+#define SUART_TIMER_PRESCALER	32
+#define SUART_TIMER_CS			(_BV(CS21) | _BV(CS20))	// clk/32
+#endif
+
+// bit period in Timer2 ticks, 8.8 fixed point. The fractional part is accumulated
+// by the interrupt routine so the average baud rate is exact.
+#define SUART_BIT_PERIOD(baud) ((uint16_t)(((F_CPU/SUART_TIMER_PRESCALER)*256UL + (baud)/2)/(baud)))
 
 //****** first default port **********
 // Put your Tx pin location here
@@ -53,6 +69,9 @@ void suart_init(long baudrate);
 void suart_putc(uint8_t b);
 void suart_puts(char* string);
 void suart_puts_p(const char *progmem_s );
+uint8_t suart_tx_complete();	// returns 1 once all queued bytes have been sent out on the pin
+uint8_t suart_tx_free();		// bytes that can be queued without waiting
+void suart_putn(uint8_t value, uint8_t width);	// decimal, zero padded to width digits, 0 for none
 
 //*********second optional port ******
 #ifdef SUART_DUAL_PORT
@@ -74,5 +93,25 @@ void suart2_init(long baudrate);
 void suart2_putc(uint8_t b);
 void suart2_puts(char* string);
 void suart2_puts_p(const char *progmem_s );
+uint8_t suart2_tx_complete();
+uint8_t suart2_tx_free();
+
+// both ports
+void suart_stage_begin();
+void suart_stage_flush();
+
+// bytes dropped because a ring buffer was full while interrupts were off (cannot wait then)
+extern volatile uint8_t suart_dropped;
+
+// output counters, one per port
+typedef struct
+{
+	uint16_t bytes;			// bytes queued in the ring buffer
+	uint16_t bursts;		// copies to the ring buffer, one per byte when not staged
+	uint16_t repeats;		// bytes of repeated commands left out
+} suart_stats_t;
+
+extern suart_stats_t suart_stats;
+extern suart_stats_t suart2_stats;
 
 #endif
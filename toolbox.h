@@ -12,9 +12,8 @@
 #ifndef toolbox_h
 #define toolbox_h
 
-#include <avr/io.h>
 #include <stdint.h> 		// uint8_t and companions
-#include <avr/sfr_defs.h> 	// register type definitions and _BV def
+#include "hal.h" 			// registers, register type definitions and _BV def
 
 // for compatibility with Arduino (wich calls it boolean)
 typedef uint8_t bool;
@@ -0,0 +1,78 @@
+/*
+ * baudcheck.c
+ * Host check of the console baud rates
+ *
+ * For each #SB baud rate code, programs the console UART with serial_init() and
+ * reads the rate back from UBRR0 and U2X0, then prints the error against the
+ * nominal rate, next to the error of the normal mode only UBRR of v2.1.
+ * Fails if a rate is more off than the datasheet recommends for the mode serial_ubrr()
+ * picked: BAUD_MAX_NORMAL in normal mode, BAUD_MAX_U2X in double speed mode, whose
+ * receiver samples 8 times per bit instead of 16. The codes left out must give 9600.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o baudcheck \
+ *       tools/baudcheck.c serial.c fifo.c realtime.c hal_host.c
+ *   ./baudcheck
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <stdio.h>
+#include "hal.h"
+#include "serial.h"
+
+#define BAUD_MAX_NORMAL	2.0		// percent, 8N1
+#define BAUD_MAX_U2X	1.5
+
+static double baud_error(uint32_t baudrate, uint8_t divider, uint16_t ubrr)
+{
+	double actual=(double)F_CPU/divider/(ubrr+1);
+	return (actual-baudrate)*100.0/baudrate;
+}
+
+int main()
+{
+	uint32_t baudrate;
+	uint16_t ubrr, old_ubrr;
+	uint8_t code, divider;
+	double error, old_error, limit;
+	int fail=0;
+
+	printf("F_CPU %lu\n", (unsigned long)F_CPU);
+	printf("code    baud  mode  UBRR   error   v2.1 UBRR   error\n");
+	for(code=0; code<SERIAL_BAUD_CODES; code++)
+	{
+		if(!serial_baud_available(code))
+		{
+			printf("%4u left out, gives %lu  %s\n", code, (unsigned long)serial_baud_rate(code),
+					serial_baud_rate(code)==9600 ? "ok" : "FAIL");
+			if(serial_baud_rate(code)!=9600) fail=1;
+			continue;
+		}
+		baudrate=serial_baud_rate(code);
+		serial_init(baudrate);
+		ubrr=((UBRR0H & 0x0F)<<8) | UBRR0L;
+		divider=bit_is_set(UCSR0A, U2X0) ? 8 : 16;
+		error=baud_error(baudrate, divider, ubrr);
+		limit=divider==8 ? BAUD_MAX_U2X : BAUD_MAX_NORMAL;
+
+		old_ubrr=(uint16_t)(F_CPU/(16UL*baudrate)-1);
+		old_error=baud_error(baudrate, 16, old_ubrr);
+
+		printf("%4u %7lu  %-4s %5u %6.2f%%      %5u %6.2f%%  %s\n", code, (unsigned long)baudrate,
+				divider==8 ? "U2X" : "norm", ubrr, error, old_ubrr, old_error,
+				error>limit || error<-limit ? "FAIL" : "ok");
+		if(error>limit || error<-limit) fail=1;
+	}
+
+	// unknown codes, from an erased EEPROM, fall back to 9600
+	if(serial_baud_rate(0xFF)!=9600)
+	{
+		printf("code 255 is not 9600\n");
+		fail=1;
+	}
+	return fail;
+}
@@ -0,0 +1,73 @@
+/*
+ * bootbench.c
+ * Host measure of the time from power up to the first command, see boot.h
+ *
+ * Runs the whole firmware on the host simulator, main() of main.c is renamed, with a
+ * setup command waiting on the console from power up, as when R2 Touch connects while
+ * the dome boots. A function on the realtime tick watches for the command to take effect
+ * and prints the virtual time it took, to 1/100 s. The console and the suart outputs
+ * are silenced. The fresh EEPROM has the defaults: startup sound on, MP3 Trigger.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o bootbench \
+ *       tools/bootbench.c boot.c clock.c command.c fifo.c fmt.c frame.c i2c.c isrprof.c latency.c \
+ *       MP3sound.c realtime.c routine.c sequencer.c serial.c servo.c settings.c stackmon.c \
+ *       stream.c suart.c wmath.c hal_host.c
+ *   ./bootbench
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define main marcduino_main
+#include "main.c"
+#undef main
+
+#define BENCH_COMMAND	"#ST07\r"		// slave delay 7, the default is 0
+#define BENCH_VALUE		7
+
+static FILE* bench_out;
+static uint8_t bench_done;
+
+// realtime tick
+static void bench_watch()
+{
+	if(bench_done || settings.slave_delay!=BENCH_VALUE) return;
+	bench_done=1;
+	fprintf(bench_out, "first command done after %.2f s\n", (double)hal_cycles()/F_CPU);
+	exit(0);
+}
+
+// the simulation stops some time after the end of the console input
+static void bench_exit()
+{
+	if(!bench_done) fprintf(bench_out, "command not done\n");
+	fflush(bench_out);
+}
+
+int main(int argc, char** argv)
+{
+	int console[2], null;
+
+	bench_out=fdopen(dup(1), "w");
+	atexit(bench_exit);
+
+	// the command is on the console input from the start
+	if(pipe(console)) return 1;
+	if(write(console[1], BENCH_COMMAND, strlen(BENCH_COMMAND))<0) return 1;
+	close(console[1]);
+	dup2(console[0], 0);
+
+	null=open("/dev/null", O_WRONLY);
+	dup2(null, 1);
+	dup2(null, 2);
+
+	rt_add_function(bench_watch);
+	marcduino_main();
+	return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * clockbench.c
+ * Host check of the Timer1 time base, see clock.h, and of the sequencer timing on it
+ *
+ * The bench plays Timer1: it sets TCNT1 to the time it wants, raises TOV1 at each wrap
+ * and runs the overflow interrupt, on time or late.
+ * - micros() and millis() against the true time: at any count, with the overflow
+ *   pending (TOV1 set, small count) and with TOV1 set just after the count was read
+ * - ten hours of random steps with the overflow serviced up to three steps late:
+ *   both exact to the truncated true time, millis() never goes back
+ * - one linear move, 1000 to 2000 us at speed 7 per 1/100 s, run by sequencer.c with the
+ *   realtime tick every 10 ms and seq_domotion() every servo frame of 39.1 ms, with the
+ *   tick and frame phases swept. Each frame's position is compared with the ideal move
+ *   from the time the sequence started, as a time error in ms. v3.7 moved the servos on
+ *   the tick: its column is the same move stepped on the ticks from the first tick after
+ *   the start, which is what the v3.7 sequencer put out. The sequencer now runs in whole
+ *   ms and positions in whole us: it should be within 1 ms and one position of the ideal.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o clockbench \
+ *       tools/clockbench.c sequencer.c servo.c realtime.c -lm
+ *   ./clockbench
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "hal.h"
+#include "sequencer.h"
+#include "realtime.h"
+
+// the register map of hal_host.c, without the rest of the simulation
+volatile uint8_t hal_io[HAL_IO_SIZE];
+
+#include "clock.c"
+
+// the real time tick, a plain function on the host
+void TIMER0_COMPA_vect(void);
+
+#define BENCH_TICK		20000		// Timer1 counts in 1/100 s
+#define BENCH_FRAME		78200		// Timer1 counts in one servo frame, 11 servos with the RC input pause
+#define BENCH_SPEED		7
+#define BENCH_FROM		1000
+#define BENCH_TO		2000
+
+static uint64_t bench_now;			// true time, Timer1 counts since clock_init()
+
+// on the chip, writing a 1 clears a flag: it stays set in the register map
+static void bench_clock_init()
+{
+	clock_init();
+	TIFR1=0;
+}
+
+// moves Timer1 to time t, the overflows on the way are serviced right away
+static void bench_time(uint64_t t)
+{
+	while((bench_now>>16)!=(t>>16))
+	{
+		bench_now=(bench_now|0xFFFF)+1;
+		TCNT1=0;
+		TIMER1_OVF_vect();
+	}
+	bench_now=t;
+	TCNT1=t&0xFFFF;
+}
+
+static int bench_result(const char* name, int ok)
+{
+	printf("%-52s %s\n", name, ok ? "ok" : "FAIL");
+	return !ok;
+}
+
+static int bench_clock_checks()
+{
+	uint64_t t;
+	uint32_t ms, last_ms=0;
+	uint8_t late=0, good;
+	int fail=0;
+
+	bench_clock_init();
+	bench_now=0;
+	bench_time(12345);
+	fail|=bench_result("micros() and millis() at a count", micros()==6172 && millis()==6);
+
+	// wrapped, the interrupt has not run
+	TCNT1=100;
+	set_bit(TIFR1, TOV1);
+	good=micros()==32768+50 && millis()==32;
+	TCNT1=0xFFF0;		// the count was read before the wrap
+	good&=micros()==0x7FF8 && millis()==32;
+	clear_bit(TIFR1, TOV1);
+	fail|=bench_result("overflow pending, TOV1 set", good);
+
+	// ten hours, random steps of up to 1.5 ms, the overflow serviced up to three steps late
+	bench_clock_init();
+	srand(1);
+	t=0;
+	good=1;
+	while(t<36000ULL*1000000*CLOCK_TICKS_PER_US)
+	{
+		uint64_t next=t+1+rand()%3000;
+		if((next>>16)!=(t>>16))
+		{
+			if(TIFR1 & _BV(TOV1)) TIMER1_OVF_vect();	// never two turns behind
+			set_bit(TIFR1, TOV1);
+			late=rand()%4;
+		}
+		t=next;
+		TCNT1=t&0xFFFF;
+		if((TIFR1 & _BV(TOV1)) && !late--)
+		{
+			clear_bit(TIFR1, TOV1);
+			TIMER1_OVF_vect();
+		}
+		ms=millis();
+		if(micros()!=(uint32_t)(t/CLOCK_TICKS_PER_US) || ms!=(uint32_t)(t/(1000*CLOCK_TICKS_PER_US)) || ms<last_ms) good=0;
+		last_ms=ms;
+	}
+	clear_bit(TIFR1, TOV1);
+	fail|=bench_result("ten hours, exact and monotonic, late overflows", good);
+	return fail;
+}
+
+static sequence_t const bench_move PROGMEM =
+{
+	{1, BENCH_FROM, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, 1, 1, _LIN},
+	{300, BENCH_TO, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, 1, 1, _LIN},
+	{0, BENCH_TO, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, _NP, 1, 1, _LIN},
+};
+static int16_t bench_speed[SERVO_NUM]={BENCH_SPEED};
+
+// ideal position, time in us from the start of the move
+static double bench_ideal(double us)
+{
+	double p=BENCH_FROM+us*BENCH_SPEED/10000.0;
+	return p>BENCH_TO ? BENCH_TO : p;
+}
+
+// time error of a position, in ms
+static double bench_error(double pos, double us)
+{
+	return fabs(pos-bench_ideal(us))*10.0/BENCH_SPEED;
+}
+
+static double old_max, old_sum, new_max, new_sum;
+static uint32_t frames;
+
+// one run, the start at a given phase of the ticks and frames
+static void bench_sequence(uint32_t tick_phase, uint32_t frame_phase)
+{
+	uint64_t tick, frame, start, end, move, first_tick;
+	double e, us;
+	int32_t old;
+
+	seq_loadsequence(bench_move, SEQ_SIZE(bench_move));
+	seq_loadspeed(bench_speed);
+	servo_set(1, BENCH_FROM);
+	start=bench_now;
+	tick=start+tick_phase;
+	frame=start+frame_phase;
+	first_tick=0;
+	end=start+2*1000000*CLOCK_TICKS_PER_US;
+	seq_startsequence();
+
+	while(tick<end || frame<end)
+	{
+		if(tick<=frame)
+		{
+			bench_time(tick);
+			TIMER0_COMPA_vect();
+			TIMER0_COMPA_vect();
+			TIMER0_COMPA_vect();
+			if(!first_tick) first_tick=tick;
+			tick+=BENCH_TICK;
+			continue;
+		}
+		bench_time(frame);
+		seq_domotion();
+		frame+=BENCH_FRAME;
+
+		// the move is the second row, 1/100 s after the ms the sequence started
+		move=start/(1000*CLOCK_TICKS_PER_US)*(1000*CLOCK_TICKS_PER_US)+BENCH_TICK;
+		if(!first_tick || bench_now<move) continue;
+		us=(double)(bench_now-move)/CLOCK_TICKS_PER_US;
+		if(bench_ideal(us-100000)>=BENCH_TO) continue;		// landed 100 ms ago
+
+		// v3.7: the second row on the tick after the first one, then a step on each tick after
+		old=BENCH_FROM;
+		if(bench_now>=first_tick+BENCH_TICK) old+=BENCH_SPEED*(int32_t)((bench_now-first_tick-BENCH_TICK)/BENCH_TICK);
+		if(old>BENCH_TO) old=BENCH_TO;
+		e=bench_error(old, us);
+		if(e>old_max) old_max=e;
+		old_sum+=e;
+		e=bench_error(servo_read(1), us);
+		if(e>new_max) new_max=e;
+		new_sum+=e;
+		frames++;
+	}
+	seq_stopsequence();
+}
+
+int main()
+{
+	uint32_t tp, fp;
+	int fail;
+
+	fail=bench_clock_checks();
+
+	bench_clock_init();
+	bench_now=0;
+	servo_init();
+	seq_init();
+	for(tp=0; tp<BENCH_TICK; tp+=BENCH_TICK/8)
+	{
+		for(fp=0; fp<BENCH_FRAME; fp+=BENCH_FRAME/16) bench_sequence(tp, fp);
+	}
+	printf("\nlinear move %u to %u at %u, %u frames, time error of the position at each frame\n",
+			BENCH_FROM, BENCH_TO, BENCH_SPEED, frames);
+	printf("%-12s %10s %10s\n", "", "max ms", "mean ms");
+	printf("%-12s %10.2f %10.2f\n", "v3.7 tick", old_max, old_sum/frames);
+	printf("%-12s %10.2f %10.2f\n", "millis()", new_max, new_sum/frames);
+	// the sequencer works in whole ms and whole us positions, one position is 10/BENCH_SPEED ms
+	fail|=bench_result("\nsequencer within 1 ms and a position of the ideal", new_max<1.0+10.0/BENCH_SPEED);
+	return fail;
+}
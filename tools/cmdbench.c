@@ -0,0 +1,268 @@
+/*
+ * cmdbench.c
+ * Host benchmark of the command dispatch
+ *
+ * Feeds a stream of command lines, as sent by the R2 Touch app with its default
+ * buttons, to two copies of the dispatcher and reports commands/second:
+ * - before: the strcmp()/atoi() chains of the old process_command() and parse_setup_command()
+ * - after: the command tables of command.h, with the same opcodes and limits as main.c
+ * The handlers only count their calls, so this measures the dispatch, not the commands.
+ * It also checks that every opcode of both tables is found, which catches CMD_HASH
+ * collisions when an opcode is added.
+ * Host numbers don't translate to AVR cycles, compare the ratios.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o cmdbench \
+ *       tools/cmdbench.c command.c
+ *   ./cmdbench [passes]
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <time.h>
+#include "hal.h"
+#include "main.h"
+#include "servo.h"			// for SERVO_NUM
+
+// one counter per handler, to check both dispatchers do the same thing
+enum {H_SE, H_OP, H_CL, H_RC, H_ST, H_HD, H_SD, H_SR, H_SL, H_SS, H_SQ, H_STD, H_SM, H_PASS, H_ERR, H_NUM};
+static uint32_t bench_calls[H_NUM];
+static uint32_t bench_sum;
+
+#define BENCH_HANDLER(name, id) static void name(uint8_t value) { bench_calls[id]++; bench_sum+=value; }
+BENCH_HANDLER(b_sequence, H_SE)
+BENCH_HANDLER(b_open, H_OP)
+BENCH_HANDLER(b_close, H_CL)
+BENCH_HANDLER(b_rc, H_RC)
+BENCH_HANDLER(b_stop, H_ST)
+BENCH_HANDLER(b_hold, H_HD)
+BENCH_HANDLER(b_servo_dir, H_SD)
+BENCH_HANDLER(b_servo_reverse, H_SR)
+BENCH_HANDLER(b_last_servo, H_SL)
+BENCH_HANDLER(b_start_sound, H_SS)
+BENCH_HANDLER(b_random_sound, H_SQ)
+BENCH_HANDLER(b_slave_delay, H_STD)
+BENCH_HANDLER(b_mp3_player, H_SM)
+
+// commands passed on to the other boards
+static void b_pass(char* command, uint8_t length) { bench_calls[H_PASS]++; bench_sum+=length; }
+
+// same tables as main.c
+static const cmd_entry_t bench_panel[CMD_TABLE_SIZE] PROGMEM =
+{
+	CMD_ENTRY(	'S','E',	b_sequence,		5, 5,	99,			CMD_ACK_BEFORE),
+	CMD_ENTRY(	'O','P',	b_open,			5, 5,	15,			CMD_ACK_BEFORE),
+	CMD_ENTRY(	'C','L',	b_close,		5, 5,	13,			CMD_ACK_BEFORE),
+	CMD_ENTRY(	'R','C',	b_rc,			5, 5,	SERVO_NUM,	CMD_ACK_BEFORE),
+	CMD_ENTRY(	'S','T',	b_stop,			5, 5,	SERVO_NUM,	CMD_ACK_BEFORE),
+	CMD_ENTRY(	'H','D',	b_hold,			5, 5,	SERVO_NUM,	CMD_ACK_BEFORE),
+};
+
+static const cmd_entry_t bench_setup[CMD_TABLE_SIZE] PROGMEM =
+{
+	CMD_ENTRY(	'S','D',	b_servo_dir,		5, 5,	1,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','R',	b_servo_reverse,	6, 6,	255,	CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','L',	b_last_servo,		4, 6,	255,	CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','S',	b_start_sound,		4, 6,	255,	CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','Q',	b_random_sound,		4, 6,	2,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','T',	b_slave_delay,		4, 6,	255,	CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','M',	b_mp3_player,		4, 6,	1,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','B',	b_servo_dir,		4, 6,	5,		0),
+	CMD_ENTRY(	'S','C',	b_servo_dir,		4, 6,	1,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'I','P',	b_servo_dir,		4, 6,	1,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'S','K',	b_servo_dir,		4, 6,	1,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'L','S',	b_servo_dir,		4, 6,	1,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'I','S',	b_servo_dir,		4, 6,	1,		CMD_ACK_AFTER),
+	CMD_ENTRY(	'I','F',	b_servo_dir,		4, 6,	1,		CMD_ACK_AFTER),
+};
+
+/////////////// before: string compares, as in v3.7
+
+static void before_panel(char* command_string, uint8_t length)
+{
+	char cmd[3];
+	char arg[3];
+	uint8_t value;
+
+	if(length!=5) { bench_calls[H_ERR]++; return; }
+	cmd[0]=command_string[1];
+	cmd[1]=command_string[2];
+	cmd[2]='\0';
+	arg[0]=command_string[3];
+	arg[1]=command_string[4];
+	arg[2]='\0';
+
+	value=atoi(arg);
+	if(strcmp(cmd,CMD_SEQUENCE )==0) { b_sequence(value); return; }
+	if(strcmp(cmd,CMD_OPEN )==0) { b_open(value); return; }
+	if(strcmp(cmd,CMD_CLOSE )==0) { b_close(value); return; }
+	if(strcmp(cmd,CMD_RC )==0) { b_rc(value); return; }
+	if(strcmp(cmd,CMD_STOP )==0) { b_stop(value); return; }
+	if(strcmp(cmd,CMD_HOLD )==0) { b_hold(value); return; }
+	bench_calls[H_ERR]++;
+}
+
+static void before_setup(char* command, uint8_t length)
+{
+	char cmd[3];
+	char arg[4];
+	uint8_t value;
+
+	cmd[0]=command[1];
+	cmd[1]=command[2];
+	cmd[2]='\0';
+	arg[0]=command[3];
+	arg[1]=command[4];
+	arg[2]=command[5];
+	arg[3]='\0';
+
+	value=atoi(arg);
+	if(strcmp(cmd,SETUP_SERVO_DIR)==0) { if(length!=5) { bench_calls[H_ERR]++; return; } b_servo_dir(value); return; }
+	if(strcmp(cmd,SETUP_SERVO_REVERSE)==0) { if(length!=6) { bench_calls[H_ERR]++; return; } b_servo_reverse(value); return; }
+	if(strcmp(cmd,SETUP_LAST_SERVO)==0) { b_last_servo(value); return; }
+	if(strcmp(cmd,SETUP_START_SOUND)==0) { b_start_sound(value); return; }
+	if(strcmp(cmd,SETUP_RANDOM_SOUND_DISABLED)==0) { b_random_sound(value); return; }
+	if(strcmp(cmd,SETUP_SLAVE_DELAY_TIME)==0) { b_slave_delay(value); return; }
+	if(strcmp(cmd,SETUP_MP3_PLAYER)==0) { if(value>1) { bench_calls[H_ERR]++; return; } b_mp3_player(value); return; }
+	bench_calls[H_ERR]++;
+}
+
+/////////////// after: command tables
+
+static void after_run(const cmd_entry_t* table, char* command, uint8_t length)
+{
+	cmd_entry_t entry;
+	uint8_t value;
+
+	if(cmd_lookup(table, command, length, &entry, &value)!=CMD_OK) { bench_calls[H_ERR]++; return; }
+	entry.handler(value);
+}
+
+static void after_panel(char* command, uint8_t length) { after_run(bench_panel, command, length); }
+static void after_setup(char* command, uint8_t length) { after_run(bench_setup, command, length); }
+
+typedef void (*bench_parser)(char* command, uint8_t length);
+
+// the start character switch of dispatch_command()
+static void bench_dispatch(char* command_str, bench_parser panel, bench_parser setup)
+{
+	uint8_t length=strlen(command_str);
+	if(length==0) return;
+	switch(command_str[0])
+	{
+		case PANEL_START_CHAR:
+			panel(command_str, length);
+			break;
+		case SETUP_START_CHAR:
+			setup(command_str, length);
+			break;
+		case HP_START_CHAR:
+		case DISPLAY_START_CHAR:
+		case SOUND_START_CHAR:
+		case ALT1_START_CHAR:
+		case ALT2_START_CHAR:
+		case I2C_START_CHAR:
+			b_pass(command_str, length);
+			break;
+		default:
+			bench_calls[H_ERR]++;
+			break;
+	}
+}
+
+// R2 Touch default buttons, plus a few setup commands and typos
+static const char* bench_stream[]=
+{
+	":SE00", ":SE01", ":SE02", ":SE03", ":SE04", ":SE05", ":SE06", ":SE07", ":SE08", ":SE09",
+	":SE10", ":SE11", ":SE13", ":SE14", ":SE15", ":SE16", ":SE51", ":SE52", ":SE53", ":SE54",
+	":SE55", ":SE56", ":SE57", ":SE58",
+	":OP00", ":OP01", ":OP02", ":OP07", ":OP14", ":OP15", ":CL00", ":CL01", ":CL07",
+	":RC00", ":ST00", ":HD00", ":HD03",
+	"$R", "$s", "$O", "$-", "$+", "$f", "$m", "$21", "$35", "$83",
+	"*RD00", "*ON00", "*OF00", "*ST00", "*HP017",
+	"@0T1", "@0T4", "@0T5", "@0T6", "@0T11", "@1MR2 D2", "@3P61",
+	"#SQ00", "#SS01", "#SD00", "#SR041", "#SM0",
+	":SE1", ":XX00",
+};
+#define BENCH_STREAM_SIZE (sizeof(bench_stream)/sizeof(bench_stream[0]))
+
+static uint64_t bench_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+static double bench_run(const char* name, uint32_t passes, bench_parser panel, bench_parser setup, uint32_t* calls)
+{
+	char line[CMD_MAX_LENGTH];
+	uint64_t t0, t1;
+	uint32_t n, i;
+	double rate;
+
+	memset(bench_calls, 0, sizeof(bench_calls));
+	t0=bench_ns();
+	for(n=0; n<passes; n++)
+	{
+		for(i=0; i<BENCH_STREAM_SIZE; i++)
+		{
+			// the command line is a copy, as build_command() makes
+			strcpy(line, bench_stream[i]);
+			bench_dispatch(line, panel, setup);
+		}
+	}
+	t1=bench_ns();
+	memcpy(calls, bench_calls, sizeof(bench_calls));
+
+	rate=(double)passes*BENCH_STREAM_SIZE*1e9/(t1-t0);
+	printf("%-8s %12.0f commands/s %8.1f ns/command\n", name, rate, 1e9/rate);
+	return rate;
+}
+
+static int bench_check_table(const char* name, const cmd_entry_t* table, const char* const* opcodes)
+{
+	cmd_entry_t entry;
+	uint8_t value;
+	char command[6]="?xx00";
+	int ok=1;
+
+	for(; *opcodes; opcodes++)
+	{
+		command[1]=(*opcodes)[0];
+		command[2]=(*opcodes)[1];
+		if(cmd_lookup(table, command, 5, &entry, &value)==CMD_UNKNOWN)
+		{
+			printf("%s table: %s not found, CMD_HASH collision?\n", name, *opcodes);
+			ok=0;
+		}
+	}
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t passes=argc>1 ? strtoul(argv[1], 0, 0) : 200000UL;
+	uint32_t calls_before[H_NUM], calls_after[H_NUM];
+	const char* panel_opcodes[]={"SE", "OP", "CL", "RC", "ST", "HD", 0};
+	const char* setup_opcodes[]={"SD", "SR", "SL", "SS", "SQ", "ST", "SM", "SB", "SC", "IP", "SK", "LS", "IS", "IF", 0};
+	double before, after;
+	int ok;
+
+	ok=bench_check_table("panel", bench_panel, panel_opcodes);
+	ok&=bench_check_table("setup", bench_setup, setup_opcodes);
+
+	printf("%u passes of %u commands\n", passes, (unsigned)BENCH_STREAM_SIZE);
+	before=bench_run("before", passes, before_panel, before_setup, calls_before);
+	after=bench_run("after", passes, after_panel, after_setup, calls_after);
+	printf("speedup %.2fx\n", after/before);
+
+	if(memcmp(calls_before, calls_after, sizeof(calls_before)))
+	{
+		printf("dispatchers disagree\n");
+		ok=0;
+	}
+	return ok ? 0 : 1;
+}
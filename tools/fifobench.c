@@ -0,0 +1,297 @@
+/*
+ * fifobench.c
+ * Host stress test and benchmark of the serial fifo
+ *
+ * Stress: the main thread plays the main loop, putting a numbered byte stream in
+ * with a mix of fifo_put() and fifo_write_block() of random lengths. A second thread
+ * plays the interrupt, taking it out with _inline_fifo_get() and fifo_read_block(),
+ * and checks every byte arrives once and in order. Run on both buffer sizes serial.c uses.
+ *
+ * Benchmark: put then get of one byte, and of 16 byte blocks, in host CPU cycles
+ * (x86 TSC) per byte:
+ * - before: the v2.1 fifo, count shared by both sides under cli()/SREG restore
+ * - after: fifo.c, head and tail owned by one side each
+ * Host numbers don't translate to AVR cycles, compare the ratios.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -pthread -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o fifobench \
+ *       tools/fifobench.c fifo.c
+ *   ./fifobench [megabytes]
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "fifo.h"
+#include "serial.h"			// for the buffer sizes
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define bench_cycles()	__rdtsc()
+#else
+#define bench_cycles()	0ULL
+#endif
+
+// the register map of hal_host.c, for SREG, without the rest of the simulation
+volatile uint8_t hal_io[HAL_IO_SIZE];
+
+// fifo_get_wait() idles, here it lets the other thread run
+void hal_idle(void)
+{
+	sched_yield();
+}
+
+/////////////// before: v2.1 fifo
+
+typedef struct
+{
+	uint8_t volatile count;
+	uint8_t size;
+	uint8_t *pread;
+	uint8_t *pwrite;
+	uint8_t read2end, write2end;
+} old_fifo_t;
+
+static void old_fifo_init (old_fifo_t *f, uint8_t *buffer, const uint8_t size)
+{
+	f->count = 0;
+	f->pread = f->pwrite = buffer;
+	f->read2end = f->write2end = f->size = size;
+}
+
+static inline uint8_t old_fifo_put (old_fifo_t *f, const uint8_t data)
+{
+	if (f->count >= f->size)
+		return 0;
+	uint8_t * pwrite = f->pwrite;
+	*(pwrite++) = data;
+	uint8_t write2end = f->write2end;
+	if (--write2end == 0)
+	{
+		write2end = f->size;
+		pwrite -= write2end;
+	}
+	f->write2end = write2end;
+	f->pwrite = pwrite;
+	uint8_t sreg = SREG;
+	cli();
+	f->count++;
+	SREG = sreg;
+	return 1;
+}
+
+static inline uint8_t old_fifo_get (old_fifo_t *f)
+{
+	uint8_t *pread = f->pread;
+	uint8_t data = *(pread++);
+	uint8_t read2end = f->read2end;
+	if (--read2end == 0)
+	{
+		read2end = f->size;
+		pread -= read2end;
+	}
+	f->pread = pread;
+	f->read2end = read2end;
+	uint8_t sreg = SREG;
+	cli();
+	f->count--;
+	SREG = sreg;
+	return data;
+}
+
+/////////////// stress test
+
+static uint32_t stress_bytes;
+static fifo_t stress_fifo;
+static uint32_t stress_errors;
+
+// same byte stream on both sides
+static inline uint8_t stress_byte(uint32_t i)
+{
+	return (uint8_t)(i*2654435761u>>24);
+}
+
+static uint32_t stress_rand(uint32_t* seed)
+{
+	*seed=*seed*1103515245u+12345u;
+	return *seed>>16;
+}
+
+// the "interrupt": takes bytes out one at a time or in blocks
+static void* stress_consumer(void* arg)
+{
+	uint8_t block[64];
+	uint32_t seed=2, i=0;
+	uint8_t n, k;
+
+	while(i<stress_bytes)
+	{
+		if(stress_rand(&seed)&1)
+		{
+			if(!fifo_available(&stress_fifo)) { sched_yield(); continue; }
+			if(_inline_fifo_get(&stress_fifo)!=stress_byte(i)) stress_errors++;
+			i++;
+		}
+		else
+		{
+			n=fifo_read_block(&stress_fifo, block, 1+stress_rand(&seed)%sizeof(block));
+			if(!n) sched_yield();
+			for(k=0; k<n; k++, i++) if(block[k]!=stress_byte(i)) stress_errors++;
+		}
+	}
+	return 0;
+}
+
+static int stress_run(uint8_t* buffer, uint16_t size, uint32_t bytes)
+{
+	uint8_t block[64];
+	pthread_t consumer;
+	uint32_t seed=1, i=0;
+	uint8_t n, k, len;
+
+	fifo_init(&stress_fifo, buffer, size);
+	stress_bytes=bytes;
+	stress_errors=0;
+	pthread_create(&consumer, 0, stress_consumer, 0);
+
+	while(i<bytes)
+	{
+		if(stress_rand(&seed)&1)
+		{
+			if(fifo_put(&stress_fifo, stress_byte(i))) i++;
+			else sched_yield();
+		}
+		else
+		{
+			len=1+stress_rand(&seed)%sizeof(block);
+			if(len>bytes-i) len=bytes-i;
+			for(k=0; k<len; k++) block[k]=stress_byte(i+k);
+			n=fifo_write_block(&stress_fifo, block, len);
+			if(!n) sched_yield();
+			i+=n;
+		}
+	}
+	pthread_join(consumer, 0);
+
+	printf("stress size %3u: %u bytes, %u errors, %s\n", size, bytes, stress_errors,
+			stress_errors || fifo_available(&stress_fifo) ? "FAIL" : "ok");
+	return stress_errors!=0;
+}
+
+/////////////// benchmark
+
+#define BENCH_BLOCK	16
+
+static double bench_old(uint32_t bytes)
+{
+	static uint8_t buffer[BUFSIZE_OUT-1];
+	old_fifo_t f;
+	uint32_t i;
+	uint8_t sum=0;
+	uint64_t c0, c1;
+
+	old_fifo_init(&f, buffer, sizeof(buffer));
+	c0=bench_cycles();
+	for(i=0; i<bytes; i++)
+	{
+		old_fifo_put(&f, (uint8_t)i);
+		sum+=old_fifo_get(&f);
+	}
+	c1=bench_cycles();
+	if(sum==1) printf(" ");
+	return (double)(c1-c0)/bytes;
+}
+
+static double bench_new(uint32_t bytes)
+{
+	static uint8_t buffer[BUFSIZE_OUT];
+	fifo_t f;
+	uint32_t i;
+	uint8_t sum=0;
+	uint64_t c0, c1;
+
+	fifo_init(&f, buffer, sizeof(buffer));
+	c0=bench_cycles();
+	for(i=0; i<bytes; i++)
+	{
+		_inline_fifo_put(&f, (uint8_t)i);
+		sum+=_inline_fifo_get(&f);
+	}
+	c1=bench_cycles();
+	if(sum==1) printf(" ");
+	return (double)(c1-c0)/bytes;
+}
+
+static double bench_old_block(uint32_t bytes)
+{
+	static uint8_t buffer[BUFSIZE_OUT-1];
+	uint8_t block[BENCH_BLOCK];
+	old_fifo_t f;
+	uint32_t i;
+	uint8_t k, sum=0;
+	uint64_t c0, c1;
+
+	for(k=0; k<BENCH_BLOCK; k++) block[k]=k;
+	old_fifo_init(&f, buffer, sizeof(buffer));
+	c0=bench_cycles();
+	for(i=0; i<bytes; i+=BENCH_BLOCK)
+	{
+		// what serial_puts() and a string reader had to do
+		for(k=0; k<BENCH_BLOCK; k++) old_fifo_put(&f, block[k]);
+		for(k=0; k<BENCH_BLOCK; k++) block[k]=old_fifo_get(&f);
+		sum+=block[3];
+	}
+	c1=bench_cycles();
+	if(sum==1) printf(" ");
+	return (double)(c1-c0)/bytes;
+}
+
+static double bench_new_block(uint32_t bytes)
+{
+	static uint8_t buffer[BUFSIZE_OUT];
+	uint8_t block[BENCH_BLOCK];
+	fifo_t f;
+	uint32_t i;
+	uint8_t k, sum=0;
+	uint64_t c0, c1;
+
+	for(k=0; k<BENCH_BLOCK; k++) block[k]=k;
+	fifo_init(&f, buffer, sizeof(buffer));
+	c0=bench_cycles();
+	for(i=0; i<bytes; i+=BENCH_BLOCK)
+	{
+		fifo_write_block(&f, block, BENCH_BLOCK);
+		fifo_read_block(&f, block, BENCH_BLOCK);
+		sum+=block[3];
+	}
+	c1=bench_cycles();
+	if(sum==1) printf(" ");
+	return (double)(c1-c0)/bytes;
+}
+
+int main(int argc, char** argv)
+{
+	static uint8_t in[BUFSIZE_IN], out[BUFSIZE_OUT];
+	uint32_t bytes=(argc>1 ? atoi(argv[1]) : 16)*1000000u;
+	double before, after;
+	int fail=0;
+
+	fail|=stress_run(in, sizeof(in), bytes);
+	fail|=stress_run(out, sizeof(out), bytes);
+
+	before=bench_old(bytes);
+	after=bench_new(bytes);
+	printf("byte   put+get: before %5.2f cycles/byte, after %5.2f cycles/byte, %.2fx\n", before, after, before/after);
+	before=bench_old_block(bytes);
+	after=bench_new_block(bytes);
+	printf("block  put+get: before %5.2f cycles/byte, after %5.2f cycles/byte, %.2fx\n", before, after, before/after);
+
+	return fail;
+}
@@ -0,0 +1,216 @@
+/*
+ * fmtbench.c
+ * Host check and benchmark of the fmt.c formatters and parsers
+ *
+ * For each conversion the firmware used to do with stdio, runs the old and the new
+ * code on every input it can get, checks they give the same result, and reports
+ * host CPU cycles (x86 TSC) per conversion:
+ * - slave commands: "*MF%02d\r" and ":SE%02d\r" for 0 to 99, "@0W%d\r" for 0 to 255
+ * - console: "Calc CRC: %X StoredCRC: %X \r\n", "STREAM frames=%u ..." on random values
+ * - I2C tokens: sscanf("%x") and sscanf("%d") on "x00" to "xFF" and "-128" to "255",
+ *   atoi() of the sound command number
+ * ":SE%2d\r" used to pad with a space, the slave reads ":SE 1" and ":SE01" the same way.
+ * Host numbers don't translate to AVR cycles, compare the ratios.
+ *
+ * The flash saved has to be measured with the AVR toolchain, on the firmware built
+ * before and after fmt.c:
+ *   avr-size -C --mcu=atmega328p MarcDuinoMain.elf
+ * and on the map file (-Wl,-Map) vfprintf and vfscanf should be gone from the release build.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o fmtbench \
+ *       tools/fmtbench.c fmt.c
+ *   ./fmtbench [rounds]
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+#include "fmt.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define bench_cycles()	__rdtsc()
+#else
+#define bench_cycles()	0ULL
+#endif
+
+// the register map of hal_host.c, without the rest of the simulation
+volatile uint8_t hal_io[HAL_IO_SIZE];
+
+static uint32_t bench_seed=1;
+
+static uint16_t bench_rand()
+{
+	bench_seed=bench_seed*1103515245u+12345u;
+	return bench_seed>>16;
+}
+
+// keeps the compiler from dropping the work
+static volatile uint32_t bench_sink;
+
+/////////////// the conversions, old then new
+
+static void old_mf(char* s, uint16_t v) { sprintf(s, "*MF%02d\r", v); }
+static void new_mf(char* s, uint16_t v) { *fmt_dec(fmt_copy_p(s, PSTR("*MF")), v, 2, '0')='\r'; s[6]='\0'; }
+
+static void old_se(char* s, uint16_t v) { sprintf(s, ":SE%02d\r", v); }
+static void new_se(char* s, uint16_t v) { *fmt_dec(fmt_copy_p(s, PSTR(":SE")), v, 2, '0')='\r'; s[6]='\0'; }
+
+static void old_wait(char* s, uint16_t v) { sprintf(s, "@0W%d\r", v); }
+static void new_wait(char* s, uint16_t v) { char* p=fmt_dec(fmt_copy_p(s, PSTR("@0W")), v, 0, ' '); p[0]='\r'; p[1]='\0'; }
+
+static void old_crc(char* s, uint16_t v) { sprintf(s, "Calc CRC: %X StoredCRC: %X \r\n", v, (uint16_t)~v); }
+static void new_crc(char* s, uint16_t v)
+{
+	char* p=fmt_copy_p(s, PSTR("Calc CRC: "));
+	p=fmt_hex(p, v);
+	p=fmt_copy_p(p, PSTR(" StoredCRC: "));
+	p=fmt_hex(p, ~v);
+	fmt_copy_p(p, PSTR(" \r\n"));
+}
+
+static void old_stream(char* s, uint16_t v)
+{
+	sprintf(s, "STREAM frames=%u dropped=%u late=%u holds=%u\r\n", v, v>>3, v>>7, v&7);
+}
+static void new_stream(char* s, uint16_t v)
+{
+	char* p=fmt_copy_p(s, PSTR("STREAM frames="));
+	p=fmt_dec(p, v, 0, ' ');
+	p=fmt_copy_p(p, PSTR(" dropped="));
+	p=fmt_dec(p, v>>3, 0, ' ');
+	p=fmt_copy_p(p, PSTR(" late="));
+	p=fmt_dec(p, v>>7, 0, ' ');
+	p=fmt_copy_p(p, PSTR(" holds="));
+	p=fmt_dec(p, v&7, 0, ' ');
+	fmt_copy_p(p, PSTR("\r\n"));
+}
+
+typedef void (*bench_format_t)(char* s, uint16_t v);
+
+typedef struct
+{
+	const char* name;
+	bench_format_t old_format, new_format;
+	uint16_t max;				// inputs 0 to max, random when 0xFFFF
+} bench_format_case_t;
+
+static const bench_format_case_t bench_formats[]=
+{
+	{ "*MF%02d", old_mf, new_mf, 99 },
+	{ ":SE%02d", old_se, new_se, 99 },
+	{ "@0W%d", old_wait, new_wait, 255 },
+	{ "CRC %X", old_crc, new_crc, 0xFFFF },
+	{ "STREAM %u", old_stream, new_stream, 0xFFFF },
+};
+
+// the token is the string the parser gets, the value is what it should read
+static int16_t old_hex(const char* s) { unsigned int u; return sscanf(s, "%x", &u)==1 ? (int16_t)u : -1; }
+static int16_t new_hex(const char* s) { uint16_t u; return fmt_parse_hex(s, &u) ? (int16_t)u : -1; }
+static int16_t old_int(const char* s) { int n; return sscanf(s, "%d", &n)==1 ? n : -1000; }
+static int16_t new_int(const char* s) { int16_t n; return fmt_parse_int(s, &n) ? n : -1000; }
+static int16_t old_atoi(const char* s) { return atoi(s); }
+static int16_t new_atoi(const char* s) { uint16_t u=0; fmt_parse_dec(s, &u); return u; }
+
+static void hex_token(char* s, int16_t v) { sprintf(s, "%02X", v); }
+static void int_token(char* s, int16_t v) { sprintf(s, "%d", v); }
+static void sound_token(char* s, int16_t v) { sprintf(s, "%2d", v); }	// as Sound() used to build it
+
+typedef int16_t (*bench_parse_t)(const char* s);
+typedef void (*bench_token_t)(char* s, int16_t v);
+
+typedef struct
+{
+	const char* name;
+	bench_parse_t old_parse, new_parse;
+	bench_token_t token;
+	int16_t min, max;
+} bench_parse_case_t;
+
+static const bench_parse_case_t bench_parses[]=
+{
+	{ "sscanf %x", old_hex, new_hex, hex_token, 0, 255 },
+	{ "sscanf %d", old_int, new_int, int_token, -128, 255 },
+	{ "atoi", old_atoi, new_atoi, sound_token, 0, 99 },
+};
+
+#define BENCH_COUNT(a)	(sizeof(a)/sizeof(a[0]))
+
+static int bench_format(const bench_format_case_t* b, uint32_t rounds)
+{
+	char old_s[80], new_s[80];
+	uint64_t t0, t1, t2;
+	uint32_t n, mismatch=0;
+	uint16_t v;
+
+	// check every input, or a random sample
+	for(n=0; n<(b->max==0xFFFF ? 100000u : (uint32_t)b->max+1); n++)
+	{
+		v=b->max==0xFFFF ? bench_rand() : n;
+		b->old_format(old_s, v);
+		b->new_format(new_s, v);
+		if(strcmp(old_s, new_s))
+		{
+			if(!mismatch) printf("%s: %u gives \"%s\" instead of \"%s\"\n", b->name, v, new_s, old_s);
+			mismatch++;
+		}
+	}
+
+	t0=bench_cycles();
+	for(n=0; n<rounds; n++) { b->old_format(old_s, n%(b->max+1u)); bench_sink+=old_s[3]; }
+	t1=bench_cycles();
+	for(n=0; n<rounds; n++) { b->new_format(new_s, n%(b->max+1u)); bench_sink+=new_s[3]; }
+	t2=bench_cycles();
+
+	printf("%-12s %10.1f %10.1f %7.1fx %s\n", b->name, (double)(t1-t0)/rounds, (double)(t2-t1)/rounds,
+			(double)(t1-t0)/(t2-t1), mismatch ? "FAIL" : "ok");
+	return mismatch!=0;
+}
+
+static int bench_parse(const bench_parse_case_t* b, uint32_t rounds)
+{
+	static char tokens[512][8];		// built once, only the parsing is timed
+	uint64_t t0, t1, t2;
+	uint32_t n, mismatch=0, range=b->max-b->min+1;
+	int16_t v;
+
+	for(v=b->min; v<=b->max; v++)
+	{
+		char* token=tokens[v-b->min];
+		b->token(token, v);
+		if(b->old_parse(token)!=v || b->new_parse(token)!=v)
+		{
+			if(!mismatch) printf("%s: \"%s\" read as %d, was %d\n", b->name, token, b->new_parse(token), b->old_parse(token));
+			mismatch++;
+		}
+	}
+
+	t0=bench_cycles();
+	for(n=0; n<rounds; n++) bench_sink+=b->old_parse(tokens[n%range]);
+	t1=bench_cycles();
+	for(n=0; n<rounds; n++) bench_sink+=b->new_parse(tokens[n%range]);
+	t2=bench_cycles();
+
+	printf("%-12s %10.1f %10.1f %7.1fx %s\n", b->name, (double)(t1-t0)/rounds, (double)(t2-t1)/rounds,
+			(double)(t1-t0)/(t2-t1), mismatch ? "FAIL" : "ok");
+	return mismatch!=0;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t rounds=argc>1 ? strtoul(argv[1], 0, 0) : 1000000UL;
+	int fail=0;
+	uint8_t i;
+
+	printf("%-12s %10s %10s %8s\n", "conversion", "stdio cyc", "fmt cyc", "ratio");
+	for(i=0; i<BENCH_COUNT(bench_formats); i++) fail|=bench_format(&bench_formats[i], rounds);
+	for(i=0; i<BENCH_COUNT(bench_parses); i++) fail|=bench_parse(&bench_parses[i], rounds);
+	return fail;
+}
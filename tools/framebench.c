@@ -0,0 +1,279 @@
+/*
+ * framebench.c
+ * Host fuzz test and benchmark of the binary command frames
+ *
+ * Fuzz, with a byte stream fed to frame_receive() like the main loop does:
+ * - mixed: good frames of every length, ASCII command lines and frames with one bit
+ *   flipped after the length byte. Every good frame must come out once and intact,
+ *   every damaged one must be dropped, and the ASCII bytes must all be turned down, in order.
+ * - noise: random bytes, sync included, then a gap of FRAME_TIMEOUT and a good frame,
+ *   which must come out. Reports how many frames the noise made up (CRC-8: about 1 in 256
+ *   of the ones it completes).
+ *
+ * Benchmark: the same commands as ASCII lines and as frames
+ * - bytes on the wire both ways: command, echo and "OK" for ASCII, frame and reply frame
+ * - host time to take the bytes in and find the command: build_command() and cmd_lookup()
+ *   for ASCII, frame_receive() and cmd_find() for frames
+ * There is no ASCII command for servo positions, the closest is one :OPxx or :CLxx per panel.
+ * Host numbers don't translate to AVR cycles, compare the ratios.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o framebench \
+ *       tools/framebench.c frame.c command.c realtime.c hal_host.c
+ *   ./framebench [rounds]
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hal.h"
+#include "main.h"
+#include "frame.h"
+#include "realtime.h"
+#include "servo.h"			// for SERVO_NUM
+
+static uint32_t bench_seed=1;
+
+static uint32_t bench_rand()
+{
+	bench_seed=bench_seed*1103515245u+12345u;
+	return bench_seed>>16;
+}
+
+/////////////// fuzz
+
+static uint32_t fuzz_frames, fuzz_damaged, fuzz_ascii, fuzz_fail;
+
+static void fuzz_feed_frame(const uint8_t* frame, uint8_t size, uint8_t good)
+{
+	const uint8_t* payload=frame+3;
+	uint8_t i, result=FRAME_NONE;
+
+	for(i=0; i<size; i++)
+	{
+		result=frame_receive(frame[i]);
+		if(result==FRAME_NONE || (result==FRAME_READY && i!=size-1))
+		{
+			fuzz_fail++;
+			return;
+		}
+	}
+	if(good)
+	{
+		if(result!=FRAME_READY || frame_rx.opcode!=frame[2] || frame_rx.length!=frame[1]
+				|| memcmp(frame_rx.payload, payload, frame[1])) fuzz_fail++;
+		fuzz_frames++;
+	}
+	else
+	{
+		if(result==FRAME_READY) fuzz_fail++;
+		fuzz_damaged++;
+	}
+}
+
+static int fuzz_mixed(uint32_t items)
+{
+	uint8_t frame[FRAME_MAX_SIZE], payload[FRAME_MAX_PAYLOAD];
+	uint8_t size, length, i;
+	uint16_t errors=frame_errors;
+	uint32_t n;
+
+	fuzz_frames=fuzz_damaged=fuzz_ascii=fuzz_fail=0;
+	for(n=0; n<items; n++)
+	{
+		switch(bench_rand()%3)
+		{
+			case 0:		// good frame
+			case 1:		// damaged frame
+				length=bench_rand()%(FRAME_MAX_PAYLOAD+1);
+				for(i=0; i<length; i++) payload[i]=bench_rand();
+				size=frame_encode(frame, bench_rand(), payload, length);
+				if(n&1)
+				{
+					// one bit, anywhere after the length byte
+					i=2+bench_rand()%(size-2);
+					frame[i]^=1<<(bench_rand()%8);
+					fuzz_feed_frame(frame, size, 0);
+				}
+				else fuzz_feed_frame(frame, size, 1);
+				break;
+			default:	// ASCII line
+				length=1+bench_rand()%20;
+				for(i=0; i<length; i++)
+				{
+					uint8_t ch=i==length-1 ? '\r' : ' '+bench_rand()%95;
+					if(frame_receive(ch)!=FRAME_NONE) fuzz_fail++;
+					fuzz_ascii++;
+				}
+				break;
+		}
+	}
+	if((uint16_t)(frame_errors-errors)!=fuzz_damaged) fuzz_fail++;
+
+	printf("mixed: %u good frames, %u damaged, %u ASCII bytes, %u errors, %s\n",
+			fuzz_frames, fuzz_damaged, fuzz_ascii, fuzz_fail, fuzz_fail ? "FAIL" : "ok");
+	return fuzz_fail!=0;
+}
+
+static int fuzz_noise(uint32_t rounds)
+{
+	uint8_t frame[FRAME_MAX_SIZE], payload[3]={'S','Q',1};
+	uint8_t size=frame_encode(frame, FRAME_SETUP, payload, sizeof(payload));
+	uint32_t n, i, bytes=0, madeup=0, lost=0;
+
+	for(n=0; n<rounds; n++)
+	{
+		uint32_t length=1+bench_rand()%200;
+		for(i=0; i<length; i++, bytes++)
+		{
+			if(frame_receive(bench_rand())==FRAME_READY) madeup++;
+		}
+		// the sender waits, then sends again
+		rt_count1+=FRAME_TIMEOUT+1;
+		for(i=0; i<size; i++)
+		{
+			if(frame_receive(frame[i])==FRAME_READY && i==size-1) break;
+		}
+		if(i==size) lost++;
+	}
+	printf("noise: %u bytes, %u frames made up (1 in %.0f bytes), %u good frames lost after the gap, %s\n",
+			bytes, madeup, madeup ? (double)bytes/madeup : 0.0, lost, lost ? "FAIL" : "ok");
+	return lost!=0;
+}
+
+/////////////// benchmark
+
+static void b_handler(uint8_t value) {}
+
+static const cmd_entry_t bench_panel[CMD_TABLE_SIZE] PROGMEM =
+{
+	CMD_ENTRY(	'S','E',	b_handler,		5, 5,	99,			CMD_ACK_BEFORE),
+	CMD_ENTRY(	'O','P',	b_handler,		5, 5,	15,			CMD_ACK_BEFORE),
+	CMD_ENTRY(	'C','L',	b_handler,		5, 5,	13,			CMD_ACK_BEFORE),
+};
+
+static const cmd_entry_t bench_setup[CMD_TABLE_SIZE] PROGMEM =
+{
+	CMD_ENTRY(	'S','Q',	b_handler,		4, 6,	2,			CMD_ACK_AFTER),
+};
+
+#define BENCH_ASCII_REPLY	4		// "OK\n\r"
+#define BENCH_FRAME_REPLY	(FRAME_OVERHEAD+1)
+
+typedef struct
+{
+	const char* name;
+	const char* ascii[SERVO_NUM];	// command lines
+	uint8_t opcode;
+	uint8_t length;
+	uint8_t payload[FRAME_MAX_PAYLOAD];
+} bench_case_t;
+
+static const bench_case_t bench_cases[]=
+{
+	{ "sequence", { ":SE05\r" }, FRAME_SEQUENCE, 1, { 5 } },
+	{ "setup", { "#SQ1\r" }, FRAME_SETUP, 3, { 'S', 'Q', 1 } },
+	{ "11 servos", { ":OP01\r", ":OP02\r", ":OP03\r", ":OP04\r", ":OP05\r", ":OP06\r",
+			":CL07\r", ":CL08\r", ":CL09\r", ":CL10\r", ":CL11\r" },
+			FRAME_SERVOS, 2+2*SERVO_NUM, { 0xFF, 0x07,
+			0xD0, 0x07, 0xD0, 0x07, 0xD0, 0x07, 0xD0, 0x07, 0xD0, 0x07, 0xD0, 0x07,
+			0xE8, 0x03, 0xE8, 0x03, 0xE8, 0x03, 0xE8, 0x03, 0xE8, 0x03 } },
+};
+#define BENCH_CASES (sizeof(bench_cases)/sizeof(bench_cases[0]))
+
+static uint64_t bench_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+// the line building of build_command(), then the table lookup
+static uint8_t bench_ascii(const char* line)
+{
+	char buffer[CMD_MAX_LENGTH];
+	const cmd_entry_t* table;
+	cmd_entry_t entry;
+	uint8_t pos=0, value;
+	char ch;
+
+	while((ch=*line++)!=CMD_END_CHAR)
+	{
+		if(frame_receive(ch)!=FRAME_NONE) return 0;
+		if(pos<CMD_MAX_LENGTH-1) buffer[pos++]=ch;
+	}
+	buffer[pos]='\0';
+	table=buffer[0]==SETUP_START_CHAR ? bench_setup : bench_panel;
+	return cmd_lookup(table, buffer, pos, &entry, &value)==CMD_OK;
+}
+
+static uint8_t bench_frame(const uint8_t* frame, uint8_t size)
+{
+	cmd_entry_t entry;
+	uint8_t i;
+
+	for(i=0; i<size; i++)
+	{
+		if(frame_receive(frame[i])==FRAME_READY)
+		{
+			if(frame_rx.opcode==FRAME_SEQUENCE) return cmd_find(bench_panel, 'S', 'E', &entry)==CMD_OK;
+			if(frame_rx.opcode==FRAME_SETUP) return cmd_find(bench_setup, frame_rx.payload[0], frame_rx.payload[1], &entry)==CMD_OK;
+			return frame_rx.opcode==FRAME_SERVOS;
+		}
+	}
+	return 0;
+}
+
+static int bench_run(uint32_t rounds)
+{
+	uint8_t frame[FRAME_MAX_SIZE];
+	uint32_t n, ascii_bytes, frame_bytes, ok;
+	uint64_t t0, t1, t2;
+	uint8_t c, i, size;
+	int fail=0;
+
+	printf("%-10s %14s %14s %8s %12s %12s\n", "command", "ASCII bytes", "frame bytes", "ratio", "ASCII ns", "frame ns");
+	for(c=0; c<BENCH_CASES; c++)
+	{
+		const bench_case_t* b=&bench_cases[c];
+		size=frame_encode(frame, b->opcode, b->payload, b->length);
+		frame_bytes=size+BENCH_FRAME_REPLY;
+		ascii_bytes=0;
+		for(i=0; i<SERVO_NUM && b->ascii[i]; i++) ascii_bytes+=2*strlen(b->ascii[i])+1+BENCH_ASCII_REPLY;	// \r echoes as \n\r
+
+		ok=0;
+		t0=bench_ns();
+		for(n=0; n<rounds; n++)
+		{
+			for(i=0; i<SERVO_NUM && b->ascii[i]; i++) ok+=bench_ascii(b->ascii[i]);
+		}
+		t1=bench_ns();
+		for(n=0; n<rounds; n++) ok+=bench_frame(frame, size);
+		t2=bench_ns();
+		if(ok!=rounds*(i+1))
+		{
+			printf("%s: commands not found\n", b->name);
+			fail=1;
+		}
+		printf("%-10s %14u %14u %7.1fx %12.1f %12.1f\n", b->name, ascii_bytes, frame_bytes,
+				(double)ascii_bytes/frame_bytes, (double)(t1-t0)/rounds, (double)(t2-t1)/rounds);
+	}
+	return fail;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t rounds=argc>1 ? strtoul(argv[1], 0, 0) : 1000000UL;
+	int fail=0;
+
+	fail|=fuzz_mixed(rounds/10);
+	fail|=fuzz_noise(rounds/100);
+	fail|=bench_run(rounds);
+	return fail;
+}
@@ -0,0 +1,507 @@
+/*
+ * i2cbench.c
+ * Host check and benchmark of the interrupt driven I2C master, see i2c.h
+ *
+ * Runs i2c.c against a scripted bus: after each TWCR command the bus model sets TWSR
+ * the way the TWI would and calls TWI_vect, until the interrupt stops asking for more.
+ * Each check queues transfers and compares the bus trace with the expected one:
+ * 	S start, Sr repeated start, Axx address byte, Wxx data byte written,
+ * 	Ra/Rn byte read and ACKed/NACKed, P stop, X bus released after a lost arbitration
+ * 	C recovery clock on SCL, P stop (from the TWI or from the bus recovery)
+ * and the status each callback gets. Covers NACK on address and data, arbitration loss,
+ * bus error, repeated start, the hang timeout and a full queue, with their retries,
+ * the bus recovery of a stuck SDA, the 400 kHz clock and the fault counters.
+ * The data pool takes the longest '&' payload, and wraps around to its start.
+ * Time is the rt_timestamp() count, moved forward by hand to reach the timeouts
+ * and the ends of the retry pauses.
+ *
+ * Then times the '&' command path: v1.1 waited on the bus for the whole transfer,
+ * v1.2 returns once the data is queued. Host numbers don't translate to AVR cycles,
+ * compare the ratios; the bus time is the real one at SCL_CLOCK.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o i2cbench \
+ *       tools/i2cbench.c fmt.c
+ *   ./i2cbench [rounds]
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+#include "realtime.h"
+#include "main.h"			// CMD_MAX_LENGTH
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define bench_cycles()	__rdtsc()
+#else
+#define bench_cycles()	0ULL
+#endif
+
+// the register map of hal_host.c, without the rest of the simulation
+volatile uint8_t hal_io[HAL_IO_SIZE];
+#define BENCH_TWCR		hal_io[0xBC]
+
+// TWCR without the bus model of hal_host.c, the bench plays the bus
+volatile uint8_t* hal_twcr(void) { return &BENCH_TWCR; }
+void hal_idle(void) {}
+
+static uint16_t bench_time;
+uint16_t rt_timestamp(void) { return bench_time; }
+
+// the console, for i2c_report()
+static char bench_console[256];
+void serial_puts(char* string) { strcat(bench_console, string); }
+void serial_puts_p(const char* progmem_s) { strcat(bench_console, progmem_s); }
+
+#include "i2c.c"
+
+/////////////// the bus
+
+#define BENCH_NONE		0xFF
+
+typedef struct
+{
+	uint8_t device;				// 7 bit address that answers
+	uint8_t nack_byte;			// data byte NACKed, BENCH_NONE for none
+	uint8_t arb_lost;			// address bytes lost to another master
+	uint8_t bus_error_byte;		// data byte getting a bus error, once
+	uint8_t busy;				// address NACKs before the device answers
+	uint8_t hang;				// starts that never complete
+	uint8_t stuck;				// SCL clocks a slave needs before it lets SDA go
+	uint8_t read[I2C_POOL_SIZE];
+} bench_bus_t;
+
+static bench_bus_t bench_bus;
+static char bench_trace[1024];
+static uint8_t bench_owned;		// bus taken by our start
+static uint8_t bench_lost;		// arbitration lost on the last step
+static uint8_t bench_rw, bench_count;
+static uint8_t bench_scl, bench_sda;	// line levels during a bus recovery
+
+static void bench_log(const char* s)
+{
+	if(bench_trace[0]) strcat(bench_trace, " ");
+	strcat(bench_trace, s);
+}
+
+static void bench_log_byte(char c, uint8_t b)
+{
+	char s[4];
+	sprintf(s, "%c%02X", c, b);
+	bench_log(s);
+}
+
+// runs the TWI steps the interrupt asks for
+static void bench_run()
+{
+	uint8_t cmd, status;
+
+	while(1)
+	{
+		cmd=BENCH_TWCR;
+		if(bench_lost)
+		{
+			// the interrupt must let the bus go, without a stop
+			bench_lost=0;
+			bench_log((cmd & _BV(TWINT)) && !(cmd & _BV(TWSTO)) ? "X" : "?");
+		}
+		if(cmd & _BV(TWSTO))
+		{
+			bench_log("P");
+			bench_owned=0;
+			BENCH_TWCR&=~_BV(TWSTO);
+		}
+		if(!(cmd & _BV(TWINT)) || !(cmd & _BV(TWIE)))
+		{
+			// nothing more for now
+			BENCH_TWCR&=~_BV(TWINT);
+			return;
+		}
+
+		if((cmd & _BV(TWSTA)) && bench_bus.hang)
+		{
+			// no answer, i2c_do() has to notice
+			bench_bus.hang--;
+			bench_log("S");
+			BENCH_TWCR&=~_BV(TWINT);
+			return;
+		}
+		if(cmd & _BV(TWSTA))
+		{
+			bench_log(bench_owned ? "Sr" : "S");
+			status=bench_owned ? TW_REP_START : TW_START;
+			bench_owned=1;
+		}
+		else if(TW_STATUS==TW_START || TW_STATUS==TW_REP_START)
+		{
+			bench_log_byte('A', TWDR);
+			bench_rw=TWDR & TW_READ;
+			bench_count=0;
+			if(bench_bus.arb_lost)
+			{
+				bench_bus.arb_lost--;
+				bench_owned=0;
+				bench_lost=1;
+				status=TW_MT_ARB_LOST;
+			}
+			else if((TWDR>>1)!=bench_bus.device || bench_bus.busy)
+			{
+				if(bench_bus.busy) bench_bus.busy--;
+				status=bench_rw ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+			}
+			else status=bench_rw ? TW_MR_SLA_ACK : TW_MT_SLA_ACK;
+		}
+		else if(!bench_rw)
+		{
+			bench_log_byte('W', TWDR);
+			if(bench_count==bench_bus.bus_error_byte)
+			{
+				bench_bus.bus_error_byte=BENCH_NONE;
+				bench_owned=0;
+				status=TW_BUS_ERROR;
+			}
+			else status=(bench_count==bench_bus.nack_byte) ? TW_MT_DATA_NACK : TW_MT_DATA_ACK;
+			bench_count++;
+		}
+		else
+		{
+			TWDR=bench_bus.read[bench_count++];
+			bench_log((cmd & _BV(TWEA)) ? "Ra" : "Rn");
+			status=(cmd & _BV(TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+		}
+
+		TWSR=status;
+		BENCH_TWCR&=~(_BV(TWINT) | _BV(TWSTA));
+		TWI_vect();
+	}
+}
+
+// runs the bus until the queue is done or the bus held, through the timeouts and the retry pauses
+static void bench_drain()
+{
+	while(1)
+	{
+		bench_run();
+		if(i2c_state==I2C_IDLE || i2c_state==I2C_HELD) return;
+		bench_time+=i2c_wait+1;
+		i2c_do();
+	}
+}
+
+// the lines during a bus recovery, i2c_recover() drives them by hand and waits after each change
+void _delay_us(double us)
+{
+	uint8_t scl=!(DDRC & _BV(I2C_SCL_PIN));
+	uint8_t sda_master=!(DDRC & _BV(I2C_SDA_PIN));
+	uint8_t sda;
+
+	if(scl && !bench_scl && sda_master) bench_log("C");
+	// a stuck slave shifts its next bit out when SCL falls
+	if(!scl && bench_scl && bench_bus.stuck) bench_bus.stuck--;
+	sda=sda_master && !bench_bus.stuck;
+	if(sda && !bench_sda && scl)
+	{
+		bench_log("P");
+		bench_owned=0;
+	}
+	bench_scl=scl;
+	bench_sda=sda;
+	PINC=(PINC & ~(_BV(I2C_SCL_PIN) | _BV(I2C_SDA_PIN))) | (scl<<I2C_SCL_PIN) | (sda<<I2C_SDA_PIN);
+}
+
+/////////////// the checks
+
+static char bench_done[64];		// statuses the callbacks got
+static uint8_t bench_data[I2C_POOL_SIZE];
+
+static void bench_callback(uint8_t status, const uint8_t* data, uint8_t length)
+{
+	sprintf(bench_done+strlen(bench_done), "%u", status);
+	memcpy(bench_data, data, length);
+}
+
+static void bench_reset(uint8_t device)
+{
+	i2c_close();
+	i2c_set_clock(FALSE);
+	i2c_init(FALSE);
+	i2c_do();
+	i2c_reset_stats();
+	memset(&bench_bus, 0, sizeof(bench_bus));
+	bench_bus.device=device;
+	bench_bus.nack_byte=BENCH_NONE;
+	bench_bus.bus_error_byte=BENCH_NONE;
+	bench_trace[0]='\0';
+	bench_done[0]='\0';
+	bench_console[0]='\0';
+	bench_owned=0;
+	bench_lost=0;
+	bench_scl=bench_sda=1;
+	DDRC=0;
+	PINC=_BV(I2C_SCL_PIN) | _BV(I2C_SDA_PIN);
+	TWSR=TW_NO_INFO;
+	BENCH_TWCR=_BV(TWEN);
+}
+
+// expected trace of a transfer tried I2C_RETRIES+1 times, then what follows
+static const char* bench_tries(const char* trace, const char* then)
+{
+	static char s[256];
+	uint8_t i;
+
+	s[0]='\0';
+	for(i=0; i<=I2C_RETRIES; i++)
+	{
+		if(i) strcat(s, " ");
+		strcat(s, trace);
+	}
+	if(then)
+	{
+		strcat(s, " ");
+		strcat(s, then);
+	}
+	return s;
+}
+
+// expected trace of a write to 0x10
+static void bench_write_trace(char* trace, const uint8_t* data, uint8_t length)
+{
+	uint8_t i;
+
+	if(trace[0]) strcat(trace, " ");
+	strcat(trace, "S A20");
+	for(i=0; i<length; i++) sprintf(trace+strlen(trace), " W%02X", data[i]);
+	strcat(trace, " P");
+}
+
+static int bench_result(const char* name, int ok)
+{
+	printf("%-36s %s\n", name, ok ? "ok" : "FAIL");
+	return !ok;
+}
+
+// bus trace and callback statuses, once i2c_do() has reported
+static int bench_check(const char* name, const char* trace, const char* done)
+{
+	int ok;
+
+	i2c_do();
+	ok=!strcmp(bench_trace, trace) && !strcmp(bench_done, done);
+	if(!ok) printf("  bus \"%s\" status \"%s\", expected \"%s\" \"%s\"\n", bench_trace, bench_done, trace, done);
+	return bench_result(name, ok);
+}
+
+// the pool takes the longest '&' payload, and wraps around when the end is taken
+static int bench_pool_checks()
+{
+	static char trace[1024];
+	uint8_t line[I2C_POOL_SIZE];
+	uint8_t i, n;
+	int fail=0;
+
+	for(i=0; i<I2C_POOL_SIZE; i++) line[i]='a'+i%26;
+
+	// &16,"abc... filling the command line, the string is the payload
+	n=CMD_MAX_LENGTH-1-strlen("&16,\"");
+	bench_reset(0x10);
+	fail|=bench_result("full length '&' string queued", !i2c_send_data(0x10, line, n, TRUE));
+	bench_drain();
+	trace[0]='\0';
+	bench_write_trace(trace, line, n);
+	fail|=bench_check("full length '&' string sent", trace, "");
+	fail|=bench_result("full length '&' string status", i2c_status()==I2C_OK);
+
+	// 40 then 30 at the end of the pool, once the 40 are reported 20 go at the start
+	bench_reset(0x10);
+	trace[0]='\0';
+	i2c_queue(0x10, I2C_WRITE, line, 40, TRUE, bench_callback);
+	bench_run();
+	bench_write_trace(trace, line, 40);
+	i2c_queue(0x10, I2C_WRITE, line+1, 30, TRUE, bench_callback);
+	fail|=bench_result("pool full refused", i2c_queue(0x10, I2C_WRITE, line, 20, TRUE, bench_callback));
+	i2c_do();
+	bench_write_trace(trace, line+1, 30);
+	fail|=bench_result("pool wraps to its start", !i2c_queue(0x10, I2C_WRITE, line+2, 20, TRUE, bench_callback)
+			&& i2c_transfers[(i2c_head-1) & I2C_QUEUE_MASK].at==0);
+	bench_write_trace(trace, line+2, 20);
+	fail|=bench_result("wrapped pool full refused", i2c_queue(0x10, I2C_WRITE, line, 21, TRUE, bench_callback));
+	i2c_queue(0x10, I2C_WRITE, line+3, 20, TRUE, bench_callback);
+	bench_write_trace(trace, line+3, 20);
+	bench_drain();
+	fail|=bench_check("wrapped pool sent in order", trace, "0000");
+	fail|=bench_result("whole pool taken, length 0 refused", i2c_send_data(0x10, line, I2C_POOL_SIZE, TRUE)==FALSE
+			&& i2c_send_data(0x10, line, 0, TRUE));
+	bench_drain();
+	i2c_do();
+	return fail;
+}
+
+static int bench_checks()
+{
+	static const uint8_t data[3]={1, 2, 3};
+	char report[160];
+	uint8_t reg=0x10, i;
+	int fail=0;
+
+	bench_reset(0x10);
+	i2c_queue(0x10, I2C_WRITE, data, 3, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("write", "S A20 W01 W02 W03 P", "0");
+
+	bench_reset(0x10);
+	i2c_queue(0x11, I2C_WRITE, data, 3, TRUE, bench_callback);
+	i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("address NACK, next one runs", bench_tries("S A22 P", "S A20 W01 P"), "10");
+	fail|=bench_result("address NACK counted", i2c_stats.nacks==I2C_RETRIES+1 && i2c_stats.retries==I2C_RETRIES
+			&& i2c_stats.failed==1 && i2c_stats.last_failed==0x11 && i2c_stats.transfers==2);
+
+	bench_reset(0x10);
+	bench_bus.busy=1;
+	i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("device busy, the retry gets through", "S A20 P S A20 W01 P", "0");
+	fail|=bench_result("retry counted", i2c_stats.retries==1 && i2c_stats.failed==0);
+
+	bench_reset(0x10);
+	bench_bus.nack_byte=1;
+	i2c_queue(0x10, I2C_WRITE, data, 3, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("data NACK", bench_tries("S A20 W01 W02 P", 0), "1");
+
+	bench_reset(0x10);
+	bench_bus.arb_lost=1;
+	i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("arbitration lost, retried", "S A20 X S A20 W01 P S A20 W01 P", "00");
+
+	bench_reset(0x10);
+	bench_bus.arb_lost=I2C_RETRIES+1;
+	i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("arbitration lost, bus released", bench_tries("S A20 X", 0), "2");
+
+	bench_reset(0x10);
+	bench_bus.bus_error_byte=0;
+	bench_bus.stuck=3;
+	i2c_queue(0x10, I2C_WRITE, data, 2, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("bus error, recovery, retried", "S A20 W01 P C C C P S A20 W01 W02 P", "0");
+	fail|=bench_result("bus error counted", i2c_stats.bus_errors==1 && i2c_stats.recoveries==1 && i2c_stats.retries==1);
+
+	bench_reset(0x10);
+	for(i=0; i<3; i++) bench_bus.read[i]=0xA0+i;
+	i2c_queue(0x10, I2C_READ, 0, 3, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("read", "S A21 Ra Ra Rn P", "0");
+	fail|=bench_result("read data", bench_data[0]==0xA0 && bench_data[1]==0xA1 && bench_data[2]==0xA2);
+
+	bench_reset(0x10);
+	i2c_queue(0x10, I2C_WRITE, &reg, 1, FALSE, bench_callback);
+	i2c_queue(0x10, I2C_READ, 0, 1, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("register read, repeated start", "S A20 W10 Sr A21 Rn P", "00");
+
+	bench_reset(0x10);
+	i2c_queue(0x10, I2C_WRITE, &reg, 1, FALSE, bench_callback);
+	bench_drain();
+	i2c_queue(0x10, I2C_READ, 0, 2, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("bus held until the read comes", "S A20 W10 Sr A21 Ra Rn P", "00");
+
+	bench_reset(0x10);
+	i2c_queue(0x10, I2C_WRITE, &reg, 1, FALSE, bench_callback);
+	bench_drain();
+	bench_time+=I2C_HOLD_COUNTS+1;
+	i2c_do();
+	bench_run();
+	fail|=bench_check("held bus let go after the timeout", "S A20 W10 P", "0");
+
+	bench_reset(0x10);
+	bench_bus.hang=1;
+	bench_bus.stuck=2;
+	i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("hang timeout, recovery, retried", "S C C P S A20 W01 P S A20 W01 P", "00");
+
+	bench_reset(0x10);
+	bench_bus.hang=I2C_RETRIES+1;
+	i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	bench_drain();
+	fail|=bench_check("hang on every try, next one runs", bench_tries("S P", "S A20 W01 P"), "40");
+	i2c_report();
+	sprintf(report, "I2C 100kHz transfers=2 retries=%u nack=0 arb=0 buserr=0 timeout=%u recovered=%u stuck=0 failed=1 last=16\r\n",
+			I2C_RETRIES, I2C_RETRIES+1, I2C_RETRIES+1);
+	fail|=bench_result("fault counters report", !strcmp(bench_console, report));
+	if(strcmp(bench_console, report)) printf("  %s", bench_console);
+
+	bench_reset(0x10);
+	bench_bus.stuck=100;
+	TWCR=0;
+	fail|=bench_result("SDA stuck for good", i2c_recover() && !strcmp(bench_trace, "C C C C C C C C C"));
+
+	bench_reset(0x10);
+	i2c_set_clock(TRUE);
+	fail|=bench_result("400 kHz clock", TWBR==I2C_TWBR(SCL_FAST_CLOCK) && TWBR==12);
+	fail|=bench_result("400 kHz step timeout shorter", i2c_step_counts<I2C_STEP_COUNTS(SCL_CLOCK));
+	i2c_set_clock(FALSE);
+	fail|=bench_result("100 kHz clock", TWBR==72);
+
+	bench_reset(0x10);
+	for(i=0; i<I2C_QUEUE_SIZE; i++) i2c_queue(0x10, I2C_WRITE, data, 1, TRUE, bench_callback);
+	fail|=bench_result("queue full refused", i2c_send_data(0x10, (uint8_t*)data, 1, TRUE));
+	bench_drain();
+	fail|=bench_check("queue drained back-to-back", "S A20 W01 P S A20 W01 P S A20 W01 P S A20 W01 P", "0000");
+	return fail|bench_pool_checks();
+}
+
+/////////////// the '&' command
+
+// v1.1: i2c_send_data() returned after the stop, the main loop waited for the bus
+static double bench_bus_us(uint8_t length)
+{
+	// start, address and data bytes of 9 clocks, stop
+	return (1.0+9.0*(1+length)+1.0)*1e6/SCL_CLOCK;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t rounds=argc>1 ? strtoul(argv[1], 0, 0) : 1000000UL;
+	static const uint8_t data[8]={1, 2, 3, 4, 5, 6, 7, 8};
+	uint64_t t0, t1, t2;
+	uint32_t n;
+	uint8_t length;
+	int fail;
+
+	fail=bench_checks();
+
+	printf("\n%-8s %14s %14s %14s\n", "bytes", "v1.1 wait us", "queue cyc", "interrupt cyc");
+	for(length=1; length<=8; length*=2)
+	{
+		uint64_t queue=0, isr=0;
+		for(n=0; n<rounds; n++)
+		{
+			bench_reset(0x10);
+			t0=bench_cycles();
+			i2c_send_data(0x10, (uint8_t*)data, length, TRUE);
+			t1=bench_cycles();
+			bench_run();
+			t2=bench_cycles();
+			queue+=t1-t0;
+			isr+=t2-t1;
+		}
+		// the interrupt time includes the bus model
+		printf("%-8u %14.0f %14.1f %14.1f\n", length, bench_bus_us(length), (double)queue/rounds, (double)isr/rounds);
+	}
+	return fail;
+}
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""
+isrprof_replay.py
+Renders the interrupt profile dumped by the #IP00 setup command (see isrprof.h).
+
+Capture the console output of a board (or of the host simulation) into a file, then:
+    isrprof_replay.py console.log
+    isrprof_replay.py --all console.log     # every dump in the log, e.g. before/after a change
+    marcduino_sim < script | isrprof_replay.py
+
+Times in the dump are Timer1 ticks (0.5 us at 16 MHz), histogram buckets are log2:
+bucket 0 holds 0-1 tick, bucket n holds 2^n to 2^(n+1)-1 ticks, the last one everything above.
+"""
+
+import argparse
+import sys
+
+TICK_US = 0.5
+BAR_WIDTH = 40
+
+
+def parse_dumps(lines):
+    """Yields one dict per ISRPROF BEGIN/END block."""
+    dump = None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("ISRPROF BEGIN"):
+            dump = {"isr": {}, "trace": []}
+        elif dump is None:
+            continue
+        elif line.startswith("ISRPROF END"):
+            yield dump
+            dump = None
+        elif line.startswith("ISR "):
+            fields = line.split()
+            name = fields[1]
+            entry = {"name": name}
+            for field in fields[2:]:
+                key, _, value = field.partition("=")
+                if key == "n":
+                    entry["count"] = int(value)
+                elif value == "-":
+                    entry[key] = None
+                else:
+                    lo, _, hi = value.partition("..")
+                    entry[key] = (int(lo), int(hi))
+            dump["isr"][name] = entry
+        elif line.startswith("LAT ") or line.startswith("DUR "):
+            fields = line.split()
+            dump["isr"].setdefault(fields[1], {"name": fields[1]})[fields[0].lower() + "_hist"] = [int(x) for x in fields[2:]]
+        elif line.startswith("TRC "):
+            fields = line.split()
+            dump["trace"].append({
+                "name": fields[1],
+                "entry": int(fields[2]),
+                "latency": None if fields[3] == "-" else int(fields[3]),
+                "duration": int(fields[4]),
+            })
+
+
+def bucket_label(i, last):
+    lo = 0 if i == 0 else 1 << i
+    if i == last:
+        return ">=%7.1f us" % (lo * TICK_US)
+    hi = (1 << (i + 1)) - 1
+    return "%6.1f-%-6.1f us" % (lo * TICK_US, hi * TICK_US)
+
+
+def render_hist(title, hist, out):
+    total = sum(hist)
+    if not total:
+        return
+    peak = max(hist)
+    out.write("  %s\n" % title)
+    for i, count in enumerate(hist):
+        if not count:
+            continue
+        bar = "#" * max(1, round(BAR_WIDTH * count / peak))
+        out.write("    %-16s %6d %5.1f%% %s\n" % (bucket_label(i, len(hist) - 1), count, 100.0 * count / total, bar))
+
+
+def render(dump, out):
+    for name, isr in dump["isr"].items():
+        out.write("%s: %d calls\n" % (name, isr.get("count", 0)))
+        lat = isr.get("lat")
+        dur = isr.get("dur")
+        if lat:
+            out.write("  latency  %.1f .. %.1f us, jitter %.1f us\n"
+                      % (lat[0] * TICK_US, lat[1] * TICK_US, (lat[1] - lat[0]) * TICK_US))
+        if dur:
+            out.write("  duration %.1f .. %.1f us\n" % (dur[0] * TICK_US, dur[1] * TICK_US))
+        if "lat_hist" in isr:
+            render_hist("latency histogram", isr["lat_hist"], out)
+        if "dur_hist" in isr:
+            render_hist("duration histogram", isr["dur_hist"], out)
+        out.write("\n")
+
+    if dump["trace"]:
+        out.write("last events (time relative to the first one, modulo 32.768 ms)\n")
+        start = dump["trace"][0]["entry"]
+        for t in dump["trace"]:
+            rel = ((t["entry"] - start) & 0xFFFF) * TICK_US
+            lat = "-" if t["latency"] is None else "%.1f" % (t["latency"] * TICK_US)
+            out.write("  %9.1f us  %-7s latency %6s us  duration %7.1f us\n"
+                      % (rel, t["name"], lat, t["duration"] * TICK_US))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", nargs="?", help="console capture, stdin if omitted")
+    parser.add_argument("--all", action="store_true", help="render every dump, not just the last one")
+    args = parser.parse_args()
+
+    source = open(args.log, errors="replace") if args.log else sys.stdin
+    dumps = list(parse_dumps(source))
+    if not dumps:
+        sys.stderr.write("no ISRPROF dump found\n")
+        return 1
+
+    for i, dump in enumerate(dumps if args.all else dumps[-1:]):
+        if args.all:
+            sys.stdout.write("===== dump %d =====\n" % (i + 1))
+        render(dump, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,271 @@
+/*
+ * seqbench.c
+ * Host benchmark of the sequencer real time tick
+ *
+ * Runs open/close sequences and reports the average cost of one 1/100s tick
+ * (three Timer0 compare interrupts: the timers, then seq_dosequence()) plus the
+ * servo frames (seq_domotion()), in host CPU cycles (x86 TSC) and ns. The millis()
+ * clock moves on by hand, 10 ms per tick, and a servo frame comes every
+ * BENCH_FRAME_TICKS ticks. That's more frames than on the board, where they last the
+ * 23 ms pause plus the 11 pulses, 28 ms at least.
+ * - v3.7 loop: the constant step loop of v3.7, each servo stepped by its speed on each
+ *   tick, on the same rows, as the reference for the profile runs
+ * - one run per motion profile, one track moving all servos
+ * - the same servos moving on one track or spread over several tracks,
+ *   the cost should follow the number of moving servos, not the number of tracks
+ * - idle: sequences running but no servo moving
+ * Host numbers don't translate to AVR cycles, compare the ratios.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o seqbench \
+ *       tools/seqbench.c sequencer.c servo.c realtime.c hal_host.c
+ *   ./seqbench [ticks]
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <time.h>
+#include "hal.h"
+#include "sequencer.h"
+#include "realtime.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define bench_cycles()	__rdtsc()
+#else
+#define bench_cycles()	0ULL
+#endif
+
+// the real time tick, a plain function on the host
+void TIMER0_COMPA_vect(void);
+
+// the clock.c time base
+static uint32_t bench_ms;
+uint32_t millis(void) { return bench_ms; }
+
+#define O 1000
+#define C 2000
+// close, open, close the servos first to last
+#define BENCH_ROWS(first, last, p) \
+	{ \
+		{60, C, C, C, C, C, C, C, C, C, C, C, _NP, first, last, p}, \
+		{60, O, O, O, O, O, O, O, O, O, O, O, _NP, first, last, p}, \
+		{60, C, C, C, C, C, C, C, C, C, C, C, _NP, first, last, p}, \
+	}
+
+static sequence_t const bench_lin PROGMEM = BENCH_ROWS(1, 11, _LIN);
+static sequence_t const bench_ease PROGMEM = BENCH_ROWS(1, 11, _EASE);
+static sequence_t const bench_trap PROGMEM = BENCH_ROWS(1, 11, _TRAP);
+static sequence_t const bench_scrv PROGMEM = BENCH_ROWS(1, 11, _SCRV);
+static sequence_t const bench_1to3 PROGMEM = BENCH_ROWS(1, 3, _LIN);
+static sequence_t const bench_4to6 PROGMEM = BENCH_ROWS(4, 6, _LIN);
+static sequence_t const bench_7to9 PROGMEM = BENCH_ROWS(7, 9, _LIN);
+static sequence_t const bench_10to11 PROGMEM = BENCH_ROWS(10, 11, _LIN);
+static sequence_t const bench_1to4 PROGMEM = BENCH_ROWS(1, 4, _LIN);
+static sequence_t const bench_1 PROGMEM = BENCH_ROWS(1, 1, _LIN);
+static sequence_t const bench_2 PROGMEM = BENCH_ROWS(2, 2, _LIN);
+static sequence_t const bench_3 PROGMEM = BENCH_ROWS(3, 3, _LIN);
+static sequence_t const bench_4 PROGMEM = BENCH_ROWS(4, 4, _LIN);
+static sequence_t const bench_idle PROGMEM = BENCH_ROWS(1, 0, _LIN);	// empty range, nothing moves
+
+// 1000us in 67 ticks, the panel_slow_speed setting
+static int16_t bench_speed[SERVO_NUM]={15,15,15,15,15,15,15,15,15,15,15};
+
+#define BENCH_FRAME_TICKS	2	// 20 ms servo frame
+#define BENCH_ROUNDS		20
+
+static uint64_t bench_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+typedef int16_t const (*bench_seq_t)[SERVO_NUM+SEQUENCE_PARAMETERS];
+
+// Runs the ticks, with a servo frame every BENCH_FRAME_TICKS if there is a frame callback.
+// They run in BENCH_ROUNDS rounds and the fastest round is reported, the others are
+// the host doing something else.
+static void bench_ticks(const char* name, uint32_t ticks, void(*frame)())
+{
+	uint32_t n, round=ticks/BENCH_ROUNDS;
+	uint64_t c0, c1, t0, t1;
+	uint64_t cycles=~0ULL, ns=~0ULL;
+	uint8_t r;
+
+	for(r=0; r<BENCH_ROUNDS; r++)
+	{
+		t0=bench_ns();
+		c0=bench_cycles();
+		for(n=0; n<round; n++)
+		{
+			// three compare interrupts make one 1/100s tick
+			bench_ms+=10;
+			TIMER0_COMPA_vect();
+			TIMER0_COMPA_vect();
+			TIMER0_COMPA_vect();
+			if(frame && n%BENCH_FRAME_TICKS==0) frame();
+		}
+		c1=bench_cycles();
+		t1=bench_ns();
+		if(c1-c0<cycles) cycles=c1-c0;
+		if(t1-t0<ns) ns=t1-t0;
+	}
+
+	printf("%-24s %8.1f cycles/tick %8.2f ns/tick\n", name, (double)cycles/round, (double)ns/round);
+}
+
+// runs one sequence per track, on the first tracks
+static void bench_run(const char* name, uint32_t ticks, uint8_t tracks, bench_seq_t* seqs)
+{
+	uint8_t i;
+
+	// start every run from the same closed position
+	for(i=0; i<SEQ_TRACKS; i++) seq_track_stopsequence(i);
+	for(i=1; i<=SERVO_NUM; i++) servo_set(i, C);
+	for(i=0; i<tracks; i++)
+	{
+		seq_track_loadsequence(i, seqs[i], 3);
+		seq_track_loadspeed(i, bench_speed);
+		seq_track_startsequence(i);
+	}
+
+	bench_ticks(name, ticks, seq_domotion);
+}
+
+// The v3.7 sequencer: no plans, each servo steps by its speed toward its goal on each
+// tick, in the tick, and the step timeout is a real time timer. Its own copy of the
+// arrays and the one track it had, so that it runs next to the current sequencer.
+static int16_t const (*ref_array)[SERVO_NUM+SEQUENCE_PARAMETERS];
+static uint8_t ref_length, ref_step, ref_started;
+static int16_t ref_current[SERVO_NUM];
+static int16_t ref_goal[SERVO_NUM];
+static int16_t* ref_speed;
+static rt_timer ref_timeout;
+
+static void ref_setservopos(uint8_t step)
+{
+	uint8_t i;
+
+	for (i=1; i<=SERVO_NUM; i++)
+	{
+		if (
+			   (i < pgm_read_word(&(ref_array[step][START_SERVO_PARAM])))
+			&& (i > pgm_read_word(&(ref_array[step][END_SERVO_PARAM])))
+			)
+		{
+			continue;
+		}
+		ref_goal[i-1]=pgm_read_word(&(ref_array[step][i]));
+		if(ref_goal[i-1]==SERVO_NO_PULSE) servo_set(i,SERVO_NO_PULSE);
+	}
+}
+
+static void ref_dosequence()
+{
+	uint8_t i;
+	int16_t maxspeed;
+	int16_t override_max_speed;
+	int16_t delta;
+
+	if(!ref_started) return;
+
+	for(i=0; i<SERVO_NUM; i++)
+	{
+		override_max_speed = pgm_read_word(&(ref_array[ref_step][SPEED_PARAM]));
+		if (override_max_speed != -1) maxspeed = override_max_speed;
+		else maxspeed=ref_speed[i];
+
+		delta=ref_goal[i]-ref_current[i];
+		if (delta==0) continue;
+
+		if (maxspeed==0 || ref_current[i]==SERVO_NO_PULSE)
+		{
+			ref_current[i]=ref_goal[i];
+			servo_set(i+1, ref_current[i]);
+		}
+		else
+		{
+			if(delta>0)
+			{
+				if(delta>maxspeed) ref_current[i]=ref_current[i]+maxspeed;
+				else ref_current[i]=ref_goal[i];
+			}
+			else
+			{
+				if(delta<maxspeed) ref_current[i]=ref_current[i]-maxspeed;
+				else ref_current[i]=ref_goal[i];
+			}
+			servo_set(i+1, ref_current[i]);
+		}
+	}
+
+	if(!ref_timeout==0) return;
+
+	// the rows loop, the last one has a time
+	ref_setservopos(ref_step);
+	ref_timeout=pgm_read_word(&(ref_array[ref_step][0]));
+	if (ref_step<ref_length-1) ref_step++;
+	else ref_step=0;
+}
+
+// runs the v3.7 loop on a sequence in place of the current sequencer
+static void bench_ref(const char* name, uint32_t ticks, bench_seq_t seq)
+{
+	uint8_t i;
+
+	for(i=0; i<SEQ_TRACKS; i++) seq_track_stopsequence(i);
+	for(i=1; i<=SERVO_NUM; i++)
+	{
+		servo_set(i, C);
+		ref_current[i-1]=C;
+		ref_goal[i-1]=C;
+	}
+	ref_array=seq;
+	ref_length=3;
+	ref_step=0;
+	ref_speed=bench_speed;
+	ref_timeout=0;
+	ref_started=1;
+	rt_remove_function(seq_dosequence);
+	rt_add_function(ref_dosequence);
+	rt_add_timer(&ref_timeout);
+
+	bench_ticks(name, ticks, 0);
+
+	rt_remove_timer(&ref_timeout);
+	rt_remove_function(ref_dosequence);
+	rt_add_function(seq_dosequence);
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t ticks=argc>1 ? strtoul(argv[1], 0, 0) : 10000000UL;
+
+	bench_seq_t lin[]={bench_lin};
+	bench_seq_t ease[]={bench_ease};
+	bench_seq_t trap[]={bench_trap};
+	bench_seq_t scrv[]={bench_scrv};
+	bench_seq_t groups[]={bench_1to3, bench_4to6, bench_7to9, bench_10to11};
+	bench_seq_t four[]={bench_1to4};
+	bench_seq_t singles[]={bench_1, bench_2, bench_3, bench_4};
+	bench_seq_t idle[]={bench_idle};
+
+	servo_init();
+	seq_init();
+
+	printf("%u ticks, %d servos, %d tracks, a servo frame every %d ticks\n", ticks, SERVO_NUM, SEQ_TRACKS, BENCH_FRAME_TICKS);
+	bench_ref("v3.7 loop 11 servos", ticks, bench_lin);
+	bench_run("_LIN  1 track 11 servos", ticks, 1, lin);
+	bench_run("_EASE 1 track 11 servos", ticks, 1, ease);
+	bench_run("_TRAP 1 track 11 servos", ticks, 1, trap);
+	bench_run("_SCRV 1 track 11 servos", ticks, 1, scrv);
+	bench_run("_LIN 4 tracks 11 servos", ticks, 4, groups);
+	bench_run("_LIN 1 track 4 servos", ticks, 1, four);
+	bench_run("_LIN 4 tracks 4 servos", ticks, 4, singles);
+	bench_run("idle", ticks, 1, idle);
+	return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * seqconv.c
+ * Converts the panel sequence tables to the compact sequence format
+ *
+ * Reads the sequence_t tables of panel_sequences.h, encodes each one in the compact
+ * format described in sequencer.h, then runs both versions through the sequencer with
+ * each of the panel speed arrays and checks that every servo gets the same position at
+ * every tick. Writes panel_sequences_compact.h on stdout, the sizes and the check
+ * results on stderr. Exits with an error if any sequence doesn't match.
+ *
+ * A row keeps a servo only if the row changes its position, its speed or its profile,
+ * or sets it to _NP. Re-setting a servo to the goal it already has at the same speed
+ * doesn't change its move, so leaving it out gives the same output. Rows with a shaped
+ * profile keep all their servos, the curve restarts when the goal is set again.
+ *
+ * Build and run from the project directory, after changing panel_sequences.h:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o seqconv \
+ *       tools/seqconv.c sequencer.c servo.c realtime.c hal_host.c
+ *   ./seqconv > panel_sequences_compact.h
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include "hal.h"
+#include "main.h"
+#undef _COMPACT_SEQUENCES_		// we want the tables
+#include "panel_sequences.h"
+#include "realtime.h"
+
+// the real time tick, a plain function on the host
+void TIMER0_COMPA_vect(void);
+
+// the clock.c time base, moved on by hand
+static uint32_t seqconv_ms;
+uint32_t millis(void) { return seqconv_ms; }
+
+typedef int16_t const (*seqconv_table_t)[SERVO_NUM+SEQUENCE_PARAMETERS];
+
+typedef struct
+{
+	const char* name;
+	seqconv_table_t table;
+	uint8_t length;
+} seqconv_seq_t;
+
+#define SEQCONV_SEQ(name) {#name, name, SEQ_SIZE(name)}
+
+// all the sequences of panel_sequences.h
+static const seqconv_seq_t seqconv_seqs[]=
+{
+	SEQCONV_SEQ(panel_all_open),
+	SEQCONV_SEQ(panel_all_open_long),
+	SEQCONV_SEQ(panel_all_open_mid),
+	SEQCONV_SEQ(panel_wave),
+	SEQCONV_SEQ(panel_fast_wave),
+	SEQCONV_SEQ(panel_open_close_wave),
+	SEQCONV_SEQ(panel_marching_ants),
+	SEQCONV_SEQ(panel_dance),
+	SEQCONV_SEQ(panel_init),
+	SEQCONV_SEQ(panel_long_disco),
+	SEQCONV_SEQ(panel_bye_bye_wave),
+	SEQCONV_SEQ(panel_wiggle),
+};
+#define SEQCONV_NUM (sizeof(seqconv_seqs)/sizeof(seqconv_seqs[0]))
+
+static int16_t* seqconv_speeds[]={0, panel_fast_speed, panel_medium_speed, panel_slow_speed, panel_super_slow_speed};
+#define SEQCONV_SPEEDS (sizeof(seqconv_speeds)/sizeof(seqconv_speeds[0]))
+
+#define SEQCONV_MAX_SIZE 4096
+
+static uint16_t seqconv_encode(const seqconv_seq_t* seq, uint8_t* out)
+{
+	int16_t codes[256];
+	uint16_t ncodes=0;
+	uint8_t rows[SEQCONV_MAX_SIZE];
+	uint16_t nrows=0;
+	int16_t last_pos[SERVO_NUM];
+	int16_t last_speed[SERVO_NUM];
+	uint8_t last_profile[SERVO_NUM];
+	uint8_t known[SERVO_NUM]={0};
+	uint16_t step, n, c;
+	uint8_t i;
+
+	for(step=0; step<seq->length; step++)
+	{
+		uint16_t time=seq->table[step][0];
+		int16_t speed=seq->table[step][SPEED_PARAM];
+		uint8_t profile=seq->table[step][PROFILE_PARAM];
+		int16_t first=seq->table[step][START_SERVO_PARAM];
+		int16_t last=seq->table[step][END_SERVO_PARAM];
+		uint16_t mask=0;
+		uint8_t flags=0;
+
+		for(i=1; i<=SERVO_NUM; i++)
+		{
+			int16_t pos=seq->table[step][i];
+			if(i<first || i>last) continue;		// same test as seq_setservopos()
+			if(!known[i-1] || pos!=last_pos[i-1] || pos==_NP || speed!=last_speed[i-1]
+				|| profile!=last_profile[i-1] || profile!=_LIN)
+			{
+				mask|=SEQ_SERVO_BIT(i);
+			}
+			known[i-1]=1;
+			last_pos[i-1]=pos;
+			last_speed[i-1]=speed;
+			last_profile[i-1]=profile;
+		}
+
+		do
+		{
+			rows[nrows++]=(time&0x7F) | (time>0x7F ? 0x80 : 0);
+			time>>=7;
+		} while(time);
+		if(speed!=-1) flags|=SEQC_SPEED;
+		if(profile!=_LIN) flags|=SEQC_PROFILE;
+		rows[nrows++]=flags;
+		if(flags & SEQC_SPEED)
+		{
+			rows[nrows++]=speed&0xFF;
+			rows[nrows++]=(speed>>8)&0xFF;
+		}
+		if(flags & SEQC_PROFILE) rows[nrows++]=profile;
+		rows[nrows++]=mask&0xFF;
+		rows[nrows++]=mask>>8;
+		for(i=1; i<=SERVO_NUM; i++)
+		{
+			if(!(mask & SEQ_SERVO_BIT(i))) continue;
+			int16_t pos=seq->table[step][i];
+			for(c=0; c<ncodes && codes[c]!=pos; c++);
+			if(c==ncodes)
+			{
+				if(ncodes==255)
+				{
+					fprintf(stderr, "%s: more than 255 different positions\n", seq->name);
+					exit(1);
+				}
+				codes[ncodes++]=pos;
+			}
+			rows[nrows++]=c;
+		}
+		if(nrows>SEQCONV_MAX_SIZE-64)
+		{
+			fprintf(stderr, "%s: too long\n", seq->name);
+			exit(1);
+		}
+	}
+
+	n=0;
+	out[n++]=seq->length;
+	out[n++]=ncodes;
+	for(c=0; c<ncodes; c++)
+	{
+		out[n++]=codes[c]&0xFF;
+		out[n++]=(codes[c]>>8)&0xFF;
+	}
+	memcpy(&out[n], rows, nrows);
+	return n+nrows;
+}
+
+// runs the sequence loaded on track 0 and records every servo at every tick
+static uint32_t seqconv_run(int16_t* speed, int16_t* trace, uint32_t ticks)
+{
+	uint32_t n;
+	uint8_t i;
+
+	seq_loadspeed(speed);
+	seq_startsequence();
+	for(n=0; n<ticks; n++)
+	{
+		// three compare interrupts make one 1/100s tick, then a servo frame
+		seqconv_ms+=10;
+		TIMER0_COMPA_vect();
+		TIMER0_COMPA_vect();
+		TIMER0_COMPA_vect();
+		seq_domotion();
+		for(i=1; i<=SERVO_NUM; i++) *trace++=servo_read(i);
+		if(!seq_track_running(0)) break;
+	}
+	seq_stopsequence();
+	return n;
+}
+
+// same starting state for both runs
+static void seqconv_reset()
+{
+	uint8_t i;
+	for(i=1; i<=SERVO_NUM; i++) servo_set(i, _NP);
+}
+
+static int seqconv_check(const seqconv_seq_t* seq, const uint8_t* compact)
+{
+	uint32_t ticks=0, n1, n2;
+	uint8_t step, s;
+	int16_t *trace1, *trace2;
+	int ok=1;
+
+	// twice the sequence length, to see looping sequences come back around
+	for(step=0; step<seq->length; step++) ticks+=(uint16_t)seq->table[step][0];
+	ticks=2*ticks+200;
+	trace1=calloc(ticks*SERVO_NUM, sizeof(int16_t));
+	trace2=calloc(ticks*SERVO_NUM, sizeof(int16_t));
+
+	for(s=0; s<SEQCONV_SPEEDS; s++)
+	{
+		seqconv_reset();
+		seq_loadsequence(seq->table, seq->length);
+		n1=seqconv_run(seqconv_speeds[s], trace1, ticks);
+		seqconv_reset();
+		seq_loadcompact(compact);
+		n2=seqconv_run(seqconv_speeds[s], trace2, ticks);
+		if(n1!=n2 || memcmp(trace1, trace2, (n1<ticks ? n1+1 : ticks)*SERVO_NUM*sizeof(int16_t)))
+		{
+			fprintf(stderr, "%s: output differs with speed array %u\n", seq->name, s);
+			ok=0;
+		}
+	}
+	free(trace1);
+	free(trace2);
+	return ok;
+}
+
+int main()
+{
+	uint8_t compact[SEQCONV_MAX_SIZE];
+	uint32_t total_table=0, total_compact=0;
+	uint16_t size, i;
+	uint8_t k;
+	int ok=1;
+
+	servo_init();
+	seq_init();
+
+	printf("/*\r\n");
+	printf(" * panel_sequences_compact.h\r\n");
+	printf(" *\r\n");
+	printf(" *  Generated by tools/seqconv.c from panel_sequences.h, do not edit.\r\n");
+	printf(" *  The panel sequences in the compact format described in sequencer.h,\r\n");
+	printf(" *  used instead of the tables when _COMPACT_SEQUENCES_ is defined in main.h.\r\n");
+	printf(" *\r\n");
+	printf(" */\r\n\r\n");
+	printf("#ifndef PANEL_SEQUENCES_COMPACT_H_\r\n");
+	printf("#define PANEL_SEQUENCES_COMPACT_H_\r\n\r\n");
+	printf("#include \"hal.h\"\r\n\r\n");
+
+	for(k=0; k<SEQCONV_NUM; k++)
+	{
+		const seqconv_seq_t* seq=&seqconv_seqs[k];
+		uint32_t table=seq->length*sizeof(seq->table[0]);
+
+		size=seqconv_encode(seq, compact);
+		if(!seqconv_check(seq, compact)) ok=0;
+		fprintf(stderr, "%-24s %3u rows %5u -> %4u bytes\n", seq->name, seq->length, table, size);
+		total_table+=table;
+		total_compact+=size;
+
+		printf("const uint8_t %s_compact[] PROGMEM =\r\n{", seq->name);
+		for(i=0; i<size; i++) printf("%s%u,", i%20 ? " " : "\r\n\t", compact[i]);
+		printf("\r\n};\r\n\r\n");
+	}
+	printf("#endif /* PANEL_SEQUENCES_COMPACT_H_ */\r\n");
+
+	fprintf(stderr, "total %u -> %u bytes (%.1fx), %s\n", total_table, total_compact,
+			(double)total_table/total_compact, ok ? "all outputs match" : "MISMATCH");
+	return ok ? 0 : 1;
+}
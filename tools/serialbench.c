@@ -0,0 +1,131 @@
+/*
+ * serialbench.c
+ * Host benchmark of the console output
+ *
+ * Runs the console UART of the host simulation at 9600 bauds and measures, in
+ * virtual time, how long the main loop is held in the string output functions:
+ * - before: the v2.1 serial_puts(), waiting for the output buffer to drain before each byte
+ * - after: serial_puts() of serial.c, only waiting when the output buffer is full
+ * Scenarios:
+ * - command: a 60 character command line typed at full line rate and echoed, then "OK"
+ * - feedback: the same, then 3 lines of feedback (as in the I2C debug output)
+ * - banner: the start up messages, printed back to back
+ * The console output of the simulation goes to stdout, the results to stderr.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o serialbench \
+ *       tools/serialbench.c serial.c fifo.c realtime.c hal_host.c
+ *   ./serialbench >/dev/null
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <stdio.h>
+#include "hal.h"
+#include "serial.h"
+
+#define BENCH_BAUD			9600
+#define BENCH_FRAME_CYCLES	(F_CPU*10/BENCH_BAUD)		// 1 start, 8 data, 1 stop
+
+typedef void (*bench_puts)(char* string);
+
+// v2.1
+static void before_puts(char* string)
+{
+	uint8_t i=0;
+	while( (string[i]!='\0') & (i<255))
+	{
+		while(!serial_tx_complete()) hal_idle();
+		serial_putc(string[i]);
+		i++;
+	}
+}
+
+static void after_puts(char* string)
+{
+	serial_puts(string);
+}
+
+static const char* bench_feedback[]=
+{
+	"Token: 10, recognized address: 10 \r\n",
+	"Token: x41\r\nData Good - Index = 1 \r\n",
+	"I2C address = 10 \r\nPayload length= 9 \r\n",
+};
+
+static const char* bench_banner[]=
+{
+	"\n\rMarcDuino Master v3.7 \n\r",
+	"Initializing...\r\n",
+	"Calc CRC: 2FC StoredCRC: 2FC \r\n",
+	"\n\rsuart1 Communication OK \n\r",
+	"\n\rsuart2 Communication OK \n\r",
+	"Enter panel command starting with \':\' \n\r",
+};
+
+static void bench_drain()
+{
+	while(!serial_tx_complete()) hal_idle();
+	hal_advance(BENCH_FRAME_CYCLES*4);
+}
+
+// types the line, echoing it like main(), then times the replies
+static double bench_command(bench_puts puts, uint8_t feedback)
+{
+	uint64_t t0;
+	uint8_t i;
+
+	bench_drain();
+	for(i=0; i<60; i++)
+	{
+		hal_advance(BENCH_FRAME_CYCLES);	// next character comes in
+		serial_putc(i<59 ? '&' : '\n');		// echo
+	}
+	serial_putc('\r');
+
+	t0=hal_cycles();
+	puts("OK\n\r");
+	for(i=0; i<feedback; i++) puts((char*)bench_feedback[i]);
+	return (double)(hal_cycles()-t0)*1000.0/F_CPU;
+}
+
+static double bench_banner_run(bench_puts puts)
+{
+	uint64_t t0;
+	uint8_t i;
+
+	bench_drain();
+	t0=hal_cycles();
+	for(i=0; i<sizeof(bench_banner)/sizeof(bench_banner[0]); i++) puts((char*)bench_banner[i]);
+	return (double)(hal_cycles()-t0)*1000.0/F_CPU;
+}
+
+static void bench_report(const char* name, double before, double after)
+{
+	fprintf(stderr, "%-9s before %7.2f ms, after %5.2f ms\n", name, before, after);
+}
+
+int main()
+{
+	double before, after;
+
+	serial_init_9600b8N1();
+
+	before=bench_command(before_puts, 0);
+	after=bench_command(after_puts, 0);
+	bench_report("command", before, after);
+
+	before=bench_command(before_puts, 3);
+	after=bench_command(after_puts, 3);
+	bench_report("feedback", before, after);
+
+	before=bench_banner_run(before_puts);
+	after=bench_banner_run(after_puts);
+	bench_report("banner", before, after);
+
+	bench_drain();
+	return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * settingsbench.c
+ * Host check and benchmark of the setup settings saves, see settings.h
+ *
+ * Runs settings.c on a model of the ATmega328P EEPROM: a byte write takes 3.4 ms,
+ * eeprom_write_byte() waits for the previous one, eeprom_update_byte() skips bytes
+ * that don't change. The main loop passes every BENCH_PASS us of virtual time.
+ * Compares v3.7, which wrote the setting and the sum at each command, with the
+ * record saved by settings_do():
+ * - burst: 20 #SR commands 300 ms apart, as when tuning the servo directions
+ * - spaced: 20 #SR commands 5 s apart, each one saved on its own
+ * reporting the main loop time spent waiting for the EEPROM, the bytes written and
+ * the most writes of a single cell (the one that wears out first, 100000 writes rated).
+ * Then checks the records: a save cut short at every byte by a power loss,
+ * the sequence wrap, and the import of the v3.7 layout.
+ * Host numbers don't translate to AVR cycles, the virtual times do.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o settingsbench \
+ *       tools/settingsbench.c
+ *   ./settingsbench [sessions]
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+
+// the register map of hal_host.c, without the rest of the simulation
+volatile uint8_t hal_io[HAL_IO_SIZE];
+
+#define BENCH_PASS			200			// us per main loop pass
+#define BENCH_WRITE_TIME	3400		// us per EEPROM byte write
+#define BENCH_COMMANDS		20
+
+static uint8_t bench_eeprom[E2END+1];
+static uint32_t bench_cell_writes[E2END+1];
+static uint64_t bench_now;				// virtual time, us
+static uint64_t bench_ready;			// end of the write in progress
+static uint64_t bench_blocked;			// time the main loop waited for it
+static uint32_t bench_writes;
+static int32_t bench_power_left=-1;		// bytes written before the power goes, -1 never
+
+static void bench_wait()
+{
+	if(bench_now<bench_ready)
+	{
+		bench_blocked+=bench_ready-bench_now;
+		bench_now=bench_ready;
+	}
+}
+
+static uint8_t bench_read_byte(const uint8_t* addr)
+{
+	bench_wait();
+	return bench_eeprom[(uintptr_t)addr & E2END];
+}
+
+static uint16_t bench_read_word(const uint16_t* addr)
+{
+	uintptr_t a=(uintptr_t)addr;
+	return bench_read_byte((const uint8_t*)a) | (bench_read_byte((const uint8_t*)(a+1))<<8);
+}
+
+static void bench_write_byte(uint8_t* addr, uint8_t value)
+{
+	if(!bench_power_left) return;
+	if(bench_power_left>0) bench_power_left--;
+	bench_wait();
+	bench_eeprom[(uintptr_t)addr & E2END]=value;
+	bench_cell_writes[(uintptr_t)addr & E2END]++;
+	bench_writes++;
+	bench_ready=bench_now+BENCH_WRITE_TIME;
+}
+
+static void bench_write_word(uint16_t* addr, uint16_t value)
+{
+	uintptr_t a=(uintptr_t)addr;
+	bench_write_byte((uint8_t*)a, (uint8_t)value);
+	bench_write_byte((uint8_t*)(a+1), (uint8_t)(value>>8));
+}
+
+static void bench_update_byte(uint8_t* addr, uint8_t value)
+{
+	if(bench_read_byte(addr)!=value) bench_write_byte(addr, value);
+}
+
+uint16_t rt_ticks()
+{
+	return (uint16_t)(bench_now/10000);
+}
+
+// settings.c on the model
+#undef eeprom_is_ready
+#define eeprom_is_ready()		(bench_now>=bench_ready)
+#define eeprom_read_byte		bench_read_byte
+#define eeprom_read_word		bench_read_word
+#define eeprom_update_byte		bench_update_byte
+#include "settings.c"
+
+/////////////// v3.7, the setting and the sum written by the command
+
+static void old_sr(uint16_t servo_dir)
+{
+	uint16_t sum;
+
+	bench_write_word((uint16_t*)SETTINGS_V37_SERVO_DIR, servo_dir);
+	sum=bench_read_word((uint16_t*)SETTINGS_V37_SERVO_DIR);
+	sum+=bench_read_byte((uint8_t*)SETTINGS_V37_START_SOUND);
+	sum+=bench_read_byte((uint8_t*)SETTINGS_V37_RANDOM_SOUND);
+	sum+=bench_read_byte((uint8_t*)SETTINGS_V37_MP3_PLAYER);
+	bench_write_word((uint16_t*)SETTINGS_V37_CRC, sum);
+}
+
+static void new_sr(uint16_t servo_dir)
+{
+	settings.servo_dir=servo_dir;
+	settings_changed();
+}
+
+/////////////// sessions
+
+enum {BENCH_OLD, BENCH_NEW, BENCH_MODES};
+static const char* bench_mode_name[BENCH_MODES]={"v3.7", "record"};
+
+typedef struct
+{
+	uint64_t blocked;
+	uint64_t longest;			// longest single main loop pass wait
+	uint32_t writes;
+	uint32_t cell_max;
+} bench_result_t;
+
+static void bench_reset()
+{
+	memset(bench_eeprom, 0xFF, sizeof(bench_eeprom));
+	memset(bench_cell_writes, 0, sizeof(bench_cell_writes));
+	bench_now=bench_ready=bench_blocked=0;
+	bench_writes=0;
+	bench_power_left=-1;
+	settings_load();
+}
+
+// a main loop pass, with a #SR command or not
+static uint64_t bench_pass(uint8_t mode, int32_t servo_dir)
+{
+	uint64_t blocked=bench_blocked;
+
+	if(servo_dir>=0) (mode==BENCH_OLD ? old_sr : new_sr)(servo_dir);
+	settings_do();
+	bench_now+=BENCH_PASS;
+	return bench_blocked-blocked;
+}
+
+static void bench_session(uint8_t mode, uint32_t sessions, uint32_t gap, bench_result_t* r)
+{
+	uint32_t s, n, i;
+	uint64_t wait;
+
+	bench_reset();
+	// settle the defaults record first
+	while(settings_pending()) bench_pass(mode, -1);
+	bench_now=bench_ready;
+	bench_blocked=0;
+	bench_writes=0;
+	memset(bench_cell_writes, 0, sizeof(bench_cell_writes));
+
+	memset(r, 0, sizeof(*r));
+	for(s=0; s<sessions; s++)
+	{
+		for(n=0; n<BENCH_COMMANDS; n++)
+		{
+			// a servo reversed then back, the direction changes every command
+			wait=bench_pass(mode, (s+n)&1 ? 1<<(n%11) : 0);
+			if(wait>r->longest) r->longest=wait;
+			for(i=0; i<gap/BENCH_PASS; i++)
+			{
+				wait=bench_pass(mode, -1);
+				if(wait>r->longest) r->longest=wait;
+			}
+		}
+		while(settings_pending() || bench_now<bench_ready) bench_pass(mode, -1);
+	}
+	r->blocked=bench_blocked;
+	r->writes=bench_writes;
+	for(i=0; i<=E2END; i++)
+	{
+		if(bench_cell_writes[i]>r->cell_max) r->cell_max=bench_cell_writes[i];
+	}
+}
+
+/////////////// record checks
+
+static int bench_check(const char* name, int ok)
+{
+	printf("%-44s %s\n", name, ok ? "ok" : "FAIL");
+	return !ok;
+}
+
+// saves value, cut after cut bytes when cut>=0, and loads it back
+static uint16_t bench_save(uint16_t value, int32_t cut)
+{
+	settings.servo_dir=value;
+	settings_changed();
+	bench_power_left=cut;
+	bench_now+=SETTINGS_DELAY*10000UL;
+	while(settings_pending()) { settings_do(); bench_now+=BENCH_PASS; }
+	bench_power_left=-1;
+	settings_load();
+	return settings.servo_dir;
+}
+
+static int bench_records()
+{
+	int fail=0, torn=0;
+	uint32_t i;
+	int32_t cut, needed;
+
+	// bytes the save writes, the unchanged ones are skipped
+	bench_reset();
+	bench_save(0x0123, -1);
+	needed=bench_writes;
+	bench_save(0x0456, -1);
+	needed=bench_writes-needed;
+
+	// a save cut short keeps the previous record, before any of its writes
+	for(cut=0; cut<needed; cut++)
+	{
+		bench_reset();
+		bench_save(0x0123, -1);
+		if(bench_save(0x0456, cut)!=0x0123) torn++;
+	}
+	fail|=bench_check("power loss during a save keeps the previous", !torn);
+
+	// past the sequence wrap, the last save still wins
+	bench_reset();
+	for(i=0; i<600; i++)
+	{
+		if(bench_save(i, -1)!=i) break;
+	}
+	fail|=bench_check("600 saves, each one loaded back", i==600);
+
+	// v3.7 settings, sum good then bad
+	bench_reset();
+	bench_write_word((uint16_t*)SETTINGS_V37_SERVO_DIR, 0x0005);
+	bench_write_byte((uint8_t*)SETTINGS_V37_START_SOUND, 2);
+	bench_write_byte((uint8_t*)SETTINGS_V37_RANDOM_SOUND, 1);
+	bench_write_byte((uint8_t*)SETTINGS_V37_MP3_PLAYER, 1);
+	bench_write_word((uint16_t*)SETTINGS_V37_CRC, 0x0005+2+1+1);
+	fail|=bench_check("v3.7 layout imported", settings_load()==SETTINGS_IMPORTED && settings.servo_dir==0x0005
+			&& settings.start_sound==2 && settings.serial_baud==0);
+	bench_write_byte((uint8_t*)SETTINGS_V37_CRC, 0);
+	fail|=bench_check("v3.7 layout with a bad sum ignored", settings_load()==SETTINGS_DEFAULTS);
+	return fail;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t sessions=argc>1 ? strtoul(argv[1], 0, 0) : 1000;
+	static const struct { const char* name; uint32_t gap; } bench_cases[]=
+	{
+		{ "burst", 300000 },
+		{ "spaced", 5000000 },
+	};
+	bench_result_t r;
+	uint8_t c, mode;
+
+	printf("%u sessions of %u #SR commands\n", sessions, BENCH_COMMANDS);
+	printf("%-7s %-7s %13s %13s %13s %12s\n", "session", "mode", "waited ms/cmd", "longest ms", "bytes/cmd", "cell max");
+	for(c=0; c<sizeof(bench_cases)/sizeof(bench_cases[0]); c++)
+	{
+		for(mode=0; mode<BENCH_MODES; mode++)
+		{
+			bench_session(mode, sessions, bench_cases[c].gap, &r);
+			printf("%-7s %-7s %13.2f %13.2f %13.2f %12u\n", bench_cases[c].name, bench_mode_name[mode],
+					(double)r.blocked/1000/sessions/BENCH_COMMANDS, (double)r.longest/1000,
+					(double)r.writes/sessions/BENCH_COMMANDS, r.cell_max);
+		}
+	}
+	printf("\n");
+	return bench_records();
+}
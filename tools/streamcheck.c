@@ -0,0 +1,209 @@
+/*
+ * streamcheck.c
+ * Host check of the streamed servo positions, see stream.h
+ *
+ * Runs the firmware on the host HAL: the frames go through dispatch_frame() as if
+ * frame_receive() had just completed them, panel commands through dispatch_command(),
+ * and virtual time runs by main loop passes that call stream_do(). The Timer1 servo
+ * frames move the servos. Frames come every CHECK_PERIOD ticks, for servos 1 to 4.
+ * - counter: in order across the 255 to 0 wrap, nothing dropped nor late; a gap across
+ *   the wrap counts the missing frames as dropped
+ * - repeated and old counters: ignored, their positions don't run, counted late
+ * - a gap over STREAM_LATE: counted late, nothing dropped
+ * - timeout: no frame for STREAM_TIMEOUT, the stream ends, stream_servos() returns 0 and
+ *   the servos hold where they were, in the middle of their move
+ * - panel command: ends the stream the same way, no hold counted. The next frame starts
+ *   a new stream whatever its counter.
+ *
+ * Build and run from the project directory, main() of main.c is renamed:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o streamcheck \
+ *       tools/streamcheck.c boot.c clock.c command.c fifo.c fmt.c frame.c i2c.c isrprof.c latency.c \
+ *       MP3sound.c realtime.c routine.c sequencer.c serial.c servo.c settings.c stackmon.c \
+ *       stream.c suart.c wmath.c hal_host.c
+ *   ./streamcheck
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#define main marcduino_main
+#include "main.c"
+#undef main
+
+#define CHECK_PERIOD	2			// ticks between frames, 50 frames per second
+#define CHECK_SETTLE	8			// ticks for a servo frame to go by, 50 ms at most
+#define CHECK_MASK		0x000F		// servos 1 to 4
+#define CHECK_SERVOS	4
+#define CHECK_NEAR		100			// position byte, 1300 us
+#define CHECK_FAR		200			// position byte, 2100 us
+#define CHECK_SLOW		2			// us per 1/100 s, 800 us take 4 s
+
+#define CHECK_PULSE(p)	(SERVO_PULSE_MIN+STREAM_STEP*(p))
+
+static uint8_t check_counter;
+
+static int check_result(const char* name, int ok)
+{
+	printf("%-52s %s\n", name, ok ? "ok" : "FAIL");
+	return !ok;
+}
+
+// main loop passes for that many ticks
+static void check_wait(uint16_t ticks)
+{
+	uint16_t start=rt_ticks();
+
+	while((uint16_t)(rt_ticks()-start)<ticks)
+	{
+		hal_idle();
+		stream_do();
+	}
+}
+
+// one frame with that counter, all servos of the mask at position
+static void check_frame(uint8_t counter, uint8_t speed, uint8_t position)
+{
+	uint8_t i;
+
+	frame_rx.opcode=FRAME_STREAM;
+	frame_rx.length=4+CHECK_SERVOS;
+	frame_rx.payload[0]=counter;
+	frame_rx.payload[1]=speed;
+	frame_rx.payload[2]=CHECK_MASK & 0xFF;
+	frame_rx.payload[3]=CHECK_MASK>>8;
+	for(i=0; i<CHECK_SERVOS; i++) frame_rx.payload[4+i]=position;
+	dispatch_frame();
+}
+
+// the next frame in order, a frame period later
+static void check_next(uint8_t speed, uint8_t position)
+{
+	check_frame(++check_counter, speed, position);
+	check_wait(CHECK_PERIOD);
+}
+
+// ends the stream and starts a new one at counter, counters reset
+static void check_start(uint8_t counter, uint8_t speed, uint8_t position)
+{
+	stream_stop();
+	stream_reset();
+	check_counter=counter-1;
+	check_next(speed, position);
+}
+
+// all the streamed servos at that pulse
+static int check_at(int16_t pulse)
+{
+	uint8_t i;
+
+	for(i=1; i<=CHECK_SERVOS; i++)
+	{
+		if(servo_read(i)!=pulse) return 0;
+	}
+	return 1;
+}
+
+// all the streamed servos between two pulses, and still there a second later
+static int check_held(int16_t low, int16_t high)
+{
+	int16_t held[CHECK_SERVOS];
+	uint8_t i;
+	int ok=1;
+
+	for(i=0; i<CHECK_SERVOS; i++)
+	{
+		held[i]=servo_read(i+1);
+		ok&=held[i]>low && held[i]<high;
+	}
+	check_wait(100);
+	for(i=0; i<CHECK_SERVOS; i++) ok&=servo_read(i+1)==held[i];
+	return ok;
+}
+
+static int check_stats(uint16_t frames, uint16_t dropped, uint16_t late, uint16_t holds)
+{
+	return stream_stats.frames==frames && stream_stats.dropped==dropped
+			&& stream_stats.late==late && stream_stats.holds==holds;
+}
+
+static int check_counters()
+{
+	uint8_t i;
+	int fail=0;
+
+	check_start(250, 0, CHECK_NEAR);
+	fail|=check_result("first frame starts the stream", stream_servos()==CHECK_MASK && check_stats(1, 0, 0, 0));
+	for(i=0; i<10; i++) check_next(0, CHECK_NEAR);
+	fail|=check_result("250 to 4 in order across the wrap", check_counter==4 && check_stats(11, 0, 0, 0));
+	fail|=check_result("servos at the streamed position", check_at(CHECK_PULSE(CHECK_NEAR)));
+
+	// 254, 255, 0 and 1 lost
+	check_start(250, 0, CHECK_NEAR);
+	for(i=0; i<3; i++) check_next(0, CHECK_NEAR);
+	check_counter+=4;
+	check_next(0, CHECK_NEAR);
+	fail|=check_result("253 then 2: 4 dropped across the wrap", check_counter==2 && check_stats(5, 4, 0, 0));
+
+	// the positions of a repeated frame or an old one don't run
+	stream_reset();
+	check_frame(check_counter, 0, CHECK_FAR);
+	check_wait(CHECK_SETTLE);
+	fail|=check_result("repeated counter ignored, counted late", check_at(CHECK_PULSE(CHECK_NEAR)) && check_stats(0, 0, 1, 0));
+	check_frame(check_counter-3, 0, CHECK_FAR);
+	check_wait(CHECK_SETTLE);
+	fail|=check_result("old counter ignored, counted late", check_at(CHECK_PULSE(CHECK_NEAR)) && check_stats(0, 0, 2, 0));
+
+	// the last good frame was 2*CHECK_SETTLE ago, but none is missing
+	stream_reset();
+	check_next(0, CHECK_FAR);
+	fail|=check_result("gap over STREAM_LATE counted late, none dropped", check_stats(1, 0, 1, 0));
+	check_wait(STREAM_LATE-CHECK_PERIOD);
+	check_next(0, CHECK_FAR);
+	fail|=check_result("gap of STREAM_LATE in time", check_stats(2, 0, 1, 0));
+	for(i=0; i<CHECK_SETTLE/CHECK_PERIOD; i++) check_next(0, CHECK_FAR);
+	fail|=check_result("next counters run", check_at(CHECK_PULSE(CHECK_FAR)) && check_stats(6, 0, 1, 0));
+	return fail;
+}
+
+static int check_ends()
+{
+	uint8_t i;
+	int fail=0;
+
+	// a slow move, the frames stop while the servos are on their way
+	check_start(0, CHECK_SLOW, CHECK_NEAR);
+	check_wait(STREAM_TIMEOUT-CHECK_PERIOD);
+	fail|=check_result("no hold at STREAM_TIMEOUT", stream_servos()==CHECK_MASK && check_stats(1, 0, 0, 0));
+	check_wait(1);
+	fail|=check_result("hold past STREAM_TIMEOUT, no servo streamed", stream_servos()==0 && check_stats(1, 0, 0, 1));
+	fail|=check_result("servos held midway, a second later still there", check_held(CHECK_PULSE(CHECK_NEAR), CHECK_PULSE(CHECK_FAR)));
+
+	// a panel command takes over the same way
+	check_start(7, CHECK_SLOW, CHECK_FAR);
+	for(i=0; i<10; i++) check_next(CHECK_SLOW, CHECK_FAR);
+	fail|=check_result("new stream whatever its counter", stream_servos()==CHECK_MASK && check_stats(11, 0, 0, 0));
+	dispatch_command(":HD01", 5);
+	fail|=check_result("panel command ends the stream, no hold counted", stream_servos()==0 && check_stats(11, 0, 0, 0));
+	fail|=check_result("servos held midway, a second later still there", check_held(CHECK_PULSE(CHECK_NEAR), CHECK_PULSE(CHECK_FAR)));
+	return fail;
+}
+
+int main()
+{
+	int fail=0;
+
+	clock_init();
+	servo_init();
+	realtime_init();
+	seq_init();
+	// the check runs the commands, the console only keeps the replies in its buffer
+	serial_init(9600);
+	UCSR0B=0;
+	sei();
+
+	fail|=check_counters();
+	fail|=check_ends();
+	return fail;
+}
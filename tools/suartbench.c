@@ -0,0 +1,186 @@
+/*
+ * suartbench.c
+ * Host benchmark of the slave and sound player output, per :SExx
+ *
+ * Runs every routine of panel_routines.h through the firmware, as the main loop does:
+ * sequence_command() for the :SExx, then routine_do() for one second of virtual time,
+ * which covers all the timed actions. Each routine runs two ways:
+ * - direct: every byte copied to the ring buffer as it comes, like v3.7
+ * - staged: between suart_stage_begin() and suart_stage_flush(), like main() now
+ * and reports:
+ * - bytes queued for the slave (suart) and the sound player (suart2)
+ * - copies to the ring buffers, and the repeated bytes left out
+ * - virtual time the main loop waited for room in the ring buffers, in us
+ * - host time of the main loop passes that sent something, in ns. Both ways run the
+ *   same routine code, the difference is the output.
+ * Each run starts while the previous run's panel sequence is still going, so its end
+ * actions go out first, as when R2 Touch sends one :SExx after the other.
+ * Before that, a few passes check which repeats are left out: only an HP or display
+ * command sent again right after itself, "*ON00;*OF00;*ON00" is sent whole.
+ * Host numbers don't translate to AVR cycles, compare the ratios.
+ *
+ * Build and run from the project directory, main() of main.c is renamed:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o suartbench \
+ *       tools/suartbench.c boot.c clock.c command.c fifo.c fmt.c frame.c i2c.c isrprof.c latency.c \
+ *       MP3sound.c realtime.c routine.c sequencer.c serial.c servo.c settings.c stackmon.c \
+ *       stream.c suart.c wmath.c hal_host.c
+ *   ./suartbench [repeats] 2>/dev/null
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <time.h>
+
+#define main marcduino_main
+#include "main.c"
+#undef main
+
+#define BENCH_WINDOW	(F_CPU)		// virtual time each routine runs for
+
+enum {BENCH_DIRECT, BENCH_STAGED, BENCH_MODES};
+static const char* bench_mode_name[BENCH_MODES]={"direct", "staged"};
+
+typedef struct
+{
+	uint32_t bytes, bytes2;
+	uint32_t bursts;
+	uint32_t repeats;
+	uint64_t blocked;		// virtual cycles
+	uint64_t ns;			// host time of the passes that sent something
+} bench_result_t;
+
+static uint64_t bench_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+static void bench_ports()
+{
+	// wait for the previous output to go out, the slave decoder prints it
+	while(!suart_tx_complete() || !suart2_tx_complete()) hal_idle();
+	suart_init(9600);
+	suart2_init(9600);
+	memset(&suart_stats, 0, sizeof(suart_stats));
+	memset(&suart2_stats, 0, sizeof(suart2_stats));
+}
+
+// one main loop pass, the :SExx when number is not 0xFF
+static void bench_pass(uint8_t mode, uint8_t number, bench_result_t* r)
+{
+	uint16_t bursts=suart_stats.bursts+suart2_stats.bursts;
+	uint64_t c0=hal_cycles();
+	uint64_t t0=bench_ns();
+
+	if(mode==BENCH_STAGED) suart_stage_begin();
+	if(number!=0xFF) sequence_command(number);
+	routine_do();
+	if(mode==BENCH_STAGED) suart_stage_flush();
+
+	uint64_t t1=bench_ns();
+	if(suart_stats.bursts+suart2_stats.bursts!=bursts) r->ns+=t1-t0;
+	r->blocked+=hal_cycles()-c0;
+}
+
+static void bench_routine(uint8_t mode, uint8_t number, bench_result_t* r)
+{
+	uint64_t end;
+
+	bench_ports();
+	end=hal_cycles()+BENCH_WINDOW;
+	bench_pass(mode, number, r);
+	while(hal_cycles()<end)
+	{
+		hal_idle();
+		bench_pass(mode, 0xFF, r);
+	}
+	r->bytes+=suart_stats.bytes;
+	r->bytes2+=suart2_stats.bytes;
+	r->bursts+=suart_stats.bursts+suart2_stats.bursts;
+	r->repeats+=suart_stats.repeats;
+}
+
+static int bench_result(const char* name, int ok)
+{
+	printf("%-52s %s\n", name, ok ? "ok" : "FAIL");
+	return !ok;
+}
+
+// one staged pass of slave commands, checks the bytes sent and the bytes left out
+static int bench_repeat(const char* name, const char* commands, uint16_t bytes, uint16_t repeats)
+{
+	bench_ports();
+	suart_stage_begin();
+	suart_puts((char*)commands);
+	suart_stage_flush();
+	return bench_result(name, suart_stats.bytes==bytes && suart_stats.repeats==repeats);
+}
+
+static int bench_repeats()
+{
+	int fail=0;
+
+	fail|=bench_repeat("A,A: second one left out", "*ON00\r*ON00\r", 6, 6);
+	fail|=bench_repeat("A,A,A: one sent", "@0T1\r@0T1\r@0T1\r", 5, 10);
+	fail|=bench_repeat("A,B,A: all sent", "*ON00\r*OF00\r*ON00\r", 18, 0);
+	fail|=bench_repeat("A,B,A,A: last one left out", "*ON00\r*OF00\r*ON00\r*ON00\r", 18, 6);
+	fail|=bench_repeat("A,A not HP or display: all sent", ":SE01\r:SE01\r", 12, 0);
+	printf("\n");
+	return fail;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t repeats=argc>1 ? strtoul(argv[1], 0, 0) : 10;
+	bench_result_t r[BENCH_MODES], total[BENCH_MODES];
+	routine_t routine;
+	uint8_t i, mode;
+	uint32_t n;
+	int fail;
+
+	clock_init();
+	servo_init();
+	realtime_init();
+	seq_init();
+	suart2_init(9600);
+	mp3_init(0);
+	mp3_stop_random();
+
+	fail=bench_repeats();
+	memset(total, 0, sizeof(total));
+	printf("%-5s %-7s %6s %6s %7s %8s %11s %10s\n", ":SE", "mode", "slave", "sound", "copies", "repeats", "blocked us", "passes ns");
+	for(i=0; i<routine_table_size; i++)
+	{
+		memcpy_P(&routine, &routine_table[i], sizeof(routine));
+		memset(r, 0, sizeof(r));
+		for(n=0; n<repeats; n++)
+		{
+			for(mode=0; mode<BENCH_MODES; mode++) bench_routine(mode, routine.number, &r[mode]);
+		}
+		for(mode=0; mode<BENCH_MODES; mode++)
+		{
+			printf(":SE%02u %-7s %6.1f %6.1f %7.1f %8.1f %11.1f %10.0f\n", routine.number, bench_mode_name[mode],
+					(double)r[mode].bytes/repeats, (double)r[mode].bytes2/repeats, (double)r[mode].bursts/repeats,
+					(double)r[mode].repeats/repeats, (double)r[mode].blocked*1e6/F_CPU/repeats, (double)r[mode].ns/repeats);
+		}
+		for(mode=0; mode<BENCH_MODES; mode++)
+		{
+			total[mode].bytes+=r[mode].bytes;
+			total[mode].bytes2+=r[mode].bytes2;
+			total[mode].bursts+=r[mode].bursts;
+			total[mode].repeats+=r[mode].repeats;
+			total[mode].ns+=r[mode].ns;
+		}
+	}
+	for(mode=0; mode<BENCH_MODES; mode++)
+	{
+		printf("all   %-7s %6u %6u %7u %8u %11s %10.0f\n", bench_mode_name[mode],
+				total[mode].bytes/repeats, total[mode].bytes2/repeats, total[mode].bursts/repeats,
+				total[mode].repeats/repeats, "", (double)total[mode].ns/repeats);
+	}
+	return fail;
+}
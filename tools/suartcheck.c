@@ -0,0 +1,197 @@
+/*
+ * suartcheck.c
+ * Host check of the software UART bit timing, see suart.h
+ *
+ * The check plays Timer2: it moves TCNT2 to the next output compare of the ports that
+ * have their interrupt on, and runs TIMER2_COMPA_vect and TIMER2_COMPB_vect right on
+ * time. The pin level each one writes is recorded with the count it was written at.
+ * Both ports send CHECK_BYTES back to back, at 9600 and 2400 bauds, alone or at once
+ * with the other port at the other rate, and for each burst:
+ * - frame layout: a low start bit, 8 data bits lsb first, a high stop bit, per byte
+ * - bit period: the one of suart_period_table for the rate
+ * - carry: each bit edge at the first edge plus the whole part of k periods, the
+ *   8.8 fractional part carried from bit to bit
+ * - each edge less than a Timer2 count from its frame's start bit plus whole table
+ *   periods, which is what a receiver resynchronizing on the start bit sees. The worst
+ *   edge against the nominal rate is printed.
+ * - rate error over the whole burst, in ppm of the nominal rate, from the rounding
+ *   of the table period
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o suartcheck \
+ *       tools/suartcheck.c fmt.c
+ *   ./suartcheck
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <stdio.h>
+#include <math.h>
+#include "hal.h"
+
+// the register map of hal_host.c, without the rest of the simulation
+volatile uint8_t hal_io[HAL_IO_SIZE];
+
+// the ring buffers are never full here, nothing waits
+void hal_idle(void) {}
+
+#include "suart.c"
+
+#define CHECK_BYTES		24			// fits in both ring buffers
+#define CHECK_EDGES		(CHECK_BYTES*10)
+#define CHECK_MAX_PPM	100			// rate error over a burst
+
+typedef struct
+{
+	uint64_t at[CHECK_EDGES];		// Timer2 count of each bit edge
+	uint8_t level[CHECK_EDGES];		// pin level from that edge on
+	uint16_t edges;
+	long baud;
+	uint16_t period;
+} check_line_t;
+
+static check_line_t check_line[2];
+static uint64_t check_now;			// Timer2 counts since the start of the burst
+
+static const uint8_t check_bytes[CHECK_BYTES] =
+{
+	0x55, 0xAA, 0x00, 0xFF, 0x01, 0x80, 0x0F, 0xF0, '*', 'O', 'N', '0', '0', '\r',
+	':', 'S', 'E', '0', '1', '\r', 0x7E, 0x81, 0xC3, 0x3C,
+};
+
+static void check_record(check_line_t* line, volatile uint8_t* port, uint8_t pin)
+{
+	if(line->edges==CHECK_EDGES) return;
+	line->at[line->edges]=check_now;
+	line->level[line->edges]=(*port >> pin) & 1;
+	line->edges++;
+}
+
+// counts to the next compare match of a channel, 0x1FF when its interrupt is off
+static uint16_t check_ticks(uint8_t enabled, uint8_t ocr)
+{
+	uint8_t n=ocr-TCNT2;
+	if(!enabled) return 0x1FF;
+	return n ? n : 256;
+}
+
+// runs Timer2 until both ports are idle
+static void check_run()
+{
+	uint16_t a, b;
+
+	while(bit_is_set(TIMSK2, OCIE2A) || bit_is_set(TIMSK2, OCIE2B))
+	{
+		a=check_ticks(bit_is_set(TIMSK2, OCIE2A), OCR2A);
+		b=check_ticks(bit_is_set(TIMSK2, OCIE2B), OCR2B);
+		check_now+=a<b ? a : b;
+		TCNT2=(uint8_t)check_now;
+		if(a<=b)
+		{
+			TIMER2_COMPA_vect();
+			if(bit_is_set(TIMSK2, OCIE2A)) check_record(&check_line[0], &SUART_TX_PORT, SUART_TX_PIN);
+		}
+		if(b<=a)
+		{
+			TIMER2_COMPB_vect();
+			if(bit_is_set(TIMSK2, OCIE2B)) check_record(&check_line[1], &SUART2_TX_PORT, SUART2_TX_PIN);
+		}
+	}
+}
+
+static int check_result(const char* name, int ok)
+{
+	printf("%-52s %s\n", name, ok ? "ok" : "FAIL");
+	return !ok;
+}
+
+// checks the recorded burst of one port
+static int check_line_timing(const char* port, check_line_t* line)
+{
+	double ideal=(double)F_CPU/SUART_TIMER_PRESCALER/line->baud;	// Timer2 counts per bit
+	double error, worst=0, nominal=0, ppm;
+	uint16_t k, start;
+	uint8_t layout=1, carry=1, b;
+	char name[64];
+	int fail=0;
+
+	for(k=0; k<line->edges; k++)
+	{
+		b=k%10;
+		start=k-b;
+		if(b==0) layout&=line->level[k]==0;
+		else if(b<9) layout&=line->level[k]==((check_bytes[k/10]>>(b-1)) & 1);
+		else layout&=line->level[k]==1;
+		carry&=line->at[k]-line->at[0]==((uint32_t)k*line->period)>>8;
+		error=fabs((double)(line->at[k]-line->at[start])-b*line->period/256.0);
+		if(error>worst) worst=error;
+		error=fabs((double)(line->at[k]-line->at[start])-b*ideal);
+		if(error>nominal) nominal=error;
+	}
+	// from the first start bit to the last stop bit
+	k=line->edges-1;
+	ppm=(k*ideal/(line->at[k]-line->at[0])-1)*1e6;
+
+	printf("%-6s %5ld bauds, period %3u+%3u/256 counts, worst edge %.2f us, rate %+.0f ppm\n",
+			port, line->baud, line->period>>8, line->period & 0xFF,
+			nominal*SUART_TIMER_PRESCALER*1e6/F_CPU, ppm);
+	sprintf(name, "  %s %ld: %u bytes framed", port, line->baud, line->edges/10);
+	fail|=check_result(name, line->edges==CHECK_EDGES && layout);
+	sprintf(name, "  %s %ld: table period", port, line->baud);
+	fail|=check_result(name, line->period==SUART_BIT_PERIOD(line->baud));
+	sprintf(name, "  %s %ld: edges on the 8.8 fractional carry", port, line->baud);
+	fail|=check_result(name, carry);
+	sprintf(name, "  %s %ld: edges within a count of the start bit", port, line->baud);
+	fail|=check_result(name, worst<1.0);
+	sprintf(name, "  %s %ld: rate within %u ppm", port, line->baud, CHECK_MAX_PPM);
+	fail|=check_result(name, fabs(ppm)<CHECK_MAX_PPM);
+	return fail;
+}
+
+// one burst on suart at baud1 and on suart2 at baud2, 0 leaves the port out
+static int check_burst(long baud1, long baud2)
+{
+	uint8_t i;
+	int fail=0;
+
+	memset(check_line, 0, sizeof(check_line));
+	check_now=0;
+	TCNT2=0;
+	TIMSK2=0;
+	sei();
+	if(baud1) suart_init(baud1);
+	if(baud2) suart2_init(baud2);
+	check_line[0].baud=baud1;
+	check_line[0].period=suart_tx.period;
+	check_line[1].baud=baud2;
+	check_line[1].period=suart2_tx.period;
+
+	for(i=0; i<CHECK_BYTES; i++)
+	{
+		if(baud1) suart_putc(check_bytes[i]);
+		if(baud2) suart2_putc(check_bytes[i]);
+	}
+	check_run();
+
+	if(baud1) fail|=check_line_timing("suart", &check_line[0]);
+	if(baud2) fail|=check_line_timing("suart2", &check_line[1]);
+	printf("\n");
+	return fail;
+}
+
+int main()
+{
+	int fail=0;
+
+	printf("F_CPU %lu, Timer2 count %.1f us\n\n", (unsigned long)F_CPU, SUART_TIMER_PRESCALER*1e6/F_CPU);
+	fail|=check_burst(9600, 0);
+	fail|=check_burst(2400, 0);
+	fail|=check_burst(0, 9600);
+	fail|=check_burst(0, 2400);
+	fail|=check_burst(9600, 2400);
+	fail|=check_burst(2400, 9600);
+	return fail;
+}
@@ -0,0 +1,256 @@
+/*
+ * timerbench.c
+ * Host check and benchmark of the realtime timer wheel, see realtime.h
+ *
+ * Checks the events: one-shots due on their exact tick, short and past a turn of the
+ * wheel, main loop events waiting for rt_do(), cancel while armed or waiting, periodic
+ * events in the interrupt and in the main loop, a restart from the callback, events
+ * across the tick counter wrap, and the packed rt_add_timer() array.
+ *
+ * Then times one tick with N timers running:
+ * - v3.7: N registered count-down timers, the tick looks at all RT_MAX_TIMERS slots.
+ *   No more than RT_MAX_TIMERS of them.
+ * - wheel: N periodic interrupt events, periods of 50 to 1000 ticks, their callbacks
+ *   included
+ * Host numbers don't translate to AVR cycles, compare the ratios.
+ *
+ * Build and run from the project directory:
+ *   gcc -std=gnu99 -O2 -fcommon -fgnu89-inline -DF_CPU=16000000UL -I. -o timerbench \
+ *       tools/timerbench.c
+ *   ./timerbench [ticks]
+ *
+ */
+
+#ifdef __AVR__
+#error "host only tool"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define bench_cycles()	__rdtsc()
+#else
+#define bench_cycles()	0ULL
+#endif
+
+// the register map of hal_host.c, without the rest of the simulation
+volatile uint8_t hal_io[HAL_IO_SIZE];
+
+#include "realtime.c"
+
+#define BENCH_EVENTS	100
+
+static rt_event bench_events[BENCH_EVENTS];
+static uint16_t bench_calls[BENCH_EVENTS];
+static uint16_t bench_called_at[BENCH_EVENTS];
+
+static void bench_callback(rt_event* event)
+{
+	uint8_t i=event-bench_events;
+	bench_calls[i]++;
+	bench_called_at[i]=rt_wheel_now;
+}
+
+static void bench_restart(rt_event* event)
+{
+	bench_callback(event);
+	if(bench_calls[event-bench_events]<3) rt_event_start(event, 7, 0);
+}
+
+static void bench_reset()
+{
+	uint8_t i;
+
+	for(i=0; i<BENCH_EVENTS; i++) rt_event_cancel(&bench_events[i]);
+	while(rt_timer_count) rt_remove_timer(rt_timer_array[0]);
+	memset(bench_calls, 0, sizeof(bench_calls));
+	memset(bench_called_at, 0, sizeof(bench_called_at));
+}
+
+static void bench_ticks(uint16_t ticks, bool main_loop)
+{
+	while(ticks--)
+	{
+		rt_tick();
+		if(main_loop) rt_do();
+	}
+}
+
+static int bench_result(const char* name, int ok)
+{
+	printf("%-44s %s\n", name, ok ? "ok" : "FAIL");
+	return !ok;
+}
+
+static int bench_checks()
+{
+	rt_event* e=&bench_events[0];
+	rt_timer timers[RT_MAX_TIMERS+1];
+	uint16_t start;
+	uint8_t i, good;
+	int fail=0;
+
+	bench_reset();
+	start=rt_wheel_now;
+	rt_event_init(e, bench_callback, RT_EVENT_ISR);
+	rt_event_start(e, 5, 0);
+	bench_ticks(100, FALSE);
+	fail|=bench_result("one-shot on its tick", bench_calls[0]==1 && bench_called_at[0]==(uint16_t)(start+5));
+
+	bench_reset();
+	start=rt_wheel_now;
+	rt_event_start(e, 1000, 0);
+	bench_ticks(2000, FALSE);
+	fail|=bench_result("one-shot past a turn of the wheel", bench_calls[0]==1 && bench_called_at[0]==(uint16_t)(start+1000));
+
+	bench_reset();
+	rt_event_init(e, bench_callback, 0);
+	rt_event_start(e, 3, 0);
+	bench_ticks(3, FALSE);
+	good=bench_calls[0]==0 && e->state==RT_EVENT_PENDING;
+	rt_do();
+	fail|=bench_result("main loop event waits for rt_do()", good && bench_calls[0]==1 && !rt_event_armed(e));
+
+	bench_reset();
+	rt_event_init(e, bench_callback, RT_EVENT_ISR);
+	rt_event_start(e, 10, 0);
+	bench_ticks(5, TRUE);
+	rt_event_cancel(e);
+	bench_ticks(20, TRUE);
+	fail|=bench_result("cancel while armed", bench_calls[0]==0);
+
+	bench_reset();
+	rt_event_init(e, bench_callback, 0);
+	rt_event_init(&bench_events[1], bench_callback, 0);
+	rt_event_start(e, 4, 0);
+	rt_event_start(&bench_events[1], 4, 0);
+	bench_ticks(4, FALSE);
+	rt_event_cancel(e);
+	rt_do();
+	fail|=bench_result("cancel while waiting for rt_do()", bench_calls[0]==0 && bench_calls[1]==1 && !rt_pending);
+
+	bench_reset();
+	rt_event_init(e, bench_callback, RT_EVENT_ISR);
+	rt_event_start(e, 3, 3);
+	bench_ticks(30, FALSE);
+	fail|=bench_result("periodic in the interrupt", bench_calls[0]==10);
+
+	bench_reset();
+	rt_event_init(e, bench_callback, 0);
+	rt_event_start(e, 64, 64);
+	bench_ticks(640, TRUE);
+	rt_event_cancel(e);
+	fail|=bench_result("periodic in the main loop, period of 2 turns", bench_calls[0]==10);
+
+	bench_reset();
+	rt_event_start(e, 10, 10);
+	bench_ticks(25, FALSE);		// main loop late, two periods due
+	rt_do();
+	bench_ticks(10, TRUE);
+	rt_event_cancel(e);
+	fail|=bench_result("periodic in a late main loop goes on", bench_calls[0]==2);
+
+	bench_reset();
+	rt_event_init(e, bench_restart, RT_EVENT_ISR);
+	rt_event_start(e, 7, 0);
+	bench_ticks(100, FALSE);
+	fail|=bench_result("restarted from its callback", bench_calls[0]==3 && !rt_event_armed(e));
+
+	// all due in the same few slots, across the wrap of the tick counter
+	bench_reset();
+	rt_wheel_now=0xFFF0;
+	for(i=0; i<BENCH_EVENTS; i++)
+	{
+		rt_event_init(&bench_events[i], bench_callback, i&1 ? RT_EVENT_ISR : 0);
+		rt_event_start(&bench_events[i], 1+(i%4)*RT_WHEEL_SLOTS+i%3, 0);
+	}
+	bench_ticks(400, TRUE);
+	for(i=0, good=1; i<BENCH_EVENTS; i++)
+	{
+		if(bench_calls[i]!=1 || bench_called_at[i]!=(uint16_t)(0xFFF0+1+(i%4)*RT_WHEEL_SLOTS+i%3)) good=0;
+	}
+	fail|=bench_result("100 events across the counter wrap", good);
+
+	bench_reset();
+	for(i=0, good=1; i<RT_MAX_TIMERS; i++) good&=rt_add_timer(&timers[i]);
+	good&=!rt_add_timer(&timers[RT_MAX_TIMERS]);
+	good&=rt_remove_timer(&timers[2]) && !rt_remove_timer(&timers[2]);
+	for(i=0; i<RT_MAX_TIMERS; i++) timers[i]=i+1;
+	bench_ticks(1, FALSE);
+	for(i=0; i<RT_MAX_TIMERS; i++) good&=(timers[i]==(i==2 ? 3 : i));
+	fail|=bench_result("count-down timers, packed array", good && rt_timer_count==RT_MAX_TIMERS-1);
+	bench_reset();
+	return fail;
+}
+
+/////////////// v3.7: every slot looked at, every tick
+
+static rt_timer* old_timer_array[RT_MAX_TIMERS];
+
+static void old_tick()
+{
+	uint8_t i;
+	rt_timer* timerpointer;
+	for (i=0; i<RT_MAX_TIMERS; i++)
+	{
+		if(old_timer_array[i])	// if non zero, it points to a registered timer
+		{
+			// decrement it until it reaches zero
+			timerpointer=old_timer_array[i];
+			if (*timerpointer) (*timerpointer)--;
+		}
+	}
+}
+
+static void bench_nothing(rt_event* event)
+{
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t ticks=argc>1 ? strtoul(argv[1], 0, 0) : 1000000UL;
+	static const uint8_t counts[]={0, 1, 4, 10, 32, 100};
+	static rt_timer old_timers[RT_MAX_TIMERS];
+	uint64_t t0, old, wheel;
+	uint32_t n;
+	uint8_t c, i;
+	int fail;
+
+	fail=bench_checks();
+
+	printf("\n%-8s %14s %14s\n", "timers", "v3.7 cyc/tick", "wheel cyc/tick");
+	srand(1);
+	for(c=0; c<sizeof(counts); c++)
+	{
+		memset(old_timer_array, 0, sizeof(old_timer_array));
+		for(i=0; i<counts[c] && i<RT_MAX_TIMERS; i++) old_timer_array[i]=&old_timers[i];
+		t0=bench_cycles();
+		for(n=0; n<ticks; n++)
+		{
+			old_tick();
+			// the main loop restarts them when they run out
+			if(!old_timers[0]) for(i=0; i<RT_MAX_TIMERS; i++) old_timers[i]=50+i*100;
+		}
+		old=bench_cycles()-t0;
+
+		bench_reset();
+		for(i=0; i<counts[c]; i++)
+		{
+			uint16_t period=50+rand()%951;
+			rt_event_init(&bench_events[i], bench_nothing, RT_EVENT_ISR);
+			rt_event_start(&bench_events[i], period, period);
+		}
+		t0=bench_cycles();
+		for(n=0; n<ticks; n++) rt_tick();
+		wheel=bench_cycles()-t0;
+
+		if(counts[c]<=RT_MAX_TIMERS) printf("%-8u %14.1f %14.1f\n", counts[c], (double)old/ticks, (double)wheel/ticks);
+		else printf("%-8u %14s %14.1f\n", counts[c], "-", (double)wheel/ticks);
+	}
+	bench_reset();
+	return fail;
+}